@@ -0,0 +1,32 @@
+#ifndef FS_COMPRESS_H
+#define FS_COMPRESS_H
+
+#include <stdint.h>
+
+/*
+ * Komprimovaný soubor (INODE_FLAG_COMPRESSED) ukládá místo obsahu "payload":
+ *
+ *   [uint16_t entry[n]] [blok 0] [blok 1] ... [blok n-1]
+ *
+ * n = počet logických clusterů souboru, každý cluster se komprimuje zvlášť,
+ * takže jde číst náhodně. Položka hlavičky nese délku uloženého bloku;
+ * COMPRESS_RAW_FLAG znamená, že se blok nevyplatilo komprimovat a je uložen syrově.
+ * Payload se na disk ukládá stejně jako běžný obsah (clustery, díry, fragment).
+ */
+#define COMPRESS_RAW_FLAG 0x8000u
+#define COMPRESS_LEN_MASK 0x7FFFu
+
+// Komprese jednoho bloku (formát podobný LZ4). Vrací délku výstupu, 0 pokud se nevejde do dst_cap.
+int fs_lz_compress(const uint8_t *src, int src_len, uint8_t *dst, int dst_cap);
+
+// Dekomprese bloku. Vrací počet bajtů výstupu, -1 při poškozených datech.
+int fs_lz_decompress(const uint8_t *src, int src_len, uint8_t *dst, int dst_cap);
+
+// Velikost hlavičky payloadu pro soubor dané velikosti
+int fs_compress_header_len(int size, int cluster_size);
+
+// Sestaví payload souboru (hlavička + bloky po clusterech) do out.
+// Vrací délku payloadu, 0 pokud se nevejde do out_cap.
+int fs_compress_file(const uint8_t *data, int size, int cluster_size, uint8_t *out, int out_cap);
+
+#endif // FS_COMPRESS_H
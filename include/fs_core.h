@@ -11,9 +11,15 @@ int fs_format(const char *filename, const char *size_str);
 // Vypíše statistiky FS (příkaz statfs)
 void fs_statfs(const char *filename);
 
-// Vypíše obsah adresáře (příkaz ls)
-// Prozatím vypíše jen kořenový adresář, pokud path == NULL nebo "/"
-void fs_ls(const char *filename, int inode_id);
+// Zapne/vypne vlastnost svazku (tune <feature> on|off), bez feature vypíše stav
+int fs_tune(const char *filename, const char *feature, const char *value);
+
+// Zátěžový test alokátoru clusterů: propustnost pro 1, 2, 4, ... max_threads vláken
+// (max_threads <= 0 = podle počtu jader). Obsazenost svazku se nezmění.
+int fs_allocbench(const char *filename, int max_threads);
+
+// Vypíše obsah adresáře (příkaz ls), long_format = ls -l (velikost, inode, počet clusterů)
+void fs_ls(const char *filename, int inode_id, bool long_format);
 
 // Vypíše informace o inodu/souboru (příkaz info)
 void fs_info(const char *filename, int inode_id);
@@ -21,9 +27,9 @@ void fs_info(const char *filename, int inode_id);
 // info nad cestou (kvůli interaktivnímu režimu)
 void fs_info_path(const char *filename, const char *path);
 
-// Najde volný bit v bitmapě (pro inody nebo clustery)
+// Obsadí volný bit v bitmapě (pro inody nebo clustery)
 // Vrací index (0..N) nebo -1, pokud je plno.
-int find_free_bit(FILE *f, struct superblock *sb, bool is_inode_bitmap);
+int alloc_bit(FILE *f, struct superblock *sb, bool is_inode_bitmap);
 
 // Označí bit jako obsazený (1) nebo volný (0)
 void set_bit(FILE *f, struct superblock *sb, bool is_inode_bitmap, int index, bool status);
@@ -37,15 +43,26 @@ int fs_path_to_inode(const char *filename, const char *path);
 int fs_mkdir(const char *filename, const char *path);
 
 // Importuje soubor z Host OS do VFS
-// incp <host_path> <vfs_path>
-int fs_incp(const char *filename, const char *host_path, const char *vfs_path);
+// incp [-z] <host_path> <vfs_path>  (-z = uložit komprimovaně)
+int fs_incp(const char *filename, const char *host_path, const char *vfs_path, bool compress);
+
+// Importuje celý strom adresářů z Host OS (incp -r <host_dir> <vfs_dir>), vfs_dir nesmí existovat.
+// Obsah souborů kopíruje víc vláken; na konci vypíše počty a propustnost.
+int fs_incp_tree(const char *filename, const char *host_dir, const char *vfs_dir, bool compress);
 
 // Export souboru z VFS do Host OS
 // outcp <vfs_path> <host_path>
 int fs_outcp(const char *filename, const char *vfs_path, const char *host_path);
 
-// Spojí soubory s1 a s2 do nového souboru s3 (xcp s1 s2 s3)
-int fs_xcp(const char *filename, const char *s1, const char *s2, const char *s3);
+// Export celého podstromu (outcp -r <vfs_dir> <host_dir>), soubory čte víc vláken
+// v pořadí fyzických clusterů; na konci vypíše počty a propustnost.
+int fs_outcp_tree(const char *filename, const char *vfs_dir, const char *host_dir);
+
+// Zapíše obsah inodu do host_path. Vrací 1 úspěch, 0 chyba čtení, -1 nejde vytvořit.
+int export_inode(FILE *f, struct superblock *sb, const struct pseudo_inode *inode, const char *host_path);
+
+// Spojí soubory sources[0..source_count-1] do nového souboru dest (xcp s1 s2 ... dest)
+int fs_xcp(const char *filename, const char *const *sources, int source_count, const char *dest);
 
 // Přidá obsah s2 na konec s1 (add s1 s2)
 int fs_add(const char *filename, const char *s1, const char *s2);
@@ -54,10 +71,48 @@ int fs_cat(const char *filename, const char *path);
 
 int fs_rm(const char *filename, const char *path);
 
+// Smaže soubor nebo celý podstrom (rm -r) jedním průchodem metadaty; bitmapy se zapíšou jednou.
+int fs_rm_tree(const char *filename, const char *path);
+
 int fs_rmdir(const char *filename, const char *path);
 
 int fs_cp(const char *filename, const char *s1, const char *s2);
 
+// Zkopíruje celý podstrom (cp -r); inody a clustery kopie se obsadí najednou.
+int fs_cp_tree(const char *filename, const char *src, const char *dest);
+
 int fs_mv(const char *filename, const char *s1, const char *s2);
 
+// Paralelní průchody podstromem (cmd_walk.c), výstup seřazený podle cest.
+// du [path]: součty pro každý přímý podadresář a celkem (soubory, adresáře, logicky, fyzicky)
+int fs_du(const char *filename, const char *path);
+
+// Podmínky find: name = vzor jména (NULL = libovolné), type 'f'/'d' (0 = obojí),
+// size < 0 = bez podmínky, jinak počet jednotek unit (B) porovnaný podle size_cmp
+// (-1 <, 0 =, 1 >) s velikostí souboru zaokrouhlenou nahoru na celé jednotky (jako GNU find)
+struct find_filter {
+    const char *name;
+    char type;
+    int size_cmp;
+    long size;
+    long unit;
+};
+
+int fs_find(const char *filename, const char *path, const struct find_filter *filter);
+
+// tree [path]: strom podadresářů a souborů seřazený podle jmen
+int fs_tree(const char *filename, const char *path);
+
+// fsck [--repair]: kontrola bitmap, tabulky sdílení, položek adresářů a počtů odkazů
+// proti stavu odvozenému z dosažitelných inodů (cmd_fsck.c). Vrací 1 = svazek v pořádku.
+int fs_fsck(const char *filename, bool repair);
+
+// Snapshoty svazku (snapshot create|list|delete|rollback <name>). Snapshot je plná kopie
+// tabulky inodů; kopie všech snapshotů smí zabrat nejvýš 25 % datových clusterů (cmd_snapshot.c).
+int fs_snapshot_create(const char *filename, const char *name);
+void fs_snapshot_list(const char *filename);
+int fs_snapshot_delete(const char *filename, const char *name);
+int fs_snapshot_rollback(const char *filename, const char *name);
+int fs_snapshot_exists(const char *filename, const char *name);
+
 #endif // FS_CORE_H
\ No newline at end of file
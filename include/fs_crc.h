@@ -0,0 +1,44 @@
+#ifndef FS_CRC_H
+#define FS_CRC_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "structs.h"
+
+/*
+ * Kontrolní součty clusterů (CRC32C, polynom Castagnoli).
+ *
+ * Tabulka uint32_t na cluster leží za tabulkou sdílení (superblock.crc_start_address).
+ * Součet se přepočítá při každém zápisu clusteru (celého i částečného – adresáře,
+ * fragment konců) a ověřuje se při čtení dat souboru. Příkaz scrub ověří všechny
+ * obsazené clustery ve více vláknech.
+ */
+
+// CRC32C bufferu (crc = předchozí hodnota, na začátku 0). Na CPU s SSE4.2 instrukcí crc32,
+// jinak tabulkově (slicing-by-8).
+uint32_t fs_crc32c(uint32_t crc, const void *data, size_t len);
+
+// Uloží součet clusteru s obsahem data (cluster_size B)
+void cluster_crc_store(FILE *f, struct superblock *sb, int32_t cluster, const uint8_t *data);
+
+// Uloží součet clusteru spočítaný předem (obsah zapsaný mimo write_cluster, incp -r)
+void cluster_crc_set(FILE *f, struct superblock *sb, int32_t cluster, uint32_t crc);
+
+// Přepočítá součet podle aktuálního obsahu clusteru na disku (po částečném zápisu)
+void cluster_crc_refresh(FILE *f, struct superblock *sb, int32_t cluster);
+
+// Ověří obsah clusteru proti tabulce; při neshodě vypíše CHECKSUM ERROR a vrátí false
+bool cluster_crc_verify(FILE *f, const struct superblock *sb, int32_t cluster, const uint8_t *data);
+
+// Ověří součty clusterů označených v bitmapě used (tvar datové bitmapy) ve více vláknech.
+// Poškozené označí v bad (cluster_count B), počet ověřených a vláken vrátí v checked/threads_used
+// (smí být NULL). Vrací počet chyb, -1 pokud obraz nemá tabulku součtů nebo ji nejde přečíst.
+int fs_crc_check(const char *filename, const struct superblock *sb, const uint8_t *used, uint8_t *bad,
+                 long *checked, int *threads_used);
+
+// Ověří všechny obsazené clustery obrazu (příkaz scrub). Vrací 1, pokud je vše v pořádku.
+int fs_scrub(const char *filename);
+
+#endif // FS_CRC_H
@@ -0,0 +1,61 @@
+#ifndef FS_DEDUP_H
+#define FS_DEDUP_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "structs.h"
+
+/*
+ * Deduplikace plných datových clusterů (FS_FEATURE_DEDUP).
+ *
+ * Index hash -> cluster (superblock.dedup_start_address, dedup_slots položek,
+ * otevřené adresování s lineárním průchodem) leží v souvislém úseku datových
+ * clusterů. Obsadí ho až tune dedup on a tune dedup off ho zase uvolní, takže
+ * svazek bez deduplikace za něj nic neplatí. Clustery indexu se zapisují mimo
+ * tabulku součtů, scrub i fsck je proto při ověřování součtů vynechají. Hash je MurmurHash3 x64_128, shoda se vždy ověřuje
+ * porovnáním obsahu, takže kolize hashe nemůže spojit různá data.
+ *
+ * Indexují se jen plné clustery souborů, které se už nikdy nepřepisují na místě
+ * (ne adresáře, ne fragment pro konce), a položka zmizí při uvolnění clusteru.
+ */
+struct dedup_entry {
+    uint64_t hash;      // dolních 64 bitů MurmurHash3
+    uint32_t check;     // dalších 32 bitů hashe (rychlé odmítnutí bez čtení clusteru)
+    int32_t cluster;    // DEDUP_EMPTY / DEDUP_TOMBSTONE / číslo clusteru
+};
+
+#define DEDUP_EMPTY 0       // cluster 0 patří kořenovému adresáři, nikdy se neindexuje
+#define DEDUP_TOMBSTONE -1  // smazaná položka, průchod pokračuje dál
+
+// MurmurHash3 x64_128 (výsledek do out[0], out[1])
+void fs_murmur3_128(const void *key, int len, uint32_t seed, uint64_t out[2]);
+
+// Počet položek indexu pro svazek s cluster_count clustery (mocnina dvou, zaplnění max. 2/3)
+int dedup_slot_count(int cluster_count);
+
+// Najde cluster se stejným obsahem jako data (cluster_size B). Vrací číslo clusteru nebo -1.
+int32_t dedup_find(FILE *f, struct superblock *sb, const uint8_t *data);
+
+// Zaznamená nově zapsaný cluster do indexu
+void dedup_insert(FILE *f, struct superblock *sb, const uint8_t *data, int32_t cluster);
+
+// Odebere cluster z indexu (volá se těsně před jeho uvolněním)
+void dedup_forget(FILE *f, struct superblock *sb, int32_t cluster);
+
+// Clustery indexu: vrací jejich počet (0 = svazek index nemá) a první cluster do *first
+int dedup_index_clusters(const struct superblock *sb, int32_t *first);
+
+// Obsadí a vynuluje úsek datových clusterů pro index (pokud ho svazek ještě nemá).
+// Mění sb, superblock zapíše volající. Vrací 0, pokud souvislý úsek není volný.
+int dedup_reserve(FILE *f, struct superblock *sb);
+
+// Uvolní clustery indexu a odpojí ho od sb (superblock zapíše volající)
+void dedup_release(FILE *f, struct superblock *sb);
+
+// Vyprázdní celý index
+void dedup_clear(FILE *f, struct superblock *sb);
+
+// Offline deduplikace celého obrazu (příkaz dedupe), hashuje paralelně
+int fs_dedupe(const char *filename);
+
+#endif // FS_DEDUP_H
@@ -0,0 +1,117 @@
+#ifndef FS_IO_H
+#define FS_IO_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Vstup/výstup nad obrazem FS + žurnál (write-ahead log).
+ *
+ * Veškeré čtení a zápis obrazu jde přes fs_pread()/fs_pwrite(). Mimo režim
+ * FS_DURABILITY_NONE se zápisy neposílají rovnou na místo, ale do paměťové
+ * vrstvy bloků (FS_IO_BLOCK B); čtení ji vidí. Na konci příkazu (fs_io_commit)
+ * se změněné bloky zapíšou jako jeden záznam do žurnálu, po fdatasync teprve
+ * na svá místa. Při připojení obrazu se potvrzené záznamy přehrají, takže příkaz
+ * se po pádu projeví buď celý, nebo vůbec.
+ *
+ * Režimy:
+ *   none   – přímé zápisy bez žurnálu (původní chování)
+ *   batch  – skupinový commit: víc příkazů sdílí jeden záznam a jeden fdatasync
+ *   always – každý příkaz je po návratu trvale na disku
+ *
+ * Víc procesů nad jedním obrazem: příkaz drží zámek fcntl (OFD) nad oblastí
+ * metadat [0, data_start_address) – čtení sdíleně, změny výhradně. Datová oblast
+ * se nezamyká, clustery jsou dosažitelné jen přes metadata. Zámek se drží přes
+ * víc příkazů a uvolní se, když proces nemá další práci (fs_io_flush), nebo po
+ * FS_BATCH_COMMANDS příkazech, aby se dostaly ostatní procesy. Před uvolněním
+ * výhradního zámku se změny potvrdí a žurnál se vyprázdní (checkpoint), takže
+ * další proces začíná s prázdným žurnálem a po pádu držitele přehraje jen jeho
+ * záznamy. Otevřená transakce drží výhradní zámek až do commit/abort.
+ *
+ * Kdo obraz zamkne pro zápis, zvýší superblock.generation (jen u obrazu se známým
+ * rozvržením, FS_LAYOUT_OK – jinde na jejím místě leží cizí data). Proces si pamatuje
+ * poslední viděnou hodnotu; když se při dalším zamčení liší, obraz mezitím měnil
+ * někdo jiný a zavolá se funkce z fs_io_on_change() (zahození cache).
+ */
+enum fs_durability {
+    FS_DURABILITY_NONE,
+    FS_DURABILITY_BATCH,
+    FS_DURABILITY_ALWAYS
+};
+
+#define FS_IO_BLOCK 512             // granularita žurnálu a paměťové vrstvy
+#define FS_BATCH_COMMANDS 64        // batch: nejvýš tolik příkazů na jeden commit
+#define FS_JOURNAL_MIN_CLUSTERS 8   // nejmenší žurnál (jinak 1/16 clusterů svazku)
+
+// Převede "none" / "batch" / "always" na režim. Vrací -1 pro neznámý název.
+int fs_durability_parse(const char *name);
+
+// Připojí obraz: nastaví režim a přehraje potvrzené záznamy žurnálu
+void fs_io_open(const char *filename, enum fs_durability mode);
+
+// Konec příkazu – potvrdí změny podle režimu
+void fs_io_commit(void);
+
+// Potvrdí rozpracovaný skupinový commit hned a uvolní zámek obrazu (proces nemá
+// další práci: server bez příkazů, shell bez čekajícího vstupu)
+void fs_io_flush(void);
+
+// Příkaz v běhu: zamkne obraz (write = výhradně, jinak sdíleně), pokud ho proces
+// ještě nedrží. Commit počká, až rozpracované příkazy skončí, aby záznam žurnálu
+// obsahoval jen celé příkazy. fs_io_commit() se volá až po fs_io_leave().
+void fs_io_enter(bool write);
+void fs_io_leave(void);
+
+// Generace obrazu zapsaná při posledním zamčení (format ji přenese do nového superblocku)
+uint32_t fs_io_generation(void);
+
+// Funkce volaná, když obraz mezitím změnil jiný proces (nikdo z procesu zrovna nepracuje)
+void fs_io_on_change(void (*fn)(void));
+
+// Zapíše vše čekající na místo a vyprázdní žurnál (konec programu)
+void fs_io_checkpoint(void);
+
+// Zahodí čekající změny (format přepisuje celý obraz)
+void fs_io_discard(void);
+
+// Jdou zápisy obrazu teď do paměťové vrstvy (batch/always nebo otevřená transakce)?
+bool fs_io_buffered(void);
+// Zvýší se při každém vyprázdnění vrstvy (commit, abort): co se uvolnilo před ním,
+// je už uvolněné i na disku (nebo uvolnění zaniklo).
+uint64_t fs_io_epoch(void);
+
+/*
+ * Transakce: mezi fs_io_begin() a fs_io_end() se všechny zápisy (bitmapy, inody,
+ * adresáře i data) drží v paměťové vrstvě a zapíšou se najednou – jeden záznam
+ * žurnálu, bloky seřazené podle offsetu. Funguje ve všech režimech včetně none.
+ * Vnořené begin se slučují do vnější transakce, abort zahodí celou.
+ * Zápisy mimo obraz (outcp) ani format transakční nejsou.
+ */
+
+// Zahájí (případně vnoří) transakci. Vnější nejdřív zapíše změny čekající z dávky
+// (potvrzené příkazy před begin), aby je abort nezahodil. Vrací 0, pokud se
+// nepodařilo je zapsat – transakce pak nezačne.
+int fs_io_begin(void);
+
+// Ukončí transakci; nejvnější zapíše všechny změny. Vrací 0, pokud žádná neběží.
+int fs_io_end(void);
+
+// Zahodí změny rozpracované transakce (vrstva obsahuje jen ty). Vrací 0, pokud žádná neběží.
+int fs_io_abort(void);
+
+// 1 pokud běží transakce
+int fs_io_in_transaction(void);
+
+// Čtení/zápis obrazu na absolutní offset. Vrací 1 při úspěchu, 0 při chybě.
+int fs_pread(FILE *f, long offset, void *buf, size_t len);
+int fs_pwrite(FILE *f, long offset, const void *buf, size_t len);
+
+// Zápis obsahu čerstvě obsazených clusterů rovnou na disk přes vlastní fd (mimo žurnál,
+// jako data=ordered: po pádu před commitem metadat zůstanou clustery volné). Bloky,
+// které už paměťová vrstva drží (sdílené se sousedem), se doplní i tam. Smí volat víc
+// vláken zároveň nad různými rozsahy, pokud mezitím nikdo nevolá fs_pwrite.
+int fs_pwrite_data(int fd, long offset, const void *buf, size_t len);
+
+#endif // FS_IO_H
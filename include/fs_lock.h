@@ -0,0 +1,69 @@
+#ifndef FS_LOCK_H
+#define FS_LOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Zámky jádra pro souběžné příkazy (serverový režim).
+ *
+ * Inody: pole FS_INODE_LOCK_STRIPES rwlocků, inode padne do pruhu id % počet.
+ * Příkaz si zámky nasbírá do sady (fs_lock_set) a zamkne je najednou seřazené
+ * podle pruhu – dva příkazy se tak nikdy nezamknou navzájem (mv s dvěma
+ * adresáři, xcp s víc zdroji). Čtení (cat, ls, info, outcp) drží cíl sdíleně,
+ * změna drží výhradně rodičovský adresář i cíl.
+ *
+ * Alokátor bitmap je bez zámků (atomické operace nad slovy, fs_utils.c); vlákno
+ * začíná hledat ve své oblasti, takže zápisy ve více vláknech si nepřekáží.
+ * Tabulka sdílení je rozdělená na FS_ALLOC_SHARDS úseků s vlastním mutexem.
+ *
+ * Pořadí (jinak hrozí deadlock):
+ *   inody (sada) -> FS_LOCK_FRAG -> FS_LOCK_DEDUP -> úseky tabulky sdílení
+ *   (vzestupně) -> FS_LOCK_COUNTERS.
+ * Paměťová vrstva fs_io a cache cest mají vnitřní zámky a volají se odkudkoli.
+ */
+
+#define FS_INODE_LOCK_STRIPES 1024
+#define FS_ALLOC_SHARDS 64
+#define FS_LOCK_SET_MAX 40
+
+struct fs_lock_item {
+    uint16_t stripe;
+    bool exclusive;
+};
+
+// Sada zámků inodů jednoho příkazu
+struct fs_lock_set {
+    int count;
+    bool held;
+    struct fs_lock_item items[FS_LOCK_SET_MAX];
+};
+
+// Globální zámky sdílených struktur svazku
+enum fs_lock_id {
+    FS_LOCK_FRAG,       // otevřený fragment cluster (sb->frag_cluster, frag_used)
+    FS_LOCK_DEDUP,      // index deduplikace (a uvolnění clusteru, který v něm může být)
+    FS_LOCK_COUNTERS,   // počítadla obsazení v superblocku
+    FS_LOCK_COUNT
+};
+
+void fs_lock_set_init(struct fs_lock_set *set);
+// Přidá inode (id < 0 se ignoruje); výhradní požadavek přebije sdílený téhož pruhu
+void fs_lock_set_add(struct fs_lock_set *set, int inode_id, bool exclusive);
+// Zamkne celou sadu (vzestupně podle pruhu) / odemkne ji
+void fs_lock_set_acquire(struct fs_lock_set *set);
+void fs_lock_set_release(struct fs_lock_set *set);
+
+void fs_lock(enum fs_lock_id id);
+void fs_unlock(enum fs_lock_id id);
+
+// Úsek tabulky sdílení (0 .. FS_ALLOC_SHARDS-1)
+void fs_lock_shard(int shard);
+void fs_unlock_shard(int shard);
+
+// Oblast bitmapy (0 .. FS_ALLOC_SHARDS-1), kde volající vlákno začíná hledat volné
+// bity. Vlákna dostávají oblasti postupně 0, 1, 2, ... podle první alokace, jediné
+// vlákno tedy hledá od začátku.
+int fs_lock_home_shard(void);
+
+#endif // FS_LOCK_H
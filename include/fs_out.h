@@ -0,0 +1,28 @@
+#ifndef FS_OUT_H
+#define FS_OUT_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+/*
+ * Výstup příkazů.
+ *
+ * Příkazy nepíšou přímo na stdout, ale do výstupu svého vlákna: mimo server je
+ * to stdout, vlákno serveru si ho po dobu příkazu přesměruje do bufferu relace.
+ * Pomocná vlákna příkazu (scrub, du, incp -r, ...) se zakládají přes
+ * fs_out_thread(), takže hlášky z nich (CHECKSUM ERROR) jdou do stejné relace.
+ */
+
+// Výstup volajícího vlákna (výchozí stdout)
+FILE *fs_out(void);
+
+// Přesměruje výstup volajícího vlákna, NULL = zpět na stdout
+void fs_out_set(FILE *out);
+
+// printf do fs_out()
+int fs_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// pthread_create s výchozími atributy; nové vlákno zdědí výstup a třídu I/O volajícího
+int fs_out_thread(pthread_t *tid, void *(*fn)(void *), void *arg);
+
+#endif // FS_OUT_H
@@ -0,0 +1,47 @@
+#ifndef FS_PREFETCH_H
+#define FS_PREFETCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Přednačítání hostitelských souborů pro load --prefetch.
+ *
+ * Operace nad obrazem (alokace, bitmapy, adresáře, žurnál) běží dál v jednom vlákně
+ * a v pořadí skriptu – výsledný obraz i výpis jsou tak stejné jako při sériovém
+ * běhu. Paralelně se dělá jen to, co stav svazku nemění: čtení vstupů incp
+ * z hostitele a u incp -z i komprese. Každá operace skriptu má lístek (ticket =
+ * index operace); fs_incp si vyzvedne obsah připravený pro právě prováděnou operaci.
+ */
+
+#define PREFETCH_MAX_THREADS 64
+#define PREFETCH_MAX_BYTES (1L << 20)   // větší soubory se čtou až při provedení
+
+// Předem připravený vstup incp
+struct prefetched_file {
+    uint8_t *data;
+    long size;
+    uint8_t *payload;       // fs_compress_file s CLUSTER_SIZE (incp -z), NULL = nepočítáno
+    int payload_len;        // 0 = komprese se nevešla
+};
+
+// Spustí N pracovních vláken. Vrací 0, pokud už pool běží (vnořený load) nebo selže start.
+int prefetch_start(int threads);
+
+// Zařadí přednačtení host_path pro operaci ticket (lístky musí růst), compress = i komprese
+void prefetch_submit(uint32_t ticket, const char *host_path, bool compress);
+
+// Začíná provedení operace ticket
+void prefetch_begin_op(uint32_t ticket);
+
+// Operace ticket skončila – zahodí její nevyzvednutá data (i starších operací)
+void prefetch_end_op(uint32_t ticket);
+
+// Zastaví vlákna a uvolní vše nevyzvednuté
+void prefetch_stop(void);
+
+// Obsah host_path připravený pro právě prováděnou operaci (počká na dokončení).
+// Při úspěchu předá vlastnictví bufferů v out volajícímu; false = číst ze souboru.
+bool prefetch_take(const char *host_path, struct prefetched_file *out);
+
+#endif // FS_PREFETCH_H
@@ -0,0 +1,61 @@
+#ifndef FS_SCHED_H
+#define FS_SCHED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+ * Priority I/O v serverovém režimu.
+ *
+ * Každý řádek klienta dostane třídu: interaktivní (jen čte obraz – ls, cat,
+ * info, ...), běžnou (změny) a hromadnou (rekurzivní -r: incp -r, outcp -r,
+ * rm -r, cp -r). Server z připravených řádků rozdává vždy ten s nejbližším
+ * termínem (čas připravení + FS_SCHED_*_BUDGET_MS dané třídy); hromadné řádky
+ * s ještě neprošlým termínem se mezi sebou střídají podle toho, kolik bajtů
+ * obrazu klient už přenesl, takže každý klient dostane stejný podíl.
+ *
+ * Pod fs_io: vlákno (i pomocná vlákna příkazu, fs_out_thread) nese třídu
+ * a počítadlo bajtů klienta. Hromadné čtení a zápis obrazu (fs_pread, fs_pwrite,
+ * fs_pwrite_data) počká, dokud běží interaktivní příkaz – nejvýš
+ * FS_SCHED_BULK_YIELD_US na jedno volání, takže hromadná práce nikdy nestojí
+ * a bez interaktivních příkazů jede plnou rychlostí.
+ */
+
+enum fs_io_class {
+    FS_IO_INTERACTIVE,
+    FS_IO_NORMAL,
+    FS_IO_BULK,
+    FS_IO_CLASSES
+};
+
+#define FS_SCHED_INTERACTIVE_BUDGET_MS 2    // termín interaktivního řádku od připravení
+#define FS_SCHED_NORMAL_BUDGET_MS 50
+#define FS_SCHED_BULK_BUDGET_MS 1000
+#define FS_SCHED_BULK_YIELD_US 2000         // nejdelší čekání hromadného I/O na jedno volání
+
+// Třída a účet vlákna (výchozí: běžná, bez účtu)
+struct fs_sched_tag {
+    enum fs_io_class cls;
+    _Atomic uint64_t *bytes;    // přenesené bajty klienta, NULL = nepočítat
+};
+
+// Termín třídy v ns od připravení řádku
+int64_t fs_sched_budget_ns(enum fs_io_class cls);
+
+// Nastaví třídu a účet volajícího vlákna (pracovní vlákno serveru před řádkem)
+void fs_sched_set(enum fs_io_class cls, _Atomic uint64_t *bytes);
+
+// Třída vlákna – pomocné vlákno ji převezme přes fs_sched_adopt()
+struct fs_sched_tag fs_sched_tag(void);
+void fs_sched_adopt(struct fs_sched_tag tag);
+
+// Interaktivní příkaz právě pracuje (už drží zámky inodů) / skončil
+void fs_sched_run_begin(void);
+void fs_sched_run_end(void);
+
+// Před čtením/zápisem len bajtů obrazu: započítá je a hromadné I/O případně přibrzdí
+void fs_sched_io(size_t len);
+
+#endif // FS_SCHED_H
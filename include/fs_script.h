@@ -0,0 +1,56 @@
+#ifndef FS_SCRIPT_H
+#define FS_SCRIPT_H
+
+#include <stdint.h>
+
+/*
+ * Kompilované skripty pro příkaz load.
+ *
+ * Skript se přeloží jednou do pole operací: jméno příkazu je už převedené na id
+ * (perfektní hash v main.c), argumenty jsou řetězce ve společném poolu a absolutní
+ * cesty ve VFS jsou předem normalizované ("." a ".." vyřešené) a internované přes
+ * strom segmentů – stejná cesta má v celém skriptu jeden řetězec.
+ *
+ * Přeložený skript jde uložit vedle zdrojového (příkaz compile, přípona .zsc).
+ * load pak platnou cache (shodná velikost, čas změny a tabulka příkazů) načte
+ * místo parsování; zastaralou přeloží znovu a přepíše.
+ */
+
+#define SCRIPT_MAX_ARGS 16                  // tokenů na řádek (jako MAX_ARGS v main.c)
+#define SCRIPT_UNKNOWN_COMMAND 0xFFFFu      // script_op.cmd pro neznámý příkaz
+#define SCRIPT_CACHE_SUFFIX ".zsc"
+
+// Popis příkazů shellu, který překladač potřebuje.
+struct script_commands {
+    int (*lookup)(const char *name);        // id příkazu, -1 = neznámý
+    unsigned (*path_args)(int id);          // bit i: i-tý poziční argument (bez přepínačů "-x") je cesta ve VFS
+    uint32_t signature;                     // otisk tabulky příkazů; jiný otisk = cache neplatí
+};
+
+struct script_op {
+    uint16_t cmd;                           // id příkazu nebo SCRIPT_UNKNOWN_COMMAND
+    uint16_t argc;                          // počet tokenů včetně jména příkazu
+    uint32_t first_arg;                     // index prvního tokenu v script.args
+};
+
+struct script {
+    struct script_op *ops;
+    uint32_t op_count;
+    uint32_t *args;                         // offsety tokenů v pool
+    uint32_t arg_count;
+    char *pool;                             // řetězce ukončené '\0'
+    uint32_t pool_size;
+};
+
+// Přeloží skript. NULL = soubor nejde otevřít (nebo chybí paměť).
+struct script *script_compile(const char *filename, const struct script_commands *cmds);
+
+// Platná cache filename.zsc, jinak překlad (a přepsání existující zastaralé cache).
+struct script *script_load(const char *filename, const struct script_commands *cmds);
+
+// Uloží přeložený skript do filename.zsc. Vrací 1 při úspěchu.
+int script_save(const struct script *s, const char *filename, const struct script_commands *cmds);
+
+void script_free(struct script *s);
+
+#endif // FS_SCRIPT_H
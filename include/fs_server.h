@@ -0,0 +1,49 @@
+#ifndef FS_SERVER_H
+#define FS_SERVER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "fs_sched.h"
+
+/*
+ * Serverový režim: fs_app --serve <socket> <obraz>.
+ *
+ * Jeden dlouho běžící proces drží obraz připojený (žurnál, cache cest, page
+ * cache) a obsluhuje klienty přes Unix domain socket. Protokol je stejný jako
+ * na stdin: klient posílá řádky příkazů, zpět dostává jejich výstup. Relace
+ * končí příkazem exit nebo zavřením zápisu klienta (shutdown) – pak se ještě
+ * provedou zbylé řádky a doposílá výstup.
+ *
+ * Smyčka událostí (epoll) běží v jednom vlákně a dělá jen vstup a výstup
+ * socketů; řádky provádí skupina pracovních vláken. Každý klient má rozdaný
+ * nejvýš jeden řádek, řádky různých klientů běží souběžně (zámky inodů a
+ * alokátoru viz fs_lock.h). Řádek, pro který ops->serial vrátí true (transakce,
+ * příkazy nad celým svazkem), počká na doběhnutí ostatních a běží sám. Výstup
+ * příkazu jde do paměťového proudu, smyčka ho přesune do fronty klienta a
+ * odesílá neblokujícím zápisem, takže pomalý klient nezdrží ostatní. Relace
+ * s otevřenou transakcí (begin) má obraz pro sebe, řádky ostatních čekají.
+ *
+ * Priority (ops->priority, fs_sched.h): čekající řádky se rozdávají podle
+ * nejbližšího termínu jejich třídy. Interaktivní řádky běží vždy, i vedle
+ * hromadného; běžný řádek (změna) nepoběží vedle hromadného a hromadný vedle
+ * změn ani jiného hromadného. Hromadný řádek po termínu zastaví rozdávání změn,
+ * takže se dostane na řadu i při stálém proudu změn.
+ */
+
+// Napojení smyčky na shell (main.c)
+struct fs_server_ops {
+    void *(*open)(void *arg);                   // nová relace, NULL = klienta odmítnout
+    bool (*exec)(void *session, char *line, FILE *out); // jeden řádek (pracovní vlákno); false = exit
+    bool (*serial)(void *session, const char *line);     // řádek musí běžet sám
+    bool (*exclusive)(void *session);           // relace drží obraz pro sebe (transakce)
+    enum fs_io_class (*priority)(void *session, const char *line); // třída řádku, NULL = vše běžné
+    void (*close)(void *session);               // konec relace, i odpojení uprostřed transakce
+    void (*idle)(void *arg);                    // žádný klient nemá co provést (před čekáním)
+    void *arg;
+};
+
+// Obsluhuje klienty na socket_path do SIGINT/SIGTERM. Vrací 0, pokud socket nejde vytvořit.
+int fs_serve(const char *socket_path, const struct fs_server_ops *ops);
+
+#endif // FS_SERVER_H
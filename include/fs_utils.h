@@ -6,19 +6,114 @@
 #include <stdbool.h>
 
 // --- I/O Superblock & Inode ---
+// Další load_superblock() uvidí tabulku inodů ze snapshotu name (NULL = zpět na živý svazek)
+void fs_set_snapshot_view(const char *name);
+// Načte superblock; 0 i pro obraz s jiným rozvržením (FS_LAYOUT_OK)
 int load_superblock(FILE *f, struct superblock *sb);
+// Rozvržení obrazu: 1 = odpovídá programu, 0 = jiné (obraz se odmítne), -1 = obraz nejde přečíst
+int fs_layout_check(const char *filename);
+int write_superblock(FILE *f, struct superblock *sb);
+// Spočítá počítadla obsazení průchodem bitmapami a tabulkou inodů (statfs při neplatných počítadlech, fsck)
+int fs_counters_scan(FILE *f, struct superblock *sb, struct fs_counters *out);
+// Zapíše počítadla (po hromadné změně metadat, např. rollback snapshotu)
+int fs_counters_store(FILE *f, struct superblock *sb, const struct fs_counters *counters);
+// Snapshot: [inode bitmapa][mapa úseků tabulky inodů] v souvislém úseku clusterů. Úsek
+// tabulky (cluster_size bajtů) s obsazeným inodem má vlastní cluster, sdílený mezi
+// snapshoty se stejným obsahem; úsek bez obsazených inodů je CLUSTER_UNUSED (čte se jako nuly).
+int snapshot_chunk_count(const struct superblock *sb);
+long snapshot_header_bytes(const struct superblock *sb);
+// Přesměruje inode bitmapu a tabulku inodů v sb na snapshot (jen pro čtení)
+void snapshot_redirect(struct superblock *sb, const struct snapshot_entry *snap);
+// Přečte len bajtů tabulky inodů od offsetu; v sb přesměrovaném na snapshot přes jeho mapu úseků
+int read_inode_table(FILE *f, const struct superblock *sb, long offset, void *out, size_t len);
 void read_inode(FILE *f, struct superblock *sb, int inode_id, struct pseudo_inode *inode);
 void write_inode(FILE *f, struct superblock *sb, int inode_id, struct pseudo_inode *inode);
+// Načte inody ids[0..count-1] do out (ve stejném pořadí). Čte je seřazené podle ID
+// a blízké inody jedním čtením úseku tabulky. Vrací 1, nebo 0 při chybě (neplatné ID).
+int read_inodes(FILE *f, struct superblock *sb, const int32_t *ids, int count, struct pseudo_inode *out);
 
 // --- Bitmapy ---
-int find_free_bit(FILE *f, struct superblock *sb, bool is_inode_bitmap);
+// Obsadí první volný bit (od úseku volajícího vlákna, viz fs_lock.h) a vrátí jeho index,
+// -1 pokud je plno. Hledání i obsazení proběhne pod zámkem úseku, takže dvě vlákna
+// nikdy nedostanou stejný inode ani cluster.
+int alloc_bit(FILE *f, struct superblock *sb, bool is_inode_bitmap);
 void set_bit(FILE *f, struct superblock *sb, bool is_inode_bitmap, int index, bool status);
+// Obsadí count volných bitů (první volné, vzestupně) jedním čtením a zápisem bitmapy;
+// čísla uloží do out. Vrací 1, nebo 0 pokud jich tolik volných není (bitmapa beze změny).
+int alloc_bits(FILE *f, struct superblock *sb, bool is_inode_bitmap, int count, int32_t *out);
+// alloc_bits pro datové clustery zapisované přímo na disk (fs_pwrite_data): vynechá
+// clustery uvolněné v ještě nepotvrzené dávce či transakci – abort nebo pád je vrátí.
+int alloc_direct_bits(FILE *f, struct superblock *sb, int count, int32_t *out);
+// Vynuluje bity indexes[0..count-1] (pole seřadí) po celých slovech jedním čtením a zápisem bitmapy.
+int clear_bits(FILE *f, struct superblock *sb, bool is_inode_bitmap, int32_t *indexes, int count);
+// Počet datových clusterů svazku (obraz může být menší, než udává cluster_count)
+int data_cluster_count(const struct superblock *sb);
+// První úsek n volných datových clusterů za sebou (kopie metadat snapshotů, index
+// deduplikace). Vrací číslo prvního clusteru nebo -1; nic neobsazuje.
+int find_free_run(FILE *f, const struct superblock *sb, int n);
+
+// --- Sdílení clusterů (copy-on-write) ---
+// Tabulka sdílení drží pro každý cluster počet *dalších* odkazů (0 = jediný vlastník),
+// takže obyčejná alokace přes set_bit ji nemusí vůbec řešit.
+int cluster_share_count(FILE *f, struct superblock *sb, int32_t cluster);
+// Přidá jeden odkaz. Vrací 0, pokud je čítač plný (UINT16_MAX) – cluster pak nejde sdílet.
+int cluster_ref(FILE *f, struct superblock *sb, int32_t cluster);
+// Cluster pro nový odkaz: sdílí ho, a při plném čítači vrátí jeho kopii v novém clusteru.
+// Vrací číslo clusteru, nebo -1 pokud došlo místo (nebo cluster nejde přečíst).
+int32_t cluster_share(FILE *f, struct superblock *sb, int32_t cluster);
+// Odebere jeden odkaz; poslední odkaz uvolní cluster v datové bitmapě.
+void cluster_unref(FILE *f, struct superblock *sb, int32_t cluster);
+// cluster_unref pro celé pole odkazů (stejný cluster může být vícekrát), bitmapa se zapíše jednou.
+// Pole se přepíše.
+void cluster_unref_batch(FILE *f, struct superblock *sb, int32_t *clusters, int count);
+// Uloží plný datový cluster; při FS_FEATURE_DEDUP sdílí existující cluster se stejným obsahem.
+// Vrací číslo clusteru nebo -1, pokud došlo místo.
+int32_t store_data_cluster(FILE *f, struct superblock *sb, const uint8_t *data);
+
+// --- Tail packing ---
+// Uloží data (len <= TAIL_PACK_MAX) do sdíleného fragment clusteru, vrátí jeho cluster a offset.
+// Vrací 1 při úspěchu, 0 pokud došlo místo.
+int frag_alloc(FILE *f, struct superblock *sb, const uint8_t *data, int len, int32_t *cluster, int *offset);
+
+// Zapíše poslední neúplný blok souboru: nulový jako díru, krátký konec do fragmentu
+// (INODE_FLAG_TAIL), delší do nového clusteru připojeného do blocks. Vrací 1 při úspěchu, 0 při nedostatku místa.
+int write_file_tail(FILE *f, struct superblock *sb, struct pseudo_inode *inode,
+                    int32_t blocks[5], int *block_count, const uint8_t *data, int len);
+
+// Clustery, na které inode drží odkaz (přímé bez děr + fragment konce). Vrací jejich počet.
+int inode_cluster_list(const struct pseudo_inode *inode, int32_t clusters[6]);
+
+// Uvolní datové clustery souboru (sdílené jen ztratí odkaz); inode samotný nechá být
+void free_file_clusters(FILE *f, struct superblock *sb, const struct pseudo_inode *inode);
 
 // --- Práce s adresáři a cestami ---
 int find_inode_in_dir(FILE *f, struct superblock *sb, int parent_inode_id, char *name);
 int add_directory_item(FILE *f, struct superblock *sb, int parent_inode_id, struct directory_item *new_item);
+// Založí prázdný adresář (inode + cluster s "." a ".."), do rodiče ho nepřidává.
+// Vrací id inodu, -1 pokud není volný inode nebo cluster.
+int new_directory_inode(FILE *f, struct superblock *sb, int parent_inode_id);
+// Zapíše inode adresáře s jediným clusterem a jeho obsah data (cluster_size bajtů);
+// bity v bitmapách nastavuje volající.
+void write_directory_inode(FILE *f, struct superblock *sb, int inode_id, int32_t cluster, const uint8_t *data);
 int fs_path_to_inode(const char *filename, const char *path);
 
+// Vzory cest: '*', '?', "[...]" ("[!...]" = doplněk), '\' ruší význam dalšího znaku.
+bool fs_glob_has_magic(const char *path);
+bool fs_glob_match(const char *pattern, const char *name);
+// Rozvine vzor absolutní cesty; každý adresář na cestě se projde jedním čtením jeho clusterů
+// a nalezené cesty se uloží do cache cest. Vrací počet shod (cesty seřazené v *out,
+// uvolní fs_glob_free), 0 = nic / vzor bez zástupných znaků, -1 = chyba.
+int fs_glob(const char *filename, const char *pattern, char ***out);
+void fs_glob_free(char **matches, int count);
+
+// Zahodí cache cest -> inode (po změně, která mění jména nebo tabulku inodů hromadně:
+// format, rollback, abort). Odebrání položky adresáře ji zahazuje samo.
+void fs_dcache_invalidate(void);
+
+// Zahodí paměťové zrcadlo bitmap po změně bitmap přímo na disku (format, abort,
+// rollback, oprava fsck); načte se znovu při další alokaci.
+void fs_bitmap_invalidate(void);
+
 // Odstraní položku (podle jména) z adresáře
 // Vrací 1 (úspěch), 0 (chyba/nenalezeno)
 int remove_directory_item(FILE *f, struct superblock *sb, int parent_inode_id, char *name);
@@ -44,6 +139,32 @@ void free_inode_resources(FILE *f, struct superblock *sb, int inode_id);
 // --- Helpery pro operace (přesunuto z fs_ops) ---
 void parse_path(const char *path, char *parent_path, char *filename);
 int load_file_content(FILE *f, struct superblock *sb, int inode_id, uint8_t *buffer);
-int write_buffer_to_new_inode(FILE *f, struct superblock *sb, int inode_id, uint8_t *buffer, int size);
+
+// Přímé odkazy inodu (direct1..direct5) jako pole
+void inode_get_direct(const struct pseudo_inode *inode, int32_t blocks[5]);
+void inode_set_direct(struct pseudo_inode *inode, const int32_t blocks[5]);
+
+// Test, zda je buffer celý nulový (vektorově po 16 B, jinak po 64bitových slovech)
+bool buffer_is_zero(const uint8_t *buf, size_t len);
+
+// Je index-tý cluster souboru díra (CLUSTER_HOLE)?
+bool file_cluster_is_hole(const struct pseudo_inode *inode, int index);
+
+// Zapíše celý cluster (cluster_size bajtů) z buf a aktualizuje jeho kontrolní součet
+int write_cluster(FILE *f, struct superblock *sb, int32_t cluster, const uint8_t *buf);
+// Načte celý cluster (cluster_size bajtů) do buf; 0 i při neshodě kontrolního součtu
+int read_cluster(FILE *f, const struct superblock *sb, int32_t cluster, uint8_t *buf);
+
+// Načte platné bajty `index`-tého clusteru souboru do buf (max. cluster_size).
+// Vrací počet načtených bajtů, 0 za koncem souboru.
+int read_file_cluster(FILE *f, struct superblock *sb, const struct pseudo_inode *inode, int index, uint8_t *buf);
+// Zapíše obsah do inodu inode_id (inline / clustery / díry / konec ve fragmentu).
+// compress vynutí kompresi souboru; při FS_FEATURE_COMPRESS se komprimuje vždy.
+int write_buffer_to_new_inode(FILE *f, struct superblock *sb, int inode_id, uint8_t *buffer, int size, bool compress);
+
+// Jako write_buffer_to_new_inode, ale s komprimovaným payloadem spočítaným předem
+// (fs_compress_file s CLUSTER_SIZE, load --prefetch). payload NULL = spočítat zde.
+int write_prepared_to_new_inode(FILE *f, struct superblock *sb, int inode_id, uint8_t *buffer, int size, bool compress,
+                                const uint8_t *payload, int payload_len);
 
 #endif
\ No newline at end of file
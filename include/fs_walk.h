@@ -0,0 +1,57 @@
+#ifndef FS_WALK_H
+#define FS_WALK_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "structs.h"
+
+/*
+ * Paralelní průchod podstromem (du, find, tree).
+ *
+ * Tabulka inodů se na začátku načte jedním sekvenčním čtením do paměti a průchod
+ * pak pracuje nad tímto neměnným snímkem – read_inode po jednom se nevolá vůbec.
+ * Adresáře zpracovává pool vláken s vlastními frontami (deque): nalezené
+ * podadresáře si vlákno přidá na konec své fronty a bere je od konce, vlákno bez
+ * práce krade ze začátku fronty jiného vlákna.
+ *
+ * Průchod hlásí i položky poškozeného obrazu (pro fsck): ID mimo tabulku má
+ * inode = NULL a adresář dosažený podruhé má repeat = true (jeho obsah se znovu
+ * neprochází). Ostatní příkazy takové položky přeskakují.
+ */
+
+#define WALK_MAX_THREADS 16
+
+struct walk_entry {
+    const char *dir_path;               // cesta rodičovského adresáře ("" = kořen VFS)
+    const char *name;
+    int32_t parent_inode;
+    int32_t inode_id;
+    const struct pseudo_inode *inode;   // položka ve snímku tabulky inodů, NULL = ID mimo tabulku
+    const struct directory_item *item;  // položka adresáře (typ)
+    bool repeat;                        // adresář už dosažený jinou položkou
+    int depth;                          // 1 = přímý potomek kořene průchodu
+    int top;                            // pozice přímého potomka kořene (v kořenovém adresáři), pod kterým položka leží
+};
+
+// Volá se pro každou položku pod kořenem (kořen sám ne), souběžně z více vláken;
+// thread = 0 .. počet vláken - 1. Ukazatele v entry platí jen po dobu volání.
+typedef void (*walk_visit_fn)(void *arg, int thread, const struct walk_entry *entry);
+
+// Počet vláken pro paralelní práci: online CPU, nejméně 1 a nejvýš max.
+// fs_walk jich použije fs_walk_threads(WALK_MAX_THREADS) (pro buffery po vláknech).
+int fs_walk_threads(int max);
+
+// Projde podstrom adresáře root_inode (root_path = jeho absolutní cesta).
+// Vrací počet použitých vláken, 0 pokud obraz nejde načíst nebo root není adresář.
+int fs_walk(const char *filename, int root_inode, const char *root_path, walk_visit_fn visit, void *arg);
+
+// Průchod nad už načtenou tabulkou inodů table (cluster_count položek); f se čte jen přes fs_pread.
+int fs_walk_table(FILE *f, const struct superblock *sb, const struct pseudo_inode *table, int root_inode,
+                  const char *root_path, walk_visit_fn visit, void *arg);
+
+// Porovnání cest po segmentech ('/' řadí před ostatní znaky) – seřazený seznam
+// je pak průchod do hloubky se sourozenci podle jména.
+int fs_walk_path_cmp(const char *a, const char *b);
+
+#endif // FS_WALK_H
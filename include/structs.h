@@ -7,10 +7,50 @@
 // ID pro volnou položku
 #define ID_ITEM_FREE 0
 #define CLUSTER_UNUSED -1
+#define CLUSTER_HOLE -2     // díra v řídkém souboru: samé nuly, žádný alokovaný cluster
+
+// Volitelné vlastnosti svazku (superblock.features, příkaz tune)
+#define FS_FEATURE_COMPRESS 0x01    // nové soubory se komprimují
+#define FS_FEATURE_DEDUP    0x02    // shodné plné clustery se sdílí (viz fs_dedup.h)
+
 // Konstanty pro velikosti
 #define CLUSTER_SIZE 1024   // Pevná velikost clusteru (zjednoduší výpočty)
 #define MAX_NAME_LEN 12     // 8+3 + \0
 
+// Snapshoty svazku (příkaz snapshot)
+#define FS_MAX_SNAPSHOTS 8
+
+// Snapshot: hlavička [inode bitmapa][mapa úseků tabulky inodů] v souvislém úseku clusterů,
+// úseky s obsazenými inody v samostatných (i sdílených) clusterech, viz snapshot_redirect().
+// Datové clustery se nekopírují – snapshot na ně drží odkazy v tabulce sdílení.
+struct snapshot_entry {
+    char name[MAX_NAME_LEN];        // jméno snapshotu, "" = volná položka
+    int32_t first_cluster;          // první cluster hlavičky
+    int32_t cluster_count;          // počet clusterů hlavičky
+};
+
+// Počítadla obsazení pro statfs bez průchodu bitmapami a inody. Mění je jen
+// změny bitů v bitmapách a zápisy obsazených inodů (fs_utils.c), na disk jdou
+// hned a write_superblock() je nepřepisuje. valid != FS_COUNTERS_VALID = neplatná
+// počítadla: změny se do nich nepřičítají, statfs je spočítá průchodem a fsck --repair
+// je obnoví. Obraz bez počítadel (starší rozvržení) se odmítne celý, viz FS_LAYOUT_VERSION.
+#define FS_COUNTERS_VALID 0x43544E31u  // "1NTC"
+
+struct fs_counters {
+    uint32_t valid;
+    int32_t used_inodes;            // bity v inode bitmapě
+    int32_t used_clusters;          // bity v datové bitmapě
+    int32_t directories;            // obsazené inody adresářů
+    int64_t logical_bytes;          // součet file_size obsazených inodů souborů
+};
+
+// Rozvržení obrazu (superblock.layout_magic/layout_version). Zapisuje ho format; obraz
+// s jinou hodnotou (starší verze programu, jiné rozvržení) se odmítne – jeho oblasti
+// by ležely jinde, než struktury čekají. Každá změna rozvržení zvyšuje verzi.
+#define FS_LAYOUT_MAGIC 0x5346565Au    // "ZVFS"
+#define FS_LAYOUT_VERSION 3            // 2: index deduplikace v datové oblasti, 3: úseky tabulky ve snapshotech
+#define FS_LAYOUT_OK(sb) ((sb)->layout_magic == FS_LAYOUT_MAGIC && (sb)->layout_version == FS_LAYOUT_VERSION)
+
 // Superblock [cite: 16-20]
 struct superblock {
     char signature[9];              // login autora FS
@@ -22,26 +62,70 @@ struct superblock {
     int32_t bitmap_start_address;   // adresa pocatku bitmapy datových bloků
     int32_t inode_start_address;    // adresa pocatku i-uzlů
     int32_t data_start_address;     // adresa pocatku datovych bloku
+    uint32_t layout_magic;          // FS_LAYOUT_MAGIC (dál jen s platným rozvržením)
+    uint32_t layout_version;        // FS_LAYOUT_VERSION
+    int32_t refcount_start_address; // adresa tabulky sdílení clusterů (uint16_t na cluster)
+    int32_t frag_cluster;           // otevřený fragment cluster pro konce souborů (CLUSTER_UNUSED = žádný)
+    int32_t frag_used;              // kolik bajtů otevřeného fragment clusteru je obsazeno
+    uint32_t features;              // FS_FEATURE_* zapnuté příkazem tune
+    int32_t dedup_start_address;    // adresa indexu hash -> cluster v datové oblasti, 0 = bez indexu
+    int32_t dedup_slots;            // počet položek indexu (mocnina dvou), 0 = bez indexu
+    int32_t crc_start_address;      // adresa tabulky CRC32C clusterů (uint32_t na cluster)
+    int32_t journal_start_address;  // adresa žurnálu metadat (viz fs_io.h)
+    int32_t journal_size;           // velikost žurnálu v bajtech
+    struct snapshot_entry snapshots[FS_MAX_SNAPSHOTS];
+    struct fs_counters counters;    // počítadla a generace musí zůstat na konci (write_superblock je vynechá)
+    uint32_t generation;            // zvyšuje ho každý proces, který obraz zamkne pro zápis (viz fs_io.h)
 };
 
+// Příznaky i-uzlu (pseudo_inode.flags)
+#define INODE_FLAG_INLINE 0x01      // obsah souboru je uložen přímo v inodu místo odkazů
+#define INODE_FLAG_TAIL   0x02      // konec souboru leží ve sdíleném fragmentu:
+                                    // indirect1 = cluster, indirect2 = (offset << 16) | délka
+#define INODE_FLAG_COMPRESSED 0x04  // odkazy nesou komprimovaný payload (viz fs_compress.h)
+
+#define TAIL_PACK(offset, len) ((int32_t)(((offset) << 16) | (len)))
+#define TAIL_OFFSET(packed)    ((int)((uint32_t)(packed) >> 16))
+#define TAIL_LENGTH(packed)    ((int)((packed) & 0xFFFF))
+
+// Nejdelší konec souboru, který se ještě balí do sdíleného fragment clusteru
+#define TAIL_PACK_MAX (CLUSTER_SIZE / 2)
+
 // I-uzel [cite: 21-29]
 struct pseudo_inode {
     int32_t nodeid;                 // ID i-uzlu
     bool isDirectory;               // soubor nebo adresar
     int8_t references;              // počet odkazů na i-uzel
+    uint8_t flags;                  // INODE_FLAG_* (využívá původní zarovnání, velikost se nemění)
     int32_t file_size;              // velikost souboru v bytech
-    int32_t direct1;                // 1. přímý odkaz
-    int32_t direct2;                // 2. přímý odkaz
-    int32_t direct3;                // 3. přímý odkaz
-    int32_t direct4;                // 4. přímý odkaz
-    int32_t direct5;                // 5. přímý odkaz
-    int32_t indirect1;              // 1. nepřímý odkaz
-    int32_t indirect2;              // 2. nepřímý odkaz
+    union {
+        struct {
+            int32_t direct1;        // 1. přímý odkaz
+            int32_t direct2;        // 2. přímý odkaz
+            int32_t direct3;        // 3. přímý odkaz
+            int32_t direct4;        // 4. přímý odkaz
+            int32_t direct5;        // 5. přímý odkaz
+            int32_t indirect1;      // 1. nepřímý odkaz
+            int32_t indirect2;      // 2. nepřímý odkaz
+        };
+        uint8_t inline_data[7 * sizeof(int32_t)]; // obsah malého souboru (INODE_FLAG_INLINE)
+    };
 };
 
+// Kapacita inline dat – odvozená od oblasti odkazů, s větším inodem roste sama
+#define INODE_INLINE_MAX ((int)sizeof(((struct pseudo_inode *)0)->inline_data))
+
+// Typ položky adresáře (directory_item.type) – ls ho zná bez čtení inodu
+#define DIR_TYPE_UNKNOWN 0          // položka ze starší verze obrazu, typ je jen v inodu
+#define DIR_TYPE_FILE    1
+#define DIR_TYPE_DIR     2
+
 // Položka adresáře [cite: 29-30]
+// Typ zabírá horní bajt původního int32_t inode (ID inodu < 2^23 i pro největší
+// disk), velikost položky se nemění a starší obrazy čtou typ jako neznámý.
 struct directory_item {
-    int32_t inode;                  // inode odpovídající souboru
+    signed int inode : 24;          // inode odpovídající souboru
+    unsigned int type : 8;          // DIR_TYPE_*
     char item_name[12];             // 8+3 + \0
 };
 
@@ -7,6 +7,8 @@
 
 #include "../include/fs_core.h"
 #include "../include/fs_utils.h"
+#include "../include/fs_io.h"
+#include "../include/fs_out.h"
 
 /**
  * @file cmd_dir.c
@@ -56,36 +58,64 @@ static void get_direct_blocks(const struct pseudo_inode *inode, int32_t out_bloc
     out_blocks[4] = inode->direct5;
 }
 
+/** Počet obsazených clusterů souboru (přímé odkazy bez děr; konec ve fragmentu se nepočítá). */
+static int used_cluster_count(const struct pseudo_inode *inode)
+{
+    if (inode->flags & INODE_FLAG_INLINE) {
+        return 0;
+    }
+    int32_t blocks[DIRECT_BLOCK_COUNT];
+    get_direct_blocks(inode, blocks);
+    int count = 0;
+    for (int i = 0; i < DIRECT_BLOCK_COUNT; i++) {
+        count += blocks[i] != CLUSTER_UNUSED && blocks[i] != CLUSTER_HOLE;
+    }
+    return count;
+}
+
 /**
  * @brief Projde položky adresáře a vypíše je (bez "." a "..").
  *
+ * Typ položky je v adresáři (directory_item.type), takže obyčejné ls inody
+ * nečte. Inody se načtou jen pro ls -l a pro položky bez typu (starší obraz),
+ * a to všechny najednou přes read_inodes (seřazeně, sousední jedním čtením).
+ *
  * @param f Otevřený FS soubor.
  * @param sb Načtený superblock.
  * @param dir_inode Inode adresáře.
+ * @param long_format ls -l: velikost, inode a počet clusterů
  */
-static void list_directory_items(FILE *f, const struct superblock *sb, const struct pseudo_inode *dir_inode)
+static void list_directory_items(FILE *f, const struct superblock *sb, const struct pseudo_inode *dir_inode,
+                                 bool long_format)
 {
     int32_t blocks[DIRECT_BLOCK_COUNT];
     get_direct_blocks(dir_inode, blocks);
 
     const int items_per_cluster = (int)(sb->cluster_size / sizeof(struct directory_item));
-    struct directory_item item;
+    const size_t max_items = (size_t)DIRECT_BLOCK_COUNT * (size_t)items_per_cluster;
+    struct directory_item *items = (struct directory_item *)malloc((size_t)sb->cluster_size);
+    struct directory_item *entries = (struct directory_item *)malloc(max_items * sizeof(*entries));
+    int32_t *ids = (int32_t *)malloc(max_items * sizeof(*ids));
+    int *id_index = (int *)malloc(max_items * sizeof(*id_index));
+    struct pseudo_inode *inodes = (struct pseudo_inode *)malloc(max_items * sizeof(*inodes));
+    if (!items || !entries || !ids || !id_index || !inodes) {
+        goto cleanup;
+    }
 
+    /* 1) položky všech clusterů adresáře; ID inodů, které je potřeba načíst */
+    int count = 0;
+    int id_count = 0;
     for (int i = 0; i < DIRECT_BLOCK_COUNT; i++) {
         if (blocks[i] == CLUSTER_UNUSED) {
             continue;
         }
 
-        const long cluster_addr = sb->data_start_address + (long)blocks[i] * sb->cluster_size;
-        if (fseek(f, cluster_addr, SEEK_SET) != 0) {
-            /* Pokud se nepovede seeknout, raději pokračuj dál než spadnout. */
+        if (!read_cluster(f, sb, blocks[i], (uint8_t *)items)) {
             continue;
         }
 
         for (int j = 0; j < items_per_cluster; j++) {
-            if (fread(&item, sizeof(item), 1, f) != 1) {
-                break;
-            }
+            const struct directory_item item = items[j];
 
             if (item.item_name[0] == '\0') {
                 continue;
@@ -96,17 +126,42 @@ static void list_directory_items(FILE *f, const struct superblock *sb, const str
                 continue;
             }
 
-            struct pseudo_inode item_inode;
-            const long return_pos = ftell(f);
-            read_inode(f, (struct superblock *)sb, item.inode, &item_inode);
-            printf("%s: %s\n", item_inode.isDirectory ? "DIR" : "FILE", item.item_name);
-
-            /* Vrať se na místo za položkou adresáře. */
-            if (return_pos >= 0) {
-                fseek(f, return_pos, SEEK_SET);
+            id_index[count] = -1;
+            if (long_format || item.type == DIR_TYPE_UNKNOWN) {
+                id_index[count] = id_count;
+                ids[id_count++] = item.inode;
             }
+            entries[count++] = item;
+        }
+    }
+
+    /* 2) potřebné inody jednou dávkou */
+    if (!read_inodes(f, (struct superblock *)sb, ids, id_count, inodes)) {
+        goto cleanup;
+    }
+
+    /* 3) výpis v pořadí adresáře */
+    for (int i = 0; i < count; i++) {
+        const struct directory_item *item = &entries[i];
+        const struct pseudo_inode *inode = (id_index[i] >= 0) ? &inodes[id_index[i]] : NULL;
+        const bool is_dir = inode ? inode->isDirectory : item->type == DIR_TYPE_DIR;
+
+        char name[MAX_NAME_LEN];
+        copy_item_name(name, sizeof(name), item->item_name);
+        if (long_format) {
+            fs_printf("%s: %s - %d B - i-node %d - %d clusters\n", is_dir ? "DIR" : "FILE", name, inode->file_size,
+                      (int)item->inode, used_cluster_count(inode));
+        } else {
+            fs_printf("%s: %s\n", is_dir ? "DIR" : "FILE", name);
         }
     }
+
+cleanup:
+    free(items);
+    free(entries);
+    free(ids);
+    free(id_index);
+    free(inodes);
 }
 
 /**
@@ -115,11 +170,11 @@ static void list_directory_items(FILE *f, const struct superblock *sb, const str
  * @param filename Cesta k souboru FS.
  * @param inode_id Inode id adresáře, který se má vypsat.
  */
-void fs_ls(const char *filename, int inode_id)
+void fs_ls(const char *filename, int inode_id, bool long_format)
 {
     FILE *f = fopen(filename, "rb");
     if (!f) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         return;
     }
 
@@ -130,12 +185,12 @@ void fs_ls(const char *filename, int inode_id)
     read_inode(f, &sb, inode_id, &dir_inode);
 
     if (!dir_inode.isDirectory) {
-        printf("PATH NOT FOUND\n");
+        fs_printf("PATH NOT FOUND\n");
         fclose(f);
         return;
     }
 
-    list_directory_items(f, &sb, &dir_inode);
+    list_directory_items(f, &sb, &dir_inode, long_format);
     fclose(f);
 }
 
@@ -195,69 +250,26 @@ int fs_mkdir(const char *filename, const char *path)
 
     const int parent_id = fs_path_to_inode(filename, parent_path);
     if (parent_id == -1) {
-        printf("PATH NOT FOUND\n");
+        fs_printf("PATH NOT FOUND\n");
         fclose(f);
         return 0;
     }
 
     if (find_inode_in_dir(f, &sb, parent_id, new_name) != -1) {
-        printf("EXIST\n");
-        fclose(f);
-        return 0;
-    }
-
-    const int free_inode = find_free_bit(f, &sb, true);
-    const int free_block = find_free_bit(f, &sb, false);
-    if (free_inode == -1 || free_block == -1) {
-        printf("NO SPACE\n");
+        fs_printf("EXIST\n");
         fclose(f);
         return 0;
     }
 
-    set_bit(f, &sb, true, free_inode, true);
-    set_bit(f, &sb, false, free_block, true);
-
-    struct pseudo_inode new_inode = {0};
-    new_inode.nodeid = free_inode;
-    new_inode.isDirectory = true;
-    new_inode.references = 1;
-    new_inode.file_size = sb.cluster_size;
-    new_inode.direct1 = free_block;
-    new_inode.direct2 = CLUSTER_UNUSED;
-    new_inode.direct3 = CLUSTER_UNUSED;
-    new_inode.direct4 = CLUSTER_UNUSED;
-    new_inode.direct5 = CLUSTER_UNUSED;
-    new_inode.indirect1 = CLUSTER_UNUSED;
-    new_inode.indirect2 = CLUSTER_UNUSED;
-
-    write_inode(f, &sb, free_inode, &new_inode);
-
-    /* Inicializace dat adresáře: vyplň cluster nulami a vlož "." + "..". */
-    const long data_addr = sb.data_start_address + (long)free_block * sb.cluster_size;
-    if (fseek(f, data_addr, SEEK_SET) != 0) {
+    const int free_inode = new_directory_inode(f, &sb, parent_id);
+    if (free_inode == -1) {
+        fs_printf("NO SPACE\n");
         fclose(f);
         return 0;
     }
 
-    uint8_t *zeros = (uint8_t *)calloc(1, sb.cluster_size);
-    if (!zeros) {
-        fclose(f);
-        return 0;
-    }
-    fwrite(zeros, 1, sb.cluster_size, f);
-    free(zeros);
-
-    struct directory_item dot = {.inode = free_inode};
-    strcpy(dot.item_name, ".");
-    struct directory_item dotdot = {.inode = parent_id};
-    strcpy(dotdot.item_name, "..");
-
-    fseek(f, data_addr, SEEK_SET);
-    fwrite(&dot, sizeof(dot), 1, f);
-    fwrite(&dotdot, sizeof(dotdot), 1, f);
-
     /* Přidej položku do rodičovského adresáře. */
-    struct directory_item new_entry = {.inode = free_inode};
+    struct directory_item new_entry = {.inode = free_inode, .type = DIR_TYPE_DIR};
     copy_item_name(new_entry.item_name, sizeof(new_entry.item_name), new_name);
     add_directory_item(f, &sb, parent_id, &new_entry);
 
@@ -292,14 +304,14 @@ int fs_rmdir(const char *filename, const char *path)
 
     const int parent_id = fs_path_to_inode(filename, parent_path);
     if (parent_id == -1) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         fclose(f);
         return 0;
     }
 
     const int inode_id = find_inode_in_dir(f, &sb, parent_id, name);
     if (inode_id == -1) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         fclose(f);
         return 0;
     }
@@ -308,13 +320,13 @@ int fs_rmdir(const char *filename, const char *path)
     read_inode(f, &sb, inode_id, &inode);
 
     if (!inode.isDirectory) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         fclose(f);
         return 0;
     }
 
     if (!is_dir_empty(f, &sb, inode_id)) {
-        printf("NOT EMPTY\n");
+        fs_printf("NOT EMPTY\n");
         fclose(f);
         return 0;
     }
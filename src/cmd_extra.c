@@ -6,6 +6,7 @@
 
 #include "../include/fs_core.h"
 #include "../include/fs_utils.h"
+#include "../include/fs_out.h"
 
 /**
  * @file cmd_extra.c
@@ -24,136 +25,254 @@ enum { FS_MAX_FILE_CLUSTERS = 5 };
 #define SAFE_FREE(p) do { free((p)); (p) = NULL; } while (0)
 
 /**
- * @brief Spojí obsah dvou souborů a uloží výsledek do nového cílového souboru.
+ * @brief Přidá do cílového souboru nový cluster s obsahem buf (celý cluster_size).
+ *
+ * Nulový cluster se nealokuje – do souboru se zapíše jako díra.
+ *
+ * @return 1 při úspěchu, 0 pokud došlo místo.
+ */
+static int append_new_cluster(FILE *f, struct superblock *sb, const uint8_t *buf,
+                              int32_t blocks[FS_MAX_FILE_CLUSTERS], int *block_count)
+{
+    if (*block_count >= FS_MAX_FILE_CLUSTERS) {
+        return 0;
+    }
+
+    if (buffer_is_zero(buf, (size_t)sb->cluster_size)) {
+        blocks[(*block_count)++] = CLUSTER_HOLE;
+        return 1;
+    }
+
+    const int32_t cluster = store_data_cluster(f, sb, buf);
+    if (cluster == -1) {
+        return 0;
+    }
+
+    blocks[(*block_count)++] = cluster;
+    return 1;
+}
+
+/**
+ * @brief Spojí obsah N souborů a uloží výsledek do nového cílového souboru.
+ *
+ * Zdroje se streamují přes jeden cluster velký buffer, nic se nenačítá celé do RAM.
+ * Pokud začátek zdroje padne na hranici clusteru cíle, jeho plné clustery se
+ * nekopírují, ale sdílí (copy-on-write přes tabulku sdílení). Poslední zdroj
+ * může sdílet i svůj neúplný konec (vlastní cluster i konec ve fragmentu).
+ * Fyzicky se tak zapisují jen bajty, které na hranici clusteru nesedí.
  *
  * Chování (včetně hlášek) odpovídá původní implementaci:
- * - s1 a s2 musí existovat a být soubory (ne adresáře)
+ * - všechny zdroje musí existovat a být soubory (ne adresáře)
  * - výsledný soubor nesmí překročit @ref FS_MAX_FILE_CLUSTERS * CLUSTER_SIZE
- * - cílová cesta s3 musí mít existující rodičovský adresář
+ * - cílová cesta musí mít existující rodičovský adresář
  * - cílový soubor nesmí existovat
  *
- * @param filename  Cesta k image souboru pseudo FS.
- * @param s1        První zdrojový soubor.
- * @param s2        Druhý zdrojový soubor.
- * @param s3        Cílová cesta (nový soubor).
+ * @param filename      Cesta k image souboru pseudo FS.
+ * @param sources       Zdrojové soubory (v pořadí spojení).
+ * @param source_count  Počet zdrojů (alespoň 1).
+ * @param dest          Cílová cesta (nový soubor).
  * @return 1 při úspěchu, jinak 0.
  */
-int fs_xcp(const char *filename, const char *s1, const char *s2, const char *s3)
+int fs_xcp(const char *filename, const char *const *sources, int source_count, const char *dest)
 {
     int ok = 0;
     FILE *f = NULL;
-    uint8_t *big_buffer = NULL;
+    uint8_t *src_buf = NULL;
+    uint8_t *out_buf = NULL;
+    int free_inode = -1;
+
+    int32_t blocks[FS_MAX_FILE_CLUSTERS] = {
+        CLUSTER_UNUSED, CLUSTER_UNUSED, CLUSTER_UNUSED, CLUSTER_UNUSED, CLUSTER_UNUSED
+    };
+    int block_count = 0;
+
+    /* Cílový inode; INODE_FLAG_TAIL v něm znamená odkaz na fragment (i pro rollback). */
+    struct pseudo_inode inode = (struct pseudo_inode){0};
+    inode.indirect1 = CLUSTER_UNUSED;
+    inode.indirect2 = CLUSTER_UNUSED;
 
     struct superblock sb;
 
+    if (!sources || source_count <= 0) {
+        fs_printf("FILE NOT FOUND (Source)\n");
+        return 0;
+    }
+
     f = fopen(filename, "rb+");
     if (!f) {
         return 0;
     }
     load_superblock(f, &sb);
 
-    /* 1) Získání inodů zdrojů */
-    const int id1 = fs_path_to_inode(filename, s1);
-    const int id2 = fs_path_to_inode(filename, s2);
-
-    if (id1 == -1 || id2 == -1) {
-        printf("FILE NOT FOUND (Source)\n");
+    /* 1) Získání inodů zdrojů + ověření, že jde o soubory */
+    struct pseudo_inode *src = (struct pseudo_inode *)calloc((size_t)source_count, sizeof(*src));
+    if (!src) {
         goto cleanup;
     }
 
-    /* 2) Ověření, že jde o soubory */
-    struct pseudo_inode i1, i2;
-    read_inode(f, &sb, id1, &i1);
-    read_inode(f, &sb, id2, &i2);
-
-    if (i1.isDirectory || i2.isDirectory) {
-        printf("SOURCE IS DIRECTORY\n");
-        goto cleanup;
+    long total_size = 0;
+    for (int i = 0; i < source_count; i++) {
+        const int id = fs_path_to_inode(filename, sources[i]);
+        if (id == -1) {
+            fs_printf("FILE NOT FOUND (Source)\n");
+            goto cleanup;
+        }
+        read_inode(f, &sb, id, &src[i]);
+        total_size += src[i].file_size;
     }
 
-    /* 3) Kontrola velikosti výsledku */
-    const int total_size = i1.file_size + i2.file_size;
-    if (total_size > FS_MAX_FILE_CLUSTERS * CLUSTER_SIZE) {
-        printf("RESULT TOO BIG\n");
-        goto cleanup;
+    for (int i = 0; i < source_count; i++) {
+        if (src[i].isDirectory) {
+            fs_printf("SOURCE IS DIRECTORY\n");
+            goto cleanup;
+        }
     }
 
-    /* 4) Načtení obou souborů do RAM (max 5 clusterů) */
-    big_buffer = (uint8_t *)calloc(1, (size_t)FS_MAX_FILE_CLUSTERS * CLUSTER_SIZE);
-    if (!big_buffer) {
-        /* V zadání se tato situace netestuje; zvolíme tichý fail. */
+    /* 2) Kontrola velikosti výsledku */
+    if (total_size > FS_MAX_FILE_CLUSTERS * CLUSTER_SIZE) {
+        fs_printf("RESULT TOO BIG\n");
         goto cleanup;
     }
-    load_file_content(f, &sb, id1, big_buffer);
-    load_file_content(f, &sb, id2, big_buffer + i1.file_size);
 
-    /* 5) Rozparsování cílové cesty s3 na (parent_path, new_name) */
+    /* 3) Cílová cesta -> (parent_path, new_name) */
     char parent_path[256] = "";
     char new_name[128] = "";
-
-    char *path_copy = strdup(s3);
-    if (!path_copy) {
-        goto cleanup;
-    }
-
-    char *last_slash = strrchr(path_copy, '/');
-
-    if (last_slash == NULL) {
-        /* "soubor" -> parent je root */
-        strcpy(parent_path, "/");
-        strncpy(new_name, s3, 11);
-        new_name[11] = '\0';
-    } else if (last_slash == path_copy) {
-        /* "/soubor" -> parent root */
-        strcpy(parent_path, "/");
-        strncpy(new_name, last_slash + 1, 11);
-        new_name[11] = '\0';
-    } else {
-        /* "/a/b/soubor" -> parent "/a/b" */
-        *last_slash = '\0';
-        strncpy(parent_path, path_copy, sizeof(parent_path) - 1);
-        parent_path[sizeof(parent_path) - 1] = '\0';
-
-        strncpy(new_name, last_slash + 1, 11);
-        new_name[11] = '\0';
-    }
-
-    free(path_copy);
-    path_copy = NULL;
+    parse_path(dest, parent_path, new_name);
 
     const int parent_id = fs_path_to_inode(filename, parent_path);
     if (parent_id == -1) {
-        printf("PATH NOT FOUND (Target)\n");
+        fs_printf("PATH NOT FOUND (Target)\n");
         goto cleanup;
     }
     if (find_inode_in_dir(f, &sb, parent_id, new_name) != -1) {
-        printf("EXIST\n");
+        fs_printf("EXIST\n");
         goto cleanup;
     }
 
-    const int free_inode = find_free_bit(f, &sb, true);
+    free_inode = alloc_bit(f, &sb, true); /* rezervace inodu */
     if (free_inode == -1) {
-        printf("NO SPACE (Inodes)\n");
+        fs_printf("NO SPACE (Inodes)\n");
         goto cleanup;
     }
-    set_bit(f, &sb, true, free_inode, true); /* rezervace inodu */
 
-    /* 6) Zápis spojených dat do nového inodu */
-    if (!write_buffer_to_new_inode(f, &sb, free_inode, big_buffer, total_size)) {
-        printf("NO SPACE (Blocks)\n");
-        /* Rollback inodu by byl ideální, ale pro SP není vyžadován. */
+    /* 4) Streamování zdrojů do cíle */
+    src_buf = (uint8_t *)malloc((size_t)sb.cluster_size);
+    out_buf = (uint8_t *)calloc(1, (size_t)sb.cluster_size);
+    if (!src_buf || !out_buf) {
         goto cleanup;
     }
 
-    /* 7) Přidání položky do cílového adresáře */
-    struct directory_item new_entry = { .inode = free_inode };
+    int fill = 0; /* kolik bajtů čeká v out_buf na zápis */
+
+    for (int i = 0; i < source_count; i++) {
+        int32_t src_blocks[FS_MAX_FILE_CLUSTERS];
+        inode_get_direct(&src[i], src_blocks);
+
+        const int full = src[i].file_size / sb.cluster_size;
+        const int tail = src[i].file_size % sb.cluster_size;
+        int c = 0;
+
+        if (fill == 0 && !(src[i].flags & (INODE_FLAG_INLINE | INODE_FLAG_COMPRESSED))) {
+            /* Zarovnaný začátek: plné clustery jen sdílíme (inline zdroj nemá co sdílet).
+               Cluster s plným čítačem sdílení se i se zbytkem zdroje zkopíruje níže. */
+            for (; c < full; c++) {
+                if (src_blocks[c] != CLUSTER_HOLE && !cluster_ref(f, &sb, src_blocks[c])) {
+                    break;
+                }
+                blocks[block_count++] = src_blocks[c];
+            }
+
+            /* Konec posledního zdroje je i koncem cíle – sdílíme ho také. */
+            if (c == full && i == source_count - 1 && tail > 0) {
+                if (src[i].flags & INODE_FLAG_TAIL) {
+                    if (cluster_ref(f, &sb, src[i].indirect1)) {
+                        inode.flags |= INODE_FLAG_TAIL;
+                        inode.indirect1 = src[i].indirect1;
+                        inode.indirect2 = src[i].indirect2;
+                        c++;
+                    }
+                } else if (src_blocks[c] == CLUSTER_HOLE || cluster_ref(f, &sb, src_blocks[c])) {
+                    blocks[block_count++] = src_blocks[c];
+                    c++;
+                }
+            }
+        }
+
+        long copied_total = (long)c * sb.cluster_size;
+        for (;; c++) {
+            const int n = read_file_cluster(f, &sb, &src[i], c, src_buf);
+            if (n <= 0) {
+                break;
+            }
+            copied_total += n;
+
+            int copied = 0;
+            while (copied < n) {
+                const int room = sb.cluster_size - fill;
+                const int chunk = (n - copied < room) ? n - copied : room;
+                memcpy(out_buf + fill, src_buf + copied, (size_t)chunk);
+                fill += chunk;
+                copied += chunk;
+
+                if (fill == sb.cluster_size) {
+                    if (!append_new_cluster(f, &sb, out_buf, blocks, &block_count)) {
+                        fs_printf("NO SPACE (Blocks)\n");
+                        goto cleanup;
+                    }
+                    memset(out_buf, 0, (size_t)sb.cluster_size);
+                    fill = 0;
+                }
+            }
+        }
+
+        /* Nečitelný cluster (CHECKSUM ERROR) – výsledek by byl neúplný. */
+        if (copied_total < src[i].file_size) {
+            goto cleanup;
+        }
+    }
+
+    /* 5) Nový inode – malý výsledek zůstane celý v inodu (inline),
+          neúplný konec jde do sdíleného fragmentu nebo vlastního clusteru */
+    inode.nodeid = free_inode;
+    inode.file_size = (int32_t)total_size;
+    inode.references = 1;
+    inode.isDirectory = false;
+
+    if (block_count == 0 && total_size > 0 && total_size <= INODE_INLINE_MAX) {
+        inode.flags = INODE_FLAG_INLINE;
+        memcpy(inode.inline_data, out_buf, (size_t)total_size);
+    } else {
+        if (fill > 0 && !write_file_tail(f, &sb, &inode, blocks, &block_count, out_buf, fill)) {
+            fs_printf("NO SPACE (Blocks)\n");
+            goto cleanup;
+        }
+        inode_set_direct(&inode, blocks);
+    }
+    write_inode(f, &sb, free_inode, &inode);
+
+    /* 6) Položka v cílovém adresáři */
+    struct directory_item new_entry = { .inode = free_inode, .type = DIR_TYPE_FILE };
     strcpy(new_entry.item_name, new_name);
     add_directory_item(f, &sb, parent_id, &new_entry);
 
     ok = 1;
 
 cleanup:
-    SAFE_FREE(big_buffer);
+    if (!ok && free_inode != -1) {
+        /* Rollback: sdílené clustery ztratí odkaz, nové se uvolní, díry nic nedrží. */
+        for (int i = 0; i < block_count; i++) {
+            if (blocks[i] != CLUSTER_HOLE) {
+                cluster_unref(f, &sb, blocks[i]);
+            }
+        }
+        if (inode.flags & INODE_FLAG_TAIL) {
+            cluster_unref(f, &sb, inode.indirect1);
+        }
+        set_bit(f, &sb, true, free_inode, false);
+    }
+    SAFE_FREE(src);
+    SAFE_FREE(src_buf);
+    SAFE_FREE(out_buf);
     if (f) {
         fclose(f);
         f = NULL;
@@ -196,7 +315,7 @@ int fs_add(const char *filename, const char *s1, const char *s2)
     const int id2 = fs_path_to_inode(filename, s2);
 
     if (id1 == -1 || id2 == -1) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         goto cleanup;
     }
 
@@ -205,13 +324,13 @@ int fs_add(const char *filename, const char *s1, const char *s2)
     read_inode(f, &sb, id2, &i2);
 
     if (i1.isDirectory || i2.isDirectory) {
-        printf("IS DIRECTORY\n");
+        fs_printf("IS DIRECTORY\n");
         goto cleanup;
     }
 
     const int new_total_size = i1.file_size + i2.file_size;
     if (new_total_size > FS_MAX_FILE_CLUSTERS * CLUSTER_SIZE) {
-        printf("TOO BIG\n");
+        fs_printf("TOO BIG\n");
         goto cleanup;
     }
 
@@ -221,26 +340,25 @@ int fs_add(const char *filename, const char *s1, const char *s2)
         goto cleanup;
     }
 
-    load_file_content(f, &sb, id1, big_buffer);
-    load_file_content(f, &sb, id2, big_buffer + i1.file_size);
+    /* Nečitelný cluster (CHECKSUM ERROR) – s1 raději necháme beze změny. */
+    if (load_file_content(f, &sb, id1, big_buffer) < i1.file_size ||
+        load_file_content(f, &sb, id2, big_buffer + i1.file_size) < i2.file_size) {
+        goto cleanup;
+    }
 
     /*
      * 3) Uvolnění původních bloků s1 a zápis nového obsahu.
      *
-     * Pozn.: CLUSTER_UNUSED znamená „není alokováno“. Uvolňujeme pouze platné clustery.
+     * Pozn.: Clustery sdílené s jiným souborem (xcp, fragmenty konců) tím jen ztratí
+     * odkaz a zůstanou nedotčené.
      */
-    const int32_t old_blocks[FS_MAX_FILE_CLUSTERS] = {
-        i1.direct1, i1.direct2, i1.direct3, i1.direct4, i1.direct5
-    };
-
-    for (int i = 0; i < FS_MAX_FILE_CLUSTERS; i++) {
-        if (old_blocks[i] != CLUSTER_UNUSED) {
-            set_bit(f, &sb, false, old_blocks[i], false);
-        }
-    }
+    free_file_clusters(f, &sb, &i1);
 
-    if (!write_buffer_to_new_inode(f, &sb, id1, big_buffer, new_total_size)) {
-        printf("NO SPACE (Blocks)\n");
+    /* Nové rozložení se volí podle nové velikosti – inline soubor, který přeroste
+       INODE_INLINE_MAX, se tím povýší na clustery. */
+    if (!write_buffer_to_new_inode(f, &sb, id1, big_buffer, new_total_size,
+                                   (i1.flags & INODE_FLAG_COMPRESSED) != 0)) {
+        fs_printf("NO SPACE (Blocks)\n");
         goto cleanup;
     }
 
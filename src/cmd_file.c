@@ -17,9 +17,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <sys/types.h>
 
 #include "../include/fs_core.h"
 #include "../include/fs_utils.h"
+#include "../include/fs_prefetch.h"
+#include "../include/fs_out.h"
 
 /* ========================================================================== */
 /* Interní helpery                                                            */
@@ -40,23 +44,6 @@ static bool load_sb_or_fail(FILE *f, struct superblock *sb)
     return f && sb && load_superblock(f, sb);
 }
 
-
-/**
- * @brief Uvolní alokované datové clustery (best-effort).
- */
-static void rollback_data_clusters(FILE *f, struct superblock *sb, const int32_t blocks[5])
-{
-    if (!f || !sb || !blocks) {
-        return;
-    }
-
-    for (int i = 0; i < 5; i++) {
-        if (blocks[i] != CLUSTER_UNUSED) {
-            set_bit(f, sb, false, blocks[i], false);
-        }
-    }
-}
-
 /* ========================================================================== */
 /* INCP / OUTCP                                                               */
 /* ========================================================================== */
@@ -67,47 +54,41 @@ static void rollback_data_clusters(FILE *f, struct superblock *sb, const int32_t
  * @param filename  Cesta k souboru s obrazem VFS.
  * @param host_path Cesta k souboru na hostiteli.
  * @param vfs_path  Cílová cesta ve VFS.
+ * @param compress  Uložit soubor komprimovaně (incp -z).
  * @return 1 při úspěchu, 0 při chybě.
  */
-int fs_incp(const char *filename, const char *host_path, const char *vfs_path)
+int fs_incp(const char *filename, const char *host_path, const char *vfs_path, bool compress)
 {
-    FILE *host_f = fopen(host_path, "rb");
-    if (!host_f) {
-        printf("FILE NOT FOUND (host)\n");
-        return 0;
-    }
-
-    /* zjištění velikosti */
-    if (fseek(host_f, 0, SEEK_END) != 0) {
-        fclose(host_f);
-        return 0;
-    }
-    const long file_size = ftell(host_f);
-    if (file_size < 0) {
-        fclose(host_f);
-        return 0;
-    }
-    (void)fseek(host_f, 0, SEEK_SET);
-
-    FILE *f = open_fs_rw(filename);
-    if (!f) {
-        fclose(host_f);
-        return 0;
+    int ok = 0;
+    FILE *f = NULL;
+    struct prefetched_file pre = {0};
+
+    /* load --prefetch mohl obsah načíst (a zkomprimovat) předem, jinak zjistíme jen velikost */
+    const bool prefetched = prefetch_take(host_path, &pre);
+    uint8_t *buffer = pre.data;
+    long file_size = pre.size;
+    FILE *host_f = prefetched ? NULL : fopen(host_path, "rb");
+    if (!prefetched) {
+        if (!host_f) {
+            fs_printf("FILE NOT FOUND (host)\n");
+            return 0;
+        }
+        if (fseek(host_f, 0, SEEK_END) != 0 || (file_size = ftell(host_f)) < 0) {
+            goto cleanup;
+        }
+        (void)fseek(host_f, 0, SEEK_SET);
     }
 
+    f = open_fs_rw(filename);
     struct superblock sb;
     if (!load_sb_or_fail(f, &sb)) {
-        fclose(host_f);
-        fclose(f);
-        return 0;
+        goto cleanup;
     }
 
     /* omezení: max 5 přímých clusterů */
     if (file_size > (long)5 * (long)sb.cluster_size) {
-        printf("TOO BIG\n");
-        fclose(host_f);
-        fclose(f);
-        return 0;
+        fs_printf("TOO BIG\n");
+        goto cleanup;
     }
 
     /* rozpad cesty na rodiče a jméno položky */
@@ -117,97 +98,105 @@ int fs_incp(const char *filename, const char *host_path, const char *vfs_path)
 
     const int parent_id = fs_path_to_inode(filename, parent_path);
     if (parent_id == -1) {
-        printf("PATH NOT FOUND\n");
-        fclose(host_f);
-        fclose(f);
-        return 0;
+        fs_printf("PATH NOT FOUND\n");
+        goto cleanup;
     }
 
     if (find_inode_in_dir(f, &sb, parent_id, new_name) != -1) {
-        printf("EXIST\n");
-        fclose(host_f);
-        fclose(f);
-        return 0;
+        fs_printf("EXIST\n");
+        goto cleanup;
     }
 
-    const int free_inode = find_free_bit(f, &sb, true);
+    const int free_inode = alloc_bit(f, &sb, true);
     if (free_inode == -1) {
-        printf("NO SPACE\n");
-        fclose(host_f);
-        fclose(f);
-        return 0;
+        fs_printf("NO SPACE\n");
+        goto cleanup;
     }
-    set_bit(f, &sb, true, free_inode, true);
 
-    int32_t blocks[5] = { CLUSTER_UNUSED, CLUSTER_UNUSED, CLUSTER_UNUSED, CLUSTER_UNUSED, CLUSTER_UNUSED };
+    /* obsah (max 5 clusterů) načteme celý, rozložení na disku (inline/clustery)
+       řeší write_buffer_to_new_inode() */
+    if (!buffer) {
+        buffer = (uint8_t *)malloc(file_size > 0 ? (size_t)file_size : 1u);
+        if (!buffer) {
+            /* rollback inode bitmap */
+            set_bit(f, &sb, true, free_inode, false);
+            goto cleanup;
+        }
+        (void)fread(buffer, 1, (size_t)file_size, host_f);
+    }
 
-    /* zapisujeme clustery po sb.cluster_size */
-    uint8_t *cluster_buf = (uint8_t *)malloc((size_t)sb.cluster_size);
-    if (!cluster_buf) {
-        /* rollback inode bitmap */
+    if (!write_prepared_to_new_inode(f, &sb, free_inode, buffer, (int)file_size, compress, pre.payload, pre.payload_len)) {
+        fs_printf("NO SPACE\n");
         set_bit(f, &sb, true, free_inode, false);
-        fclose(host_f);
-        fclose(f);
-        return 0;
+        goto cleanup;
     }
 
-    long bytes_remaining = file_size;
-    int b_idx = 0;
-
-    while (bytes_remaining > 0 && b_idx < 5) {
-        const int free_block = find_free_bit(f, &sb, false);
-        if (free_block == -1) {
-            printf("NO SPACE\n");
-            rollback_data_clusters(f, &sb, blocks);
-            set_bit(f, &sb, true, free_inode, false);
-            free(cluster_buf);
-            fclose(host_f);
-            fclose(f);
-            return 0;
-        }
-
-        set_bit(f, &sb, false, free_block, true);
-        blocks[b_idx++] = free_block;
+    struct directory_item new_entry = {0};
+    new_entry.inode = free_inode;
+    new_entry.type = DIR_TYPE_FILE;
+    strcpy(new_entry.item_name, new_name);
+    (void)add_directory_item(f, &sb, parent_id, &new_entry);
+    ok = 1;
 
-        memset(cluster_buf, 0, (size_t)sb.cluster_size);
+cleanup:
+    free(buffer);
+    free(pre.payload);
+    if (host_f) {
+        fclose(host_f);
+    }
+    if (f) {
+        fclose(f);
+    }
+    return ok;
+}
 
-        const size_t to_read = (bytes_remaining > sb.cluster_size)
-                             ? (size_t)sb.cluster_size
-                             : (size_t)bytes_remaining;
+/**
+ * @brief Zapíše obsah inodu do souboru na hostiteli (díry jako řídký soubor).
+ * @return 1 úspěch, 0 nečitelný cluster (soubor se smaže), -1 soubor nejde vytvořit.
+ */
+int export_inode(FILE *f, struct superblock *sb, const struct pseudo_inode *inode, const char *host_path)
+{
+    FILE *out = fopen(host_path, "wb");
+    if (!out) {
+        return -1;
+    }
 
-        (void)fread(cluster_buf, 1, to_read, host_f);
+    uint8_t *cluster_buf = (uint8_t *)malloc((size_t)sb->cluster_size);
+    if (!cluster_buf) {
+        fclose(out);
+        (void)remove(host_path);
+        return 0;
+    }
 
-        /* přímý zápis do clusteru (stejně jako původní implementace) */
-        (void)fseek(f, sb.data_start_address + (long)free_block * (long)sb.cluster_size, SEEK_SET);
-        (void)fwrite(cluster_buf, 1, (size_t)sb.cluster_size, f);
+    /* Po clusterech; díry se nezapisují, jen se přes ně přeskočí, takže na hostiteli
+       vznikne řídký soubor (viditelný přes lseek(SEEK_HOLE)). */
+    long exported = 0;
+    for (int i = 0;; i++) {
+        const int n = read_file_cluster(f, sb, inode, i, cluster_buf);
+        if (n <= 0) {
+            break;
+        }
 
-        bytes_remaining -= (long)to_read;
+        if (file_cluster_is_hole(inode, i)) {
+            (void)fseek(out, n, SEEK_CUR);
+        } else {
+            (void)fwrite(cluster_buf, 1, (size_t)n, out);
+        }
+        exported += n;
     }
-
     free(cluster_buf);
 
-    struct pseudo_inode new_inode = (struct pseudo_inode){0};
-    new_inode.nodeid = free_inode;
-    new_inode.file_size = (int)file_size;
-    new_inode.references = 1;
-    new_inode.isDirectory = false;
-    new_inode.direct1 = blocks[0];
-    new_inode.direct2 = blocks[1];
-    new_inode.direct3 = blocks[2];
-    new_inode.direct4 = blocks[3];
-    new_inode.direct5 = blocks[4];
-    new_inode.indirect1 = CLUSTER_UNUSED;
-    new_inode.indirect2 = CLUSTER_UNUSED;
-
-    write_inode(f, &sb, free_inode, &new_inode);
-
-    struct directory_item new_entry = {0};
-    new_entry.inode = free_inode;
-    strcpy(new_entry.item_name, new_name);
-    (void)add_directory_item(f, &sb, parent_id, &new_entry);
+    /* Nečitelný cluster (CHECKSUM ERROR) – neúplnou kopii nenecháme na hostiteli. */
+    if (exported < inode->file_size) {
+        fclose(out);
+        (void)remove(host_path);
+        return 0;
+    }
 
-    fclose(host_f);
-    fclose(f);
+    /* Díra na konci souboru se musí dotáhnout na správnou délku. */
+    (void)fflush(out);
+    (void)ftruncate(fileno(out), (off_t)inode->file_size);
+    fclose(out);
     return 1;
 }
 
@@ -220,20 +209,20 @@ int fs_outcp(const char *filename, const char *vfs_path, const char *host_path)
 {
     FILE *f = open_fs_ro(filename);
     if (!f) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         return 0;
     }
 
     struct superblock sb;
     if (!load_sb_or_fail(f, &sb)) {
         fclose(f);
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         return 0;
     }
 
     const int inode_id = fs_path_to_inode(filename, vfs_path);
     if (inode_id == -1) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         fclose(f);
         return 0;
     }
@@ -241,31 +230,17 @@ int fs_outcp(const char *filename, const char *vfs_path, const char *host_path)
     struct pseudo_inode inode;
     read_inode(f, &sb, inode_id, &inode);
     if (inode.isDirectory) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         fclose(f);
         return 0;
     }
 
-    uint8_t *buffer = (uint8_t *)malloc((size_t)inode.file_size);
-    if (!buffer) {
-        fclose(f);
-        return 0;
+    const int exported = export_inode(f, &sb, &inode, host_path);
+    if (exported < 0) {
+        fs_printf("CANNOT CREATE FILE\n");
     }
-
-    (void)load_file_content(f, &sb, inode_id, buffer);
     fclose(f);
-
-    FILE *out = fopen(host_path, "wb");
-    if (!out) {
-        printf("CANNOT CREATE FILE\n");
-        free(buffer);
-        return 0;
-    }
-
-    (void)fwrite(buffer, 1, (size_t)inode.file_size, out);
-    fclose(out);
-    free(buffer);
-    return 1;
+    return exported > 0;
 }
 
 /* ========================================================================== */
@@ -284,7 +259,7 @@ int fs_cat(const char *filename, const char *path)
 
     const int inode_id = fs_path_to_inode(filename, path);
     if (inode_id == -1) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         fclose(f);
         return 0;
     }
@@ -293,11 +268,21 @@ int fs_cat(const char *filename, const char *path)
     read_inode(f, &sb, inode_id, &inode);
 
     if (inode.isDirectory) {
-        printf("FILE NOT FOUND (It is a directory)\n");
+        fs_printf("FILE NOT FOUND (It is a directory)\n");
         fclose(f);
         return 0;
     }
 
+    /* Inline soubor: obsah je už v načteném inodu, žádné další čtení. */
+    if (inode.flags & INODE_FLAG_INLINE) {
+        char text[INODE_INLINE_MAX + 1];
+        memcpy(text, inode.inline_data, (size_t)inode.file_size);
+        text[inode.file_size] = '\0';
+        fs_printf("%s\n", text);
+        fclose(f);
+        return 1;
+    }
+
     /* Načteme obsah (+1 pro nulový znak kvůli printf). */
     uint8_t *buffer = (uint8_t *)malloc((size_t)inode.file_size + 1);
     if (!buffer) {
@@ -305,10 +290,15 @@ int fs_cat(const char *filename, const char *path)
         return 0;
     }
 
-    (void)load_file_content(f, &sb, inode_id, buffer);
+    if (load_file_content(f, &sb, inode_id, buffer) < inode.file_size) {
+        /* poškozený cluster – hlášku už vypsalo ověření součtu */
+        free(buffer);
+        fclose(f);
+        return 0;
+    }
     buffer[inode.file_size] = '\0';
 
-    printf("%s\n", (char *)buffer);
+    fs_printf("%s\n", (char *)buffer);
 
     free(buffer);
     fclose(f);
@@ -332,14 +322,14 @@ int fs_rm(const char *filename, const char *path)
 
     const int parent_id = fs_path_to_inode(filename, parent_path);
     if (parent_id == -1) {
-        printf("FILE NOT FOUND (Parent not found)\n");
+        fs_printf("FILE NOT FOUND (Parent not found)\n");
         fclose(f);
         return 0;
     }
 
     const int inode_id = find_inode_in_dir(f, &sb, parent_id, name);
     if (inode_id == -1) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         fclose(f);
         return 0;
     }
@@ -349,7 +339,7 @@ int fs_rm(const char *filename, const char *path)
 
     if (inode.isDirectory) {
         /* rm nesmí mazat adresáře (jen rmdir) */
-        printf("FILE NOT FOUND (It is a directory)\n");
+        fs_printf("FILE NOT FOUND (It is a directory)\n");
         fclose(f);
         return 0;
     }
@@ -374,7 +364,7 @@ int fs_cp(const char *filename, const char *s1, const char *s2)
     /* 1) zdroj */
     const int src_id = fs_path_to_inode(filename, s1);
     if (src_id == -1) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         fclose(f);
         return 0;
     }
@@ -382,7 +372,7 @@ int fs_cp(const char *filename, const char *s1, const char *s2)
     struct pseudo_inode src_inode;
     read_inode(f, &sb, src_id, &src_inode);
     if (src_inode.isDirectory) {
-        printf("FILE NOT FOUND (Source is dir)\n");
+        fs_printf("FILE NOT FOUND (Source is dir)\n");
         fclose(f);
         return 0;
     }
@@ -394,13 +384,13 @@ int fs_cp(const char *filename, const char *s1, const char *s2)
 
     const int dest_parent_id = fs_path_to_inode(filename, parent_path);
     if (dest_parent_id == -1) {
-        printf("PATH NOT FOUND\n");
+        fs_printf("PATH NOT FOUND\n");
         fclose(f);
         return 0;
     }
 
     if (find_inode_in_dir(f, &sb, dest_parent_id, name) != -1) {
-        printf("EXIST\n");
+        fs_printf("EXIST\n");
         fclose(f);
         return 0;
     }
@@ -411,21 +401,25 @@ int fs_cp(const char *filename, const char *s1, const char *s2)
         fclose(f);
         return 0;
     }
-    (void)load_file_content(f, &sb, src_id, buffer);
+    if (load_file_content(f, &sb, src_id, buffer) < src_inode.file_size) {
+        free(buffer);
+        fclose(f);
+        return 0;
+    }
 
     /* 4) nový inode */
-    const int free_inode = find_free_bit(f, &sb, true);
+    const int free_inode = alloc_bit(f, &sb, true);
     if (free_inode == -1) {
-        printf("NO SPACE\n");
+        fs_printf("NO SPACE\n");
         free(buffer);
         fclose(f);
         return 0;
     }
-    set_bit(f, &sb, true, free_inode, true);
 
-    /* 5) zápis obsahu do nového inodu */
-    if (!write_buffer_to_new_inode(f, &sb, free_inode, buffer, src_inode.file_size)) {
-        printf("NO SPACE\n");
+    /* 5) zápis obsahu do nového inodu (kopie zůstává komprimovaná jako zdroj) */
+    if (!write_buffer_to_new_inode(f, &sb, free_inode, buffer, src_inode.file_size,
+                                   (src_inode.flags & INODE_FLAG_COMPRESSED) != 0)) {
+        fs_printf("NO SPACE\n");
         set_bit(f, &sb, true, free_inode, false); /* rollback inode bitmap */
         free(buffer);
         fclose(f);
@@ -435,6 +429,7 @@ int fs_cp(const char *filename, const char *s1, const char *s2)
     /* 6) vložení do adresáře */
     struct directory_item item = {0};
     item.inode = free_inode;
+    item.type = DIR_TYPE_FILE;
     strcpy(item.item_name, name);
     (void)add_directory_item(f, &sb, dest_parent_id, &item);
 
@@ -464,7 +459,7 @@ int fs_mv(const char *filename, const char *s1, const char *s2)
                            : find_inode_in_dir(f, &sb, src_parent_id, src_name);
 
     if (src_inode_id == -1) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         fclose(f);
         return 0;
     }
@@ -476,13 +471,13 @@ int fs_mv(const char *filename, const char *s1, const char *s2)
 
     const int dest_parent_id = fs_path_to_inode(filename, dest_parent_path);
     if (dest_parent_id == -1) {
-        printf("PATH NOT FOUND\n");
+        fs_printf("PATH NOT FOUND\n");
         fclose(f);
         return 0;
     }
 
     if (find_inode_in_dir(f, &sb, dest_parent_id, dest_name) != -1) {
-        printf("EXIST (Target file exists)\n");
+        fs_printf("EXIST (Target file exists)\n");
         fclose(f);
         return 0;
     }
@@ -491,12 +486,15 @@ int fs_mv(const char *filename, const char *s1, const char *s2)
     (void)remove_directory_item(f, &sb, src_parent_id, src_name);
 
     /* 2) přidat do cíle (stejný inode) */
+    struct pseudo_inode src_inode;
+    read_inode(f, &sb, src_inode_id, &src_inode);
     struct directory_item item = {0};
     item.inode = src_inode_id;
+    item.type = src_inode.isDirectory ? DIR_TYPE_DIR : DIR_TYPE_FILE;
     strcpy(item.item_name, dest_name);
 
     if (!add_directory_item(f, &sb, dest_parent_id, &item)) {
-        printf("ERROR MOVING (Target dir full?)\n");
+        fs_printf("ERROR MOVING (Target dir full?)\n");
         /* původní kód zde také neprovádí rollback */
     }
 
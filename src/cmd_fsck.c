@@ -0,0 +1,858 @@
+#define _POSIX_C_SOURCE 200809L
+/**
+ * @file cmd_fsck.c
+ * @brief Kontrola konzistence svazku: fsck [--repair].
+ *
+ * Kontrola pracuje s metadaty načtenými do paměti, každá oblast se čte
+ * sekvenčně jedním voláním (bitmapy, tabulka sdílení, index deduplikace),
+ * tabulka inodů po souvislých úsecích paralelně:
+ *  1) každé vlákno načte svůj úsek tabulky a rovnou ověří obsazené inody
+ *     (odkazy na clustery v rozsahu svazku, konec souboru uvnitř fragmentu);
+ *  2) z kořene se projde strom adresářů (fs_walk_table nad načtenou tabulkou) –
+ *     položky na neobsazené inody, adresář odkazovaný dvakrát, typ položky,
+ *     počet položek na každý inode;
+ *  3) z dosažitelných inodů, snapshotů a otevřeného fragmentu se po úsecích
+ *     postaví očekávaná inode bitmapa a počty odkazů na clustery (z nich datová
+ *     bitmapa a tabulka sdílení); s diskem se porovnají po 64bitových slovech;
+ *  4) jediné čtení dat: kontrolní součty odkazovaných clusterů (fs_crc_check,
+ *     jako scrub). Obraz bez tabulky součtů hlásí CHECKSUMS NOT CHECKED. Clustery
+ *     indexu deduplikace součty nemají, do očekávané bitmapy se přidají až potom.
+ *
+ * --repair opraví inody a položky adresářů přes běžné funkce (fs_utils.c),
+ * bitmapy a tabulku sdílení zapíše celé znovu z očekávaného stavu, ve zbylém
+ * indexu deduplikace zruší položky na uvolněné clustery a přepočítá počítadla.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../include/fs_core.h"
+#include "../include/fs_utils.h"
+#include "../include/fs_io.h"
+#include "../include/fs_walk.h"
+#include "../include/fs_dedup.h"
+#include "../include/fs_crc.h"
+#include "../include/fs_out.h"
+
+#define FSCK_ROOT_INODE 0       /* kořenový adresář (format) */
+#define FSCK_REPORT_MAX 32      /* víc řádků jedné kategorie se už jen sečte */
+
+enum fsck_entry_kind {
+    FSCK_DANGLING,              /* položka na neobsazený inode */
+    FSCK_REPEAT,                /* adresář odkazovaný druhou položkou */
+    FSCK_TYPE,                  /* typ v položce nesouhlasí s inodem */
+};
+
+struct fsck_entry_issue {
+    enum fsck_entry_kind kind;
+    int32_t parent;
+    int32_t inode;
+    unsigned int type;          /* správný DIR_TYPE_* (FSCK_TYPE) */
+    char name[MAX_NAME_LEN];
+    char *path;
+};
+
+struct fsck_issue_list {
+    struct fsck_entry_issue *items;
+    int count;
+    int cap;
+};
+
+/** Metadata svazku v paměti a z nich odvozený očekávaný stav. */
+struct fsck_state {
+    FILE *f;
+    const char *filename;       /* vlákna kontroly součtů si otevírají vlastní FILE */
+    struct superblock sb;
+    int data_clusters;          /* clustery, které se do obrazu skutečně vejdou */
+    int words;                  /* délka bitmap v 64bitových slovech */
+    size_t bitmap_bytes;
+    uint64_t *ibm;              /* bitmapy z disku (doplněné nulami na celá slova) */
+    uint64_t *dbm;
+    uint16_t *shares;
+    struct pseudo_inode *table; /* neobsazené inody vynulované, chybné odkazy opravené */
+    uint8_t *bad;               /* inode měl chybný odkaz (oprava je v table) */
+    atomic_uint *links;         /* počet položek adresářů na inode */
+    atomic_uint *refs;          /* očekávaný počet odkazů na cluster */
+    uint64_t *exp_ibm;
+    uint64_t *exp_dbm;
+    struct fsck_entry_issue *entries; /* seřazené podle cesty */
+    int entry_count;
+    uint8_t *crc_bad;           /* cluster neodpovídá součtu (po clusterech) */
+    int crc_errors;             /* -1 = součty se neověřovaly (obraz bez tabulky) */
+    struct fsck_issue_list lists[WALK_MAX_THREADS];
+    int threads;
+};
+
+struct fsck_job {
+    struct fsck_state *st;
+    int begin;                  /* úsek inodů, začátek zarovnaný na 64 */
+    int end;
+    bool ok;
+};
+
+/* ========================================================================== */
+/* Bitmapy                                                                    */
+/* ========================================================================== */
+
+/* Bity se adresují po bajtech jako na disku, slova slouží jen k hromadným operacím. */
+static bool bit_get(const uint64_t *bm, int i)
+{
+    return (((const uint8_t *)bm)[i / 8] >> (i % 8)) & 1;
+}
+
+static void bit_set(uint64_t *bm, int i)
+{
+    ((uint8_t *)bm)[i / 8] |= (uint8_t)(1u << (i % 8));
+}
+
+/** Vynuluje bity za posledním inodem/clusterem (na disku je obsah nedefinovaný). */
+static void bitmap_trim(uint64_t *bm, int bits)
+{
+    uint8_t *bytes = (uint8_t *)bm;
+    if (bits % 8) {
+        bytes[bits / 8] &= (uint8_t)((1u << (bits % 8)) - 1);
+    }
+}
+
+/** Počet bitů nastavených v a a nenastavených v b. */
+static long bitmap_count_diff(const uint64_t *a, const uint64_t *b, int words)
+{
+    long n = 0;
+    for (int w = 0; w < words; w++) {
+        n += __builtin_popcountll(a[w] & ~b[w]);
+    }
+    return n;
+}
+
+/* ========================================================================== */
+/* Fáze 1 + 3: úseky tabulky inodů                                            */
+/* ========================================================================== */
+
+static bool cluster_valid(const struct fsck_state *st, int32_t cluster)
+{
+    return cluster >= 0 && cluster < st->data_clusters;
+}
+
+/**
+ * @brief Ověří obsazený inode a chybné odkazy v něm rovnou opraví.
+ * @return true pokud byl inode v pořádku.
+ */
+static bool inode_sanitize(const struct fsck_state *st, struct pseudo_inode *inode)
+{
+    bool ok = true;
+    if (inode->file_size < 0) {
+        inode->file_size = 0;
+        ok = false;
+    }
+    if (inode->flags & INODE_FLAG_INLINE) {
+        if (inode->file_size > INODE_INLINE_MAX) {
+            inode->file_size = INODE_INLINE_MAX;
+            ok = false;
+        }
+        return ok;
+    }
+
+    int32_t blocks[5];
+    inode_get_direct(inode, blocks);
+    for (int i = 0; i < 5; i++) {
+        if (blocks[i] != CLUSTER_UNUSED && blocks[i] != CLUSTER_HOLE && !cluster_valid(st, blocks[i])) {
+            /* adresář díry nezná, v souboru se ztracený cluster čte jako nuly */
+            blocks[i] = inode->isDirectory ? CLUSTER_UNUSED : CLUSTER_HOLE;
+            ok = false;
+        }
+    }
+    inode_set_direct(inode, blocks);
+
+    if ((inode->flags & INODE_FLAG_TAIL) &&
+        (!cluster_valid(st, inode->indirect1) || inode->indirect2 < 0 ||
+         TAIL_OFFSET(inode->indirect2) + TAIL_LENGTH(inode->indirect2) > st->sb.cluster_size)) {
+        inode->flags &= (uint8_t)~INODE_FLAG_TAIL;
+        inode->indirect1 = CLUSTER_UNUSED;
+        inode->indirect2 = CLUSTER_UNUSED;
+        ok = false;
+    }
+    return ok;
+}
+
+static void *fsck_load_worker(void *arg)
+{
+    struct fsck_job *job = (struct fsck_job *)arg;
+    struct fsck_state *st = job->st;
+    if (job->begin >= job->end) {
+        job->ok = true;
+        return NULL;
+    }
+
+    job->ok = fs_pread(st->f, st->sb.inode_start_address + (long)job->begin * (long)sizeof(struct pseudo_inode),
+                       &st->table[job->begin], (size_t)(job->end - job->begin) * sizeof(struct pseudo_inode));
+    for (int id = job->begin; job->ok && id < job->end; id++) {
+        if (!bit_get(st->ibm, id)) {
+            /* neobsazený inode průchod nesmí brát jako adresář */
+            memset(&st->table[id], 0, sizeof(st->table[id]));
+        } else if (!inode_sanitize(st, &st->table[id])) {
+            st->bad[id] = 1;
+        }
+    }
+    return NULL;
+}
+
+static bool inode_reachable(const struct fsck_state *st, int id)
+{
+    return id == FSCK_ROOT_INODE || atomic_load_explicit(&st->links[id], memory_order_relaxed) > 0;
+}
+
+static void *fsck_expect_worker(void *arg)
+{
+    struct fsck_job *job = (struct fsck_job *)arg;
+    struct fsck_state *st = job->st;
+
+    /* úseky začínají na hranici slova, takže bity exp_ibm zapisuje jen jedno vlákno */
+    for (int id = job->begin; id < job->end; id++) {
+        if (!bit_get(st->ibm, id) || !inode_reachable(st, id)) {
+            continue;
+        }
+        bit_set(st->exp_ibm, id);
+
+        int32_t clusters[6];
+        const int count = inode_cluster_list(&st->table[id], clusters);
+        for (int i = 0; i < count; i++) {
+            atomic_fetch_add_explicit(&st->refs[clusters[i]], 1, memory_order_relaxed);
+        }
+    }
+    job->ok = true;
+    return NULL;
+}
+
+/**
+ * @brief Spustí worker nad tabulkou inodů rozdělenou na st->threads úseků.
+ */
+static bool run_chunks(struct fsck_state *st, void *(*worker)(void *))
+{
+    pthread_t tid[WALK_MAX_THREADS];
+    struct fsck_job jobs[WALK_MAX_THREADS];
+    bool started[WALK_MAX_THREADS];
+    const int count = st->sb.cluster_count;
+    const int per = ((count + st->threads - 1) / st->threads + 63) & ~63;
+
+    for (int t = 0; t < st->threads; t++) {
+        const int begin = (per * t < count) ? per * t : count;
+        const int end = (begin + per < count) ? begin + per : count;
+        jobs[t] = (struct fsck_job){ st, begin, end, false };
+        started[t] = t > 0 && fs_out_thread(&tid[t], worker, &jobs[t]) == 0;
+        if (!started[t]) {
+            worker(&jobs[t]); /* úsek 0 a úsek bez vlákna zpracuje hlavní vlákno */
+        }
+    }
+
+    bool ok = true;
+    for (int t = 0; t < st->threads; t++) {
+        if (started[t]) {
+            pthread_join(tid[t], NULL);
+        }
+        ok = ok && jobs[t].ok;
+    }
+    return ok;
+}
+
+/* ========================================================================== */
+/* Fáze 2: strom adresářů                                                     */
+/* ========================================================================== */
+
+static void issue_add(struct fsck_issue_list *list, enum fsck_entry_kind kind, const struct walk_entry *entry,
+                      unsigned int type)
+{
+    if (list->count == list->cap) {
+        const int cap = list->cap ? list->cap * 2 : 16;
+        struct fsck_entry_issue *items = (struct fsck_entry_issue *)realloc(list->items, (size_t)cap * sizeof(*items));
+        if (!items) {
+            return;
+        }
+        list->items = items;
+        list->cap = cap;
+    }
+
+    const size_t len = strlen(entry->dir_path) + strlen(entry->name) + 2;
+    struct fsck_entry_issue *issue = &list->items[list->count];
+    *issue = (struct fsck_entry_issue){ kind, entry->parent_inode, entry->inode_id, type, "", (char *)malloc(len) };
+    if (!issue->path) {
+        return;
+    }
+    (void)snprintf(issue->name, sizeof(issue->name), "%s", entry->name);
+    (void)snprintf(issue->path, len, "%s/%s", entry->dir_path, entry->name);
+    list->count++;
+}
+
+static void fsck_visit(void *arg, int thread, const struct walk_entry *entry)
+{
+    struct fsck_state *st = (struct fsck_state *)arg;
+    struct fsck_issue_list *list = &st->lists[thread];
+
+    if (!entry->inode || !bit_get(st->ibm, entry->inode_id)) {
+        issue_add(list, FSCK_DANGLING, entry, 0);
+        return;
+    }
+    if (entry->repeat) {
+        issue_add(list, FSCK_REPEAT, entry, 0);
+        return;
+    }
+
+    atomic_fetch_add_explicit(&st->links[entry->inode_id], 1, memory_order_relaxed);
+    const unsigned int type = entry->inode->isDirectory ? DIR_TYPE_DIR : DIR_TYPE_FILE;
+    if (entry->item->type != DIR_TYPE_UNKNOWN && entry->item->type != type) {
+        issue_add(list, FSCK_TYPE, entry, type);
+    }
+}
+
+static int issue_cmp(const void *a, const void *b)
+{
+    return fs_walk_path_cmp(((const struct fsck_entry_issue *)a)->path, ((const struct fsck_entry_issue *)b)->path);
+}
+
+/** Sloučí hlášení vláken do jednoho seznamu seřazeného podle cesty. */
+static bool merge_issues(struct fsck_state *st)
+{
+    int total = 0;
+    for (int t = 0; t < st->threads; t++) {
+        total += st->lists[t].count;
+    }
+    st->entries = (struct fsck_entry_issue *)malloc((size_t)(total ? total : 1) * sizeof(*st->entries));
+    if (!st->entries) {
+        return false;
+    }
+    for (int t = 0; t < st->threads; t++) {
+        if (st->lists[t].count == 0) {
+            continue; /* items smí být NULL */
+        }
+        memcpy(st->entries + st->entry_count, st->lists[t].items, (size_t)st->lists[t].count * sizeof(*st->entries));
+        st->entry_count += st->lists[t].count;
+        st->lists[t].count = 0; /* cesty teď vlastní st->entries */
+    }
+    qsort(st->entries, (size_t)st->entry_count, sizeof(*st->entries), issue_cmp);
+    return true;
+}
+
+/* ========================================================================== */
+/* Analýza                                                                    */
+/* ========================================================================== */
+
+static void fsck_free(struct fsck_state *st)
+{
+    free(st->ibm);
+    free(st->dbm);
+    free(st->shares);
+    free(st->table);
+    free(st->bad);
+    free(st->links);
+    free(st->refs);
+    free(st->exp_ibm);
+    free(st->exp_dbm);
+    for (int i = 0; i < st->entry_count; i++) {
+        free(st->entries[i].path);
+    }
+    free(st->entries);
+    free(st->crc_bad);
+    for (int t = 0; t < WALK_MAX_THREADS; t++) {
+        for (int i = 0; i < st->lists[t].count; i++) {
+            free(st->lists[t].items[i].path);
+        }
+        free(st->lists[t].items);
+    }
+
+    FILE *f = st->f;
+    const char *filename = st->filename;
+    *st = (struct fsck_state){ .f = f, .filename = filename };
+}
+
+/** Odkazy snapshotů: clustery hlavičky, úseky tabulky z mapy a clustery obsazených inodů. */
+static bool expect_snapshots(struct fsck_state *st)
+{
+    const struct superblock *sb = &st->sb;
+    const int header = (int)((snapshot_header_bytes(sb) + sb->cluster_size - 1) / sb->cluster_size);
+    const int chunks = snapshot_chunk_count(sb);
+    struct pseudo_inode *table = (struct pseudo_inode *)malloc((size_t)sb->cluster_count * sizeof(*table));
+    uint8_t *ibm = (uint8_t *)malloc(st->bitmap_bytes);
+    int32_t *map = (int32_t *)malloc((size_t)chunks * sizeof(int32_t));
+    bool ok = table && ibm && map;
+
+    for (int s = 0; ok && s < FS_MAX_SNAPSHOTS; s++) {
+        const struct snapshot_entry *snap = &sb->snapshots[s];
+        if (snap->name[0] == '\0') {
+            continue;
+        }
+        if (snap->cluster_count != header || !cluster_valid(st, snap->first_cluster) ||
+            !cluster_valid(st, snap->first_cluster + snap->cluster_count - 1)) {
+            fs_printf("BAD SNAPSHOT: %s\n", snap->name);
+            continue;
+        }
+
+        struct superblock view = *sb;
+        snapshot_redirect(&view, snap);
+        if (!fs_pread(st->f, view.inode_start_address, map, (size_t)chunks * sizeof(int32_t))) {
+            ok = false;
+            break;
+        }
+        bool bad = false;
+        for (int c = 0; c < chunks; c++) {
+            bad |= map[c] != CLUSTER_UNUSED && !cluster_valid(st, map[c]);
+        }
+        if (bad) {
+            fs_printf("BAD SNAPSHOT: %s\n", snap->name);
+            continue;
+        }
+        if (!fs_pread(st->f, view.bitmapi_start_address, ibm, st->bitmap_bytes) ||
+            !read_inode_table(st->f, &view, 0, table, (size_t)sb->cluster_count * sizeof(*table))) {
+            ok = false;
+            break;
+        }
+
+        for (int i = 0; i < snap->cluster_count; i++) {
+            atomic_fetch_add_explicit(&st->refs[snap->first_cluster + i], 1, memory_order_relaxed);
+        }
+        for (int c = 0; c < chunks; c++) {
+            if (map[c] != CLUSTER_UNUSED) {
+                atomic_fetch_add_explicit(&st->refs[map[c]], 1, memory_order_relaxed);
+            }
+        }
+        for (int id = 0; id < sb->cluster_count; id++) {
+            if (!((ibm[id / 8] >> (id % 8)) & 1)) {
+                continue;
+            }
+            int32_t clusters[6];
+            const int count = inode_cluster_list(&table[id], clusters);
+            for (int i = 0; i < count; i++) {
+                if (cluster_valid(st, clusters[i])) {
+                    atomic_fetch_add_explicit(&st->refs[clusters[i]], 1, memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    free(table);
+    free(ibm);
+    free(map);
+    return ok;
+}
+
+/**
+ * @brief Načte metadata svazku a spočítá očekávaný stav (fáze 1–3).
+ */
+static bool fsck_analyze(struct fsck_state *st)
+{
+    fsck_free(st);
+    if (!load_superblock(st->f, &st->sb)) {
+        return false;
+    }
+    struct superblock *sb = &st->sb;
+    const int count = sb->cluster_count;
+
+    st->data_clusters = (int)((sb->disk_size - sb->data_start_address) / sb->cluster_size);
+    if (st->data_clusters > count) {
+        st->data_clusters = count;
+    }
+    st->words = (count + 63) / 64;
+    st->bitmap_bytes = (size_t)(count + 7) / 8;
+    st->threads = fs_walk_threads(WALK_MAX_THREADS);
+
+    st->ibm = (uint64_t *)calloc((size_t)st->words, sizeof(uint64_t));
+    st->dbm = (uint64_t *)calloc((size_t)st->words, sizeof(uint64_t));
+    st->exp_ibm = (uint64_t *)calloc((size_t)st->words, sizeof(uint64_t));
+    st->exp_dbm = (uint64_t *)calloc((size_t)st->words, sizeof(uint64_t));
+    st->shares = (uint16_t *)malloc((size_t)count * sizeof(uint16_t));
+    st->table = (struct pseudo_inode *)malloc((size_t)count * sizeof(struct pseudo_inode));
+    st->bad = (uint8_t *)calloc((size_t)count, 1);
+    st->links = (atomic_uint *)calloc((size_t)count, sizeof(atomic_uint));
+    st->refs = (atomic_uint *)calloc((size_t)count, sizeof(atomic_uint));
+    if (!st->ibm || !st->dbm || !st->exp_ibm || !st->exp_dbm || !st->shares || !st->table || !st->bad ||
+        !st->links || !st->refs ||
+        !fs_pread(st->f, sb->bitmapi_start_address, st->ibm, st->bitmap_bytes) ||
+        !fs_pread(st->f, sb->bitmap_start_address, st->dbm, st->bitmap_bytes) ||
+        !fs_pread(st->f, sb->refcount_start_address, st->shares, (size_t)count * sizeof(uint16_t))) {
+        return false;
+    }
+    bitmap_trim(st->ibm, count);
+    bitmap_trim(st->dbm, count);
+
+    /* 1) tabulka inodů */
+    if (!run_chunks(st, fsck_load_worker)) {
+        return false;
+    }
+
+    /* 2) strom adresářů */
+    if (!bit_get(st->ibm, FSCK_ROOT_INODE) || !st->table[FSCK_ROOT_INODE].isDirectory) {
+        fs_printf("ROOT DIRECTORY DAMAGED\n");
+        return false;
+    }
+    if (fs_walk_table(st->f, sb, st->table, FSCK_ROOT_INODE, "/", fsck_visit, st) == 0 || !merge_issues(st)) {
+        return false;
+    }
+
+    /* 3) očekávaný stav */
+    if (!run_chunks(st, fsck_expect_worker) || !expect_snapshots(st)) {
+        return false;
+    }
+    if (cluster_valid(st, sb->frag_cluster)) {
+        atomic_fetch_add_explicit(&st->refs[sb->frag_cluster], 1, memory_order_relaxed);
+    }
+    for (int c = 0; c < count; c++) {
+        if (atomic_load_explicit(&st->refs[c], memory_order_relaxed) > 0) {
+            bit_set(st->exp_dbm, c);
+        }
+    }
+
+    /* 4) kontrolní součty odkazovaných clusterů */
+    st->crc_bad = (uint8_t *)calloc((size_t)count, 1);
+    if (!st->crc_bad) {
+        return false;
+    }
+    st->crc_errors = fs_crc_check(st->filename, sb, (const uint8_t *)st->exp_dbm, st->crc_bad, NULL, NULL);
+
+    /* Index deduplikace je obsazený, ale bez součtů – do očekávané bitmapy až po nich. */
+    int32_t index_first = 0;
+    const int index_clusters = dedup_index_clusters(sb, &index_first);
+    for (int c = index_first; c < index_first + index_clusters; c++) {
+        if (cluster_valid(st, c)) {
+            bit_set(st->exp_dbm, c);
+        }
+    }
+    return true;
+}
+
+static uint16_t expected_shares(const struct fsck_state *st, int cluster)
+{
+    const unsigned int refs = atomic_load_explicit(&st->refs[cluster], memory_order_relaxed);
+    return (uint16_t)(refs == 0 ? 0 : (refs - 1 > UINT16_MAX ? UINT16_MAX : refs - 1));
+}
+
+static int expected_references(const struct fsck_state *st, int id)
+{
+    /* kořen nemá položku, adresář smí mít jen jednu (druhé se hlásí jako REPEAT) */
+    if (id == FSCK_ROOT_INODE || st->table[id].isDirectory) {
+        return 1;
+    }
+    const unsigned int links = atomic_load_explicit(&st->links[id], memory_order_relaxed);
+    return links > INT8_MAX ? INT8_MAX : (int)links;
+}
+
+static bool dedup_stale(const struct fsck_state *st, const struct dedup_entry *entry)
+{
+    return entry->cluster > 0 &&
+           (entry->cluster >= st->sb.cluster_count ||
+            atomic_load_explicit(&st->refs[entry->cluster], memory_order_relaxed) == 0);
+}
+
+/** Položky indexu deduplikace (NULL pokud svazek index nemá). */
+static struct dedup_entry *read_dedup_index(const struct fsck_state *st)
+{
+    if (st->sb.dedup_start_address <= 0 || st->sb.dedup_slots <= 0) {
+        return NULL;
+    }
+    const size_t bytes = (size_t)st->sb.dedup_slots * sizeof(struct dedup_entry);
+    struct dedup_entry *index = (struct dedup_entry *)malloc(bytes);
+    if (index && !fs_pread(st->f, st->sb.dedup_start_address, index, bytes)) {
+        free(index);
+        return NULL;
+    }
+    return index;
+}
+
+/* ========================================================================== */
+/* Hlášení                                                                    */
+/* ========================================================================== */
+
+static void report_more(long count)
+{
+    if (count > FSCK_REPORT_MAX) {
+        fs_printf("... %ld MORE\n", count - FSCK_REPORT_MAX);
+    }
+}
+
+/**
+ * @brief Porovná stav na disku s očekávaným.
+ * @param print Vypsat nalezené chyby.
+ * @return Počet chyb.
+ */
+static long fsck_report(struct fsck_state *st, bool print)
+{
+    const int count = st->sb.cluster_count;
+    long errors = 0;
+    long n = 0;
+
+    for (int id = 0; id < count; id++) {
+        if (st->bad[id] && ++n <= FSCK_REPORT_MAX && print) {
+            fs_printf("BAD CLUSTER REFERENCE: i-node %d\n", id);
+        }
+    }
+    errors += n;
+    if (print) {
+        report_more(n);
+    }
+
+    static const char *const kinds[] = { "DANGLING ENTRY", "DUPLICATE DIRECTORY ENTRY", "WRONG ENTRY TYPE" };
+    for (int i = 0; i < st->entry_count; i++) {
+        const struct fsck_entry_issue *issue = &st->entries[i];
+        if (print && i < FSCK_REPORT_MAX) {
+            fs_printf("%s: %s -> i-node %d\n", kinds[issue->kind], issue->path, issue->inode);
+        }
+    }
+    errors += st->entry_count;
+    if (print) {
+        report_more(st->entry_count);
+    }
+
+    /* inody obsazené, ale nedosažitelné z kořene (a naopak) */
+    n = 0;
+    for (int w = 0; w < st->words; w++) {
+        const uint64_t diff = st->ibm[w] ^ st->exp_ibm[w];
+        for (int id = w * 64; diff != 0 && id < (w + 1) * 64 && id < count; id++) {
+            if (bit_get(st->ibm, id) != bit_get(st->exp_ibm, id) && ++n <= FSCK_REPORT_MAX && print) {
+                fs_printf("%s: i-node %d\n", bit_get(st->ibm, id) ? "ORPHAN INODE" : "UNALLOCATED INODE", id);
+            }
+        }
+    }
+    errors += n;
+    if (print) {
+        report_more(n);
+    }
+
+    n = 0;
+    for (int id = 0; id < count; id++) {
+        if (!bit_get(st->exp_ibm, id) || st->table[id].references == expected_references(st, id)) {
+            continue;
+        }
+        if (++n <= FSCK_REPORT_MAX && print) {
+            fs_printf("LINK COUNT: i-node %d has references %d, expected %d\n", id, st->table[id].references,
+                      expected_references(st, id));
+        }
+    }
+    errors += n;
+    if (print) {
+        report_more(n);
+    }
+
+    /* clustery: po slovech, jednotlivě se nevypisují */
+    const long leaked = bitmap_count_diff(st->dbm, st->exp_dbm, st->words);
+    const long missing = bitmap_count_diff(st->exp_dbm, st->dbm, st->words);
+    long shares = 0;
+    for (int c = 0; c < count; c++) {
+        shares += st->shares[c] != expected_shares(st, c);
+    }
+    long stale = 0;
+    struct dedup_entry *index = read_dedup_index(st);
+    for (int i = 0; index && i < st->sb.dedup_slots; i++) {
+        stale += dedup_stale(st, &index[i]);
+    }
+    free(index);
+
+    if (print) {
+        if (leaked) {
+            fs_printf("LEAKED CLUSTERS: %ld\n", leaked);
+        }
+        if (missing) {
+            fs_printf("UNALLOCATED CLUSTERS IN USE: %ld\n", missing);
+        }
+        if (shares) {
+            fs_printf("SHARE COUNT MISMATCH: %ld clusters\n", shares);
+        }
+        if (stale) {
+            fs_printf("STALE DEDUP ENTRIES: %ld\n", stale);
+        }
+    }
+    errors += leaked + missing + shares + stale;
+
+    /* poškozená data fsck neopraví – zůstanou jako chyby i po --repair */
+    if (st->crc_errors < 0) {
+        if (print) {
+            fs_printf("CHECKSUMS NOT CHECKED\n");
+        }
+    } else {
+        n = 0;
+        for (int c = 0; c < count; c++) {
+            if (st->crc_bad[c] && ++n <= FSCK_REPORT_MAX && print) {
+                fs_printf("CHECKSUM ERROR: cluster %d\n", c);
+            }
+        }
+        errors += n;
+        if (print) {
+            report_more(n);
+        }
+    }
+
+    struct fs_counters actual;
+    const struct fs_counters *stored = &st->sb.counters;
+    if (fs_counters_scan(st->f, &st->sb, &actual) &&
+        (stored->valid != FS_COUNTERS_VALID || stored->used_inodes != actual.used_inodes ||
+         stored->used_clusters != actual.used_clusters || stored->directories != actual.directories ||
+         stored->logical_bytes != actual.logical_bytes)) {
+        if (print) {
+            fs_printf("USAGE COUNTERS OUT OF DATE\n");
+        }
+        errors++;
+    }
+    return errors;
+}
+
+/* ========================================================================== */
+/* Oprava                                                                     */
+/* ========================================================================== */
+
+/**
+ * @brief Zapíše bitmapy a tabulku sdílení z očekávaného stavu a vyčistí index deduplikace.
+ */
+static bool write_expected(struct fsck_state *st)
+{
+    const int count = st->sb.cluster_count;
+    uint16_t *shares = (uint16_t *)malloc((size_t)count * sizeof(uint16_t));
+    if (!shares) {
+        return false;
+    }
+    for (int c = 0; c < count; c++) {
+        shares[c] = expected_shares(st, c);
+    }
+
+    bool ok = fs_pwrite(st->f, st->sb.bitmapi_start_address, st->exp_ibm, st->bitmap_bytes) &&
+              fs_pwrite(st->f, st->sb.bitmap_start_address, st->exp_dbm, st->bitmap_bytes) &&
+              fs_pwrite(st->f, st->sb.refcount_start_address, shares, (size_t)count * sizeof(uint16_t));
+    free(shares);
+    fs_bitmap_invalidate();
+
+    struct dedup_entry *index = read_dedup_index(st);
+    bool dirty = false;
+    for (int i = 0; index && i < st->sb.dedup_slots; i++) {
+        if (dedup_stale(st, &index[i])) {
+            index[i].cluster = DEDUP_TOMBSTONE;
+            dirty = true;
+        }
+    }
+    if (ok && dirty) {
+        ok = fs_pwrite(st->f, st->sb.dedup_start_address, index,
+                       (size_t)st->sb.dedup_slots * sizeof(struct dedup_entry));
+    }
+    free(index);
+    return ok;
+}
+
+/**
+ * @brief Opraví svazek podle analýzy v st. Na konci st obsahuje novou analýzu.
+ */
+static bool fsck_repair(struct fsck_state *st)
+{
+    struct superblock *sb = &st->sb;
+
+    /* 1) inody: opravené odkazy a počty položek (pracuje jen s obsazenými inody) */
+    for (int id = 0; id < sb->cluster_count; id++) {
+        if (!bit_get(st->exp_ibm, id)) {
+            continue;
+        }
+        const int references = expected_references(st, id);
+        if (st->bad[id] || st->table[id].references != references) {
+            struct pseudo_inode inode = st->table[id];
+            inode.references = (int8_t)references;
+            write_inode(st->f, sb, id, &inode);
+        }
+    }
+
+    /* 2) bitmapy dřív než položky – kopie sdíleného adresáře při zápisu už alokuje nad správnou bitmapou */
+    if (!write_expected(st)) {
+        return false;
+    }
+
+    /* 3) položky adresářů */
+    for (int i = 0; i < st->entry_count; i++) {
+        struct fsck_entry_issue *issue = &st->entries[i];
+        if (!remove_directory_item(st->f, sb, issue->parent, issue->name)) {
+            return false;
+        }
+        if (issue->kind == FSCK_TYPE) {
+            struct directory_item item = { .inode = issue->inode, .type = issue->type };
+            (void)snprintf(item.item_name, sizeof(item.item_name), "%s", issue->name);
+            if (!add_directory_item(st->f, sb, issue->parent, &item)) {
+                return false;
+            }
+        }
+    }
+
+    /* 4) odstraněné položky mohly osiřet podstromy – znovu analyzovat a zapsat */
+    if (!fsck_analyze(st) || !write_expected(st) || !fsck_analyze(st)) {
+        return false;
+    }
+
+    struct fs_counters counters;
+    return fs_counters_scan(st->f, sb, &counters) && fs_counters_store(st->f, sb, &counters);
+}
+
+/* ========================================================================== */
+/* FSCK                                                                       */
+/* ========================================================================== */
+
+/**
+ * @brief Zkontroluje konzistenci svazku (příkaz fsck [--repair]).
+ *
+ * @param filename Cesta k souboru s obrazem VFS.
+ * @param repair   Nalezené chyby opravit.
+ * @return 1 pokud je svazek (po opravě) v pořádku, jinak 0.
+ */
+int fs_fsck(const char *filename, bool repair)
+{
+    FILE *f = filename ? fopen(filename, repair ? "rb+" : "rb") : NULL;
+    if (!f) {
+        fs_printf("FILE NOT FOUND\n");
+        return 0;
+    }
+
+    int ok = 0;
+    struct fsck_state st = { .f = f, .filename = filename };
+
+    struct timespec t0;
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (!fsck_analyze(&st)) {
+        fs_printf("FSCK FAILED\n");
+        goto cleanup;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    int inodes = 0;
+    int directories = 0;
+    for (int id = 0; id < st.sb.cluster_count; id++) {
+        if (bit_get(st.exp_ibm, id)) {
+            inodes++;
+            directories += st.table[id].isDirectory;
+        }
+    }
+    long used_clusters = 0;
+    for (int w = 0; w < st.words; w++) {
+        used_clusters += __builtin_popcountll(st.exp_dbm[w]);
+    }
+    const double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fs_printf("FSCK: %d inodes, %d directories, %ld clusters in %.3f s (%d threads)\n", inodes, directories,
+              used_clusters, secs, st.threads);
+
+    const long errors = fsck_report(&st, true);
+    if (errors == 0) {
+        fs_printf("CLEAN\n");
+        ok = 1;
+    } else if (!repair) {
+        fs_printf("ERRORS: %ld\n", errors);
+    } else if (!fsck_repair(&st)) {
+        fs_printf("REPAIR FAILED\n");
+    } else {
+        const long left = fsck_report(&st, false);
+        if (left == 0) {
+            fs_printf("REPAIRED: %ld errors\n", errors);
+            ok = 1;
+        } else {
+            fs_printf("REPAIRED: %ld errors, %ld left\n", errors - left, left);
+        }
+    }
+
+cleanup:
+    fsck_free(&st);
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,661 @@
+/**
+ * @file cmd_snapshot.c
+ * @brief Snapshoty svazku: snapshot create/list/delete/rollback.
+ *
+ * Snapshot je kopie inode bitmapy a obsazených inodů (jen metadata). Datové
+ * clustery se nekopírují: snapshot na každý cluster odkazovaný jeho inody drží
+ * odkaz v tabulce sdílení, takže pozdější rm/add/... je jen odemknou a data
+ * zůstanou. Jediná data měněná na místě jsou adresáře – ty se při zápisu do
+ * sdíleného clusteru kopírují (dir_cluster_for_write).
+ *
+ * Na disku má snapshot hlavičku [inode bitmapa][mapa úseků tabulky inodů]
+ * v souvislém úseku clusterů (snapshot_header_bytes, fs_utils.h). Tabulka inodů
+ * se kopíruje po úsecích velikosti clusteru a jen úseky s obsazeným inodem
+ * (neobsazené inody se v kopii nulují). Úsek se stejným obsahem jako ve starším
+ * snapshotu se nekopíruje znovu, ale sdílí přes tabulku sdílení – další snapshot
+ * tak stojí hlavičku a úseky změněné od předchozích.
+ *
+ * Obsah snapshotu jde číst přes cesty @snap:/cesta (ls, cat, info, outcp).
+ *
+ * Cena: kopie metadat všech snapshotů dohromady (různé clustery) smí zabrat
+ * nejvýš SNAPSHOT_MAX_PERCENT % datových clusterů; create vypíše cenu nového
+ * snapshotu a list velikost kopie každého z nich.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/fs_core.h"
+#include "../include/fs_utils.h"
+#include "../include/fs_io.h"
+#include "../include/fs_out.h"
+
+enum {
+    SNAPSHOT_MAX_PERCENT = 25           /* strop kopií metadat všech snapshotů (% datových clusterů) */
+};
+
+/* ========================================================================== */
+/* Interní helpery                                                            */
+/* ========================================================================== */
+
+/**
+ * @brief Najde snapshot podle jména. Vrací index v sb->snapshots nebo -1.
+ */
+static int snapshot_find(const struct superblock *sb, const char *name)
+{
+    for (int i = 0; i < FS_MAX_SNAPSHOTS; i++) {
+        if (sb->snapshots[i].name[0] != '\0' && strcmp(sb->snapshots[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/** Velikost metadat v paměti: [tabulka inodů][inode bitmapa]. */
+static size_t metadata_bytes(const struct superblock *sb)
+{
+    return (size_t)sb->cluster_count * sizeof(struct pseudo_inode) + (size_t)(sb->cluster_count + 7) / 8;
+}
+
+/** Počet clusterů hlavičky snapshotu (inode bitmapa a mapa úseků). */
+static int header_clusters(const struct superblock *sb)
+{
+    return (int)((snapshot_header_bytes(sb) + sb->cluster_size - 1) / sb->cluster_size);
+}
+
+/**
+ * @brief Načte mapu úseků tabulky snapshotu (snapshot_chunk_count položek).
+ */
+static bool read_snapshot_map(FILE *f, const struct superblock *sb, const struct snapshot_entry *snap, int32_t *map)
+{
+    struct superblock view = *sb;
+    snapshot_redirect(&view, snap);
+    return fs_pread(f, view.inode_start_address, map, (size_t)snapshot_chunk_count(sb) * sizeof(int32_t));
+}
+
+/**
+ * @brief Clustery obsazené kopiemi metadat existujících snapshotů (sdílený úsek jednou).
+ * @return počet clusterů, -1 při chybě čtení.
+ */
+static int snapshot_clusters_used(FILE *f, const struct superblock *sb)
+{
+    const int chunks = snapshot_chunk_count(sb);
+    uint8_t *seen = (uint8_t *)calloc((size_t)sb->cluster_count, 1);
+    int32_t *map = (int32_t *)malloc((size_t)chunks * sizeof(int32_t));
+    int used = (seen && map) ? 0 : -1;
+
+    for (int i = 0; used != -1 && i < FS_MAX_SNAPSHOTS; i++) {
+        const struct snapshot_entry *snap = &sb->snapshots[i];
+        if (snap->name[0] == '\0') {
+            continue;
+        }
+        used += snap->cluster_count;
+        if (!read_snapshot_map(f, sb, snap, map)) {
+            used = -1;
+            break;
+        }
+        for (int c = 0; c < chunks; c++) {
+            if (map[c] >= 0 && map[c] < sb->cluster_count && !seen[map[c]]) {
+                seen[map[c]] = 1;
+                used++;
+            }
+        }
+    }
+
+    free(seen);
+    free(map);
+    return used;
+}
+
+static bool inode_used(const uint8_t *ibm, int id)
+{
+    return (ibm[id / 8] >> (id % 8)) & 1;
+}
+
+/**
+ * @brief Načte metadata živého svazku do bufferu [tabulka inodů][inode bitmapa].
+ *
+ * Neobsazené inody se v bufferu vynulují – do snapshotu patří jen obsazené
+ * a úsek tabulky bez nich se pak vůbec neukládá.
+ */
+static bool read_live_metadata(FILE *f, const struct superblock *sb, uint8_t *blob)
+{
+    const size_t table = (size_t)sb->cluster_count * sizeof(struct pseudo_inode);
+    const size_t ibm = (size_t)(sb->cluster_count + 7) / 8;
+
+    if (!fs_pread(f, sb->inode_start_address, blob, table) || !fs_pread(f, sb->bitmapi_start_address, blob + table, ibm)) {
+        return false;
+    }
+    struct pseudo_inode *inodes = (struct pseudo_inode *)blob;
+    for (int id = 0; id < sb->cluster_count; id++) {
+        if (!inode_used(blob + table, id)) {
+            memset(&inodes[id], 0, sizeof(inodes[id]));
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Načte metadata snapshotu do bufferu [tabulka inodů][inode bitmapa].
+ */
+static bool read_snapshot_metadata(FILE *f, const struct superblock *sb, const struct snapshot_entry *snap, uint8_t *blob)
+{
+    const size_t table = (size_t)sb->cluster_count * sizeof(struct pseudo_inode);
+    const size_t ibm = (size_t)(sb->cluster_count + 7) / 8;
+
+    struct superblock view = *sb;
+    snapshot_redirect(&view, snap);
+    return read_inode_table(f, &view, 0, blob, table) && fs_pread(f, view.bitmapi_start_address, blob + table, ibm);
+}
+
+/**
+ * @brief Úsek chunk tabulky z bufferu metadat do buf (cluster_size B, za koncem tabulky nuly).
+ * @return false, pokud je úsek celý nulový (neukládá se).
+ */
+static bool table_chunk(const struct superblock *sb, const uint8_t *blob, int chunk, uint8_t *buf)
+{
+    const long table = (long)sb->cluster_count * (long)sizeof(struct pseudo_inode);
+    const long begin = (long)chunk * sb->cluster_size;
+    const long len = (table - begin < sb->cluster_size) ? table - begin : sb->cluster_size;
+
+    memset(buf, 0, (size_t)sb->cluster_size);
+    memcpy(buf, blob + begin, (size_t)len);
+    return !buffer_is_zero(buf, (size_t)sb->cluster_size);
+}
+
+/**
+ * @brief Najde úsek chunk se stejným obsahem ve starším snapshotu.
+ * @return cluster úseku, nebo -1.
+ */
+static int32_t shared_chunk(FILE *f, struct superblock *sb, int32_t *const maps[FS_MAX_SNAPSHOTS], int chunk,
+                            const uint8_t *data, uint8_t *other)
+{
+    for (int i = 0; i < FS_MAX_SNAPSHOTS; i++) {
+        const int32_t cluster = maps[i] ? maps[i][chunk] : CLUSTER_UNUSED;
+        if (cluster >= 0 && read_cluster(f, sb, cluster, other) &&
+            memcmp(other, data, (size_t)sb->cluster_size) == 0) {
+            return cluster;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Mapy úseků existujících snapshotů (prázdná položka = NULL). Uvolní free_snapshot_maps.
+ */
+static bool read_snapshot_maps(FILE *f, const struct superblock *sb, int32_t *maps[FS_MAX_SNAPSHOTS])
+{
+    const size_t bytes = (size_t)snapshot_chunk_count(sb) * sizeof(int32_t);
+    bool ok = true;
+    for (int i = 0; i < FS_MAX_SNAPSHOTS; i++) {
+        maps[i] = NULL;
+        if (ok && sb->snapshots[i].name[0] != '\0') {
+            maps[i] = (int32_t *)malloc(bytes);
+            ok = maps[i] && read_snapshot_map(f, sb, &sb->snapshots[i], maps[i]);
+        }
+    }
+    return ok;
+}
+
+static void free_snapshot_maps(int32_t *maps[FS_MAX_SNAPSHOTS])
+{
+    for (int i = 0; i < FS_MAX_SNAPSHOTS; i++) {
+        free(maps[i]);
+        maps[i] = NULL;
+    }
+}
+
+/**
+ * @brief Uloží úseky tabulky z bufferu metadat a vyplní mapu úseků.
+ *
+ * Nulový úsek dostane CLUSTER_UNUSED, úsek shodný s úsekem staršího snapshotu
+ * jeho cluster (+1 odkaz), jinak se zapíše do nového clusteru. Při dry_run se
+ * nic nezapisuje, jen spočítá počet nových clusterů (odhad ceny před create).
+ * @return počet nových clusterů, -1 když došlo místo (uložené úseky jsou vrácené).
+ */
+static int store_table_chunks(FILE *f, struct superblock *sb, const uint8_t *blob, int32_t *map, bool dry_run)
+{
+    const int chunks = snapshot_chunk_count(sb);
+    int32_t *maps[FS_MAX_SNAPSHOTS];
+    uint8_t *buf = (uint8_t *)malloc((size_t)sb->cluster_size);
+    uint8_t *other = (uint8_t *)malloc((size_t)sb->cluster_size);
+    int created = (buf && other && read_snapshot_maps(f, sb, maps)) ? 0 : -1;
+
+    int c = 0;
+    for (; created != -1 && c < chunks; c++) {
+        map[c] = CLUSTER_UNUSED;
+        if (!table_chunk(sb, blob, c, buf)) {
+            continue;
+        }
+        const int32_t shared = shared_chunk(f, sb, maps, c, buf, other);
+        if (shared != -1 && (dry_run || cluster_ref(f, sb, shared))) {
+            map[c] = shared;
+            continue;
+        }
+        created++;
+        if (!dry_run) {
+            map[c] = alloc_bit(f, sb, false);
+            if (map[c] == -1 || !write_cluster(f, sb, map[c], buf)) {
+                created = -1;
+            }
+        }
+    }
+
+    if (created == -1 && !dry_run) {
+        for (int i = 0; i < c && i < chunks; i++) {
+            if (map[i] >= 0) {
+                cluster_unref(f, sb, map[i]);
+            }
+        }
+    }
+    free_snapshot_maps(maps);
+    free(buf);
+    free(other);
+    return created;
+}
+
+/**
+ * @brief Odebere odkaz na každý cluster, na který ukazují použité inody
+ *        0..limit-1 v kopii metadat.
+ */
+static void unref_metadata_clusters(FILE *f, struct superblock *sb, const uint8_t *blob, int limit)
+{
+    const struct pseudo_inode *table = (const struct pseudo_inode *)blob;
+    const uint8_t *ibm = blob + (size_t)sb->cluster_count * sizeof(struct pseudo_inode);
+
+    for (int id = 0; id < limit; id++) {
+        if (!inode_used(ibm, id)) {
+            continue;
+        }
+
+        int32_t clusters[6];
+        const int count = inode_cluster_list(&table[id], clusters);
+        for (int i = 0; i < count; i++) {
+            cluster_unref(f, sb, clusters[i]);
+        }
+    }
+}
+
+/**
+ * @brief Přidá odkaz na každý cluster, na který ukazují použité inody v kopii metadat.
+ *
+ * Cluster s plným čítačem sdílení se zkopíruje a inode v kopii se přesměruje
+ * na kopii; konec ve fragmentu s plným čítačem se přepíše znovu (do nového
+ * fragmentu nebo vlastního clusteru). Kopie metadat se proto zapisuje až potom.
+ * @return true, nebo false pokud na kopie nezbylo místo (odkazy jsou vrácené).
+ */
+static bool ref_metadata_clusters(FILE *f, struct superblock *sb, uint8_t *blob)
+{
+    struct pseudo_inode *table = (struct pseudo_inode *)blob;
+    const uint8_t *ibm = blob + (size_t)sb->cluster_count * sizeof(struct pseudo_inode);
+    uint8_t *buf = (uint8_t *)malloc((size_t)sb->cluster_size);
+    if (!buf) {
+        return false;
+    }
+
+    for (int id = 0; id < sb->cluster_count; id++) {
+        if (!inode_used(ibm, id) || (table[id].flags & INODE_FLAG_INLINE)) {
+            continue;
+        }
+
+        struct pseudo_inode node = table[id];
+        int32_t blocks[5];
+        inode_get_direct(&node, blocks);
+
+        int n = 0;
+        bool ok = true;
+        for (; ok && n < 5 && blocks[n] != CLUSTER_UNUSED; n++) {
+            if (blocks[n] != CLUSTER_HOLE) {
+                const int32_t shared = cluster_share(f, sb, blocks[n]);
+                ok = shared != -1;
+                blocks[n] = ok ? shared : CLUSTER_HOLE;
+            }
+        }
+
+        if (ok && (node.flags & INODE_FLAG_TAIL) && !cluster_ref(f, sb, node.indirect1)) {
+            node.flags &= (uint8_t)~INODE_FLAG_TAIL;
+            node.indirect1 = CLUSTER_UNUSED;
+            node.indirect2 = CLUSTER_UNUSED;
+            ok = read_cluster(f, sb, table[id].indirect1, buf) &&
+                 write_file_tail(f, sb, &node, blocks, &n, buf + TAIL_OFFSET(table[id].indirect2),
+                                 TAIL_LENGTH(table[id].indirect2));
+        }
+
+        if (!ok) {
+            /* Vrátit odkazy tohoto inodu (kopie se tím uvolní) i všech předchozích. */
+            for (int i = 0; i < n && i < 5; i++) {
+                if (blocks[i] != CLUSTER_UNUSED && blocks[i] != CLUSTER_HOLE) {
+                    cluster_unref(f, sb, blocks[i]);
+                }
+            }
+            unref_metadata_clusters(f, sb, blob, id);
+            free(buf);
+            return false;
+        }
+
+        inode_set_direct(&node, blocks);
+        table[id] = node;
+    }
+
+    free(buf);
+    return true;
+}
+
+static FILE *open_snapshot_fs(const char *filename, struct superblock *sb)
+{
+    FILE *f = filename ? fopen(filename, "r+b") : NULL;
+    if (!f) {
+        fs_printf("FILE NOT FOUND\n");
+        return NULL;
+    }
+    if (!load_superblock(f, sb)) {
+        fs_printf("FILE NOT FOUND\n");
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+/* ========================================================================== */
+/* SNAPSHOT                                                                   */
+/* ========================================================================== */
+
+int fs_snapshot_exists(const char *filename, const char *name)
+{
+    FILE *f = filename ? fopen(filename, "rb") : NULL;
+    if (!f) {
+        return 0;
+    }
+
+    struct superblock sb;
+    const int found = load_superblock(f, &sb) && name && snapshot_find(&sb, name) != -1;
+    fclose(f);
+    return found;
+}
+
+/**
+ * @brief Vytvoří snapshot: uloží metadata a přidá odkazy na všechny datové clustery.
+ *
+ * Cena je hlavička (úměrná počtu inodů svazku, inode bitmapa a mapa úseků) plus
+ * úseky tabulky s obsazenými inody, které se od starších snapshotů změnily.
+ * Pokud by kopie všech snapshotů přesáhly SNAPSHOT_MAX_PERCENT % datových
+ * clusterů, vypíše NO SPACE s limitem. Po úspěchu vypíše SNAPSHOT: počet
+ * nových clusterů a podíl na datové oblasti.
+ * @return 1 při úspěchu, 0 při chybě (hláška už je vypsaná).
+ */
+int fs_snapshot_create(const char *filename, const char *name)
+{
+    if (!name || name[0] == '\0' || strlen(name) >= MAX_NAME_LEN || strchr(name, ':') || strchr(name, '/')) {
+        fs_printf("INVALID ARGUMENT\n");
+        return 0;
+    }
+
+    struct superblock sb;
+    FILE *f = open_snapshot_fs(filename, &sb);
+    if (!f) {
+        return 0;
+    }
+
+    if (snapshot_find(&sb, name) != -1) {
+        fs_printf("EXIST\n");
+        fclose(f);
+        return 0;
+    }
+
+    int slot = -1;
+    for (int i = 0; i < FS_MAX_SNAPSHOTS && slot == -1; i++) {
+        if (sb.snapshots[i].name[0] == '\0') {
+            slot = i;
+        }
+    }
+    if (slot == -1) {
+        fs_printf("NO SPACE\n");
+        fclose(f);
+        return 0;
+    }
+
+    int ok = 0;
+    const int n = header_clusters(&sb);
+    const int chunks = snapshot_chunk_count(&sb);
+    uint8_t *blob = (uint8_t *)calloc(1, metadata_bytes(&sb));
+    uint8_t *header = (uint8_t *)calloc((size_t)n, (size_t)sb.cluster_size);
+    int32_t *map = (int32_t *)malloc((size_t)chunks * sizeof(int32_t));
+    if (!blob || !header || !map || !read_live_metadata(f, &sb, blob)) {
+        goto cleanup;
+    }
+
+    const int data_clusters = data_cluster_count(&sb);
+    const int used = snapshot_clusters_used(f, &sb);
+    const int estimate = store_table_chunks(f, &sb, blob, map, true);
+    const long limit = (long)data_clusters * SNAPSHOT_MAX_PERCENT / 100;
+    if (used < 0 || estimate < 0) {
+        goto cleanup;
+    }
+    if (used + n + estimate > limit) {
+        fs_printf("NO SPACE: snapshot metadata limit %ld clusters (%d%% of data), %d used, %d needed\n", limit,
+                  SNAPSHOT_MAX_PERCENT, used, n + estimate);
+        goto cleanup;
+    }
+
+    const int first = find_free_run(f, &sb, n);
+    if (first == -1) {
+        fs_printf("NO SPACE\n");
+        goto cleanup;
+    }
+
+    /* Úsek se obsadí předem, aby do něj nepadly kopie clusterů s plným čítačem ani úseky tabulky. */
+    for (int i = 0; i < n; i++) {
+        set_bit(f, &sb, false, first + i, true);
+    }
+
+    /* Od teď snapshot drží data svých souborů (včetně adresářových clusterů). */
+    int created = -1;
+    if (ref_metadata_clusters(f, &sb, blob)) {
+        created = store_table_chunks(f, &sb, blob, map, false);
+        if (created == -1) {
+            unref_metadata_clusters(f, &sb, blob, sb.cluster_count);
+        }
+    }
+    if (created == -1) {
+        for (int i = 0; i < n; i++) {
+            set_bit(f, &sb, false, first + i, false);
+        }
+        fs_printf("NO SPACE\n");
+        goto cleanup;
+    }
+
+    const size_t ibm = (size_t)(sb.cluster_count + 7) / 8;
+    memcpy(header, blob + (size_t)sb.cluster_count * sizeof(struct pseudo_inode), ibm);
+    memcpy(header + ibm, map, (size_t)chunks * sizeof(int32_t));
+    for (int i = 0; i < n; i++) {
+        (void)write_cluster(f, &sb, first + i, header + (long)i * sb.cluster_size);
+    }
+
+    struct snapshot_entry *snap = &sb.snapshots[slot];
+    memset(snap, 0, sizeof(*snap));
+    (void)snprintf(snap->name, sizeof(snap->name), "%s", name);
+    snap->first_cluster = first;
+    snap->cluster_count = n;
+
+    (void)write_superblock(f, &sb);
+
+    const int cost = n + created;
+    fs_printf("SNAPSHOT: %d clusters metadata (%ld.%ld%% of data), all snapshots %d of %ld allowed\n", cost,
+              (long)cost * 1000 / data_clusters / 10, (long)cost * 1000 / data_clusters % 10, used + cost, limit);
+    ok = 1;
+
+cleanup:
+    free(blob);
+    free(header);
+    free(map);
+    fclose(f);
+    return ok;
+}
+
+/**
+ * @brief Vypíše snapshoty: jméno, počet obsazených inodů a velikost kopie metadat.
+ *
+ * Velikost zahrnuje i úseky sdílené s jinými snapshoty.
+ */
+void fs_snapshot_list(const char *filename)
+{
+    FILE *f = filename ? fopen(filename, "rb") : NULL;
+    struct superblock sb;
+    if (!f || !load_superblock(f, &sb)) {
+        fs_printf("FILE NOT FOUND\n");
+        if (f) {
+            fclose(f);
+        }
+        return;
+    }
+
+    const int chunks = snapshot_chunk_count(&sb);
+    const size_t ibm_bytes = (size_t)(sb.cluster_count + 7) / 8;
+    uint8_t *ibm = (uint8_t *)malloc(ibm_bytes);
+    int32_t *map = (int32_t *)malloc((size_t)chunks * sizeof(int32_t));
+
+    for (int i = 0; ibm && map && i < FS_MAX_SNAPSHOTS; i++) {
+        const struct snapshot_entry *snap = &sb.snapshots[i];
+        if (snap->name[0] == '\0') {
+            continue;
+        }
+
+        long inodes = 0;
+        if (fs_pread(f, sb.data_start_address + (long)snap->first_cluster * sb.cluster_size, ibm, ibm_bytes)) {
+            for (int id = 0; id < sb.cluster_count; id++) {
+                inodes += inode_used(ibm, id);
+            }
+        }
+        int clusters = snap->cluster_count;
+        if (read_snapshot_map(f, &sb, snap, map)) {
+            for (int c = 0; c < chunks; c++) {
+                clusters += map[c] >= 0;
+            }
+        }
+        fs_printf("%s - %ld i-nodes - %d B metadata\n", snap->name, inodes, clusters * sb.cluster_size);
+    }
+
+    free(ibm);
+    free(map);
+    fclose(f);
+}
+
+/**
+ * @brief Smaže snapshot: odebere jeho odkazy na data a úseky tabulky a uvolní hlavičku.
+ */
+int fs_snapshot_delete(const char *filename, const char *name)
+{
+    struct superblock sb;
+    FILE *f = open_snapshot_fs(filename, &sb);
+    if (!f) {
+        return 0;
+    }
+
+    const int idx = name ? snapshot_find(&sb, name) : -1;
+    if (idx == -1) {
+        fs_printf("SNAPSHOT NOT FOUND\n");
+        fclose(f);
+        return 0;
+    }
+
+    const struct snapshot_entry snap = sb.snapshots[idx];
+    const int chunks = snapshot_chunk_count(&sb);
+    uint8_t *blob = (uint8_t *)malloc(metadata_bytes(&sb));
+    int32_t *map = (int32_t *)malloc((size_t)chunks * sizeof(int32_t));
+    if (!blob || !map || !read_snapshot_metadata(f, &sb, &snap, blob) || !read_snapshot_map(f, &sb, &snap, map)) {
+        free(blob);
+        free(map);
+        fclose(f);
+        return 0;
+    }
+
+    unref_metadata_clusters(f, &sb, blob, sb.cluster_count);
+    free(blob);
+
+    /* sdílený úsek tabulky zůstane ostatním snapshotům */
+    for (int c = 0; c < chunks; c++) {
+        if (map[c] >= 0) {
+            cluster_unref(f, &sb, map[c]);
+        }
+    }
+    free(map);
+    for (int i = 0; i < snap.cluster_count; i++) {
+        cluster_unref(f, &sb, snap.first_cluster + i);
+    }
+
+    memset(&sb.snapshots[idx], 0, sizeof(sb.snapshots[idx]));
+    (void)write_superblock(f, &sb);
+
+    fclose(f);
+    return 1;
+}
+
+/**
+ * @brief Vrátí živý svazek do stavu snapshotu (snapshot zůstává).
+ *
+ * Nejdřív se přidají odkazy pro obnovené inody, teprve pak se odeberou odkazy
+ * současných – společné clustery tak ani na okamžik nejsou volné.
+ */
+int fs_snapshot_rollback(const char *filename, const char *name)
+{
+    struct superblock sb;
+    FILE *f = open_snapshot_fs(filename, &sb);
+    if (!f) {
+        return 0;
+    }
+
+    const int idx = name ? snapshot_find(&sb, name) : -1;
+    if (idx == -1) {
+        fs_printf("SNAPSHOT NOT FOUND\n");
+        fclose(f);
+        return 0;
+    }
+
+    const struct snapshot_entry snap = sb.snapshots[idx];
+    const size_t blob_size = metadata_bytes(&sb);
+    uint8_t *restored = (uint8_t *)malloc(blob_size);
+    uint8_t *live = (uint8_t *)calloc(1, blob_size);
+    if (!restored || !live || !read_snapshot_metadata(f, &sb, &snap, restored) || !read_live_metadata(f, &sb, live)) {
+        free(restored);
+        free(live);
+        fclose(f);
+        return 0;
+    }
+
+    if (!ref_metadata_clusters(f, &sb, restored)) {
+        fs_printf("NO SPACE\n");
+        free(restored);
+        free(live);
+        fclose(f);
+        return 0;
+    }
+    unref_metadata_clusters(f, &sb, live, sb.cluster_count);
+
+    /* snapshot neobsazené inody nenese – do živé tabulky jdou jako po formátu */
+    const size_t table = (size_t)sb.cluster_count * sizeof(struct pseudo_inode);
+    const size_t ibm = (size_t)(sb.cluster_count + 7) / 8;
+    struct pseudo_inode *inodes = (struct pseudo_inode *)restored;
+    for (int id = 0; id < sb.cluster_count; id++) {
+        if (!inode_used(restored + table, id)) {
+            const int32_t none[5] = { CLUSTER_UNUSED, CLUSTER_UNUSED, CLUSTER_UNUSED, CLUSTER_UNUSED, CLUSTER_UNUSED };
+            memset(&inodes[id], 0, sizeof(inodes[id]));
+            inode_set_direct(&inodes[id], none);
+            inodes[id].indirect1 = CLUSTER_UNUSED;
+            inodes[id].indirect2 = CLUSTER_UNUSED;
+        }
+    }
+    (void)fs_pwrite(f, sb.inode_start_address, restored, table);
+    (void)fs_pwrite(f, sb.bitmapi_start_address, restored + table, ibm);
+
+    /* inody a inode bitmapa se vyměnily celé mimo set_bit/write_inode – počítadla znovu */
+    struct fs_counters counters;
+    if (fs_counters_scan(f, &sb, &counters)) {
+        (void)fs_counters_store(f, &sb, &counters);
+    }
+
+    free(restored);
+    free(live);
+    fclose(f);
+    return 1;
+}
@@ -1,7 +1,7 @@
 #define _POSIX_C_SOURCE 200809L /* kvůli strdup (v jiných modulech) */
 /**
  * @file cmd_system.c
- * @brief Systémové příkazy: format, statfs, info.
+ * @brief Systémové příkazy: format, statfs, info, tune, allocbench.
  *
  * Konzervativní refaktoring:
  *  - zachované veřejné funkce a jejich signatury (fs_format, fs_statfs, fs_info, fs_info_path)
@@ -17,9 +17,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "../include/fs_core.h"
 #include "../include/fs_utils.h"
+#include "../include/fs_dedup.h"
+#include "../include/fs_crc.h"
+#include "../include/fs_io.h"
+#include "../include/fs_walk.h"
+#include "../include/fs_out.h"
 
 /* ========================================================================== */
 /* Interní helpery                                                            */
@@ -49,14 +56,6 @@ static int ends_with_ci(const char *s, const char *suffix)
     return 1;
 }
 
-/**
- * @brief Načte celé N bajtů ze souboru (best-effort).
- */
-static int read_exact(FILE *f, void *buf, size_t n)
-{
-    return f && buf && fread(buf, 1, n, f) == n;
-}
-
 /**
  * @brief Zapíše celé N bajtů do souboru (best-effort).
  */
@@ -104,6 +103,9 @@ int fs_format(const char *filename, const char *size_str)
 {
     const long disk_size = parse_size(size_str);
 
+    /* Obraz se přepisuje celý – čekající změny starého obsahu už nemají kam jít. */
+    fs_io_discard();
+
     FILE *f = filename ? fopen(filename, "wb+") : NULL;
     if (!f) {
         return 0;
@@ -116,6 +118,8 @@ int fs_format(const char *filename, const char *size_str)
     strncpy(sb.signature, "rossnerd", sizeof(sb.signature) - 1);
     strncpy(sb.volume_descriptor, "Semestralni prace ZOS 2025", sizeof(sb.volume_descriptor) - 1);
 
+    sb.layout_magic = FS_LAYOUT_MAGIC;
+    sb.layout_version = FS_LAYOUT_VERSION;
     sb.disk_size = (int32_t)disk_size;
     sb.cluster_size = CLUSTER_SIZE;
     sb.cluster_count = (sb.cluster_size > 0) ? (sb.disk_size / sb.cluster_size) : 0;
@@ -126,11 +130,40 @@ int fs_format(const char *filename, const char *size_str)
     sb.bitmap_start_address = sb.bitmapi_start_address + inode_bitmap_size;
 
     const int data_bitmap_size = (sb.cluster_count + 7) / 8;
-    sb.inode_start_address = sb.bitmap_start_address + data_bitmap_size;
+    sb.refcount_start_address = sb.bitmap_start_address + data_bitmap_size;
+
+    /* Tabulka sdílení clusterů (copy-on-write): uint16_t na cluster, na začátku nuly */
+    const long refcount_size = (long)sb.cluster_count * (long)sizeof(uint16_t);
+    sb.crc_start_address = sb.refcount_start_address + (int32_t)refcount_size;
+
+    /* Index deduplikace se obsadí v datové oblasti až příkazem tune dedup on */
+    sb.dedup_start_address = 0;
+    sb.dedup_slots = 0;
+
+    /* Kontrolní součty clusterů: uint32_t na cluster */
+    const long crc_size = (long)sb.cluster_count * (long)sizeof(uint32_t);
+    sb.journal_start_address = sb.crc_start_address + (int32_t)crc_size;
+
+    /* Žurnál: 1/16 clusterů, aspoň FS_JOURNAL_MIN_CLUSTERS; hlavička se založí při prvním commitu */
+    const int journal_clusters = (sb.cluster_count / 16 > FS_JOURNAL_MIN_CLUSTERS) ? sb.cluster_count / 16
+                                                                                  : FS_JOURNAL_MIN_CLUSTERS;
+    sb.journal_size = journal_clusters * sb.cluster_size;
+    sb.inode_start_address = sb.journal_start_address + sb.journal_size;
 
     const long inodes_area_size = (long)sb.cluster_count * (long)sizeof(struct pseudo_inode);
     sb.data_start_address = sb.inode_start_address + (int32_t)inodes_area_size;
 
+    /* Fragment pro konce souborů se otevře až s prvním zabaleným koncem */
+    sb.frag_cluster = CLUSTER_UNUSED;
+    sb.frag_used = 0;
+    sb.features = 0;
+    /* generace pokračuje – jiný proces s cache starého obsahu ji nesmí vidět stejnou */
+    sb.generation = fs_io_generation();
+
+    /* Obsazený je jen kořenový adresář (inode 0, cluster 0) */
+    sb.counters = (struct fs_counters){ .valid = FS_COUNTERS_VALID, .used_inodes = 1, .used_clusters = 1,
+                                        .directories = 1, .logical_bytes = 0 };
+
     if (sb.data_start_address >= sb.disk_size) {
         fclose(f);
         return 0;
@@ -160,6 +193,20 @@ int fs_format(const char *filename, const char *size_str)
     (void)write_exact(f, dbitmap, (size_t)data_bitmap_size);
     free(dbitmap);
 
+    /* Tabulka sdílení i tabulka součtů začínají nulami (stačí jeden buffer té větší) */
+    uint8_t *refcounts = (uint8_t *)calloc(1, (size_t)((crc_size > refcount_size) ? crc_size : refcount_size));
+    if (!refcounts) {
+        fclose(f);
+        return 0;
+    }
+    (void)fseek(f, sb.refcount_start_address, SEEK_SET);
+    (void)write_exact(f, refcounts, (size_t)refcount_size);
+    (void)fseek(f, sb.crc_start_address, SEEK_SET);
+    (void)write_exact(f, refcounts, (size_t)crc_size);
+    free(refcounts);
+
+    /* Žurnál zůstane nulový (soubor je po "wb+" prázdný). */
+
     /* Inody */
     struct pseudo_inode root_inode;
     memset(&root_inode, 0, sizeof(root_inode));
@@ -193,31 +240,27 @@ int fs_format(const char *filename, const char *size_str)
         (void)write_exact(f, &empty_inode, sizeof(empty_inode));
     }
 
-    /* Root data (., ..) */
-    struct directory_item self;
-    memset(&self, 0, sizeof(self));
-    self.inode = 0;
-    strcpy(self.item_name, ".");
-
-    struct directory_item parent;
-    memset(&parent, 0, sizeof(parent));
-    parent.inode = 0;
-    strcpy(parent.item_name, "..");
+    /* Root data (., ..), zbytek clusteru nuly */
+    uint8_t *root_data = (uint8_t *)calloc(1, (size_t)sb.cluster_size);
+    if (!root_data) {
+        fclose(f);
+        return 0;
+    }
+    struct directory_item *items = (struct directory_item *)root_data;
+    items[0].inode = 0;
+    items[0].type = DIR_TYPE_DIR;
+    strcpy(items[0].item_name, ".");
+    items[1].inode = 0;
+    items[1].type = DIR_TYPE_DIR;
+    strcpy(items[1].item_name, "..");
 
     (void)fseek(f, sb.data_start_address, SEEK_SET);
-    (void)write_exact(f, &self, sizeof(self));
-    (void)write_exact(f, &parent, sizeof(parent));
-
-    /* Vyplnění zbytku clusteru nulami */
-    const long used = 2L * (long)sizeof(struct directory_item);
-    const long pad = (long)sb.cluster_size - used;
-    if (pad > 0) {
-        uint8_t *zeros = (uint8_t *)calloc(1, (size_t)pad);
-        if (zeros) {
-            (void)write_exact(f, zeros, (size_t)pad);
-            free(zeros);
-        }
-    }
+    (void)write_exact(f, root_data, (size_t)sb.cluster_size);
+
+    const uint32_t root_crc = fs_crc32c(0, root_data, (size_t)sb.cluster_size);
+    (void)fseek(f, sb.crc_start_address, SEEK_SET);
+    (void)write_exact(f, &root_crc, sizeof(root_crc));
+    free(root_data);
 
     /* Dotáhneme soubor na požadovanou velikost disku */
     (void)fseek(f, disk_size - 1, SEEK_SET);
@@ -231,32 +274,18 @@ int fs_format(const char *filename, const char *size_str)
 /* STATFS + INFO                                                              */
 /* ========================================================================== */
 
-static int bit_is_set(const uint8_t *bm, int idx)
-{
-    return (bm[idx / 8] >> (idx % 8)) & 1;
-}
-
-static long count_set_bits_upto(const uint8_t *bm, long n_bits)
-{
-    long c = 0;
-    for (long i = 0; i < n_bits; i++) {
-        c += bit_is_set(bm, (int)i);
-    }
-    return c;
-}
-
 void fs_statfs(const char *filename)
 {
     FILE *f = filename ? fopen(filename, "rb") : NULL;
     if (!f) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         return;
     }
 
     struct superblock sb;
     if (!load_superblock(f, &sb)) {
         fclose(f);
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         return;
     }
 
@@ -266,69 +295,60 @@ void fs_statfs(const char *filename)
     const long data_cluster_count =
         (sb.disk_size - sb.data_start_address) / (long)sb.cluster_size;
 
-    const long inode_bm_bytes = sb.bitmap_start_address - sb.bitmapi_start_address;
-    const long data_bm_bytes  = sb.inode_start_address - sb.bitmap_start_address;
-
-    if (inode_bm_bytes <= 0 || data_bm_bytes <= 0 || inode_count < 0 || data_cluster_count < 0) {
+    if (inode_count < 0 || data_cluster_count < 0) {
         fclose(f);
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         return;
     }
 
-    uint8_t *ibm = (uint8_t *)malloc((size_t)inode_bm_bytes);
-    uint8_t *dbm = (uint8_t *)malloc((size_t)data_bm_bytes);
-    if (!ibm || !dbm) {
-        free(ibm);
-        free(dbm);
+    /* Počty drží superblock (fs_counters); při neplatných (do fsck --repair) se obraz prochází celý. */
+    struct fs_counters counters = sb.counters;
+    if (counters.valid != FS_COUNTERS_VALID && !fs_counters_scan(f, &sb, &counters)) {
         fclose(f);
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         return;
     }
 
-    (void)fseek(f, sb.bitmapi_start_address, SEEK_SET);
-    (void)read_exact(f, ibm, (size_t)inode_bm_bytes);
-
-    (void)fseek(f, sb.bitmap_start_address, SEEK_SET);
-    (void)read_exact(f, dbm, (size_t)data_bm_bytes);
-
-    const long used_inodes = count_set_bits_upto(ibm, inode_count);
-    const long used_blocks = count_set_bits_upto(dbm, data_cluster_count);
-
+    const long used_inodes = counters.used_inodes;
+    const long used_blocks = counters.used_clusters;
     const long free_inodes = inode_count - used_inodes;
     const long free_blocks = data_cluster_count - used_blocks;
-
-    /* Počet adresářů: projdeme pouze obsazené inody */
-    long dir_count = 0;
-    for (long i = 0; i < inode_count; i++) {
-        if (!bit_is_set(ibm, (int)i)) {
-            continue;
-        }
-        struct pseudo_inode ino;
-        read_inode(f, &sb, (int)i, &ino);
-        if (ino.isDirectory) {
-            dir_count++;
-        }
+    const long dir_count = counters.directories;
+    const long logical_bytes = (long)counters.logical_bytes;
+
+    fs_printf("--- STATFS ---\n");
+    fs_printf("Disk: %d B\n", sb.disk_size);
+    fs_printf("Cluster: %d B\n", sb.cluster_size);
+    fs_printf("Inodes: %ld used, %ld free\n", used_inodes, free_inodes);
+    fs_printf("Blocks: %ld used, %ld free\n", used_blocks, free_blocks);
+    fs_printf("Directories: %ld\n", dir_count);
+    /* logicky = součet velikostí souborů, fyzicky = obsazené clustery (komprese, díry, sdílení) */
+    fs_printf("Data: %ld B logical, %ld B physical\n", logical_bytes, used_blocks * (long)sb.cluster_size);
+    int32_t dedup_first = 0;
+    const int dedup_clusters = dedup_index_clusters(&sb, &dedup_first);
+    if (dedup_clusters > 0) {
+        /* index je mezi obsazenými clustery (a ve fyzické velikosti) */
+        fs_printf("Dedup index: %d clusters\n", dedup_clusters);
     }
 
-    printf("--- STATFS ---\n");
-    printf("Disk: %d B\n", sb.disk_size);
-    printf("Cluster: %d B\n", sb.cluster_size);
-    printf("Inodes: %ld used, %ld free\n", used_inodes, free_inodes);
-    printf("Blocks: %ld used, %ld free\n", used_blocks, free_blocks);
-    printf("Directories: %ld\n", dir_count);
-
-    free(ibm);
-    free(dbm);
     fclose(f);
 }
 
 static void fs_info_print(const char *name, const struct pseudo_inode *inode)
 {
     /* Název – velikost – i-uzel – odkazy (přímé + nepřímé) */
-    printf("%s - %d B - i-node %d\n", name, inode->file_size, inode->nodeid);
+    fs_printf("%s - %d B - i-node %d\n", name, inode->file_size, inode->nodeid);
+
+    /* Inline soubor nemá žádné clustery – oblast odkazů obsahuje data. */
+    if (inode->flags & INODE_FLAG_INLINE) {
+        fs_printf("direct: - (inline)\n");
+        fs_printf("indirect1: -1\n");
+        fs_printf("indirect2: -1\n");
+        return;
+    }
 
     /* přímé odkazy */
-    printf("direct: ");
+    fs_printf("direct: ");
     int first = 1;
     const int32_t d[5] = { inode->direct1, inode->direct2, inode->direct3, inode->direct4, inode->direct5 };
     for (int i = 0; i < 5; i++) {
@@ -336,26 +356,44 @@ static void fs_info_print(const char *name, const struct pseudo_inode *inode)
             continue;
         }
         if (!first) {
-            printf(", ");
+            fs_printf(", ");
+        }
+        if (d[i] == CLUSTER_HOLE) {
+            fs_printf("hole");
+        } else {
+            fs_printf("%d", d[i]);
         }
-        printf("%d", d[i]);
         first = 0;
     }
     if (first) {
-        printf("-");
+        fs_printf("-");
+    }
+    fs_printf("\n");
+
+    /* Komprimovaný soubor – odkazy ukazují na payload, ne přímo na obsah */
+    if (inode->flags & INODE_FLAG_COMPRESSED) {
+        fs_printf("compressed: yes\n");
+    }
+
+    /* Konec ve sdíleném fragmentu – indirect pole nesou (cluster, offset, délka) */
+    if (inode->flags & INODE_FLAG_TAIL) {
+        fs_printf("tail: cluster %d, offset %d, %d B\n",
+                  inode->indirect1, TAIL_OFFSET(inode->indirect2), TAIL_LENGTH(inode->indirect2));
+        fs_printf("indirect1: -1\n");
+        fs_printf("indirect2: -1\n");
+        return;
     }
-    printf("\n");
 
     /* nepřímé odkazy */
-    printf("indirect1: %d\n", inode->indirect1 == CLUSTER_UNUSED ? -1 : inode->indirect1);
-    printf("indirect2: %d\n", inode->indirect2 == CLUSTER_UNUSED ? -1 : inode->indirect2);
+    fs_printf("indirect1: %d\n", inode->indirect1 == CLUSTER_UNUSED ? -1 : inode->indirect1);
+    fs_printf("indirect2: %d\n", inode->indirect2 == CLUSTER_UNUSED ? -1 : inode->indirect2);
 }
 
 void fs_info(const char *filename, int inode_id)
 {
     FILE *f = filename ? fopen(filename, "rb") : NULL;
     if (!f) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         return;
     }
 
@@ -377,7 +415,7 @@ void fs_info_path(const char *filename, const char *path)
 {
     const int inode_id = fs_path_to_inode(filename, path);
     if (inode_id == -1) {
-        printf("PATH NOT FOUND\n");
+        fs_printf("PATH NOT FOUND\n");
         return;
     }
 
@@ -393,7 +431,7 @@ void fs_info_path(const char *filename, const char *path)
 
     FILE *f = filename ? fopen(filename, "rb") : NULL;
     if (!f) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         return;
     }
 
@@ -406,3 +444,202 @@ void fs_info_path(const char *filename, const char *path)
     fclose(f);
     fs_info_print(name, &inode);
 }
+
+/* ========================================================================== */
+/* TUNE                                                                       */
+/* ========================================================================== */
+
+/** Vlastnosti svazku přepínatelné příkazem tune. */
+static const struct {
+    const char *name;
+    uint32_t bit;
+} fs_features[] = {
+    { "compress", FS_FEATURE_COMPRESS },
+    { "dedup", FS_FEATURE_DEDUP },
+};
+
+enum { FS_FEATURE_COUNT = (int)(sizeof(fs_features) / sizeof(fs_features[0])) };
+
+/**
+ * @brief Zapne/vypne vlastnost svazku (tune <feature> on|off).
+ *
+ * Bez feature (NULL) vypíše stav všech vlastností. Změna platí pro nově
+ * zapisovaná data, existující soubory zůstávají, jak byly uloženy.
+ *
+ * @return 1 při úspěchu, 0 při chybě (chybová hláška už je vypsaná).
+ */
+int fs_tune(const char *filename, const char *feature, const char *value)
+{
+    FILE *f = filename ? fopen(filename, "r+b") : NULL;
+    if (!f) {
+        fs_printf("FILE NOT FOUND\n");
+        return 0;
+    }
+
+    struct superblock sb;
+    if (!load_superblock(f, &sb)) {
+        fclose(f);
+        fs_printf("FILE NOT FOUND\n");
+        return 0;
+    }
+
+    if (!feature) {
+        for (int i = 0; i < FS_FEATURE_COUNT; i++) {
+            fs_printf("%s: %s\n", fs_features[i].name, (sb.features & fs_features[i].bit) ? "on" : "off");
+        }
+        fclose(f);
+        return 1;
+    }
+
+    int idx = -1;
+    for (int i = 0; i < FS_FEATURE_COUNT; i++) {
+        if (strcmp(fs_features[i].name, feature) == 0) {
+            idx = i;
+        }
+    }
+
+    const int on = value && strcmp(value, "on") == 0;
+    const int off = value && strcmp(value, "off") == 0;
+    if (idx == -1 || (!on && !off)) {
+        fclose(f);
+        fs_printf("INVALID ARGUMENT\n");
+        return 0;
+    }
+
+    /* Index deduplikace existuje jen se zapnutou deduplikací: zapnutí ho obsadí
+       prázdný (naplní ho nové zápisy nebo příkaz dedupe), vypnutí ho uvolní –
+       vypnutá deduplikace by stejně nehlídala uvolňované clustery. */
+    if (fs_features[idx].bit == FS_FEATURE_DEDUP) {
+        if (on && !dedup_reserve(f, &sb)) {
+            fclose(f);
+            fs_printf("NO SPACE\n");
+            return 0;
+        }
+        if (off) {
+            dedup_release(f, &sb);
+        }
+    }
+
+    if (on) {
+        sb.features |= fs_features[idx].bit;
+    } else {
+        sb.features &= ~fs_features[idx].bit;
+    }
+    write_superblock(f, &sb);
+
+    fclose(f);
+    return 1;
+}
+
+/* ========================================================================== */
+/* ALLOCBENCH                                                                 */
+/* ========================================================================== */
+
+enum {
+    ALLOCBENCH_BATCH = 64,          /* clusterů, které vlákno drží, než je vrátí */
+    ALLOCBENCH_ROUNDS = 256,        /* dávek na vlákno */
+    ALLOCBENCH_MAX_THREADS = 64
+};
+
+struct allocbench_job {
+    FILE *f;
+    struct superblock sb;           /* vlastní kopie (počítadla se v ní přepisují) */
+    long allocated;
+};
+
+static void *allocbench_worker(void *arg)
+{
+    struct allocbench_job *job = (struct allocbench_job *)arg;
+    int held[ALLOCBENCH_BATCH];
+
+    for (int round = 0; round < ALLOCBENCH_ROUNDS; round++) {
+        int n = 0;
+        while (n < ALLOCBENCH_BATCH && (held[n] = alloc_bit(job->f, &job->sb, false)) != -1) {
+            n++;
+        }
+        for (int i = 0; i < n; i++) {
+            set_bit(job->f, &job->sb, false, held[i], false);
+        }
+        job->allocated += n;
+        if (n < ALLOCBENCH_BATCH) {
+            break;  /* plný disk */
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Jeden běh allocbench s daným počtem vláken; vrací počet alokací.
+ */
+static long allocbench_run(FILE *f, const struct superblock *sb, int threads, double *secs)
+{
+    pthread_t tids[ALLOCBENCH_MAX_THREADS];
+    struct allocbench_job jobs[ALLOCBENCH_MAX_THREADS];
+    int started = 0;
+
+    struct timespec t0;
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int t = 0; t < threads; t++) {
+        jobs[t] = (struct allocbench_job){ f, *sb, 0 };
+        if (fs_out_thread(&tids[t], allocbench_worker, &jobs[t]) == 0) {
+            started++;
+        } else {
+            allocbench_worker(&jobs[t]);
+        }
+    }
+    long total = 0;
+    for (int t = 0; t < threads; t++) {
+        if (t < started) {
+            pthread_join(tids[t], NULL);
+        }
+        total += jobs[t].allocated;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    *secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    return total;
+}
+
+/**
+ * @brief Zátěžový test alokátoru clusterů (allocbench [vlákna]).
+ *
+ * Pro 1, 2, 4, ... až max_threads vláken každé vlákno opakovaně obsadí dávku
+ * clusterů (alloc_bit) a zase je uvolní, vypíše propustnost. Obsazenost svazku
+ * se nezmění.
+ */
+int fs_allocbench(const char *filename, int max_threads)
+{
+    FILE *f = filename ? fopen(filename, "r+b") : NULL;
+    if (!f) {
+        fs_printf("FILE NOT FOUND\n");
+        return 0;
+    }
+    struct superblock sb;
+    if (!load_superblock(f, &sb)) {
+        fclose(f);
+        fs_printf("FILE NOT FOUND\n");
+        return 0;
+    }
+
+    if (max_threads <= 0) {
+        const int cpus = fs_walk_threads(ALLOCBENCH_MAX_THREADS);
+        max_threads = (cpus > 4) ? cpus : 4;
+    }
+    if (max_threads > ALLOCBENCH_MAX_THREADS) {
+        max_threads = ALLOCBENCH_MAX_THREADS;
+    }
+
+    for (int threads = 1;; threads = (threads * 2 < max_threads) ? threads * 2 : max_threads) {
+        double secs = 0.0;
+        const long total = allocbench_run(f, &sb, threads, &secs);
+        fs_printf("ALLOCBENCH: %d threads, %ld allocations in %.3f s (%.0f allocs/s)\n", threads, total, secs,
+                  (secs > 0.0) ? (double)total / secs : 0.0);
+        if (threads == max_threads) {
+            break;
+        }
+    }
+
+    fclose(f);
+    return 1;
+}
@@ -0,0 +1,1214 @@
+#define _XOPEN_SOURCE 700 /* nftw */
+/**
+ * @file cmd_tree.c
+ * @brief Rekurzivní příkazy nad celými stromy: incp -r, outcp -r, rm -r, cp -r.
+ *
+ * incp -r <host_adresář> <vfs_adresář>: strom na hostiteli se projde přes nftw,
+ * adresáře se ve VFS založí v jednom průchodu metadaty a soubory se zpracují
+ * po dávkách (IMPORT_BATCH):
+ *   1) hlavní vlákno obsadí inody a clustery pro celé clustery souborů dávky
+ *      (jedno čtení a zápis každé bitmapy, alloc_bits),
+ *   2) pracovní vlákna čtou soubory, obsah zapisují rovnou do vyhrazených clusterů
+ *      (fs_pwrite_data) a počítají kontrolní součty,
+ *   3) hlavní vlákno zapíše inody, konce souborů (fragmenty) a položky adresářů.
+ * S kompresí nebo deduplikací (incp -r -z, tune) se rozložení na disku zná až po
+ * přečtení dat – vlákna pak soubory jen načtou (a zkomprimují) a zápis jde běžnou
+ * cestou přes write_prepared_to_new_inode().
+ *
+ * outcp -r <vfs_adresář> <host_adresář>: hlavní vlákno projde strom ve VFS, založí
+ * adresáře na hostiteli a posbírá soubory. Ty se seřadí podle prvního fyzického
+ * clusteru a vlákna si je berou v tomto pořadí, takže obraz se čte skoro sekvenčně.
+ *
+ * rm -r a cp -r projdou podstrom ve VFS jednou (vfs_tree_collect). rm -r posbírá
+ * všechny inody a odkazy na clustery a bitmapy upraví po celých slovech jedním
+ * zápisem; cp -r obsadí inody i clustery kopie najednou (alloc_bits) a každý
+ * adresář kopie sestaví v paměti a zapíše jedním zápisem clusteru.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ftw.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "../include/fs_core.h"
+#include "../include/fs_utils.h"
+#include "../include/fs_io.h"
+#include "../include/fs_crc.h"
+#include "../include/fs_compress.h"
+#include "../include/fs_walk.h"
+#include "../include/fs_out.h"
+
+enum {
+    IMPORT_MAX_THREADS = 8,     /* platí i pro export */
+    IMPORT_BATCH = 1024,        /* souborů na jednu dávku */
+    IMPORT_MAX_CLUSTERS = 5,    /* přímé odkazy inodu */
+    IMPORT_WALK_FDS = 64        /* otevřených adresářů při průchodu nftw */
+};
+
+/* ========================================================================== */
+/* Průchod stromem na hostiteli                                               */
+/* ========================================================================== */
+
+/** Položka stromu (cesta relativně ke kořeni importu). */
+struct tree_entry {
+    char *rel;
+    bool is_dir;
+    long size;
+    int inode;          /* adresář: id ve VFS, -1 = nezaložen */
+};
+
+struct tree_list {
+    struct tree_entry *items;
+    int count;
+    int cap;
+    size_t root_len;
+};
+
+static _Thread_local struct tree_list *walk_list; /* nftw nemá uživatelský ukazatel */
+
+static int walk_collect(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    if (ftw->level == 0) {
+        return 0;
+    }
+    /* symlinky, zařízení a nečitelné adresáře se vynechají */
+    const bool is_dir = (type == FTW_D);
+    if (!is_dir && !(type == FTW_F && S_ISREG(st->st_mode))) {
+        return 0;
+    }
+
+    struct tree_list *list = walk_list;
+    if (list->count == list->cap) {
+        const int cap = list->cap ? list->cap * 2 : 256;
+        struct tree_entry *items = (struct tree_entry *)realloc(list->items, (size_t)cap * sizeof(*items));
+        if (!items) {
+            return -1;
+        }
+        list->items = items;
+        list->cap = cap;
+    }
+
+    char *rel = strdup(path + list->root_len + 1);
+    if (!rel) {
+        return -1;
+    }
+    list->items[list->count++] = (struct tree_entry){ rel, is_dir, (long)st->st_size, -1 };
+    return 0;
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+    return strcmp(((const struct tree_entry *)a)->rel, ((const struct tree_entry *)b)->rel);
+}
+
+static void tree_list_free(struct tree_list *list)
+{
+    for (int i = 0; i < list->count; i++) {
+        free(list->items[i].rel);
+    }
+    free(list->items);
+}
+
+/**
+ * @brief Inode rodičovského adresáře položky: kořen importu, nebo už založený adresář.
+ *
+ * Seznam je seřazený, takže rodič (prefix cesty) jde najít půlením.
+ */
+static int parent_inode(const struct tree_list *list, const char *rel, int root_inode)
+{
+    const char *slash = strrchr(rel, '/');
+    if (!slash) {
+        return root_inode;
+    }
+
+    char *parent = strndup(rel, (size_t)(slash - rel));
+    if (!parent) {
+        return -1;
+    }
+    const struct tree_entry key = { parent, true, 0, -1 };
+    const struct tree_entry *found = (const struct tree_entry *)bsearch(&key, list->items, (size_t)list->count,
+                                                                        sizeof(key), cmp_entry);
+    free(parent);
+    return (found && found->is_dir) ? found->inode : -1;
+}
+
+/** Jméno položky ve VFS: poslední segment cesty oříznutý jako u incp. */
+static void entry_name(const char *rel, char name[MAX_NAME_LEN])
+{
+    const char *slash = strrchr(rel, '/');
+    (void)snprintf(name, MAX_NAME_LEN, "%s", slash ? slash + 1 : rel);
+}
+
+/* ========================================================================== */
+/* Pracovní vlákna                                                            */
+/* ========================================================================== */
+
+enum import_status {
+    IMPORT_OK,
+    IMPORT_NOT_FOUND,   /* soubor nejde přečíst nebo se mezitím změnila jeho velikost */
+    IMPORT_IO_ERROR
+};
+
+struct import_job {
+    char *host_path;
+    const char *rel;
+    int parent;
+    int inode;
+    long size;
+    int full;                                   /* celé clustery (přímý zápis) */
+    int32_t clusters[IMPORT_MAX_CLUSTERS];      /* vyhrazené clustery */
+    int32_t blocks[IMPORT_MAX_CLUSTERS];        /* výsledek: cluster nebo CLUSTER_HOLE */
+    uint32_t crc[IMPORT_MAX_CLUSTERS];
+    uint8_t *data;                              /* přímý zápis: jen konec, jinak celý obsah */
+    uint8_t *payload;
+    int payload_len;
+    enum import_status status;
+};
+
+struct import_batch {
+    struct import_job *jobs;
+    int count;
+    int next;
+    pthread_mutex_t lock;
+    int fd;                     /* vlastní fd obrazu pro fs_pwrite_data */
+    const struct superblock *sb;
+    bool direct;                /* obsah celých clusterů zapisují vlákna */
+    bool compress;
+};
+
+static bool read_host_file(const char *path, long size, uint8_t **out)
+{
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        return false;
+    }
+    uint8_t *buf = (uint8_t *)malloc(size > 0 ? (size_t)size : 1u);
+    const bool ok = buf && fread(buf, 1, (size_t)size, in) == (size_t)size && fgetc(in) == EOF;
+    fclose(in);
+    if (!ok) {
+        free(buf);
+        return false;
+    }
+    *out = buf;
+    return true;
+}
+
+static void import_file(const struct import_batch *batch, struct import_job *job)
+{
+    const int cs = batch->sb->cluster_size;
+    uint8_t *buf = NULL;
+    if (!read_host_file(job->host_path, job->size, &buf)) {
+        job->status = IMPORT_NOT_FOUND;
+        return;
+    }
+
+    if (!batch->direct) {
+        job->data = buf;
+        if (batch->compress && job->size > INODE_INLINE_MAX) {
+            job->payload = (uint8_t *)malloc((size_t)job->size);
+            job->payload_len = job->payload
+                ? fs_compress_file(buf, (int)job->size, CLUSTER_SIZE, job->payload, (int)job->size)
+                : 0;
+        }
+        return;
+    }
+
+    for (int i = 0; i < job->full; i++) {
+        const uint8_t *chunk = buf + (long)i * cs;
+        if (buffer_is_zero(chunk, (size_t)cs)) {
+            job->blocks[i] = CLUSTER_HOLE;
+            continue;
+        }
+        const long addr = batch->sb->data_start_address + (long)job->clusters[i] * cs;
+        if (!fs_pwrite_data(batch->fd, addr, chunk, (size_t)cs)) {
+            job->status = IMPORT_IO_ERROR;
+            break;
+        }
+        job->blocks[i] = job->clusters[i];
+        job->crc[i] = fs_crc32c(0, chunk, (size_t)cs);
+    }
+
+    /* Konec (a malé soubory celé) zapíše hlavní vlákno. */
+    const long tail = job->size - (long)job->full * cs;
+    if (tail > 0 && job->status == IMPORT_OK) {
+        job->data = (uint8_t *)malloc((size_t)tail);
+        if (job->data) {
+            memcpy(job->data, buf + (long)job->full * cs, (size_t)tail);
+        } else {
+            job->status = IMPORT_IO_ERROR;
+        }
+    }
+    free(buf);
+}
+
+static void *import_worker(void *arg)
+{
+    struct import_batch *batch = (struct import_batch *)arg;
+    for (;;) {
+        pthread_mutex_lock(&batch->lock);
+        const int i = batch->next++;
+        pthread_mutex_unlock(&batch->lock);
+        if (i >= batch->count) {
+            return NULL;
+        }
+        import_file(batch, &batch->jobs[i]);
+    }
+}
+
+/* ========================================================================== */
+/* Zápis metadat (hlavní vlákno)                                              */
+/* ========================================================================== */
+
+/**
+ * @brief Dokončí soubor: inode, konec souboru, položka v rodiči.
+ *
+ * Při chybě uvolní, co soubor obsadil (soubor, který nešel načíst, uvolní release_job).
+ * @return NULL při úspěchu, jinak hláška pro výpis.
+ */
+static const char *finish_file(FILE *f, struct superblock *sb, const struct import_batch *batch,
+                               struct import_job *job)
+{
+    if (job->status != IMPORT_OK) {
+        return (job->status == IMPORT_NOT_FOUND) ? "FILE NOT FOUND (host)" : "NO SPACE";
+    }
+
+    int ok;
+    if (!batch->direct || (job->size > 0 && job->size <= INODE_INLINE_MAX)) {
+        ok = write_prepared_to_new_inode(f, sb, job->inode, job->data, (int)job->size, batch->compress,
+                                         job->payload, job->payload_len);
+    } else {
+        struct pseudo_inode inode = {0};
+        inode.nodeid = job->inode;
+        inode.file_size = (int32_t)job->size;
+        inode.references = 1;
+        inode.isDirectory = false;
+        inode.indirect1 = CLUSTER_UNUSED;
+        inode.indirect2 = CLUSTER_UNUSED;
+
+        int32_t blocks[IMPORT_MAX_CLUSTERS] = { CLUSTER_UNUSED, CLUSTER_UNUSED, CLUSTER_UNUSED,
+                                                CLUSTER_UNUSED, CLUSTER_UNUSED };
+        int n = 0;
+        for (int i = 0; i < job->full; i++) {
+            blocks[n++] = job->blocks[i];
+            if (job->blocks[i] == CLUSTER_HOLE) {
+                set_bit(f, sb, false, job->clusters[i], false); /* rezervace pro nulový cluster */
+            } else {
+                cluster_crc_set(f, sb, job->blocks[i], job->crc[i]);
+            }
+        }
+
+        const int tail = (int)(job->size - (long)job->full * sb->cluster_size);
+        ok = tail == 0 || write_file_tail(f, sb, &inode, blocks, &n, job->data, tail);
+        if (ok) {
+            inode_set_direct(&inode, blocks);
+            write_inode(f, sb, job->inode, &inode);
+        } else {
+            for (int i = 0; i < job->full; i++) {
+                if (job->blocks[i] != CLUSTER_HOLE) {
+                    set_bit(f, sb, false, job->clusters[i], false);
+                }
+            }
+        }
+    }
+
+    char name[MAX_NAME_LEN];
+    entry_name(job->rel, name);
+    if (!ok) {
+        set_bit(f, sb, true, job->inode, false);
+        return "NO SPACE";
+    }
+    if (find_inode_in_dir(f, sb, job->parent, name) != -1) {
+        free_inode_resources(f, sb, job->inode);
+        return "EXIST";
+    }
+
+    struct directory_item item = { .inode = job->inode, .type = DIR_TYPE_FILE };
+    memcpy(item.item_name, name, sizeof(item.item_name));
+    if (!add_directory_item(f, sb, job->parent, &item)) {
+        free_inode_resources(f, sb, job->inode);
+        return "NO SPACE";
+    }
+    return NULL;
+}
+
+/** Vrátí rezervace souboru, který vlákno nedokázalo načíst nebo zapsat. */
+static void release_job(FILE *f, struct superblock *sb, const struct import_job *job)
+{
+    if (job->status == IMPORT_OK) {
+        return;
+    }
+    for (int i = 0; i < job->full; i++) {
+        set_bit(f, sb, false, job->clusters[i], false);
+    }
+    set_bit(f, sb, true, job->inode, false);
+}
+
+/* ========================================================================== */
+/* INCP -r                                                                    */
+/* ========================================================================== */
+
+struct import_stats {
+    int files;
+    int dirs;
+    int failed;
+    long bytes;
+};
+
+static int import_threads(int jobs)
+{
+    const int threads = fs_walk_threads(IMPORT_MAX_THREADS);
+    return (threads < jobs) ? threads : (jobs > 0 ? jobs : 1);
+}
+
+/**
+ * @brief Zpracuje jednu dávku souborů (rezervace -> vlákna -> metadata).
+ * @return false pokud došlo místo (import končí).
+ */
+static bool import_batch_run(FILE *f, struct superblock *sb, const char *filename, struct import_batch *batch,
+                             struct import_stats *stats)
+{
+    /* 1) rezervace: inody a celé clustery všech souborů dávky najednou */
+    int total_clusters = 0;
+    for (int i = 0; i < batch->count; i++) {
+        batch->jobs[i].full = batch->direct ? (int)(batch->jobs[i].size / sb->cluster_size) : 0;
+        total_clusters += batch->jobs[i].full;
+    }
+
+    int32_t *inodes = (int32_t *)malloc((size_t)batch->count * sizeof(int32_t));
+    int32_t *clusters = (int32_t *)malloc((size_t)(total_clusters + 1) * sizeof(int32_t));
+    if (!inodes || !clusters || !alloc_bits(f, sb, true, batch->count, inodes)) {
+        free(inodes);
+        free(clusters);
+        return false;
+    }
+    if (!alloc_direct_bits(f, sb, total_clusters, clusters)) {
+        for (int i = 0; i < batch->count; i++) {
+            set_bit(f, sb, true, inodes[i], false);
+        }
+        free(inodes);
+        free(clusters);
+        return false;
+    }
+
+    for (int i = 0, c = 0; i < batch->count; i++) {
+        batch->jobs[i].inode = inodes[i];
+        for (int k = 0; k < batch->jobs[i].full; k++) {
+            batch->jobs[i].clusters[k] = clusters[c++];
+        }
+    }
+    free(inodes);
+    free(clusters);
+
+    /* 2) obsah souborů ve vláknech */
+    batch->fd = batch->direct ? open(filename, O_RDWR) : -1;
+    if (batch->direct && batch->fd < 0) {
+        for (int i = 0; i < batch->count; i++) {
+            batch->jobs[i].status = IMPORT_IO_ERROR;
+        }
+    } else {
+        const int threads = import_threads(batch->count);
+        pthread_t tid[IMPORT_MAX_THREADS];
+        bool started[IMPORT_MAX_THREADS];
+        batch->next = 0;
+        for (int t = 0; t < threads; t++) {
+            started[t] = fs_out_thread(&tid[t], import_worker, batch) == 0;
+        }
+        import_worker(batch); /* hlavní vlákno pomáhá (a zastoupí vlákna, která nešla vytvořit) */
+        for (int t = 0; t < threads; t++) {
+            if (started[t]) {
+                pthread_join(tid[t], NULL);
+            }
+        }
+    }
+    if (batch->fd >= 0) {
+        close(batch->fd);
+    }
+
+    /* 3) metadata v pořadí souborů */
+    for (int i = 0; i < batch->count; i++) {
+        struct import_job *job = &batch->jobs[i];
+        const char *err = finish_file(f, sb, batch, job);
+        if (err) {
+            release_job(f, sb, job);
+            fs_printf("%s: %s\n", err, job->rel);
+            stats->failed++;
+        } else {
+            stats->files++;
+            stats->bytes += job->size;
+        }
+    }
+    return true;
+}
+
+int fs_incp_tree(const char *filename, const char *host_dir, const char *vfs_dir, bool compress)
+{
+    struct stat st;
+    if (!host_dir || stat(host_dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fs_printf("FILE NOT FOUND (host)\n");
+        return 0;
+    }
+
+    struct timespec t0;
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    /* kořen bez koncových lomítek, ať relativní cesty začínají hned za ním */
+    char root[1024];
+    (void)snprintf(root, sizeof(root), "%s", host_dir);
+    for (size_t len = strlen(root); len > 1 && root[len - 1] == '/'; len--) {
+        root[len - 1] = '\0';
+    }
+
+    FILE *f = fopen(filename, "rb+");
+    struct superblock sb;
+    if (!f || !load_superblock(f, &sb)) {
+        if (f) {
+            fclose(f);
+        }
+        return 0;
+    }
+
+    char parent_path[256];
+    char root_name[128];
+    parse_path(vfs_dir, parent_path, root_name);
+    const int root_parent = fs_path_to_inode(filename, parent_path);
+    if (root_parent == -1 || root_name[0] == '\0') {
+        fs_printf("PATH NOT FOUND\n");
+        fclose(f);
+        return 0;
+    }
+    if (find_inode_in_dir(f, &sb, root_parent, root_name) != -1) {
+        fs_printf("EXIST\n");
+        fclose(f);
+        return 0;
+    }
+
+    struct tree_list list = { NULL, 0, 0, strlen(root) };
+    walk_list = &list;
+    const int walked = nftw(root, walk_collect, IMPORT_WALK_FDS, FTW_PHYS);
+    walk_list = NULL;
+    if (walked != 0) {
+        fs_printf("FILE NOT FOUND (host)\n");
+        tree_list_free(&list);
+        fclose(f);
+        return 0;
+    }
+    qsort(list.items, (size_t)list.count, sizeof(list.items[0]), cmp_entry);
+
+    int ok = 0;
+    struct import_stats stats = { 0, 0, 0, 0 };
+    struct import_job *jobs = (struct import_job *)calloc(IMPORT_BATCH, sizeof(*jobs));
+
+    /* Metadata adresářů v jednom průchodu (rodiče jsou v seřazeném seznamu před dětmi). */
+    struct directory_item item = {
+        .inode = jobs ? new_directory_inode(f, &sb, root_parent) : -1,
+        .type = DIR_TYPE_DIR,
+    };
+    if (item.inode == -1) {
+        fs_printf("NO SPACE\n");
+        goto cleanup;
+    }
+    memcpy(item.item_name, root_name, sizeof(item.item_name));
+    (void)add_directory_item(f, &sb, root_parent, &item);
+    const int root_inode = item.inode;
+
+    for (int i = 0; i < list.count; i++) {
+        struct tree_entry *e = &list.items[i];
+        if (!e->is_dir) {
+            continue;
+        }
+        const int parent = parent_inode(&list, e->rel, root_inode);
+        char name[MAX_NAME_LEN];
+        entry_name(e->rel, name);
+
+        const char *err = NULL;
+        if (parent == -1) {
+            err = "PATH NOT FOUND";
+        } else if (find_inode_in_dir(f, &sb, parent, name) != -1) {
+            err = "EXIST";
+        } else if ((e->inode = new_directory_inode(f, &sb, parent)) == -1) {
+            err = "NO SPACE";
+        } else {
+            struct directory_item dir = { .inode = e->inode, .type = DIR_TYPE_DIR };
+            memcpy(dir.item_name, name, sizeof(dir.item_name));
+            if (!add_directory_item(f, &sb, parent, &dir)) {
+                free_inode_resources(f, &sb, e->inode);
+                e->inode = -1;
+                err = "NO SPACE";
+            }
+        }
+        if (err) {
+            fs_printf("%s: %s\n", err, e->rel);
+            stats.failed++;
+        } else {
+            stats.dirs++;
+        }
+    }
+
+    /* Soubory po dávkách. */
+    struct import_batch batch = {
+        .jobs = jobs,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .fd = -1,
+        .sb = &sb,
+        .direct = !compress && !(sb.features & (FS_FEATURE_COMPRESS | FS_FEATURE_DEDUP)),
+        .compress = compress || (sb.features & FS_FEATURE_COMPRESS),
+    };
+    const long max_size = (long)IMPORT_MAX_CLUSTERS * sb.cluster_size;
+    bool space = true;
+
+    for (int i = 0; i < list.count && space;) {
+        batch.count = 0;
+        for (; i < list.count && batch.count < IMPORT_BATCH; i++) {
+            const struct tree_entry *e = &list.items[i];
+            if (e->is_dir) {
+                continue;
+            }
+            const int parent = parent_inode(&list, e->rel, root_inode);
+            const char *err = (parent == -1) ? "PATH NOT FOUND" : (e->size > max_size) ? "TOO BIG" : NULL;
+            char *host_path = err ? NULL : (char *)malloc(strlen(root) + strlen(e->rel) + 2);
+            if (!err && !host_path) {
+                err = "NO SPACE";
+            }
+            if (err) {
+                fs_printf("%s: %s\n", err, e->rel);
+                stats.failed++;
+                continue;
+            }
+            sprintf(host_path, "%s/%s", root, e->rel);
+            batch.jobs[batch.count++] = (struct import_job){ .host_path = host_path, .rel = e->rel,
+                                                             .parent = parent, .size = e->size };
+        }
+
+        space = import_batch_run(f, &sb, filename, &batch, &stats);
+        if (!space) {
+            fs_printf("NO SPACE\n");
+            stats.failed++;
+        }
+        for (int k = 0; k < batch.count; k++) {
+            free(batch.jobs[k].host_path);
+            free(batch.jobs[k].data);
+            free(batch.jobs[k].payload);
+        }
+    }
+    pthread_mutex_destroy(&batch.lock);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    if (secs <= 0.0) {
+        secs = 1e-9;
+    }
+    fs_printf("INCP: %d files, %d directories, %ld B in %.3f s (%.0f files/s, %.1f MB/s, %d threads)\n",
+              stats.files, stats.dirs + 1, stats.bytes, secs, (double)stats.files / secs,
+              (double)stats.bytes / secs / 1e6, import_threads(IMPORT_BATCH));
+    ok = stats.failed == 0;
+
+cleanup:
+    free(jobs);
+    tree_list_free(&list);
+    fclose(f);
+    return ok;
+}
+
+/* ========================================================================== */
+/* Průchod podstromem ve VFS (outcp -r, rm -r, cp -r)                         */
+/* ========================================================================== */
+
+/**
+ * Uzel podstromu. Seznam vzniká průchodem do šířky: kořen je na indexu 0, rodič
+ * je vždy před dětmi a děti jednoho adresáře leží v seznamu za sebou.
+ */
+struct vfs_node {
+    int inode_id;
+    int parent;                 /* index rodiče, -1 = kořen */
+    int first_child;
+    int child_count;
+    char name[MAX_NAME_LEN];
+    struct pseudo_inode inode;
+    int new_inode;              /* cp -r: id kopie */
+    bool failed;
+};
+
+struct vfs_tree {
+    struct vfs_node *nodes;
+    int count;
+    int cap;
+};
+
+static bool vfs_tree_push(struct vfs_tree *tree, FILE *f, struct superblock *sb, int inode_id, int parent,
+                          const char *name)
+{
+    if (tree->count == tree->cap) {
+        const int cap = tree->cap ? tree->cap * 2 : 256;
+        struct vfs_node *nodes = (struct vfs_node *)realloc(tree->nodes, (size_t)cap * sizeof(*nodes));
+        if (!nodes) {
+            return false;
+        }
+        tree->nodes = nodes;
+        tree->cap = cap;
+    }
+
+    struct vfs_node *node = &tree->nodes[tree->count++];
+    *node = (struct vfs_node){ .inode_id = inode_id, .parent = parent, .new_inode = -1 };
+    (void)snprintf(node->name, sizeof(node->name), "%s", name);
+    read_inode(f, sb, inode_id, &node->inode);
+    return true;
+}
+
+/**
+ * @brief Načte podstrom od root_inode jedním průchodem přes metadata.
+ *
+ * Každý adresář se přečte jednou; adresář odkazovaný podruhé (poškozený obraz)
+ * se přeskočí, aby průchod nezacyklil.
+ * @return false při nedostatku paměti.
+ */
+static bool vfs_tree_collect(FILE *f, struct superblock *sb, int root_inode, const char *root_name,
+                             struct vfs_tree *tree)
+{
+    const int items_per_cluster = (int)(sb->cluster_size / sizeof(struct directory_item));
+    struct directory_item *items = (struct directory_item *)malloc((size_t)sb->cluster_size);
+    bool *visited = (bool *)calloc((size_t)sb->cluster_count, sizeof(bool));
+    bool ok = items && visited && root_inode >= 0 && root_inode < sb->cluster_count &&
+              vfs_tree_push(tree, f, sb, root_inode, -1, root_name);
+    if (ok) {
+        visited[root_inode] = true;
+    }
+
+    for (int i = 0; ok && i < tree->count; i++) {
+        if (!tree->nodes[i].inode.isDirectory) {
+            continue;
+        }
+        int32_t blocks[IMPORT_MAX_CLUSTERS];
+        inode_get_direct(&tree->nodes[i].inode, blocks);
+        tree->nodes[i].first_child = tree->count;
+
+        for (int b = 0; ok && b < IMPORT_MAX_CLUSTERS; b++) {
+            if (blocks[b] == CLUSTER_UNUSED || blocks[b] == CLUSTER_HOLE ||
+                !read_cluster(f, sb, blocks[b], (uint8_t *)items)) {
+                continue;
+            }
+            for (int j = 0; ok && j < items_per_cluster; j++) {
+                const struct directory_item *item = &items[j];
+                if (item->item_name[0] == '\0' || strcmp(item->item_name, ".") == 0 ||
+                    strcmp(item->item_name, "..") == 0 || item->inode < 0 ||
+                    item->inode >= sb->cluster_count || visited[item->inode]) {
+                    continue;
+                }
+                char name[MAX_NAME_LEN];
+                (void)snprintf(name, sizeof(name), "%s", item->item_name);
+                ok = vfs_tree_push(tree, f, sb, item->inode, i, name);
+                /* soubory smí být odkazované víckrát, adresáře ne */
+                if (ok && tree->nodes[tree->count - 1].inode.isDirectory) {
+                    visited[item->inode] = true;
+                }
+            }
+        }
+        tree->nodes[i].child_count = tree->count - tree->nodes[i].first_child;
+    }
+
+    free(items);
+    free(visited);
+    return ok;
+}
+
+/**
+ * @brief Uvolní inody a clustery celého podstromu: odkazy na clustery se posbírají
+ *        a bitmapy se zapíšou každá jednou (cluster_unref_batch, clear_bits).
+ */
+static void vfs_tree_release(FILE *f, struct superblock *sb, const struct vfs_tree *tree)
+{
+    int32_t *inodes = (int32_t *)malloc((size_t)tree->count * sizeof(int32_t));
+    int32_t *clusters = (int32_t *)malloc((size_t)tree->count * 6 * sizeof(int32_t));
+    if (!inodes || !clusters) {
+        /* bez paměti na dávku aspoň po jednom */
+        for (int i = 0; i < tree->count; i++) {
+            free_inode_resources(f, sb, tree->nodes[i].inode_id);
+        }
+        free(inodes);
+        free(clusters);
+        return;
+    }
+
+    int cluster_count = 0;
+    for (int i = 0; i < tree->count; i++) {
+        inodes[i] = tree->nodes[i].inode_id;
+        cluster_count += inode_cluster_list(&tree->nodes[i].inode, clusters + cluster_count);
+    }
+
+    cluster_unref_batch(f, sb, clusters, cluster_count);
+    (void)clear_bits(f, sb, true, inodes, tree->count);
+    free(inodes);
+    free(clusters);
+}
+
+static void vfs_tree_free(struct vfs_tree *tree)
+{
+    free(tree->nodes);
+    tree->nodes = NULL;
+    tree->count = 0;
+    tree->cap = 0;
+}
+
+/* ========================================================================== */
+/* OUTCP -r                                                                   */
+/* ========================================================================== */
+
+struct export_job {
+    char *host_path;
+    const char *rel;            /* ukazuje do host_path za kořen exportu */
+    struct pseudo_inode inode;
+    int32_t first_cluster;      /* řadicí klíč, -1 = bez datových clusterů */
+    int result;                 /* export_inode() */
+};
+
+struct export_queue {
+    struct export_job *jobs;
+    int count;
+    int next;
+    pthread_mutex_t lock;
+    const char *filename;
+    const struct superblock *sb;
+};
+
+/** První fyzický cluster s daty souboru (přímý odkaz, jinak fragment s koncem). */
+static int32_t first_data_cluster(const struct pseudo_inode *inode)
+{
+    int32_t clusters[6];
+    return (inode_cluster_list(inode, clusters) > 0) ? clusters[0] : -1;
+}
+
+static int cmp_export_job(const void *a, const void *b)
+{
+    const struct export_job *x = (const struct export_job *)a;
+    const struct export_job *y = (const struct export_job *)b;
+    if (x->first_cluster != y->first_cluster) {
+        return (x->first_cluster < y->first_cluster) ? -1 : 1;
+    }
+    return (x->inode.nodeid < y->inode.nodeid) ? -1 : (x->inode.nodeid > y->inode.nodeid);
+}
+
+/** Vytvoří adresář na hostiteli; už existující adresář nevadí. */
+static bool make_host_dir(const char *path)
+{
+    struct stat st;
+    return mkdir(path, 0755) == 0 || (errno == EEXIST && stat(path, &st) == 0 && S_ISDIR(st.st_mode));
+}
+
+static void *export_worker(void *arg)
+{
+    struct export_queue *q = (struct export_queue *)arg;
+    FILE *f = fopen(q->filename, "rb");   /* vlastní FILE *, čte se přes pread */
+    struct superblock sb = *q->sb;
+
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        const int i = q->next++;
+        pthread_mutex_unlock(&q->lock);
+        if (i >= q->count) {
+            break;
+        }
+        struct export_job *job = &q->jobs[i];
+        job->result = f ? export_inode(f, &sb, &job->inode, job->host_path) : 0;
+    }
+
+    if (f) {
+        fclose(f);
+    }
+    return NULL;
+}
+
+int fs_outcp_tree(const char *filename, const char *vfs_dir, const char *host_dir)
+{
+    struct timespec t0;
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    FILE *f = fopen(filename, "rb");
+    struct superblock sb;
+    if (!f || !load_superblock(f, &sb)) {
+        if (f) {
+            fclose(f);
+        }
+        fs_printf("FILE NOT FOUND\n");
+        return 0;
+    }
+
+    int ok = 0;
+    struct vfs_tree tree = { NULL, 0, 0 };
+    char **paths = NULL;
+    struct export_queue q = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .filename = filename,
+        .sb = &sb,
+    };
+
+    const int root_inode = fs_path_to_inode(filename, vfs_dir);
+    if (root_inode == -1 || !vfs_tree_collect(f, &sb, root_inode, "", &tree) || !tree.nodes[0].inode.isDirectory) {
+        fs_printf("FILE NOT FOUND\n");
+        goto cleanup;
+    }
+
+    /* kořen bez koncových lomítek, ať relativní cesty začínají hned za ním */
+    char host_root[1024];
+    (void)snprintf(host_root, sizeof(host_root), "%s", host_dir);
+    for (size_t len = strlen(host_root); len > 1 && host_root[len - 1] == '/'; len--) {
+        host_root[len - 1] = '\0';
+    }
+    const size_t root_len = strlen(host_root);
+
+    paths = (char **)calloc((size_t)tree.count, sizeof(char *));
+    q.jobs = (struct export_job *)malloc((size_t)tree.count * sizeof(*q.jobs));
+    if (!paths || !q.jobs || !(paths[0] = strdup(host_root))) {
+        goto cleanup;
+    }
+    if (!make_host_dir(host_root)) {
+        fs_printf("CANNOT CREATE FILE\n");
+        goto cleanup;
+    }
+
+    /* 1) adresáře na hostiteli (rodiče jsou v seznamu před dětmi) a seznam souborů */
+    struct import_stats stats = { 0, 0, 0, 0 };
+    for (int i = 1; i < tree.count; i++) {
+        struct vfs_node *node = &tree.nodes[i];
+        const char *parent_path = paths[node->parent];
+        if (!parent_path) {
+            continue;   /* rodič se nepovedl, podstrom se přeskočí */
+        }
+        paths[i] = (char *)malloc(strlen(parent_path) + strlen(node->name) + 2);
+        if (!paths[i]) {
+            stats.failed++;
+            continue;
+        }
+        sprintf(paths[i], "%s/%s", parent_path, node->name);
+
+        if (!node->inode.isDirectory) {
+            q.jobs[q.count++] = (struct export_job){ paths[i], paths[i] + root_len + 1, node->inode,
+                                                     first_data_cluster(&node->inode), 0 };
+            paths[i] = NULL;    /* cestu teď vlastní úloha */
+        } else if (make_host_dir(paths[i])) {
+            stats.dirs++;
+        } else {
+            fs_printf("CANNOT CREATE FILE: %s\n", paths[i] + root_len + 1);
+            stats.failed++;
+            free(paths[i]);
+            paths[i] = NULL;
+        }
+    }
+
+    /* 2) obsah souborů ve vláknech, v pořadí fyzických clusterů */
+    qsort(q.jobs, (size_t)q.count, sizeof(q.jobs[0]), cmp_export_job);
+    const int threads = import_threads(q.count);
+    pthread_t tid[IMPORT_MAX_THREADS];
+    bool started[IMPORT_MAX_THREADS];
+    for (int t = 0; t < threads; t++) {
+        started[t] = fs_out_thread(&tid[t], export_worker, &q) == 0;
+    }
+    export_worker(&q); /* hlavní vlákno pomáhá */
+    for (int t = 0; t < threads; t++) {
+        if (started[t]) {
+            pthread_join(tid[t], NULL);
+        }
+    }
+
+    for (int i = 0; i < q.count; i++) {
+        const struct export_job *job = &q.jobs[i];
+        if (job->result > 0) {
+            stats.files++;
+            stats.bytes += job->inode.file_size;
+        } else {
+            fs_printf("%s: %s\n", (job->result < 0) ? "CANNOT CREATE FILE" : "READ ERROR", job->rel);
+            stats.failed++;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    if (secs <= 0.0) {
+        secs = 1e-9;
+    }
+    fs_printf("OUTCP: %d files, %d directories, %ld B in %.3f s (%.0f files/s, %.1f MB/s, %d threads)\n",
+              stats.files, stats.dirs + 1, stats.bytes, secs, (double)stats.files / secs,
+              (double)stats.bytes / secs / 1e6, threads);
+    ok = stats.failed == 0;
+
+cleanup:
+    for (int i = 0; paths && i < tree.count; i++) {
+        free(paths[i]);
+    }
+    for (int i = 0; q.jobs && i < q.count; i++) {
+        free(q.jobs[i].host_path);
+    }
+    free(paths);
+    free(q.jobs);
+    vfs_tree_free(&tree);
+    pthread_mutex_destroy(&q.lock);
+    fclose(f);
+    return ok;
+}
+
+/* ========================================================================== */
+/* RM -r                                                                      */
+/* ========================================================================== */
+
+int fs_rm_tree(const char *filename, const char *path)
+{
+    FILE *f = fopen(filename, "rb+");
+    struct superblock sb;
+    if (!f || !load_superblock(f, &sb)) {
+        if (f) {
+            fclose(f);
+        }
+        return 0;
+    }
+
+    char parent_path[256];
+    char name[128];
+    parse_path(path, parent_path, name);
+
+    const int parent_id = fs_path_to_inode(filename, parent_path);
+    const int inode_id = (parent_id == -1 || name[0] == '\0') ? -1 : find_inode_in_dir(f, &sb, parent_id, name);
+    if (inode_id == -1) {
+        fs_printf("FILE NOT FOUND\n");
+        fclose(f);
+        return 0;
+    }
+
+    /* 1) jeden průchod metadaty podstromu */
+    struct vfs_tree tree = { NULL, 0, 0 };
+    int ok = vfs_tree_collect(f, &sb, inode_id, name, &tree);
+
+    /* 2) odpojení od rodiče, pak uvolnění všeho najednou */
+    if (ok) {
+        (void)remove_directory_item(f, &sb, parent_id, name);
+        vfs_tree_release(f, &sb, &tree);
+    }
+
+    vfs_tree_free(&tree);
+    fclose(f);
+    return ok;
+}
+
+/* ========================================================================== */
+/* CP -r                                                                      */
+/* ========================================================================== */
+
+/** Počet clusterů, které kopie uzlu potřebuje dopředu (bez konce ve fragmentu). */
+static int node_cluster_need(const struct vfs_node *node)
+{
+    if (node->inode.isDirectory) {
+        return 1;
+    }
+    int32_t clusters[6];
+    const int count = inode_cluster_list(&node->inode, clusters);
+    return (node->inode.flags & INODE_FLAG_TAIL) ? count - 1 : count;
+}
+
+/**
+ * @brief Zkopíruje soubor fyzicky: přímé clustery do vyhrazených clusterů (díry
+ *        zůstanou dírami), konec ve fragmentu do nového fragmentu.
+ *
+ * Rozložení i příznaky inodu se zachovají, takže stejně funguje i komprimovaný
+ * soubor (payload se kopíruje tak, jak leží na disku).
+ */
+static bool copy_file_node(FILE *f, struct superblock *sb, const struct vfs_node *node, const int32_t *reserved,
+                           uint8_t *buf)
+{
+    struct pseudo_inode copy = node->inode;
+    copy.nodeid = node->new_inode;
+
+    if (!(copy.flags & INODE_FLAG_INLINE)) {
+        int32_t blocks[IMPORT_MAX_CLUSTERS];
+        inode_get_direct(&node->inode, blocks);
+
+        int n = 0;
+        int r = 0;
+        for (; n < IMPORT_MAX_CLUSTERS && blocks[n] != CLUSTER_UNUSED; n++) {
+            if (blocks[n] == CLUSTER_HOLE) {
+                continue;
+            }
+            if (!read_cluster(f, sb, blocks[n], buf) || !write_cluster(f, sb, reserved[r], buf)) {
+                return false;
+            }
+            blocks[n] = reserved[r++];
+        }
+
+        if (copy.flags & INODE_FLAG_TAIL) {
+            copy.flags &= (uint8_t)~INODE_FLAG_TAIL;
+            copy.indirect1 = CLUSTER_UNUSED;
+            copy.indirect2 = CLUSTER_UNUSED;
+            if (!read_cluster(f, sb, node->inode.indirect1, buf) ||
+                !write_file_tail(f, sb, &copy, blocks, &n, buf + TAIL_OFFSET(node->inode.indirect2),
+                                 TAIL_LENGTH(node->inode.indirect2))) {
+                return false;
+            }
+        }
+        inode_set_direct(&copy, blocks);
+    }
+
+    write_inode(f, sb, copy.nodeid, &copy);
+    return true;
+}
+
+/** Zapíše adresář kopie: inode a jediný cluster s "." / ".." a zkopírovanými dětmi. */
+static void write_dir_node(FILE *f, struct superblock *sb, const struct vfs_tree *tree, int index,
+                           int32_t cluster, int parent_inode, uint8_t *buf)
+{
+    const struct vfs_node *node = &tree->nodes[index];
+    struct directory_item *items = (struct directory_item *)buf;
+    const int items_per_cluster = (int)(sb->cluster_size / sizeof(struct directory_item));
+    memset(buf, 0, (size_t)sb->cluster_size);
+
+    items[0].inode = node->new_inode;
+    items[0].type = DIR_TYPE_DIR;
+    strcpy(items[0].item_name, ".");
+    items[1].inode = parent_inode;
+    items[1].type = DIR_TYPE_DIR;
+    strcpy(items[1].item_name, "..");
+
+    int used = 2;
+    for (int c = node->first_child; c < node->first_child + node->child_count && used < items_per_cluster; c++) {
+        const struct vfs_node *child = &tree->nodes[c];
+        if (child->failed) {
+            continue;
+        }
+        items[used].inode = child->new_inode;
+        items[used].type = child->inode.isDirectory ? DIR_TYPE_DIR : DIR_TYPE_FILE;
+        memcpy(items[used].item_name, child->name, sizeof(items[used].item_name));
+        used++;
+    }
+
+    write_directory_inode(f, sb, node->new_inode, cluster, buf);
+}
+
+int fs_cp_tree(const char *filename, const char *src, const char *dest)
+{
+    FILE *f = fopen(filename, "rb+");
+    struct superblock sb;
+    if (!f || !load_superblock(f, &sb)) {
+        if (f) {
+            fclose(f);
+        }
+        return 0;
+    }
+
+    const int src_id = fs_path_to_inode(filename, src);
+    if (src_id == -1) {
+        fs_printf("FILE NOT FOUND\n");
+        fclose(f);
+        return 0;
+    }
+    struct pseudo_inode src_inode;
+    read_inode(f, &sb, src_id, &src_inode);
+    if (!src_inode.isDirectory) {
+        fclose(f);
+        return fs_cp(filename, src, dest); /* cp -r souboru = obyčejné cp */
+    }
+
+    char parent_path[256];
+    char name[128];
+    parse_path(dest, parent_path, name);
+    const int dest_parent = fs_path_to_inode(filename, parent_path);
+    if (dest_parent == -1 || name[0] == '\0') {
+        fs_printf("PATH NOT FOUND\n");
+        fclose(f);
+        return 0;
+    }
+    if (find_inode_in_dir(f, &sb, dest_parent, name) != -1) {
+        fs_printf("EXIST\n");
+        fclose(f);
+        return 0;
+    }
+
+    int ok = 0;
+    struct vfs_tree tree = { NULL, 0, 0 };
+    int32_t *inodes = NULL;
+    int32_t *clusters = NULL;
+    int32_t *release = NULL;
+    uint8_t *buf = (uint8_t *)malloc((size_t)sb.cluster_size);
+
+    /* 1) jeden průchod metadaty zdroje, pak rezervace všech inodů a clusterů najednou */
+    if (!buf || !vfs_tree_collect(f, &sb, src_id, name, &tree)) {
+        goto cleanup;
+    }
+    int total_clusters = 0;
+    for (int i = 0; i < tree.count; i++) {
+        total_clusters += node_cluster_need(&tree.nodes[i]);
+    }
+
+    inodes = (int32_t *)malloc((size_t)tree.count * sizeof(int32_t));
+    clusters = (int32_t *)malloc((size_t)(total_clusters + 1) * sizeof(int32_t));
+    release = (int32_t *)malloc((size_t)(total_clusters + 1) * sizeof(int32_t));
+    if (!inodes || !clusters || !release) {
+        goto cleanup;
+    }
+    if (!alloc_bits(f, &sb, true, tree.count, inodes)) {
+        fs_printf("NO SPACE\n");
+        goto cleanup;
+    }
+    if (!alloc_bits(f, &sb, false, total_clusters, clusters)) {
+        (void)clear_bits(f, &sb, true, inodes, tree.count);
+        fs_printf("NO SPACE\n");
+        goto cleanup;
+    }
+
+    /* 2) obsah souborů; nepovedený soubor v kopii chybí a jeho rezervace se vrátí */
+    int failed_inodes = 0;
+    int release_count = 0;
+    bool complete = true;
+    for (int i = 0, c = 0; i < tree.count; i++) {
+        struct vfs_node *node = &tree.nodes[i];
+        node->new_inode = inodes[i];
+        const int need = node_cluster_need(node);
+        if (!node->inode.isDirectory && !copy_file_node(f, &sb, node, clusters + c, buf)) {
+            node->failed = true;
+            complete = false;
+            inodes[failed_inodes++] = node->new_inode;
+            memcpy(release + release_count, clusters + c, (size_t)need * sizeof(int32_t));
+            release_count += need;
+        }
+        c += need;
+    }
+
+    /* 3) adresáře kopie: každý cluster se sestaví v paměti a zapíše jednou */
+    for (int i = 0, c = 0; i < tree.count; i++) {
+        const struct vfs_node *node = &tree.nodes[i];
+        if (node->inode.isDirectory) {
+            const int parent_inode = (i == 0) ? dest_parent : tree.nodes[node->parent].new_inode;
+            write_dir_node(f, &sb, &tree, i, clusters[c], parent_inode, buf);
+        }
+        c += node_cluster_need(node);
+    }
+    (void)clear_bits(f, &sb, true, inodes, failed_inodes);
+    (void)clear_bits(f, &sb, false, release, release_count);
+
+    /* 4) připojení kopie; při neúspěchu se celá kopie zase uvolní */
+    struct directory_item item = { .inode = tree.nodes[0].new_inode, .type = DIR_TYPE_DIR };
+    memcpy(item.item_name, name, sizeof(item.item_name));
+    if (!add_directory_item(f, &sb, dest_parent, &item)) {
+        struct vfs_tree copy = { NULL, 0, 0 };
+        if (vfs_tree_collect(f, &sb, item.inode, name, &copy)) {
+            vfs_tree_release(f, &sb, &copy);
+        }
+        vfs_tree_free(&copy);
+        fs_printf("NO SPACE\n");
+        goto cleanup;
+    }
+    ok = complete;
+
+cleanup:
+    free(buf);
+    free(inodes);
+    free(clusters);
+    free(release);
+    vfs_tree_free(&tree);
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,454 @@
+/**
+ * @file cmd_walk.c
+ * @brief Příkazy nad celým podstromem jen pro čtení: du, find, tree.
+ *
+ * Všechny jdou přes fs_walk (fs_walk.h): tabulka inodů se načte jedním čtením
+ * a adresáře prochází pool vláken. Každé vlákno sbírá výsledky do vlastního
+ * bufferu (bez zámků), po doběhnutí se sloučí a seřadí podle cesty – výstup tak
+ * nezávisí na počtu vláken ani na tom, kdo co ukradl.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../include/fs_core.h"
+#include "../include/fs_utils.h"
+#include "../include/fs_walk.h"
+#include "../include/fs_out.h"
+
+/* ========================================================================== */
+/* Společné helpery                                                           */
+/* ========================================================================== */
+
+/**
+ * @brief Najde kořen průchodu a načte jeho inode. Při chybě vypíše PATH NOT FOUND.
+ */
+static bool walk_root(const char *filename, const char *path, struct superblock *sb, int *inode_id,
+                      struct pseudo_inode *inode)
+{
+    *inode_id = fs_path_to_inode(filename, path);
+    FILE *f = (*inode_id == -1) ? NULL : fopen(filename, "rb");
+    if (!f || !load_superblock(f, sb)) {
+        if (f) {
+            fclose(f);
+        }
+        fs_printf("PATH NOT FOUND\n");
+        return false;
+    }
+    read_inode(f, sb, *inode_id, inode);
+    fclose(f);
+    return true;
+}
+
+/** Cesta položky: rodič + "/" + jméno. */
+static char *entry_path(const struct walk_entry *entry)
+{
+    const size_t len = strlen(entry->dir_path) + strlen(entry->name) + 2;
+    char *path = (char *)malloc(len);
+    if (path) {
+        (void)snprintf(path, len, "%s/%s", entry->dir_path, entry->name);
+    }
+    return path;
+}
+
+/** Obsazené místo v bajtech: celé clustery (bez děr) + délka konce ve fragmentu. */
+static long physical_bytes(const struct superblock *sb, const struct pseudo_inode *inode)
+{
+    if (inode->flags & INODE_FLAG_INLINE) {
+        return 0;
+    }
+    int32_t blocks[5];
+    inode_get_direct(inode, blocks);
+    long bytes = 0;
+    for (int b = 0; b < 5; b++) {
+        if (blocks[b] != CLUSTER_UNUSED && blocks[b] != CLUSTER_HOLE) {
+            bytes += sb->cluster_size;
+        }
+    }
+    if (inode->flags & INODE_FLAG_TAIL) {
+        bytes += TAIL_LENGTH(inode->indirect2);
+    }
+    return bytes;
+}
+
+/** Seznam cest (jeden na vlákno). */
+struct path_list {
+    char **items;
+    int count;
+    int cap;
+};
+
+static bool path_list_push(struct path_list *list, char *path)
+{
+    if (!path) {
+        return false;
+    }
+    if (list->count == list->cap) {
+        const int cap = list->cap ? list->cap * 2 : 64;
+        char **items = (char **)realloc(list->items, (size_t)cap * sizeof(char *));
+        if (!items) {
+            free(path);
+            return false;
+        }
+        list->items = items;
+        list->cap = cap;
+    }
+    list->items[list->count++] = path;
+    return true;
+}
+
+static int cmp_path(const void *a, const void *b)
+{
+    return fs_walk_path_cmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/**
+ * @brief Spojí seznamy vláken do lists[0] a seřadí ho (průchod do hloubky podle jmen).
+ */
+static bool path_lists_merge(struct path_list *lists, int threads, int (*cmp)(const void *, const void *))
+{
+    bool ok = true;
+    for (int t = 1; t < threads; t++) {
+        for (int i = 0; i < lists[t].count; i++) {
+            if (ok) {
+                ok = path_list_push(&lists[0], lists[t].items[i]);
+            } else {
+                free(lists[t].items[i]);
+            }
+        }
+        free(lists[t].items);
+        lists[t] = (struct path_list){ NULL, 0, 0 };
+    }
+    if (lists[0].count > 1) {
+        qsort(lists[0].items, (size_t)lists[0].count, sizeof(char *), cmp);
+    }
+    return ok;
+}
+
+static void path_lists_free(struct path_list *lists, int threads)
+{
+    for (int t = 0; t < threads; t++) {
+        for (int i = 0; i < lists[t].count; i++) {
+            free(lists[t].items[i]);
+        }
+        free(lists[t].items);
+    }
+}
+
+/* ========================================================================== */
+/* du                                                                         */
+/* ========================================================================== */
+
+struct du_sum {
+    long files;
+    long dirs;
+    long logical;
+    long physical;
+};
+
+struct du_state {
+    const struct superblock *sb;
+    int top_count;
+    struct du_sum *sums;                /* [vlákno][top] */
+    char (*top_names)[MAX_NAME_LEN];    /* jméno přímého potomka, "" = není adresář */
+};
+
+static void du_visit(void *arg, int thread, const struct walk_entry *entry)
+{
+    struct du_state *st = (struct du_state *)arg;
+    if (!entry->inode || entry->repeat) {
+        return; /* poškozená položka (hlásí fsck) */
+    }
+    struct du_sum *sum = &st->sums[thread * st->top_count + entry->top];
+    const struct pseudo_inode *inode = entry->inode;
+
+    if (entry->depth == 1) {
+        if (inode->isDirectory) {
+            (void)snprintf(st->top_names[entry->top], MAX_NAME_LEN, "%s", entry->name);
+        }
+    } else if (inode->isDirectory) {
+        sum->dirs++;    /* přímý potomek se nepočítá do vlastního řádku */
+    }
+    if (!inode->isDirectory) {
+        sum->files++;
+        sum->logical += inode->file_size;
+    }
+    sum->physical += physical_bytes(st->sb, inode);
+}
+
+static void du_print(const char *path, const struct du_sum *sum)
+{
+    fs_printf("%s: %ld files, %ld directories, %ld B logical, %ld B physical\n", path, sum->files, sum->dirs,
+              sum->logical, sum->physical);
+}
+
+int fs_du(const char *filename, const char *path)
+{
+    struct superblock sb;
+    struct pseudo_inode root;
+    int root_inode;
+    if (!walk_root(filename, path, &sb, &root_inode, &root)) {
+        return 0;
+    }
+
+    struct du_sum total = { 0, 0, 0, physical_bytes(&sb, &root) };
+    if (!root.isDirectory) {
+        total.files = 1;
+        total.logical = root.file_size;
+        du_print(path, &total);
+        return 1;
+    }
+
+    int ok = 0;
+    const int threads = fs_walk_threads(WALK_MAX_THREADS);
+    struct du_state st = {
+        .sb = &sb,
+        .top_count = 5 * (int)(sb.cluster_size / sizeof(struct directory_item)),
+    };
+    st.sums = (struct du_sum *)calloc((size_t)threads * (size_t)st.top_count, sizeof(struct du_sum));
+    st.top_names = (char (*)[MAX_NAME_LEN])calloc((size_t)st.top_count, MAX_NAME_LEN);
+    int *order = (int *)malloc((size_t)st.top_count * sizeof(int));
+    if (!st.sums || !st.top_names || !order || fs_walk(filename, root_inode, path, du_visit, &st) == 0) {
+        fs_printf("PATH NOT FOUND\n");
+        goto cleanup;
+    }
+
+    /* součty vláken do řádku 0, přímé podadresáře seřazené podle jména */
+    int dir_count = 0;
+    for (int k = 0; k < st.top_count; k++) {
+        struct du_sum *sum = &st.sums[k];
+        for (int t = 1; t < threads; t++) {
+            const struct du_sum *part = &st.sums[t * st.top_count + k];
+            sum->files += part->files;
+            sum->dirs += part->dirs;
+            sum->logical += part->logical;
+            sum->physical += part->physical;
+        }
+        total.files += sum->files;
+        total.dirs += sum->dirs + (st.top_names[k][0] != '\0');
+        total.logical += sum->logical;
+        total.physical += sum->physical;
+
+        if (st.top_names[k][0] == '\0') {
+            continue;
+        }
+        int i = dir_count++;
+        for (; i > 0 && strcmp(st.top_names[order[i - 1]], st.top_names[k]) > 0; i--) {
+            order[i] = order[i - 1];
+        }
+        order[i] = k;
+    }
+
+    const bool root_slash = strcmp(path, "/") == 0;
+    for (int i = 0; i < dir_count; i++) {
+        char child[1024];
+        (void)snprintf(child, sizeof(child), "%s/%s", root_slash ? "" : path, st.top_names[order[i]]);
+        du_print(child, &st.sums[order[i]]);
+    }
+    du_print(path, &total);
+    ok = 1;
+
+cleanup:
+    free(order);
+    free(st.top_names);
+    free(st.sums);
+    return ok;
+}
+
+/* ========================================================================== */
+/* find                                                                       */
+/* ========================================================================== */
+
+struct find_state {
+    const struct find_filter *filter;
+    struct path_list *lists;
+};
+
+static bool find_match(const struct find_filter *filter, const char *name, const struct pseudo_inode *inode)
+{
+    if (filter->name && !fs_glob_match(filter->name, name)) {
+        return false;
+    }
+    if ((filter->type == 'f' && inode->isDirectory) || (filter->type == 'd' && !inode->isDirectory)) {
+        return false;
+    }
+    if (filter->size < 0) {
+        return true;
+    }
+    const long unit = (filter->unit > 0) ? filter->unit : 1;
+    const long units = ((long)inode->file_size + unit - 1) / unit;
+    if (filter->size_cmp != 0) {
+        return (filter->size_cmp > 0) ? units > filter->size : units < filter->size;
+    }
+    return units == filter->size;
+}
+
+static void find_visit(void *arg, int thread, const struct walk_entry *entry)
+{
+    struct find_state *st = (struct find_state *)arg;
+    if (entry->inode && !entry->repeat && find_match(st->filter, entry->name, entry->inode)) {
+        (void)path_list_push(&st->lists[thread], entry_path(entry));
+    }
+}
+
+int fs_find(const char *filename, const char *path, const struct find_filter *filter)
+{
+    struct superblock sb;
+    struct pseudo_inode root;
+    int root_inode;
+    if (!walk_root(filename, path, &sb, &root_inode, &root)) {
+        return 0;
+    }
+
+    /* kořen jako u find(1) také, jménem je poslední část cesty */
+    const char *slash = strrchr(path, '/');
+    const bool root_match = find_match(filter, (slash && slash[1] != '\0') ? slash + 1 : path, &root);
+    if (!root.isDirectory) {
+        if (root_match) {
+            fs_printf("%s\n", path);
+        }
+        return 1;
+    }
+
+    const int threads = fs_walk_threads(WALK_MAX_THREADS);
+    struct path_list *lists = (struct path_list *)calloc((size_t)threads, sizeof(struct path_list));
+    struct find_state st = { filter, lists };
+    if (!lists || fs_walk(filename, root_inode, path, find_visit, &st) == 0) {
+        free(lists);
+        fs_printf("PATH NOT FOUND\n");
+        return 0;
+    }
+
+    (void)path_lists_merge(lists, threads, cmp_path);
+    if (root_match) {
+        fs_printf("%s\n", path);
+    }
+    for (int i = 0; i < lists[0].count; i++) {
+        fs_printf("%s\n", lists[0].items[i]);
+    }
+
+    path_lists_free(lists, threads);
+    free(lists);
+    return 1;
+}
+
+/* ========================================================================== */
+/* tree                                                                       */
+/* ========================================================================== */
+
+/*
+ * Cesta se uloží s jedním bajtem navíc před textem: 'd' = adresář, 'f' = soubor.
+ * Seřadí se podle textu (pořadí průchodu do hloubky), hloubka = počet '/' za kořenem.
+ */
+
+static void tree_visit(void *arg, int thread, const struct walk_entry *entry)
+{
+    struct path_list *lists = (struct path_list *)arg;
+    if (!entry->inode || entry->repeat) {
+        return;
+    }
+    const size_t len = strlen(entry->dir_path) + strlen(entry->name) + 3;
+    char *item = (char *)malloc(len);
+    if (item) {
+        (void)snprintf(item, len, "%c%s/%s", entry->inode->isDirectory ? 'd' : 'f', entry->dir_path, entry->name);
+    }
+    (void)path_list_push(&lists[thread], item);
+}
+
+static int cmp_tree_item(const void *a, const void *b)
+{
+    return fs_walk_path_cmp(*(const char *const *)a + 1, *(const char *const *)b + 1);
+}
+
+int fs_tree(const char *filename, const char *path)
+{
+    struct superblock sb;
+    struct pseudo_inode root;
+    int root_inode;
+    if (!walk_root(filename, path, &sb, &root_inode, &root)) {
+        return 0;
+    }
+    fs_printf("%s\n", path);
+    if (!root.isDirectory) {
+        fs_printf("0 directories, 1 files\n");
+        return 1;
+    }
+
+    int ok = 0;
+    const int threads = fs_walk_threads(WALK_MAX_THREADS);
+    struct path_list *lists = (struct path_list *)calloc((size_t)threads, sizeof(struct path_list));
+    int *depth = NULL;
+    bool *last = NULL;
+    bool *open = NULL;
+    if (!lists || fs_walk(filename, root_inode, path, tree_visit, lists) == 0) {
+        fs_printf("PATH NOT FOUND\n");
+        goto cleanup;
+    }
+
+    (void)path_lists_merge(lists, threads, cmp_tree_item);
+    const struct path_list *all = &lists[0];
+
+    const size_t skip = (strcmp(path, "/") == 0) ? 1 : strlen(path) + 1; /* "<kořen>/" */
+    int max_depth = 0;
+    depth = (int *)malloc(((size_t)all->count + 1) * sizeof(int));
+    last = (bool *)malloc(((size_t)all->count + 1) * sizeof(bool));
+    if (!depth || !last) {
+        goto cleanup;
+    }
+    for (int i = 0; i < all->count; i++) {
+        depth[i] = 1;
+        for (const char *p = all->items[i] + 1 + skip; *p != '\0'; ++p) {
+            depth[i] += *p == '/';
+        }
+        if (depth[i] > max_depth) {
+            max_depth = depth[i];
+        }
+    }
+
+    /* poslední sourozenec: zpětným průchodem, hlubší úrovně patří jinému rodiči */
+    open = (bool *)calloc((size_t)max_depth + 2, sizeof(bool));
+    if (!open) {
+        goto cleanup;
+    }
+    for (int i = all->count - 1; i >= 0; i--) {
+        last[i] = !open[depth[i]];
+        open[depth[i]] = true;
+        for (int d = depth[i] + 1; d <= max_depth; d++) {
+            open[d] = false;
+        }
+    }
+
+    /* open[d] = na úrovni d ještě přijde sourozenec (kreslí se "|   ") */
+    long dirs = 0;
+    long files = 0;
+    for (int i = 0; i < all->count; i++) {
+        const char *item = all->items[i];
+        for (int d = 1; d < depth[i]; d++) {
+            fputs(open[d] ? "|   " : "    ", fs_out());
+        }
+        const char *name = strrchr(item + 1, '/');
+        fs_printf("%s%s\n", last[i] ? "`-- " : "|-- ", name ? name + 1 : item + 1);
+        open[depth[i]] = !last[i];
+
+        if (item[0] == 'd') {
+            dirs++;
+        } else {
+            files++;
+        }
+    }
+    fs_printf("%ld directories, %ld files\n", dirs, files);
+    ok = 1;
+
+cleanup:
+    if (lists) {
+        path_lists_free(lists, threads);
+    }
+    free(lists);
+    free(depth);
+    free(last);
+    free(open);
+    return ok;
+}
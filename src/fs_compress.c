@@ -0,0 +1,267 @@
+/**
+ * @file fs_compress.c
+ * @brief Vestavěný rychlý kompresor (formát podobný LZ4) bez externích závislostí.
+ *
+ * Blok je posloupnost sekvencí:
+ *   token (horní 4 bity = délka literálů, dolní 4 bity = délka shody - 4)
+ *   [další bajty délky literálů] literály [offset LE16] [další bajty délky shody]
+ * Poslední sekvence obsahuje jen literály. Délky >= 15 pokračují bajty 255 ... + zbytek.
+ *
+ * Kompresor je greedy s jednou hash tabulkou (stejný princip jako LZ4 "fast"),
+ * dekompresor kontroluje všechny meze, takže poškozený blok skončí chybou, ne pádem.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../include/fs_compress.h"
+
+enum {
+    LZ_MIN_MATCH = 4,       /* nejkratší kódovaná shoda */
+    LZ_HASH_BITS = 12,      /* 4096 položek hash tabulky */
+    LZ_LAST_LITERALS = 5,   /* konec bloku jsou vždy literály */
+    LZ_MFLIMIT = 12,        /* shoda nesmí začít blíž ke konci */
+    LZ_MAX_OFFSET = 65535
+};
+
+static uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t lz_hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/**
+ * @brief Zapíše pokračování délky (255, 255, ..., zbytek). Vrací nový offset nebo -1.
+ */
+static int put_length(uint8_t *dst, int op, int dst_cap, int len)
+{
+    for (; len >= 255; len -= 255) {
+        if (op >= dst_cap) {
+            return -1;
+        }
+        dst[op++] = 255;
+    }
+    if (op >= dst_cap) {
+        return -1;
+    }
+    dst[op++] = (uint8_t)len;
+    return op;
+}
+
+/**
+ * @brief Zapíše jednu sekvenci (literály + volitelně shodu). match_len == 0 => poslední sekvence.
+ * @return nový offset ve výstupu, -1 pokud se nevejde.
+ */
+static int put_sequence(uint8_t *dst, int op, int dst_cap,
+                        const uint8_t *lit, int lit_len, int offset, int match_len)
+{
+    if (op >= dst_cap) {
+        return -1;
+    }
+
+    const int ml = (match_len > 0) ? match_len - LZ_MIN_MATCH : 0;
+    const int token_pos = op++;
+    dst[token_pos] = (uint8_t)(((lit_len < 15) ? lit_len : 15) << 4 | ((ml < 15) ? ml : 15));
+
+    if (lit_len >= 15 && (op = put_length(dst, op, dst_cap, lit_len - 15)) < 0) {
+        return -1;
+    }
+    if (op + lit_len > dst_cap) {
+        return -1;
+    }
+    memcpy(dst + op, lit, (size_t)lit_len);
+    op += lit_len;
+
+    if (match_len == 0) {
+        return op;
+    }
+
+    if (op + 2 > dst_cap) {
+        return -1;
+    }
+    dst[op++] = (uint8_t)(offset & 0xFF);
+    dst[op++] = (uint8_t)(offset >> 8);
+
+    if (ml >= 15 && (op = put_length(dst, op, dst_cap, ml - 15)) < 0) {
+        return -1;
+    }
+    return op;
+}
+
+int fs_lz_compress(const uint8_t *src, int src_len, uint8_t *dst, int dst_cap)
+{
+    if (!src || !dst || src_len < 0 || dst_cap <= 0) {
+        return 0;
+    }
+
+    int table[1 << LZ_HASH_BITS];
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i++) {
+        table[i] = -1;
+    }
+
+    int ip = 0;
+    int anchor = 0;
+    int op = 0;
+
+    const int limit = src_len - LZ_MFLIMIT;
+    while (ip <= limit) {
+        const uint32_t seq = read32(src + ip);
+        const uint32_t h = lz_hash(seq);
+        const int ref = table[h];
+        table[h] = ip;
+
+        if (ref < 0 || ip - ref > LZ_MAX_OFFSET || read32(src + ref) != seq) {
+            ip++;
+            continue;
+        }
+
+        int match_len = LZ_MIN_MATCH;
+        while (ip + match_len < src_len - LZ_LAST_LITERALS && src[ref + match_len] == src[ip + match_len]) {
+            match_len++;
+        }
+
+        op = put_sequence(dst, op, dst_cap, src + anchor, ip - anchor, ip - ref, match_len);
+        if (op < 0) {
+            return 0;
+        }
+
+        ip += match_len;
+        anchor = ip;
+    }
+
+    op = put_sequence(dst, op, dst_cap, src + anchor, src_len - anchor, 0, 0);
+    return (op < 0) ? 0 : op;
+}
+
+/**
+ * @brief Načte pokračování délky. Vrací -1, pokud vstup skončí uprostřed.
+ */
+static int get_length(const uint8_t *src, int src_len, int *ip)
+{
+    int len = 0;
+    uint8_t b;
+    do {
+        if (*ip >= src_len) {
+            return -1;
+        }
+        b = src[(*ip)++];
+        len += b;
+    } while (b == 255);
+    return len;
+}
+
+int fs_lz_decompress(const uint8_t *src, int src_len, uint8_t *dst, int dst_cap)
+{
+    if (!src || !dst || src_len <= 0) {
+        return -1;
+    }
+
+    int ip = 0;
+    int op = 0;
+
+    while (ip < src_len) {
+        const uint8_t token = src[ip++];
+
+        int lit_len = token >> 4;
+        if (lit_len == 15) {
+            const int extra = get_length(src, src_len, &ip);
+            if (extra < 0) {
+                return -1;
+            }
+            lit_len += extra;
+        }
+        if (ip + lit_len > src_len || op + lit_len > dst_cap) {
+            return -1;
+        }
+        memcpy(dst + op, src + ip, (size_t)lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        if (ip == src_len) {
+            break; /* poslední sekvence má jen literály */
+        }
+
+        if (ip + 2 > src_len) {
+            return -1;
+        }
+        const int offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return -1;
+        }
+
+        int match_len = token & 0x0F;
+        if (match_len == 15) {
+            const int extra = get_length(src, src_len, &ip);
+            if (extra < 0) {
+                return -1;
+            }
+            match_len += extra;
+        }
+        match_len += LZ_MIN_MATCH;
+        if (op + match_len > dst_cap) {
+            return -1;
+        }
+
+        /* Shoda se může překrývat s právě zapisovanými daty (RLE) – kopie po bajtech. */
+        for (int i = 0; i < match_len; i++, op++) {
+            dst[op] = dst[op - offset];
+        }
+    }
+
+    return op;
+}
+
+int fs_compress_header_len(int size, int cluster_size)
+{
+    if (size <= 0 || cluster_size <= 0) {
+        return 0;
+    }
+    return ((size + cluster_size - 1) / cluster_size) * (int)sizeof(uint16_t);
+}
+
+int fs_compress_file(const uint8_t *data, int size, int cluster_size, uint8_t *out, int out_cap)
+{
+    if (!data || !out || size <= 0 || cluster_size <= 0) {
+        return 0;
+    }
+
+    const int header_len = fs_compress_header_len(size, cluster_size);
+    if (header_len > out_cap) {
+        return 0;
+    }
+
+    int pos = header_len;
+    int entry = 0;
+
+    for (int start = 0; start < size; start += cluster_size, entry++) {
+        const int len = (size - start > cluster_size) ? cluster_size : size - start;
+
+        /* Komprimovaný blok musí být kratší než syrový, jinak ho uložíme syrově. */
+        const int room = out_cap - pos;
+        const int cap = (room < len - 1) ? room : len - 1;
+        int stored = (cap > 0) ? fs_lz_compress(data + start, len, out + pos, cap) : 0;
+        uint16_t value = (uint16_t)stored;
+
+        if (stored == 0) {
+            if (len > room) {
+                return 0;
+            }
+            memcpy(out + pos, data + start, (size_t)len);
+            stored = len;
+            value = (uint16_t)(len | COMPRESS_RAW_FLAG);
+        }
+
+        out[entry * 2] = (uint8_t)(value & 0xFF);
+        out[entry * 2 + 1] = (uint8_t)(value >> 8);
+        pos += stored;
+    }
+
+    return pos;
+}
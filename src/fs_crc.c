@@ -0,0 +1,385 @@
+#define _POSIX_C_SOURCE 200809L
+/**
+ * @file fs_crc.c
+ * @brief CRC32C kontrolní součty clusterů a příkaz scrub.
+ *
+ * Výpočet volí implementaci jednou za běh programu: na x86-64 s SSE4.2 instrukci
+ * crc32 (8 B na instrukci), jinak tabulkový slicing-by-8. Obě dávají stejný výsledek,
+ * takže obraz zapsaný na jednom stroji jde ověřit na jiném.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define FS_CRC_HW 1
+#endif
+
+#include "../include/fs_crc.h"
+#include "../include/fs_utils.h"
+#include "../include/fs_dedup.h"
+#include "../include/fs_io.h"
+#include "../include/fs_walk.h"
+#include "../include/fs_out.h"
+
+enum {
+    CRC32C_POLY = 0x82F63B78u,  /* Castagnoli, reflektovaný */
+    SCRUB_MAX_THREADS = 8,
+    SCRUB_BATCH = 64            /* clusterů na jedno čtení */
+};
+
+/* ========================================================================== */
+/* CRC32C                                                                     */
+/* ========================================================================== */
+
+static uint32_t crc_table[8][256];
+static uint32_t (*crc_impl)(uint32_t crc, const uint8_t *p, size_t len);
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t len)
+{
+    while (len >= 8) {
+        uint32_t lo;
+        uint32_t hi;
+        memcpy(&lo, p, sizeof(lo));
+        memcpy(&hi, p + 4, sizeof(hi));
+        lo ^= crc;
+        crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^
+              crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24] ^
+              crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF] ^
+              crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = crc_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef FS_CRC_HW
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t len)
+{
+    uint64_t c = crc;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)c;
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+static void crc_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        crc_table[0][i] = c;
+    }
+    for (int t = 1; t < 8; t++) {
+        for (int i = 0; i < 256; i++) {
+            const uint32_t prev = crc_table[t - 1][i];
+            crc_table[t][i] = (prev >> 8) ^ crc_table[0][prev & 0xFF];
+        }
+    }
+
+    crc_impl = crc32c_sw;
+#ifdef FS_CRC_HW
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc_impl = crc32c_hw;
+    }
+#endif
+}
+
+uint32_t fs_crc32c(uint32_t crc, const void *data, size_t len)
+{
+    (void)pthread_once(&crc_once, crc_init);
+    return ~crc_impl(~crc, (const uint8_t *)data, len);
+}
+
+/* ========================================================================== */
+/* Tabulka součtů                                                             */
+/* ========================================================================== */
+
+static bool crc_table_present(const struct superblock *sb, int32_t cluster)
+{
+    return sb->crc_start_address > 0 && cluster >= 0 && cluster < sb->cluster_count;
+}
+
+static long crc_offset(const struct superblock *sb, int32_t cluster)
+{
+    return sb->crc_start_address + (long)cluster * (long)sizeof(uint32_t);
+}
+
+void cluster_crc_store(FILE *f, struct superblock *sb, int32_t cluster, const uint8_t *data)
+{
+    if (!f || !sb || !data || !crc_table_present(sb, cluster)) {
+        return;
+    }
+
+    cluster_crc_set(f, sb, cluster, fs_crc32c(0, data, (size_t)sb->cluster_size));
+}
+
+void cluster_crc_set(FILE *f, struct superblock *sb, int32_t cluster, uint32_t crc)
+{
+    if (!f || !sb || !crc_table_present(sb, cluster)) {
+        return;
+    }
+    (void)fs_pwrite(f, crc_offset(sb, cluster), &crc, sizeof(crc));
+}
+
+void cluster_crc_refresh(FILE *f, struct superblock *sb, int32_t cluster)
+{
+    if (!f || !sb || !crc_table_present(sb, cluster)) {
+        return;
+    }
+
+    uint8_t *buf = (uint8_t *)malloc((size_t)sb->cluster_size);
+    if (!buf) {
+        return;
+    }
+
+    const long addr = sb->data_start_address + (long)cluster * (long)sb->cluster_size;
+    if (fs_pread(f, addr, buf, (size_t)sb->cluster_size)) {
+        cluster_crc_store(f, sb, cluster, buf);
+    }
+    free(buf);
+}
+
+bool cluster_crc_verify(FILE *f, const struct superblock *sb, int32_t cluster, const uint8_t *data)
+{
+    if (!f || !sb || !data || !crc_table_present(sb, cluster)) {
+        return true;
+    }
+
+    uint32_t stored = 0;
+    if (!fs_pread(f, crc_offset(sb, cluster), &stored, sizeof(stored))) {
+        return true; /* tabulku nejde přečíst – nemáme s čím porovnat */
+    }
+
+    if (fs_crc32c(0, data, (size_t)sb->cluster_size) == stored) {
+        return true;
+    }
+
+    fs_printf("CHECKSUM ERROR: cluster %d\n", cluster);
+    return false;
+}
+
+/* ========================================================================== */
+/* SCRUB                                                                      */
+/* ========================================================================== */
+
+/** Úsek clusterů ověřovaný jedním vláknem. */
+struct scrub_job {
+    const char *filename;
+    const struct superblock *sb;
+    const uint8_t *dbm;     /* datová bitmapa */
+    const uint32_t *crcs;   /* tabulka součtů */
+    uint8_t *bad;           /* výsledek po clusterech (každé vlákno píše jen svůj úsek) */
+    int begin;
+    int end;
+    long checked;
+    int errors;
+};
+
+static bool scrub_allocated(const uint8_t *dbm, int cluster)
+{
+    return (dbm[cluster / 8] >> (cluster % 8)) & 1;
+}
+
+static void *scrub_worker(void *arg)
+{
+    struct scrub_job *job = (struct scrub_job *)arg;
+    const int cs = job->sb->cluster_size;
+
+    FILE *f = fopen(job->filename, "rb");
+    uint8_t *buf = (uint8_t *)malloc((size_t)SCRUB_BATCH * (size_t)cs);
+    if (!f || !buf) {
+        free(buf);
+        if (f) {
+            fclose(f);
+        }
+        return NULL;
+    }
+
+    for (int start = job->begin; start < job->end; start += SCRUB_BATCH) {
+        const int n = (job->end - start < SCRUB_BATCH) ? job->end - start : SCRUB_BATCH;
+
+        /* Dávku jen s volnými clustery vůbec nečteme. */
+        int used = 0;
+        for (int i = 0; i < n; i++) {
+            used += scrub_allocated(job->dbm, start + i);
+        }
+        if (used == 0) {
+            continue;
+        }
+
+        const long addr = job->sb->data_start_address + (long)start * cs;
+        const int got = fs_pread(f, addr, buf, (size_t)n * (size_t)cs) ? n : 0;
+
+        for (int i = 0; i < n; i++) {
+            const int c = start + i;
+            if (!scrub_allocated(job->dbm, c)) {
+                continue;
+            }
+            job->checked++;
+            if (i >= got || fs_crc32c(0, buf + (long)i * cs, (size_t)cs) != job->crcs[c]) {
+                job->bad[c] = 1;
+                job->errors++;
+            }
+        }
+    }
+
+    free(buf);
+    fclose(f);
+    return NULL;
+}
+
+/**
+ * @brief Ověří součty clusterů označených v bitmapě used ve více vláknech.
+ *
+ * Datová oblast se rozdělí na souvislé úseky pro jednotlivá vlákna, každé čte
+ * po dávkách SCRUB_BATCH clusterů přes vlastní FILE.
+ */
+int fs_crc_check(const char *filename, const struct superblock *sb, const uint8_t *used, uint8_t *bad,
+                 long *checked, int *threads_used)
+{
+    FILE *f = filename ? fopen(filename, "rb") : NULL;
+    uint32_t *crcs = (uint32_t *)malloc((size_t)sb->cluster_count * sizeof(uint32_t));
+    if (!f || !crcs || sb->crc_start_address <= 0 ||
+        !fs_pread(f, sb->crc_start_address, crcs, (size_t)sb->cluster_count * sizeof(uint32_t))) {
+        free(crcs);
+        if (f) {
+            fclose(f);
+        }
+        return -1;
+    }
+    fclose(f);
+
+    int data_clusters = (int)((sb->disk_size - sb->data_start_address) / sb->cluster_size);
+    if (data_clusters > sb->cluster_count) {
+        data_clusters = sb->cluster_count;
+    }
+
+    const int threads = fs_walk_threads(SCRUB_MAX_THREADS);
+
+    pthread_t tid[SCRUB_MAX_THREADS];
+    struct scrub_job jobs[SCRUB_MAX_THREADS];
+    bool started[SCRUB_MAX_THREADS];
+
+    for (int t = 0; t < threads; t++) {
+        jobs[t] = (struct scrub_job){ filename, sb, used, crcs, bad,
+                                      data_clusters * t / threads, data_clusters * (t + 1) / threads, 0, 0 };
+        started[t] = fs_out_thread(&tid[t], scrub_worker, &jobs[t]) == 0;
+        if (!started[t]) {
+            scrub_worker(&jobs[t]); /* vlákno nešlo vytvořit – úsek zpracujeme sami */
+        }
+    }
+
+    long total = 0;
+    int errors = 0;
+    for (int t = 0; t < threads; t++) {
+        if (started[t]) {
+            pthread_join(tid[t], NULL);
+        }
+        total += jobs[t].checked;
+        errors += jobs[t].errors;
+    }
+
+    free(crcs);
+    if (checked) {
+        *checked = total;
+    }
+    if (threads_used) {
+        *threads_used = threads;
+    }
+    return errors;
+}
+
+/**
+ * @brief Ověří součty všech obsazených clusterů (příkaz scrub).
+ *
+ * Nakonec se vypíše souhrn s propustností a seznam poškozených clusterů.
+ *
+ * @return 1 pokud jsou všechny clustery v pořádku, jinak 0.
+ */
+int fs_scrub(const char *filename)
+{
+    FILE *f = filename ? fopen(filename, "rb") : NULL;
+    if (!f) {
+        fs_printf("FILE NOT FOUND\n");
+        return 0;
+    }
+
+    struct superblock sb;
+    if (!load_superblock(f, &sb) || sb.crc_start_address <= 0) {
+        fs_printf("FILE NOT FOUND\n");
+        fclose(f);
+        return 0;
+    }
+
+    const size_t dbm_bytes = (size_t)(sb.cluster_count + 7) / 8;
+    uint8_t *dbm = (uint8_t *)malloc(dbm_bytes);
+    uint8_t *bad = (uint8_t *)calloc(1, (size_t)sb.cluster_count);
+    if (!dbm || !bad || !fs_pread(f, sb.bitmap_start_address, dbm, dbm_bytes)) {
+        free(dbm);
+        free(bad);
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+
+    /* Clustery indexu deduplikace se zapisují mimo tabulku součtů. */
+    int32_t index_first = 0;
+    const int index_clusters = dedup_index_clusters(&sb, &index_first);
+    for (int c = index_first; c < index_first + index_clusters && c < sb.cluster_count; c++) {
+        dbm[c / 8] &= (uint8_t)~(1u << (c % 8));
+    }
+
+    struct timespec t0;
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    long checked = 0;
+    int threads = 0;
+    const int errors = fs_crc_check(filename, &sb, dbm, bad, &checked, &threads);
+    if (errors < 0) {
+        free(dbm);
+        free(bad);
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    if (secs <= 0.0) {
+        secs = 1e-9;
+    }
+    const long bytes = checked * (long)sb.cluster_size;
+
+    fs_printf("SCRUB: %ld clusters, %ld B verified, %d errors, %.1f MB/s (%d threads)\n",
+              checked, bytes, errors, (double)bytes / secs / 1e6, threads);
+    for (int c = 0; c < sb.cluster_count; c++) {
+        if (bad[c]) {
+            fs_printf("CHECKSUM ERROR: cluster %d\n", c);
+        }
+    }
+
+    free(dbm);
+    free(bad);
+    return errors == 0;
+}
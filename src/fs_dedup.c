@@ -0,0 +1,555 @@
+#define _POSIX_C_SOURCE 200809L
+/**
+ * @file fs_dedup.c
+ * @brief Deduplikace clusterů: MurmurHash3, index hash -> cluster na disku, offline dedupe.
+ *
+ * Online část (dedup_find/dedup_insert/dedup_forget) používá store_data_cluster()
+ * v fs_utils.c, takže ji automaticky dostanou incp, cp, add i xcp.
+ * Offline příkaz dedupe projde celý obraz, obsah clusterů hashuje ve více vláknech
+ * (každé vlákno má vlastní FILE) a duplicity pak sloučí přes tabulku sdílení.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../include/fs_dedup.h"
+#include "../include/fs_utils.h"
+#include "../include/fs_io.h"
+#include "../include/fs_walk.h"
+#include "../include/fs_out.h"
+
+enum {
+    DEDUP_SEED = 0x5A4F5321u,   /* "ZOS!" */
+    DEDUPE_MAX_THREADS = 8
+};
+
+/* ========================================================================== */
+/* MurmurHash3 x64_128                                                        */
+/* ========================================================================== */
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+void fs_murmur3_128(const void *key, int len, uint32_t seed, uint64_t out[2])
+{
+    const uint8_t *data = (const uint8_t *)key;
+    const int nblocks = len / 16;
+
+    uint64_t h1 = seed;
+    uint64_t h2 = seed;
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+    for (int i = 0; i < nblocks; i++) {
+        uint64_t k1;
+        uint64_t k2;
+        memcpy(&k1, data + i * 16, sizeof(k1));
+        memcpy(&k2, data + i * 16 + 8, sizeof(k2));
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    /* zbytek (0..15 bajtů) */
+    const uint8_t *tail = data + nblocks * 16;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+    const int rest = len & 15;
+
+    for (int i = rest - 1; i >= 8; i--) {
+        k2 ^= (uint64_t)tail[i] << ((i - 8) * 8);
+    }
+    if (rest > 8) {
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    }
+
+    for (int i = (rest < 8 ? rest : 8) - 1; i >= 0; i--) {
+        k1 ^= (uint64_t)tail[i] << (i * 8);
+    }
+    if (rest > 0) {
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= (uint64_t)len;
+    h2 ^= (uint64_t)len;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+
+    out[0] = h1;
+    out[1] = h2;
+}
+
+/* ========================================================================== */
+/* Index na disku                                                             */
+/* ========================================================================== */
+
+int dedup_slot_count(int cluster_count)
+{
+    int slots = 1;
+    while (slots < cluster_count + cluster_count / 2) {
+        slots <<= 1;
+    }
+    return slots;
+}
+
+static bool dedup_enabled(const struct superblock *sb)
+{
+    return (sb->features & FS_FEATURE_DEDUP) && sb->dedup_slots > 0 && sb->dedup_start_address > 0;
+}
+
+static long slot_offset(const struct superblock *sb, int slot)
+{
+    return sb->dedup_start_address + (long)slot * (long)sizeof(struct dedup_entry);
+}
+
+static int read_slot(FILE *f, const struct superblock *sb, int slot, struct dedup_entry *e)
+{
+    return fs_pread(f, slot_offset(sb, slot), e, sizeof(*e));
+}
+
+static void write_slot(FILE *f, const struct superblock *sb, int slot, const struct dedup_entry *e)
+{
+    (void)fs_pwrite(f, slot_offset(sb, slot), e, sizeof(*e));
+}
+
+static void hash_cluster(const struct superblock *sb, const uint8_t *data, uint64_t out[2])
+{
+    fs_murmur3_128(data, sb->cluster_size, DEDUP_SEED, out);
+}
+
+/**
+ * @brief Zapíše položku do prvního volného (nebo smazaného) slotu od pozice hashe.
+ */
+static void insert_hashed(FILE *f, struct superblock *sb, const uint64_t hash[2], int32_t cluster)
+{
+    const int mask = sb->dedup_slots - 1;
+    for (int i = 0; i < sb->dedup_slots; i++) {
+        const int slot = (int)((hash[0] + (uint64_t)i) & (uint64_t)mask);
+        struct dedup_entry e;
+        if (!read_slot(f, sb, slot, &e)) {
+            return;
+        }
+        if (e.cluster == DEDUP_EMPTY || e.cluster == DEDUP_TOMBSTONE) {
+            e.hash = hash[0];
+            e.check = (uint32_t)hash[1];
+            e.cluster = cluster;
+            write_slot(f, sb, slot, &e);
+            return;
+        }
+    }
+    /* plný index – cluster prostě zůstane neindexovaný */
+}
+
+int32_t dedup_find(FILE *f, struct superblock *sb, const uint8_t *data)
+{
+    if (!f || !sb || !data || !dedup_enabled(sb)) {
+        return -1;
+    }
+
+    uint64_t hash[2];
+    hash_cluster(sb, data, hash);
+
+    uint8_t *other = (uint8_t *)malloc((size_t)sb->cluster_size);
+    if (!other) {
+        return -1;
+    }
+
+    int32_t found = -1;
+    const int mask = sb->dedup_slots - 1;
+    for (int i = 0; i < sb->dedup_slots && found == -1; i++) {
+        const int slot = (int)((hash[0] + (uint64_t)i) & (uint64_t)mask);
+        struct dedup_entry e;
+        if (!read_slot(f, sb, slot, &e) || e.cluster == DEDUP_EMPTY) {
+            break;
+        }
+        if (e.cluster == DEDUP_TOMBSTONE || e.hash != hash[0] || e.check != (uint32_t)hash[1]) {
+            continue;
+        }
+
+        /* Shodný hash – obsah se ještě ověří bajt po bajtu. */
+        if (read_cluster(f, sb, e.cluster, other) && memcmp(other, data, (size_t)sb->cluster_size) == 0) {
+            found = e.cluster;
+        }
+    }
+
+    free(other);
+    return found;
+}
+
+void dedup_insert(FILE *f, struct superblock *sb, const uint8_t *data, int32_t cluster)
+{
+    if (!f || !sb || !data || cluster <= 0 || !dedup_enabled(sb)) {
+        return;
+    }
+
+    uint64_t hash[2];
+    hash_cluster(sb, data, hash);
+    insert_hashed(f, sb, hash, cluster);
+}
+
+void dedup_forget(FILE *f, struct superblock *sb, int32_t cluster)
+{
+    if (!f || !sb || cluster <= 0 || !dedup_enabled(sb)) {
+        return;
+    }
+
+    uint8_t *data = (uint8_t *)malloc((size_t)sb->cluster_size);
+    if (!data) {
+        return;
+    }
+    if (!read_cluster(f, sb, cluster, data)) {
+        free(data);
+        return;
+    }
+
+    uint64_t hash[2];
+    hash_cluster(sb, data, hash);
+    free(data);
+
+    const int mask = sb->dedup_slots - 1;
+    for (int i = 0; i < sb->dedup_slots; i++) {
+        const int slot = (int)((hash[0] + (uint64_t)i) & (uint64_t)mask);
+        struct dedup_entry e;
+        if (!read_slot(f, sb, slot, &e) || e.cluster == DEDUP_EMPTY) {
+            return;
+        }
+        if (e.cluster == cluster) {
+            e.cluster = DEDUP_TOMBSTONE;
+            write_slot(f, sb, slot, &e);
+            return;
+        }
+    }
+}
+
+int dedup_index_clusters(const struct superblock *sb, int32_t *first)
+{
+    if (sb->dedup_slots <= 0 || sb->dedup_start_address < sb->data_start_address || sb->cluster_size <= 0) {
+        return 0;
+    }
+    const long bytes = (long)sb->dedup_slots * (long)sizeof(struct dedup_entry);
+    *first = (int32_t)((sb->dedup_start_address - sb->data_start_address) / sb->cluster_size);
+    return (int)((bytes + sb->cluster_size - 1) / sb->cluster_size);
+}
+
+int dedup_reserve(FILE *f, struct superblock *sb)
+{
+    int32_t first = 0;
+    if (dedup_index_clusters(sb, &first) > 0) {
+        return 1;
+    }
+
+    const int slots = dedup_slot_count(sb->cluster_count);
+    const long bytes = (long)slots * (long)sizeof(struct dedup_entry);
+    const int n = (int)((bytes + sb->cluster_size - 1) / sb->cluster_size);
+    first = find_free_run(f, sb, n);
+    if (first == -1) {
+        return 0;
+    }
+
+    /* Úsek se obsadí dřív, než se vynuluje – nic jiného do něj už nezapíše. */
+    for (int i = 0; i < n; i++) {
+        set_bit(f, sb, false, first + i, true);
+    }
+    sb->dedup_start_address = sb->data_start_address + first * sb->cluster_size;
+    sb->dedup_slots = slots;
+    dedup_clear(f, sb);
+    return 1;
+}
+
+void dedup_release(FILE *f, struct superblock *sb)
+{
+    int32_t first = 0;
+    const int n = dedup_index_clusters(sb, &first);
+    for (int i = 0; i < n; i++) {
+        set_bit(f, sb, false, first + i, false);
+    }
+    sb->dedup_start_address = 0;
+    sb->dedup_slots = 0;
+}
+
+void dedup_clear(FILE *f, struct superblock *sb)
+{
+    if (!f || !sb || sb->dedup_slots <= 0 || sb->dedup_start_address <= 0) {
+        return;
+    }
+
+    const size_t bytes = (size_t)sb->dedup_slots * sizeof(struct dedup_entry);
+    uint8_t *zeros = (uint8_t *)calloc(1, bytes);
+    if (!zeros) {
+        return;
+    }
+    (void)fs_pwrite(f, sb->dedup_start_address, zeros, bytes);
+    free(zeros);
+}
+
+/* ========================================================================== */
+/* DEDUPE (offline)                                                           */
+/* ========================================================================== */
+
+/** Jeden odkazovaný cluster a hash jeho obsahu. */
+struct dedupe_ref {
+    int32_t cluster;
+    uint64_t hash[2];
+};
+
+/** Úsek práce jednoho hashovacího vlákna. */
+struct dedupe_job {
+    const char *filename;
+    const struct superblock *sb;
+    struct dedupe_ref *refs;
+    int begin;
+    int end;
+    int ok;
+};
+
+static void *dedupe_hash_worker(void *arg)
+{
+    struct dedupe_job *job = (struct dedupe_job *)arg;
+
+    /* Každé vlákno čte přes vlastní FILE – žádné sdílené pozice ani zámky. */
+    FILE *f = fopen(job->filename, "rb");
+    uint8_t *buf = (uint8_t *)malloc((size_t)job->sb->cluster_size);
+    if (!f || !buf) {
+        free(buf);
+        if (f) {
+            fclose(f);
+        }
+        return NULL;
+    }
+
+    struct superblock sb = *job->sb;
+    job->ok = 1;
+    for (int i = job->begin; i < job->end; i++) {
+        if (!read_cluster(f, &sb, job->refs[i].cluster, buf)) {
+            job->ok = 0;
+            break;
+        }
+        hash_cluster(&sb, buf, job->refs[i].hash);
+    }
+
+    free(buf);
+    fclose(f);
+    return NULL;
+}
+
+static int cmp_dedupe_ref(const void *a, const void *b)
+{
+    const struct dedupe_ref *x = (const struct dedupe_ref *)a;
+    const struct dedupe_ref *y = (const struct dedupe_ref *)b;
+
+    if (x->hash[0] != y->hash[0]) {
+        return (x->hash[0] < y->hash[0]) ? -1 : 1;
+    }
+    if (x->hash[1] != y->hash[1]) {
+        return (x->hash[1] < y->hash[1]) ? -1 : 1;
+    }
+    return (x->cluster > y->cluster) - (x->cluster < y->cluster);
+}
+
+/**
+ * @brief Spočítá hashe všech clusterů v refs[0..count-1] ve více vláknech.
+ */
+static int dedupe_hash_all(const char *filename, const struct superblock *sb, struct dedupe_ref *refs, int count)
+{
+    int threads = fs_walk_threads(DEDUPE_MAX_THREADS);
+    if (threads > count) {
+        threads = (count > 0) ? count : 1;
+    }
+
+    pthread_t tid[DEDUPE_MAX_THREADS];
+    struct dedupe_job jobs[DEDUPE_MAX_THREADS];
+    int started = 0;
+
+    for (int t = 0; t < threads; t++) {
+        jobs[t] = (struct dedupe_job){ filename, sb, refs, count * t / threads, count * (t + 1) / threads, 0 };
+        if (fs_out_thread(&tid[t], dedupe_hash_worker, &jobs[t]) != 0) {
+            /* vlákno nešlo vytvořit – úsek zpracujeme sami */
+            dedupe_hash_worker(&jobs[t]);
+            continue;
+        }
+        started |= 1 << t;
+    }
+
+    int ok = 1;
+    for (int t = 0; t < threads; t++) {
+        if (started & (1 << t)) {
+            pthread_join(tid[t], NULL);
+        }
+        ok = ok && jobs[t].ok;
+    }
+    return ok;
+}
+
+/**
+ * @brief Offline deduplikace obrazu (příkaz dedupe).
+ *
+ * 1) posbírá všechny datové clustery souborů (bez děr, inline dat a fragmentu konců),
+ * 2) paralelně je zahashuje, seřadí podle hashe a shody ověří porovnáním obsahu,
+ * 3) odkazy na duplicity přesměruje na první shodný cluster (tabulka sdílení),
+ *    duplicita se uvolní s posledním odkazem,
+ * 4) při zapnutém FS_FEATURE_DEDUP index znovu sestaví z výsledku.
+ *
+ * @return 1 při úspěchu, 0 při chybě.
+ */
+int fs_dedupe(const char *filename)
+{
+    FILE *f = filename ? fopen(filename, "r+b") : NULL;
+    if (!f) {
+        fs_printf("FILE NOT FOUND\n");
+        return 0;
+    }
+
+    struct superblock sb;
+    if (!load_superblock(f, &sb)) {
+        fs_printf("FILE NOT FOUND\n");
+        fclose(f);
+        return 0;
+    }
+
+    int ok = 0;
+    const int inode_bm_bytes = (sb.cluster_count + 7) / 8;
+    uint8_t *ibm = (uint8_t *)calloc(1, (size_t)inode_bm_bytes);
+    uint8_t *seen = (uint8_t *)calloc(1, (size_t)sb.cluster_count);
+    int32_t *canon = (int32_t *)malloc((size_t)sb.cluster_count * sizeof(int32_t));
+    struct dedupe_ref *refs = (struct dedupe_ref *)malloc((size_t)sb.cluster_count * sizeof(struct dedupe_ref));
+    uint8_t *a = (uint8_t *)malloc((size_t)sb.cluster_size);
+    uint8_t *b = (uint8_t *)malloc((size_t)sb.cluster_size);
+    if (!ibm || !seen || !canon || !refs || !a || !b) {
+        goto cleanup;
+    }
+
+    if (!fs_pread(f, sb.bitmapi_start_address, ibm, (size_t)inode_bm_bytes)) {
+        goto cleanup;
+    }
+
+    /* 1) odkazované clustery souborů (každý jen jednou) */
+    int count = 0;
+    for (int id = 0; id < sb.cluster_count; id++) {
+        if (!((ibm[id / 8] >> (id % 8)) & 1)) {
+            continue;
+        }
+        struct pseudo_inode ino;
+        read_inode(f, &sb, id, &ino);
+        if (ino.isDirectory || (ino.flags & INODE_FLAG_INLINE)) {
+            continue;
+        }
+
+        int32_t blocks[5];
+        inode_get_direct(&ino, blocks);
+        for (int k = 0; k < 5; k++) {
+            if (blocks[k] > 0 && blocks[k] < sb.cluster_count && !seen[blocks[k]]) {
+                seen[blocks[k]] = 1;
+                refs[count++].cluster = blocks[k];
+            }
+        }
+    }
+
+    /* 2) hashe paralelně, pak seřazení – shodné clustery jsou vedle sebe */
+    if (!dedupe_hash_all(filename, &sb, refs, count)) {
+        goto cleanup;
+    }
+    qsort(refs, (size_t)count, sizeof(refs[0]), cmp_dedupe_ref);
+
+    for (int i = 0; i < sb.cluster_count; i++) {
+        canon[i] = -1;
+    }
+
+    int duplicates = 0;
+    for (int g = 0; g < count;) {
+        int end = g + 1;
+        while (end < count && refs[end].hash[0] == refs[g].hash[0] && refs[end].hash[1] == refs[g].hash[1]) {
+            end++;
+        }
+        if (end - g > 1 && read_cluster(f, &sb, refs[g].cluster, a)) {
+            for (int j = g + 1; j < end; j++) {
+                if (read_cluster(f, &sb, refs[j].cluster, b) && memcmp(a, b, (size_t)sb.cluster_size) == 0) {
+                    canon[refs[j].cluster] = refs[g].cluster;
+                    duplicates++;
+                }
+            }
+        }
+        g = end;
+    }
+
+    /* 3) přesměrování odkazů v inodech */
+    int freed = 0;
+    if (duplicates > 0) {
+        for (int id = 0; id < sb.cluster_count; id++) {
+            if (!((ibm[id / 8] >> (id % 8)) & 1)) {
+                continue;
+            }
+            struct pseudo_inode ino;
+            read_inode(f, &sb, id, &ino);
+            if (ino.isDirectory || (ino.flags & INODE_FLAG_INLINE)) {
+                continue;
+            }
+
+            int32_t blocks[5];
+            inode_get_direct(&ino, blocks);
+            bool changed = false;
+            for (int k = 0; k < 5; k++) {
+                if (blocks[k] <= 0 || blocks[k] >= sb.cluster_count || canon[blocks[k]] < 0) {
+                    continue;
+                }
+                const int32_t target = canon[blocks[k]];
+                if (!cluster_ref(f, &sb, target)) {
+                    continue; /* plný čítač sdílení – duplicitu necháme být */
+                }
+                if (cluster_share_count(f, &sb, blocks[k]) == 0) {
+                    freed++; /* poslední odkaz na duplicitu */
+                }
+                cluster_unref(f, &sb, blocks[k]);
+                blocks[k] = target;
+                changed = true;
+            }
+            if (changed) {
+                inode_set_direct(&ino, blocks);
+                write_inode(f, &sb, id, &ino);
+            }
+        }
+    }
+
+    /* 4) index odpovídá jen přeživším clusterům */
+    if (dedup_enabled(&sb)) {
+        dedup_clear(f, &sb);
+        for (int i = 0; i < count; i++) {
+            if (canon[refs[i].cluster] < 0) {
+                insert_hashed(f, &sb, refs[i].hash, refs[i].cluster);
+            }
+        }
+    }
+
+    fs_printf("DEDUPE: %d clusters merged, %ld B freed\n", freed, (long)freed * sb.cluster_size);
+    ok = 1;
+
+cleanup:
+    free(ibm);
+    free(seen);
+    free(canon);
+    free(refs);
+    free(a);
+    free(b);
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,1100 @@
+#define _GNU_SOURCE /* F_OFD_SETLKW */
+/**
+ * @file fs_io.c
+ * @brief I/O nad obrazem FS: pread/pwrite, paměťová vrstva změněných bloků a žurnál.
+ *
+ * Žurnál leží v obrazu (superblock.journal_start_address, journal_size):
+ *   [hlavička: magic, seq][záznam seq][záznam seq+1]...
+ * Záznam = hlavička (magic, seq, počet bloků, CRC32C) + čísla bloků + obsah bloků.
+ * Platný je jen záznam se správným pořadím a součtem, takže roztržený zápis
+ * (pád uprostřed) se při přehrání prostě ignoruje.
+ *
+ * Pořadí při commitu: záznam do žurnálu -> fdatasync -> bloky na svá místa (bez sync).
+ * Když žurnál dojde, udělá se checkpoint: fdatasync míst, nová hlavička, fdatasync.
+ *
+ * Souběh (server): paměťovou vrstvu a žurnál chrání io_lock – čtení sdíleně,
+ * zápis výhradně. Záznam žurnálu ale smí obsahovat jen celé příkazy, proto commit
+ * zavře "bránu" (gate) měnícím příkazům, počká, až rozpracované doběhnou
+ * (fs_io_enter/fs_io_leave), a nové pustí až po zápisu záznamu. Vrstva se při
+ * commitu jen čte (io_lock sdíleně, výhradně až na její vyprázdnění), takže čtecí
+ * příkazy běží dál i během fdatasync.
+ *
+ * Víc procesů: zámek fcntl nad metadaty. Je to OFD zámek na vlastním fd, takže
+ * ho neuvolní zavření jiných fd téhož souboru (commit i příkazy je otevírají pořád).
+ * Zamyká se a uvolňuje jen se zavřenou branou, tedy když žádný příkaz neběží.
+ * Před zámkem se prochází turniketem (výhradní zámek jednoho bajtu za koncem
+ * obrazu): kdo čeká, drží turniket, a proces, který zámek právě pustil, se tak
+ * nepředběhne zpátky.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../include/fs_io.h"
+#include "../include/fs_crc.h"
+#include "../include/fs_sched.h"
+#include "../include/structs.h"
+
+#define JOURNAL_MAGIC 0x4C4E4A5Au   /* "ZJNL" */
+#define RECORD_MAGIC  0x43524A5Au   /* "ZJRC" */
+
+/* Turniket leží za koncem každého obrazu (adresy v superblocku jsou int32_t). */
+#define TURNSTILE_OFFSET ((off_t)INT32_MAX + 1)
+#define TURN_OVERDUE 4      /* za běhu příkazů se střídá až po tolika dávkách FS_BATCH_COMMANDS */
+#define GENERATION_OFFSET ((long)offsetof(struct superblock, generation))
+
+struct journal_header {
+    uint32_t magic;
+    uint32_t seq;       /* pořadové číslo prvního platného záznamu */
+};
+
+struct journal_record {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t count;     /* počet bloků */
+    uint32_t crc;       /* CRC32C celého záznamu s crc = 0 */
+};
+
+/* ========================================================================== */
+/* Stav                                                                       */
+/* ========================================================================== */
+
+/** Změněné bloky čekající na commit (otevřené adresování, klíč = číslo bloku). */
+static struct {
+    int64_t *keys;      /* -1 = volno */
+    uint8_t *data;      /* cap * FS_IO_BLOCK */
+    size_t cap;
+    size_t count;
+} dirty;
+
+static enum fs_durability io_mode = FS_DURABILITY_NONE;
+static char io_filename[1024];
+static int batch_commands;
+static int txn_depth;       /* vnoření begin/load; > 0 = změny se drží v paměti */
+static _Atomic uint64_t io_epoch;   /* počet vyprázdnění vrstvy (fs_io_epoch) */
+
+static pthread_rwlock_t io_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/**
+ * Příkazy v běhu. Commit zavře bránu zápisům (closed) a počká, až měnící příkazy
+ * doběhnou; čtecí běží dál. Změna zámku obrazu (turn) nepouští nic a čeká na všechny.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int inflight;
+    int writers;        /* z nich měnící obraz (fs_io_enter(true)) */
+    bool closed;
+    bool turn;
+} gate = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, false, false };
+
+static _Thread_local bool entered_write;    /* poslední fs_io_enter vlákna byl zápis */
+
+/** Zámek obrazu mezi procesy; mění se jen se zavřenou branou a io_lock. */
+static struct {
+    int fd;             /* vlastní fd zámku, -1 = obraz zatím neexistuje (před formátem) */
+    short mode;         /* F_UNLCK / F_RDLCK / F_WRLCK */
+    int commands;       /* příkazy od zamčení (po FS_BATCH_COMMANDS se pustí ostatní) */
+    uint32_t seen;      /* generace po posledním zamčení */
+    bool seen_valid;
+    void (*on_change)(void);
+} img = { -1, F_UNLCK, 0, 0, false, NULL };
+
+/* Stav žurnálu, načte se při připojení nebo líně při prvním commitu. */
+static bool j_loaded;
+static uint32_t j_seq;      /* seq dalšího záznamu */
+static long j_off;          /* offset dalšího záznamu v žurnálu */
+static long j_start;
+static long j_size;
+
+int fs_durability_parse(const char *name)
+{
+    if (!name) {
+        return -1;
+    }
+    if (strcmp(name, "none") == 0) {
+        return FS_DURABILITY_NONE;
+    }
+    if (strcmp(name, "batch") == 0) {
+        return FS_DURABILITY_BATCH;
+    }
+    if (strcmp(name, "always") == 0) {
+        return FS_DURABILITY_ALWAYS;
+    }
+    return -1;
+}
+
+/* ========================================================================== */
+/* Nízkoúrovňové pread/pwrite                                                 */
+/* ========================================================================== */
+
+static bool pread_all(int fd, void *buf, size_t len, long offset)
+{
+    uint8_t *p = (uint8_t *)buf;
+    while (len > 0) {
+        const ssize_t n = pread(fd, p, len, (off_t)offset);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return true;
+}
+
+static bool pwrite_all(int fd, const void *buf, size_t len, long offset)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    while (len > 0) {
+        const ssize_t n = pwrite(fd, p, len, (off_t)offset);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return true;
+}
+
+/**
+ * @brief Zapíše blok na jeho místo, poslední neúplný blok obrazu jen do konce souboru.
+ */
+static bool write_home_block(int fd, int64_t block, const uint8_t *data, long file_size)
+{
+    const long off = (long)block * FS_IO_BLOCK;
+    if (off >= file_size) {
+        return true;
+    }
+    const size_t len = (file_size - off < FS_IO_BLOCK) ? (size_t)(file_size - off) : FS_IO_BLOCK;
+    return pwrite_all(fd, data, len, off);
+}
+
+static long fd_size(int fd)
+{
+    struct stat st;
+    return (fstat(fd, &st) == 0) ? (long)st.st_size : 0;
+}
+
+/* ========================================================================== */
+/* Paměťová vrstva bloků                                                      */
+/* ========================================================================== */
+
+static size_t slot_of(int64_t block, size_t cap)
+{
+    return (size_t)(((uint64_t)block * 0x9E3779B97F4A7C15ULL) >> 32) & (cap - 1);
+}
+
+static long dirty_find(int64_t block)
+{
+    if (dirty.count == 0) {
+        return -1;
+    }
+    for (size_t i = slot_of(block, dirty.cap);; i = (i + 1) & (dirty.cap - 1)) {
+        if (dirty.keys[i] == block) {
+            return (long)i;
+        }
+        if (dirty.keys[i] == -1) {
+            return -1;
+        }
+    }
+}
+
+static bool dirty_grow(void)
+{
+    const size_t cap = dirty.cap ? dirty.cap * 2 : 64;
+    int64_t *keys = (int64_t *)malloc(cap * sizeof(int64_t));
+    uint8_t *data = (uint8_t *)malloc(cap * FS_IO_BLOCK);
+    if (!keys || !data) {
+        free(keys);
+        free(data);
+        return false;
+    }
+    for (size_t i = 0; i < cap; i++) {
+        keys[i] = -1;
+    }
+
+    for (size_t i = 0; i < dirty.cap; i++) {
+        if (dirty.keys[i] == -1) {
+            continue;
+        }
+        size_t j = slot_of(dirty.keys[i], cap);
+        while (keys[j] != -1) {
+            j = (j + 1) & (cap - 1);
+        }
+        keys[j] = dirty.keys[i];
+        memcpy(data + j * FS_IO_BLOCK, dirty.data + i * FS_IO_BLOCK, FS_IO_BLOCK);
+    }
+
+    free(dirty.keys);
+    free(dirty.data);
+    dirty.keys = keys;
+    dirty.data = data;
+    dirty.cap = cap;
+    return true;
+}
+
+/**
+ * @brief Vrátí paměťovou kopii bloku; poprvé ji naplní obsahem z disku.
+ */
+static uint8_t *dirty_block(int fd, int64_t block)
+{
+    const long found = dirty_find(block);
+    if (found >= 0) {
+        return dirty.data + (size_t)found * FS_IO_BLOCK;
+    }
+
+    if ((dirty.count + 1) * 2 > dirty.cap && !dirty_grow()) {
+        return NULL;
+    }
+
+    size_t i = slot_of(block, dirty.cap);
+    while (dirty.keys[i] != -1) {
+        i = (i + 1) & (dirty.cap - 1);
+    }
+
+    uint8_t *data = dirty.data + i * FS_IO_BLOCK;
+    memset(data, 0, FS_IO_BLOCK);
+    const ssize_t n = pread(fd, data, FS_IO_BLOCK, (off_t)(block * FS_IO_BLOCK));
+    (void)n; /* za koncem souboru zůstanou nuly */
+
+    dirty.keys[i] = block;
+    dirty.count++;
+    return data;
+}
+
+static void dirty_clear(void)
+{
+    for (size_t i = 0; i < dirty.cap; i++) {
+        dirty.keys[i] = -1;
+    }
+    dirty.count = 0;
+    atomic_fetch_add(&io_epoch, 1);
+}
+
+static int cmp_block(const void *a, const void *b)
+{
+    const int64_t x = dirty.keys[*(const size_t *)a];
+    const int64_t y = dirty.keys[*(const size_t *)b];
+    return (x > y) - (x < y);
+}
+
+/* ========================================================================== */
+/* Veřejné čtení/zápis                                                        */
+/* ========================================================================== */
+
+int fs_pread(FILE *f, long offset, void *buf, size_t len)
+{
+    if (!f || !buf || offset < 0) {
+        return 0;
+    }
+    fs_sched_io(len);
+
+    pthread_rwlock_rdlock(&io_lock);
+    const bool ok = pread_all(fileno(f), buf, len, offset);
+
+    /* Necommitnuté bloky mají přednost před obsahem disku. Bez čtení z disku
+       (za koncem obrazu) uspěje, jen když je celý rozsah ve vrstvě. */
+    if (dirty.count > 0 && len > 0) {
+        size_t covered = 0;
+        const int64_t first = offset / FS_IO_BLOCK;
+        const int64_t last = (offset + (long)len - 1) / FS_IO_BLOCK;
+        for (int64_t b = first; b <= last; b++) {
+            const long idx = dirty_find(b);
+            if (idx < 0) {
+                continue;
+            }
+            const long block_start = (long)b * FS_IO_BLOCK;
+            const long from = (offset > block_start) ? offset : block_start;
+            const long to = (offset + (long)len < block_start + FS_IO_BLOCK) ? offset + (long)len
+                                                                            : block_start + FS_IO_BLOCK;
+            memcpy((uint8_t *)buf + (from - offset),
+                   dirty.data + (size_t)idx * FS_IO_BLOCK + (from - block_start), (size_t)(to - from));
+            covered += (size_t)(to - from);
+        }
+        pthread_rwlock_unlock(&io_lock);
+        return ok || covered == len;
+    }
+
+    pthread_rwlock_unlock(&io_lock);
+    return ok;
+}
+
+int fs_pwrite(FILE *f, long offset, const void *buf, size_t len)
+{
+    if (!f || !buf || offset < 0) {
+        return 0;
+    }
+    fs_sched_io(len);
+
+    pthread_rwlock_wrlock(&io_lock);
+    if (io_mode == FS_DURABILITY_NONE && txn_depth == 0) {
+        const bool ok = pwrite_all(fileno(f), buf, len, offset);
+        pthread_rwlock_unlock(&io_lock);
+        return ok;
+    }
+
+    const uint8_t *src = (const uint8_t *)buf;
+    int ok = 1;
+    while (len > 0) {
+        const int64_t block = offset / FS_IO_BLOCK;
+        const long within = offset % FS_IO_BLOCK;
+        const size_t chunk = (len < (size_t)(FS_IO_BLOCK - within)) ? len : (size_t)(FS_IO_BLOCK - within);
+
+        uint8_t *data = dirty_block(fileno(f), block);
+        if (!data) {
+            ok = 0;
+            break;
+        }
+        memcpy(data + within, src, chunk);
+
+        src += chunk;
+        offset += (long)chunk;
+        len -= chunk;
+    }
+    pthread_rwlock_unlock(&io_lock);
+    return ok;
+}
+
+int fs_pwrite_data(int fd, long offset, const void *buf, size_t len)
+{
+    if (fd < 0 || !buf || offset < 0) {
+        return 0;
+    }
+    fs_sched_io(len);
+    if (!pwrite_all(fd, buf, len, offset)) {
+        return 0;
+    }
+
+    /* Jen čtení tabulky – nové bloky se nepřidávají, takže souběh vláken nevadí. */
+    pthread_rwlock_rdlock(&io_lock);
+    if (dirty.count > 0 && len > 0) {
+        const int64_t first = offset / FS_IO_BLOCK;
+        const int64_t last = (offset + (long)len - 1) / FS_IO_BLOCK;
+        for (int64_t b = first; b <= last; b++) {
+            const long idx = dirty_find(b);
+            if (idx < 0) {
+                continue;
+            }
+            const long block_start = (long)b * FS_IO_BLOCK;
+            const long from = (offset > block_start) ? offset : block_start;
+            const long to = (offset + (long)len < block_start + FS_IO_BLOCK) ? offset + (long)len
+                                                                            : block_start + FS_IO_BLOCK;
+            memcpy(dirty.data + (size_t)idx * FS_IO_BLOCK + (from - block_start),
+                   (const uint8_t *)buf + (from - offset), (size_t)(to - from));
+        }
+    }
+    pthread_rwlock_unlock(&io_lock);
+    return 1;
+}
+
+/* ========================================================================== */
+/* Žurnál                                                                     */
+/* ========================================================================== */
+
+/**
+ * @brief Načte polohu žurnálu ze superblocku na disku.
+ */
+static bool journal_geometry(int fd)
+{
+    struct superblock sb;
+    /* obraz jiného rozvržení má na místě adres žurnálu cizí data */
+    if (!pread_all(fd, &sb, sizeof(sb), 0) || !FS_LAYOUT_OK(&sb) || sb.journal_start_address <= 0 ||
+        sb.journal_size <= FS_IO_BLOCK) {
+        return false;
+    }
+    j_start = sb.journal_start_address;
+    j_size = sb.journal_size;
+    return true;
+}
+
+static void journal_write_header(int fd, uint32_t seq)
+{
+    const struct journal_header h = { JOURNAL_MAGIC, seq };
+    (void)pwrite_all(fd, &h, sizeof(h), j_start);
+    (void)fdatasync(fd);
+}
+
+/**
+ * @brief Checkpoint: všechny bloky jsou na místě, žurnál se může začít psát od začátku.
+ */
+static void journal_checkpoint(int fd)
+{
+    (void)fdatasync(fd);
+    journal_write_header(fd, j_seq);
+    j_off = FS_IO_BLOCK;
+}
+
+/**
+ * @brief Přehraje potvrzené záznamy žurnálu. Vrací počet přehraných záznamů.
+ */
+static int journal_replay(int fd)
+{
+    struct journal_header h;
+    if (!pread_all(fd, &h, sizeof(h), j_start) || h.magic != JOURNAL_MAGIC) {
+        /* čerstvý obraz – žurnál se založí */
+        j_seq = 1;
+        journal_write_header(fd, j_seq);
+        j_off = FS_IO_BLOCK;
+        return 0;
+    }
+
+    const long file_size = fd_size(fd);
+    const long max_count = (j_size - FS_IO_BLOCK) / (FS_IO_BLOCK + (long)sizeof(int64_t));
+    uint32_t seq = h.seq;
+    long off = FS_IO_BLOCK;
+    int replayed = 0;
+
+    for (;;) {
+        struct journal_record rec;
+        if (off + (long)sizeof(rec) > j_size || !pread_all(fd, &rec, sizeof(rec), j_start + off) ||
+            rec.magic != RECORD_MAGIC || rec.seq != seq || rec.count == 0 || (long)rec.count > max_count) {
+            break;
+        }
+
+        const size_t size = sizeof(rec) + (size_t)rec.count * (sizeof(int64_t) + FS_IO_BLOCK);
+        if (off + (long)size > j_size) {
+            break;
+        }
+
+        uint8_t *buf = (uint8_t *)malloc(size);
+        if (!buf || !pread_all(fd, buf, size, j_start + off)) {
+            free(buf);
+            break;
+        }
+
+        const uint32_t crc = rec.crc;
+        ((struct journal_record *)buf)->crc = 0;
+        if (fs_crc32c(0, buf, size) != crc) {
+            free(buf);
+            break; /* roztržený zápis – záznam nebyl potvrzen */
+        }
+
+        const int64_t *blocks = (const int64_t *)(buf + sizeof(rec));
+        const uint8_t *data = buf + sizeof(rec) + (size_t)rec.count * sizeof(int64_t);
+        for (uint32_t i = 0; i < rec.count; i++) {
+            (void)write_home_block(fd, blocks[i], data + (size_t)i * FS_IO_BLOCK, file_size);
+        }
+        free(buf);
+
+        off += (long)size;
+        seq++;
+        replayed++;
+    }
+
+    j_seq = seq;
+    if (replayed > 0) {
+        journal_checkpoint(fd);
+    }
+    j_off = FS_IO_BLOCK;
+    return replayed;
+}
+
+/**
+ * @brief Vyprázdní vrstvu po zápisu. Se sdíleným io_lock (shared) ho na tu chvíli
+ *        povýší – měnící příkazy stojí za zavřenou branou, nic nového nepřibude.
+ */
+static void dirty_retire(bool shared)
+{
+    if (shared) {
+        pthread_rwlock_unlock(&io_lock);
+        pthread_rwlock_wrlock(&io_lock);
+    }
+    dirty_clear();
+    if (shared) {
+        pthread_rwlock_unlock(&io_lock);
+        pthread_rwlock_rdlock(&io_lock);
+    }
+}
+
+/**
+ * @brief Zapíše změněné bloky (přes žurnál podle režimu) a vyprázdní vrstvu.
+ *
+ * Volá se s výhradním io_lock, nebo se sdíleným (shared) a bránou zavřenou zápisům:
+ * vrstva se do vyprázdnění jen čte, takže čtecí příkazy mezitím běží.
+ * Když se bloky zapsat nepodaří, zůstanou ve vrstvě (jsou to potvrzené příkazy)
+ * a zkusí se znovu při dalším commitu.
+ * @return true, nebo false při chybě zápisu (hláška na stderr).
+ */
+static bool commit_dirty(bool shared)
+{
+    if (dirty.count == 0) {
+        return true;
+    }
+
+    const int fd = open(io_filename, O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "COMMIT FAILED: %s (%zu blocks kept)\n", strerror(errno), dirty.count);
+        return false;
+    }
+    const long file_size = fd_size(fd);
+
+    if (!j_loaded && io_mode != FS_DURABILITY_NONE && journal_geometry(fd)) {
+        (void)journal_replay(fd);
+        j_loaded = true;
+    }
+
+    size_t *order = (size_t *)malloc(dirty.count * sizeof(size_t));
+    if (!order) {
+        close(fd);
+        return false;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < dirty.cap; i++) {
+        if (dirty.keys[i] != -1) {
+            order[n++] = i;
+        }
+    }
+    /* Bloky seřazené podle pozice – zápis na místo jde sekvenčně. */
+    qsort(order, n, sizeof(order[0]), cmp_block);
+
+    const size_t size = sizeof(struct journal_record) + n * (sizeof(int64_t) + FS_IO_BLOCK);
+
+    if (io_mode == FS_DURABILITY_NONE || !j_loaded || (long)size > j_size - FS_IO_BLOCK) {
+        /* Bez žurnálu (nebo větší než celý žurnál): přímý zápis, atomicita se ztrácí. */
+        if (io_mode != FS_DURABILITY_NONE && j_loaded) {
+            journal_checkpoint(fd);
+        }
+        bool written = true;
+        for (size_t i = 0; i < n; i++) {
+            written &= write_home_block(fd, dirty.keys[order[i]], dirty.data + order[i] * FS_IO_BLOCK, file_size);
+        }
+        if (io_mode != FS_DURABILITY_NONE) {
+            written &= fdatasync(fd) == 0;
+        }
+        free(order);
+        if (written) {
+            dirty_retire(shared);
+        } else {
+            fprintf(stderr, "COMMIT FAILED: %s (%zu blocks kept)\n", strerror(errno), dirty.count);
+        }
+        close(fd);
+        return written;
+    }
+
+    if (j_off + (long)size > j_size) {
+        journal_checkpoint(fd);
+    }
+
+    uint8_t *buf = (uint8_t *)malloc(size);
+    if (!buf) {
+        free(order);
+        close(fd);
+        return false;
+    }
+
+    struct journal_record rec = { RECORD_MAGIC, j_seq, (uint32_t)n, 0 };
+    memcpy(buf, &rec, sizeof(rec));
+    int64_t *blocks = (int64_t *)(buf + sizeof(rec));
+    uint8_t *data = buf + sizeof(rec) + n * sizeof(int64_t);
+    for (size_t i = 0; i < n; i++) {
+        blocks[i] = dirty.keys[order[i]];
+        memcpy(data + i * FS_IO_BLOCK, dirty.data + order[i] * FS_IO_BLOCK, FS_IO_BLOCK);
+    }
+    rec.crc = fs_crc32c(0, buf, size);
+    memcpy(buf, &rec, sizeof(rec));
+
+    /* 1) záznam + fdatasync = commit, 2) bloky na místo (trvalé až s checkpointem) */
+    if (!pwrite_all(fd, buf, size, j_start + j_off) || fdatasync(fd) != 0) {
+        /* Záznam není potvrzený (a jeho seq se použije znovu) – bloky zůstanou ve vrstvě. */
+        fprintf(stderr, "COMMIT FAILED: %s (%zu blocks kept)\n", strerror(errno), dirty.count);
+        free(buf);
+        free(order);
+        close(fd);
+        return false;
+    }
+    j_off += (long)size;
+    j_seq++;
+
+    /* Po potvrzení záznamu chybu zápisu na místo opraví přehrání žurnálu. */
+    for (size_t i = 0; i < n; i++) {
+        (void)write_home_block(fd, blocks[i], data + i * FS_IO_BLOCK, file_size);
+    }
+
+    free(buf);
+    free(order);
+    dirty_retire(shared);
+    close(fd);
+    return true;
+}
+
+/* ========================================================================== */
+/* Zámek obrazu mezi procesy                                                  */
+/* ========================================================================== */
+
+static bool lock_range(int fd, short type, off_t start, off_t len, bool wait)
+{
+    struct flock fl = { .l_type = type, .l_whence = SEEK_SET, .l_start = start, .l_len = len };
+    while (fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &fl) != 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Konec oblasti metadat podle superblocku. Čte se ještě bez zámku, ale všechny
+ *        rozsahy začínají na 0, takže se překrývají i během formátu jiným procesem.
+ */
+static off_t meta_end(int fd)
+{
+    struct superblock sb;
+    if (!pread_all(fd, &sb, sizeof(sb), 0) || sb.data_start_address <= 0) {
+        return (off_t)sizeof(sb);
+    }
+    return (off_t)sb.data_start_address;
+}
+
+/**
+ * @brief Generace obrazu; 0 pro obraz jiného rozvržení (FS_LAYOUT_OK), kde na jejím
+ *        místě leží cizí data – takový obraz se generací nikdy nepřepisuje.
+ */
+static uint32_t read_generation(int fd, bool *known)
+{
+    struct superblock sb;
+    *known = pread_all(fd, &sb, sizeof(sb), 0) && FS_LAYOUT_OK(&sb);
+    return *known ? sb.generation : 0;
+}
+
+/**
+ * @brief Má žurnál potvrzené a nepřehrané záznamy (držitel zámku spadl)?
+ *
+ * Po checkpointu je seq v hlavičce vždy vyšší než u starého záznamu na začátku.
+ */
+static bool journal_pending(int fd)
+{
+    struct journal_header h;
+    struct journal_record rec;
+    return journal_geometry(fd) && pread_all(fd, &h, sizeof(h), j_start) && h.magic == JOURNAL_MAGIC &&
+           pread_all(fd, &rec, sizeof(rec), j_start + FS_IO_BLOCK) && rec.magic == RECORD_MAGIC &&
+           rec.seq == h.seq;
+}
+
+/**
+ * @brief Zamkne oblast metadat přes turniket (viz začátek souboru).
+ */
+static bool image_lock(short type)
+{
+    if (!lock_range(img.fd, F_WRLCK, TURNSTILE_OFFSET, 1, true)) {
+        return false;
+    }
+    const bool ok = lock_range(img.fd, type, 0, meta_end(img.fd), true);
+    (void)lock_range(img.fd, F_UNLCK, TURNSTILE_OFFSET, 1, false);
+    return ok;
+}
+
+/**
+ * @brief Zamkne obraz a zjistí, jestli ho mezitím neměnil jiný proces.
+ *
+ * Při cizí změně se zavolá img.on_change; žurnál zemřelého držitele přehraje až
+ * výhradní zámek (čtenář si o něj řekne sám). Výhradní zámek zvýší generaci hned,
+ * takže ostatní změnu poznají, i kdyby tento proces uprostřed spadl.
+ * Volá se se zavřenou branou a výhradním io_lock.
+ */
+static void image_acquire(bool write)
+{
+    short type = write ? F_WRLCK : F_RDLCK;
+    for (;;) {
+        if (!image_lock(type)) {
+            return; /* fcntl selhal – příkazy poběží bez zámku jako dřív */
+        }
+
+        bool known;
+        uint32_t gen = read_generation(img.fd, &known);
+        const bool changed = !img.seen_valid || gen != img.seen;
+        if (changed && type == F_RDLCK && journal_pending(img.fd)) {
+            (void)lock_range(img.fd, F_UNLCK, 0, 0, false);
+            type = F_WRLCK;
+            continue;
+        }
+
+        if (type == F_WRLCK) {
+            if (changed || !j_loaded) {
+                j_loaded = false;
+                if (journal_geometry(img.fd)) {
+                    const int replayed = journal_replay(img.fd);
+                    if (replayed > 0) {
+                        fprintf(stderr, "JOURNAL: replayed %d transactions\n", replayed);
+                    }
+                    j_loaded = true;
+                }
+                gen = read_generation(img.fd, &known);
+            }
+            if (known) {
+                gen++;
+                (void)pwrite_all(img.fd, &gen, sizeof(gen), GENERATION_OFFSET);
+            }
+        }
+
+        img.mode = type;
+        img.seen = gen;
+        img.seen_valid = true;
+        img.commands = 0;
+        if (changed && img.on_change) {
+            img.on_change();
+        }
+        return;
+    }
+}
+
+/**
+ * @brief Před puštěním zámku: potvrdí čekající změny a výhradní držitel vyprázdní žurnál.
+ *
+ * Další proces tak žurnál nemusí přehrávat a nepřepíše na místě nic, co se mezitím
+ * zapsalo mimo žurnál (fs_pwrite_data). Volá se s výhradním io_lock, nebo se sdíleným
+ * (shared) a bránou zavřenou zápisům.
+ * @return false, pokud změny zůstaly nezapsané (commit selhal).
+ */
+static bool image_settle(bool shared)
+{
+    if (txn_depth > 0) {
+        return true;
+    }
+    if (io_mode != FS_DURABILITY_NONE) {
+        if (!commit_dirty(shared)) {
+            return false;
+        }
+        batch_commands = 0;
+    }
+
+    /* bez fd zámku (obraz vznikl formátem až v tomto procesu) patří žurnál jen nám */
+    if ((img.mode == F_WRLCK || img.fd < 0) && j_loaded && j_off > FS_IO_BLOCK) {
+        const int fd = (img.fd >= 0) ? img.fd : open(io_filename, O_RDWR);
+        if (fd >= 0) {
+            journal_checkpoint(fd);
+            if (fd != img.fd) {
+                close(fd);
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Potvrdí čekající změny a pustí zámek obrazu (otevřená transakce ho drží dál).
+ *        Volá se se zavřenou branou a výhradním io_lock.
+ *
+ * Nezapsané změny (commit selhal) zámek drží dál – jiný proces by je jinak přepsal.
+ */
+static void image_release(void)
+{
+    if (txn_depth > 0 || !image_settle(false)) {
+        return;
+    }
+
+    if (img.mode != F_UNLCK) {
+        (void)lock_range(img.fd, F_UNLCK, 0, 0, false);
+        img.mode = F_UNLCK;
+    }
+    img.commands = 0;
+}
+
+/** Musí se před příkazem zámek změnit? Volá se pod gate.lock. */
+static bool image_needs_turn(bool write)
+{
+    if (img.fd < 0) {
+        return io_filename[0] != '\0' && access(io_filename, F_OK) == 0;
+    }
+    if (img.mode == F_UNLCK || (write && img.mode == F_RDLCK)) {
+        return true;
+    }
+    /* Střídání s ostatními procesy: kdo ho spustí, čeká na doběhnutí měnících příkazů
+       a na potvrzení jejich změn. Radši tedy, když nic neběží, a po změnách ho čtení
+       nechává měnícím příkazům (nebo nečinnosti, fs_io_flush) – samo až po TURN_OVERDUE
+       dávkách. */
+    const bool costly = gate.inflight > 0 || (!write && img.mode == F_WRLCK);
+    const int due = costly ? FS_BATCH_COMMANDS * TURN_OVERDUE : FS_BATCH_COMMANDS;
+    return img.commands >= due && !fs_io_in_transaction();
+}
+
+/** Zavře bránu zápisům (až bude otevřená) a počká na rozpracované zápisy. Drží gate.lock. */
+static void gate_close_locked(void)
+{
+    while (gate.closed || gate.turn) {
+        pthread_cond_wait(&gate.cond, &gate.lock);
+    }
+    gate.closed = true;
+    while (gate.writers > 0) {
+        pthread_cond_wait(&gate.cond, &gate.lock);
+    }
+}
+
+/**
+ * @brief Změna zámku obrazu. Změny se nejdřív potvrdí se sdíleným io_lock (čtení
+ *        běží dál), pak se zavře brána všem a počká se na rozpracované čtení.
+ *
+ * Volá se s bránou zavřenou zápisům, gate.lock se mezitím pouští.
+ */
+static void gate_turn_locked(void)
+{
+    pthread_mutex_unlock(&gate.lock);
+    pthread_rwlock_rdlock(&io_lock);
+    (void)image_settle(true);
+    pthread_rwlock_unlock(&io_lock);
+    pthread_mutex_lock(&gate.lock);
+
+    gate.turn = true;
+    while (gate.inflight > 0) {
+        pthread_cond_wait(&gate.cond, &gate.lock);
+    }
+}
+
+static void gate_open_locked(void)
+{
+    gate.closed = false;
+    gate.turn = false;
+    pthread_cond_broadcast(&gate.cond);
+}
+
+/* ========================================================================== */
+/* Veřejné řízení                                                             */
+/* ========================================================================== */
+
+void fs_io_open(const char *filename, enum fs_durability mode)
+{
+    pthread_rwlock_wrlock(&io_lock);
+    (void)snprintf(io_filename, sizeof(io_filename), "%s", filename ? filename : "");
+    io_mode = mode;
+    batch_commands = 0;
+    j_loaded = false;
+
+    /* Sdílený zámek stačí; po pádu předchozího držitele si řekne o výhradní a přehraje
+       žurnál. Bez obrazu se zámek i žurnál založí až po formátu. */
+    img.fd = open(io_filename, O_RDWR);
+    if (img.fd >= 0) {
+        image_acquire(false);
+        image_release();
+    }
+    pthread_rwlock_unlock(&io_lock);
+}
+
+void fs_io_on_change(void (*fn)(void))
+{
+    img.on_change = fn;
+}
+
+uint32_t fs_io_generation(void)
+{
+    return img.seen;
+}
+
+void fs_io_enter(bool write)
+{
+    pthread_mutex_lock(&gate.lock);
+    while (gate.turn || (write && gate.closed)) {
+        pthread_cond_wait(&gate.cond, &gate.lock);
+    }
+    if (image_needs_turn(write)) {
+        /* Zámek se mění jen, když žádný příkaz neběží; po FS_BATCH_COMMANDS
+           příkazech se pustí a zamkne znovu, aby se dostaly ostatní procesy. */
+        gate_close_locked();
+        gate_turn_locked();
+        pthread_mutex_unlock(&gate.lock);
+
+        pthread_rwlock_wrlock(&io_lock);
+        image_release();
+        if (img.fd < 0) {
+            img.fd = open(io_filename, O_RDWR);
+        }
+        if (img.fd >= 0 && img.mode == F_UNLCK) {
+            image_acquire(write);
+        }
+        pthread_rwlock_unlock(&io_lock);
+
+        pthread_mutex_lock(&gate.lock);
+        gate_open_locked();
+    }
+    gate.inflight++;
+    gate.writers += write;
+    entered_write = write;
+    pthread_mutex_unlock(&gate.lock);
+}
+
+void fs_io_leave(void)
+{
+    pthread_mutex_lock(&gate.lock);
+    img.commands++;
+    const bool last_writer = entered_write && --gate.writers == 0;
+    if (--gate.inflight == 0 || last_writer) {
+        pthread_cond_broadcast(&gate.cond);
+    }
+    pthread_mutex_unlock(&gate.lock);
+}
+
+/**
+ * @brief Commit na hranici příkazů: zavře bránu zápisům, počká na rozpracované
+ *        změny a zapíše záznam. Čtecí příkazy mezitím běží.
+ *
+ * Pokud už commit (nebo změna zámku) běží, pokryje i změny volajícího (ten je
+ * dokončil před voláním), takže se jen počká na jeho konec.
+ */
+static void commit_quiesced(void)
+{
+    pthread_mutex_lock(&gate.lock);
+    if (gate.closed || gate.turn) {
+        while (gate.closed || gate.turn) {
+            pthread_cond_wait(&gate.cond, &gate.lock);
+        }
+        pthread_mutex_unlock(&gate.lock);
+        return;
+    }
+    gate.closed = true;
+    while (gate.writers > 0) {
+        pthread_cond_wait(&gate.cond, &gate.lock);
+    }
+    pthread_mutex_unlock(&gate.lock);
+
+    pthread_rwlock_rdlock(&io_lock);
+    if (io_mode != FS_DURABILITY_NONE && txn_depth == 0 && commit_dirty(true)) {
+        batch_commands = 0;
+    }
+    pthread_rwlock_unlock(&io_lock);
+
+    pthread_mutex_lock(&gate.lock);
+    gate_open_locked();
+    pthread_mutex_unlock(&gate.lock);
+}
+
+void fs_io_commit(void)
+{
+    pthread_rwlock_wrlock(&io_lock);
+    bool due = io_mode != FS_DURABILITY_NONE && dirty.count > 0 && txn_depth == 0;
+    if (due && io_mode == FS_DURABILITY_BATCH) {
+        /* Skupinový commit: čeká se na víc příkazů, dokud se záznam vejde do půlky žurnálu. */
+        const long pending = (long)dirty.count * (FS_IO_BLOCK + (long)sizeof(int64_t));
+        const long limit = j_loaded ? (j_size - FS_IO_BLOCK) / 2 : 64L * FS_IO_BLOCK;
+        due = ++batch_commands >= FS_BATCH_COMMANDS || pending >= limit;
+    }
+    pthread_rwlock_unlock(&io_lock);
+
+    if (due) {
+        commit_quiesced();
+    }
+}
+
+void fs_io_flush(void)
+{
+    pthread_rwlock_rdlock(&io_lock);
+    const bool pending = dirty.count > 0 || img.fd < 0;
+    pthread_rwlock_unlock(&io_lock);
+
+    pthread_mutex_lock(&gate.lock);
+    while (gate.closed || gate.turn) {
+        pthread_cond_wait(&gate.cond, &gate.lock);
+    }
+    if (!pending && img.mode == F_UNLCK) {
+        pthread_mutex_unlock(&gate.lock);
+        return;
+    }
+    gate_close_locked();
+    gate_turn_locked();
+    pthread_mutex_unlock(&gate.lock);
+
+    pthread_rwlock_wrlock(&io_lock);
+    image_release();
+    pthread_rwlock_unlock(&io_lock);
+
+    pthread_mutex_lock(&gate.lock);
+    gate_open_locked();
+    pthread_mutex_unlock(&gate.lock);
+}
+
+void fs_io_checkpoint(void)
+{
+    /* Nedokončená transakce se při ukončení zahodí. */
+    fs_io_abort();
+    fs_io_flush();
+}
+
+void fs_io_discard(void)
+{
+    pthread_rwlock_wrlock(&io_lock);
+    if (dirty.count > 0) {
+        dirty_clear();
+    }
+    batch_commands = 0;
+    j_loaded = false;
+    pthread_rwlock_unlock(&io_lock);
+}
+
+bool fs_io_buffered(void)
+{
+    pthread_rwlock_rdlock(&io_lock);
+    const bool buffered = io_mode != FS_DURABILITY_NONE || txn_depth > 0;
+    pthread_rwlock_unlock(&io_lock);
+    return buffered;
+}
+
+uint64_t fs_io_epoch(void)
+{
+    return atomic_load(&io_epoch);
+}
+
+/* ========================================================================== */
+/* Transakce (begin/commit/abort, load)                                       */
+/* ========================================================================== */
+
+int fs_io_begin(void)
+{
+    pthread_rwlock_wrlock(&io_lock);
+    /* Vrstva před vnější transakcí drží potvrzené příkazy dávky (i jiných klientů
+       serveru – begin běží sám). Zapíšou se hned, takže abort zahodí jen transakci. */
+    const bool ok = txn_depth > 0 || commit_dirty(false);
+    if (ok) {
+        if (txn_depth == 0) {
+            batch_commands = 0;
+        }
+        txn_depth++;
+    }
+    pthread_rwlock_unlock(&io_lock);
+    return ok;
+}
+
+int fs_io_in_transaction(void)
+{
+    pthread_rwlock_rdlock(&io_lock);
+    const int active = txn_depth > 0;
+    pthread_rwlock_unlock(&io_lock);
+    return active;
+}
+
+int fs_io_end(void)
+{
+    pthread_rwlock_wrlock(&io_lock);
+    const int active = txn_depth > 0;
+    /* nejvnější konec: jeden zápis všech změn, bloky seřazené podle offsetu
+       (vnořená transakce zapíše až ta vnější) */
+    if (active && --txn_depth == 0 && commit_dirty(false)) {
+        batch_commands = 0;
+    }
+    pthread_rwlock_unlock(&io_lock);
+    return active;
+}
+
+int fs_io_abort(void)
+{
+    pthread_rwlock_wrlock(&io_lock);
+    const int active = txn_depth > 0;
+    if (active) {
+        /* fs_io_begin vrstvu vyprázdnil – všechno v ní patří transakci */
+        txn_depth = 0;
+        if (dirty.count > 0) {
+            dirty_clear();
+        }
+    }
+    pthread_rwlock_unlock(&io_lock);
+    return active;
+}
@@ -0,0 +1,131 @@
+#define _POSIX_C_SOURCE 200809L
+/**
+ * @file fs_lock.c
+ * @brief Zámky inodů, úseků tabulky sdílení a sdílených struktur svazku (viz fs_lock.h).
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "../include/fs_lock.h"
+
+static pthread_rwlock_t inode_locks[FS_INODE_LOCK_STRIPES];
+static pthread_mutex_t shard_locks[FS_ALLOC_SHARDS];
+static pthread_mutex_t global_locks[FS_LOCK_COUNT];
+static pthread_once_t locks_once = PTHREAD_ONCE_INIT;
+
+static atomic_int next_home_shard;
+static _Thread_local int home_shard = -1;
+
+static void locks_init(void)
+{
+    for (int i = 0; i < FS_INODE_LOCK_STRIPES; i++) {
+        pthread_rwlock_init(&inode_locks[i], NULL);
+    }
+    for (int i = 0; i < FS_ALLOC_SHARDS; i++) {
+        pthread_mutex_init(&shard_locks[i], NULL);
+    }
+    for (int i = 0; i < FS_LOCK_COUNT; i++) {
+        pthread_mutex_init(&global_locks[i], NULL);
+    }
+}
+
+/* ========================================================================== */
+/* Sady zámků inodů                                                           */
+/* ========================================================================== */
+
+void fs_lock_set_init(struct fs_lock_set *set)
+{
+    set->count = 0;
+    set->held = false;
+}
+
+void fs_lock_set_add(struct fs_lock_set *set, int inode_id, bool exclusive)
+{
+    if (inode_id < 0) {
+        return;
+    }
+    const uint16_t stripe = (uint16_t)(inode_id % FS_INODE_LOCK_STRIPES);
+    for (int i = 0; i < set->count; i++) {
+        if (set->items[i].stripe == stripe) {
+            set->items[i].exclusive |= exclusive;
+            return;
+        }
+    }
+    if (set->count < FS_LOCK_SET_MAX) {
+        set->items[set->count].stripe = stripe;
+        set->items[set->count].exclusive = exclusive;
+        set->count++;
+    }
+}
+
+void fs_lock_set_acquire(struct fs_lock_set *set)
+{
+    pthread_once(&locks_once, locks_init);
+
+    /* vkládání podle pruhu – sada je malá */
+    for (int i = 1; i < set->count; i++) {
+        for (int j = i; j > 0 && set->items[j - 1].stripe > set->items[j].stripe; j--) {
+            const struct fs_lock_item tmp = set->items[j];
+            set->items[j] = set->items[j - 1];
+            set->items[j - 1] = tmp;
+        }
+    }
+
+    for (int i = 0; i < set->count; i++) {
+        pthread_rwlock_t *lock = &inode_locks[set->items[i].stripe];
+        if (set->items[i].exclusive) {
+            pthread_rwlock_wrlock(lock);
+        } else {
+            pthread_rwlock_rdlock(lock);
+        }
+    }
+    set->held = true;
+}
+
+void fs_lock_set_release(struct fs_lock_set *set)
+{
+    if (!set->held) {
+        return;
+    }
+    for (int i = set->count - 1; i >= 0; i--) {
+        pthread_rwlock_unlock(&inode_locks[set->items[i].stripe]);
+    }
+    set->held = false;
+}
+
+/* ========================================================================== */
+/* Globální zámky a úseky tabulky sdílení                                     */
+/* ========================================================================== */
+
+void fs_lock(enum fs_lock_id id)
+{
+    pthread_once(&locks_once, locks_init);
+    pthread_mutex_lock(&global_locks[id]);
+}
+
+void fs_unlock(enum fs_lock_id id)
+{
+    pthread_mutex_unlock(&global_locks[id]);
+}
+
+void fs_lock_shard(int shard)
+{
+    pthread_once(&locks_once, locks_init);
+    pthread_mutex_lock(&shard_locks[shard]);
+}
+
+void fs_unlock_shard(int shard)
+{
+    pthread_mutex_unlock(&shard_locks[shard]);
+}
+
+int fs_lock_home_shard(void)
+{
+    if (home_shard < 0) {
+        home_shard = atomic_fetch_add_explicit(&next_home_shard, 1, memory_order_relaxed) % FS_ALLOC_SHARDS;
+    }
+    return home_shard;
+}
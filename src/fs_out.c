@@ -0,0 +1,69 @@
+#define _POSIX_C_SOURCE 200809L
+/**
+ * @file fs_out.c
+ * @brief Výstup příkazů po vláknech (viz fs_out.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+#include "../include/fs_out.h"
+#include "../include/fs_sched.h"
+
+static _Thread_local FILE *thread_out; /* NULL = stdout */
+
+FILE *fs_out(void)
+{
+    return thread_out ? thread_out : stdout;
+}
+
+void fs_out_set(FILE *out)
+{
+    thread_out = out;
+}
+
+int fs_printf(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    const int n = vfprintf(fs_out(), fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+/* ========================================================================== */
+/* Pomocná vlákna                                                             */
+/* ========================================================================== */
+
+struct out_start {
+    void *(*fn)(void *);
+    void *arg;
+    FILE *out;
+    struct fs_sched_tag tag;    /* třída I/O příkazu (fs_sched.h) */
+};
+
+static void *out_thread_main(void *p)
+{
+    struct out_start start = *(struct out_start *)p;
+    free(p);
+    thread_out = start.out;
+    fs_sched_adopt(start.tag);
+    return start.fn(start.arg);
+}
+
+int fs_out_thread(pthread_t *tid, void *(*fn)(void *), void *arg)
+{
+    struct out_start *start = (struct out_start *)malloc(sizeof(*start));
+    if (!start) {
+        return -1;
+    }
+    *start = (struct out_start){ fn, arg, thread_out, fs_sched_tag() };
+
+    const int rc = pthread_create(tid, NULL, out_thread_main, start);
+    if (rc != 0) {
+        free(start);
+    }
+    return rc;
+}
@@ -0,0 +1,269 @@
+#define _POSIX_C_SOURCE 200809L
+/**
+ * @file fs_prefetch.c
+ * @brief Pool vláken připravujících vstupy incp pro load --prefetch.
+ *
+ * Záznamy tvoří frontu v pořadí lístků. Vlákna berou nezpracované záznamy od
+ * začátku fronty (next_job), hlavní vlákno je po provedení operace odebírá z čela.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../include/fs_prefetch.h"
+#include "../include/fs_compress.h"
+#include "../include/structs.h"
+
+enum prefetch_state {
+    PREFETCH_QUEUED,
+    PREFETCH_RUNNING,
+    PREFETCH_READY,
+    PREFETCH_FAILED     /* nejde otevřít / moc velký – fs_incp čte sám a vypíše hlášku */
+};
+
+struct prefetch_entry {
+    uint32_t ticket;
+    enum prefetch_state state;
+    bool compress;
+    char *path;
+    struct prefetched_file file;
+    struct prefetch_entry *next;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;                /* nový záznam nebo stop */
+    pthread_cond_t done;                /* záznam dočten */
+    pthread_t threads[PREFETCH_MAX_THREADS];
+    int thread_count;
+    struct prefetch_entry *head, *tail;
+    struct prefetch_entry *next_job;    /* první záznam, který žádné vlákno nevzalo */
+    uint32_t current;
+    bool active;
+    bool stop;
+} pf = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+/* ========================================================================== */
+/* Vlákna                                                                     */
+/* ========================================================================== */
+
+/**
+ * @brief Načte celý soubor do paměti. Vrací false, pokud nejde (nebo je větší než limit).
+ */
+static bool read_whole_file(const char *path, uint8_t **data, long *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+
+    bool ok = false;
+    uint8_t *buf = NULL;
+    if (fseek(f, 0, SEEK_END) != 0) {
+        goto cleanup;
+    }
+    const long len = ftell(f);
+    if (len < 0 || len > PREFETCH_MAX_BYTES || fseek(f, 0, SEEK_SET) != 0) {
+        goto cleanup;
+    }
+
+    buf = (uint8_t *)malloc(len > 0 ? (size_t)len : 1u);
+    if (!buf || fread(buf, 1, (size_t)len, f) != (size_t)len) {
+        goto cleanup;
+    }
+
+    *data = buf;
+    *size = len;
+    buf = NULL;
+    ok = true;
+
+cleanup:
+    free(buf);
+    fclose(f);
+    return ok;
+}
+
+static void *prefetch_worker(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&pf.lock);
+    for (;;) {
+        while (!pf.next_job && !pf.stop) {
+            pthread_cond_wait(&pf.work, &pf.lock);
+        }
+        if (!pf.next_job) {
+            break;
+        }
+
+        struct prefetch_entry *e = pf.next_job;
+        pf.next_job = e->next;
+        e->state = PREFETCH_RUNNING;
+        pthread_mutex_unlock(&pf.lock);
+
+        struct prefetched_file file = {0};
+        const bool ok = read_whole_file(e->path, &file.data, &file.size);
+
+        /* stejný výpočet jako ve write_buffer_to_new_inode() (malé soubory jdou inline) */
+        if (ok && e->compress && file.size > INODE_INLINE_MAX) {
+            file.payload = (uint8_t *)malloc((size_t)file.size);
+            file.payload_len = file.payload
+                ? fs_compress_file(file.data, (int)file.size, CLUSTER_SIZE, file.payload, (int)file.size)
+                : 0;
+        }
+
+        pthread_mutex_lock(&pf.lock);
+        e->file = file;
+        e->state = ok ? PREFETCH_READY : PREFETCH_FAILED;
+        pthread_cond_broadcast(&pf.done);
+    }
+    pthread_mutex_unlock(&pf.lock);
+    return NULL;
+}
+
+static void wait_finished(const struct prefetch_entry *e)
+{
+    while (e->state == PREFETCH_QUEUED || e->state == PREFETCH_RUNNING) {
+        pthread_cond_wait(&pf.done, &pf.lock);
+    }
+}
+
+static void free_entry(struct prefetch_entry *e)
+{
+    free(e->path);
+    free(e->file.data);
+    free(e->file.payload);
+    free(e);
+}
+
+/* ========================================================================== */
+/* API                                                                        */
+/* ========================================================================== */
+
+int prefetch_start(int threads)
+{
+    if (pf.active || threads < 1) {
+        return 0;
+    }
+    if (threads > PREFETCH_MAX_THREADS) {
+        threads = PREFETCH_MAX_THREADS;
+    }
+
+    pf.stop = false;
+    pf.thread_count = 0;
+    for (int t = 0; t < threads; t++) {
+        if (pthread_create(&pf.threads[t], NULL, prefetch_worker, NULL) != 0) {
+            break;
+        }
+        pf.thread_count++;
+    }
+    if (pf.thread_count == 0) {
+        return 0;
+    }
+
+    pf.active = true;
+    return 1;
+}
+
+void prefetch_submit(uint32_t ticket, const char *host_path, bool compress)
+{
+    struct prefetch_entry *e = (struct prefetch_entry *)calloc(1, sizeof(*e));
+    if (!e || !(e->path = strdup(host_path))) {
+        free(e);
+        return; /* bez přednačtení – fs_incp si soubor přečte sám */
+    }
+    e->ticket = ticket;
+    e->state = PREFETCH_QUEUED;
+    e->compress = compress;
+
+    pthread_mutex_lock(&pf.lock);
+    if (pf.tail) {
+        pf.tail->next = e;
+    } else {
+        pf.head = e;
+    }
+    pf.tail = e;
+    if (!pf.next_job) {
+        pf.next_job = e;
+    }
+    pthread_cond_signal(&pf.work);
+    pthread_mutex_unlock(&pf.lock);
+}
+
+void prefetch_begin_op(uint32_t ticket)
+{
+    pthread_mutex_lock(&pf.lock);
+    pf.current = ticket;
+    pthread_mutex_unlock(&pf.lock);
+}
+
+void prefetch_end_op(uint32_t ticket)
+{
+    pthread_mutex_lock(&pf.lock);
+    while (pf.head && pf.head->ticket <= ticket) {
+        struct prefetch_entry *e = pf.head;
+        wait_finished(e);   /* vlákno s ním může ještě pracovat */
+        pf.head = e->next;
+        if (pf.tail == e) {
+            pf.tail = NULL;
+        }
+        free_entry(e);
+    }
+    pthread_mutex_unlock(&pf.lock);
+}
+
+void prefetch_stop(void)
+{
+    if (!pf.active) {
+        return;
+    }
+
+    pthread_mutex_lock(&pf.lock);
+    pf.stop = true;
+    pf.next_job = NULL;     /* nezačatá práce se zahodí */
+    pthread_cond_broadcast(&pf.work);
+    pthread_mutex_unlock(&pf.lock);
+
+    for (int t = 0; t < pf.thread_count; t++) {
+        pthread_join(pf.threads[t], NULL);
+    }
+
+    while (pf.head) {
+        struct prefetch_entry *e = pf.head;
+        pf.head = e->next;
+        free_entry(e);
+    }
+    pf.tail = NULL;
+    pf.thread_count = 0;
+    pf.active = false;
+}
+
+bool prefetch_take(const char *host_path, struct prefetched_file *out)
+{
+    if (!pf.active) {
+        return false;
+    }
+
+    bool found = false;
+    pthread_mutex_lock(&pf.lock);
+    for (struct prefetch_entry *e = pf.head; e && e->ticket <= pf.current; e = e->next) {
+        if (e->ticket != pf.current || strcmp(e->path, host_path) != 0) {
+            continue;
+        }
+        wait_finished(e);
+        if (e->state == PREFETCH_READY) {
+            *out = e->file;
+            e->file = (struct prefetched_file){0};
+            e->state = PREFETCH_FAILED; /* vyzvednuto, podruhé už ne */
+            found = true;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&pf.lock);
+    return found;
+}
@@ -0,0 +1,91 @@
+#define _POSIX_C_SOURCE 200809L
+/**
+ * @file fs_sched.c
+ * @brief Třídy I/O vláken a přibrzdění hromadného I/O (viz fs_sched.h).
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../include/fs_sched.h"
+
+static _Thread_local struct fs_sched_tag thread_tag = { FS_IO_NORMAL, NULL };
+static _Thread_local int thread_running;    /* vnoření run_begin (load uvnitř řádku) */
+
+/** Běžící interaktivní příkazy; hromadné I/O čeká na nulu. */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+    atomic_int running;
+} interactive = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0 };
+
+int64_t fs_sched_budget_ns(enum fs_io_class cls)
+{
+    static const int64_t budget_ms[FS_IO_CLASSES] = {
+        [FS_IO_INTERACTIVE] = FS_SCHED_INTERACTIVE_BUDGET_MS,
+        [FS_IO_NORMAL] = FS_SCHED_NORMAL_BUDGET_MS,
+        [FS_IO_BULK] = FS_SCHED_BULK_BUDGET_MS,
+    };
+    return budget_ms[(cls >= 0 && cls < FS_IO_CLASSES) ? cls : FS_IO_NORMAL] * 1000000;
+}
+
+void fs_sched_set(enum fs_io_class cls, _Atomic uint64_t *bytes)
+{
+    thread_tag = (struct fs_sched_tag){ cls, bytes };
+}
+
+struct fs_sched_tag fs_sched_tag(void)
+{
+    return thread_tag;
+}
+
+void fs_sched_adopt(struct fs_sched_tag tag)
+{
+    thread_tag = tag;
+}
+
+void fs_sched_run_begin(void)
+{
+    if (thread_tag.cls == FS_IO_INTERACTIVE && thread_running++ == 0) {
+        atomic_fetch_add(&interactive.running, 1);
+    }
+}
+
+void fs_sched_run_end(void)
+{
+    if (thread_tag.cls != FS_IO_INTERACTIVE || thread_running == 0 || --thread_running > 0) {
+        return;
+    }
+    if (atomic_fetch_sub(&interactive.running, 1) == 1) {
+        pthread_mutex_lock(&interactive.lock);
+        pthread_cond_broadcast(&interactive.idle);
+        pthread_mutex_unlock(&interactive.lock);
+    }
+}
+
+void fs_sched_io(size_t len)
+{
+    if (thread_tag.bytes) {
+        atomic_fetch_add_explicit(thread_tag.bytes, len, memory_order_relaxed);
+    }
+    if (thread_tag.cls != FS_IO_BULK || atomic_load(&interactive.running) == 0) {
+        return;
+    }
+
+    /* Přednost interaktivních příkazů, ale s termínem – hromadná práce nestojí. */
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += FS_SCHED_BULK_YIELD_US * 1000L;
+    if (until.tv_nsec >= 1000000000L) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&interactive.lock);
+    while (atomic_load(&interactive.running) > 0 &&
+           pthread_cond_timedwait(&interactive.idle, &interactive.lock, &until) == 0) {
+    }
+    pthread_mutex_unlock(&interactive.lock);
+}
@@ -0,0 +1,533 @@
+#define _POSIX_C_SOURCE 200809L
+/**
+ * @file fs_script.c
+ * @brief Překlad skriptů pro load: pole operací, pool řetězců, strom cest, cache na disku.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#include "../include/fs_script.h"
+#include "../include/fs_crc.h"
+
+enum {
+    SCRIPT_MAX_PATH = 1024,     /* delší cesty se nenormalizují (MAX_PATH_LEN v main.c) */
+    SCRIPT_MAX_SEGMENTS = 256   /* víc segmentů make_abs_path nezpracuje stejně */
+};
+
+#define NO_ENTRY UINT32_MAX
+
+/** Hlavička souboru .zsc, za ní ops, args a pool. */
+struct script_cache_header {
+    char magic[4];              /* "ZSC1" */
+    uint32_t signature;         /* otisk tabulky příkazů */
+    int64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint32_t op_count;
+    uint32_t arg_count;
+    uint32_t pool_size;
+    uint32_t crc;               /* CRC32C ops + args + pool */
+};
+
+/* ========================================================================== */
+/* Sestavení                                                                  */
+/* ========================================================================== */
+
+/** Uzel stromu cest: jeden segment, celá normalizovaná cesta je v poolu. */
+struct path_node {
+    uint32_t parent;
+    uint32_t name;              /* offset internovaného segmentu */
+    uint32_t path;              /* offset internované celé cesty */
+};
+
+struct builder {
+    struct script *s;
+    uint32_t ops_cap;
+    uint32_t args_cap;
+    uint32_t pool_cap;
+
+    uint32_t *strings;          /* hash řetězec -> offset (NO_ENTRY = volno) */
+    uint32_t strings_cap;
+    uint32_t strings_count;
+
+    struct path_node *nodes;
+    uint32_t node_count;
+    uint32_t nodes_cap;
+    uint32_t *children;         /* hash (rodič, segment) -> uzel */
+    uint32_t children_cap;
+};
+
+static uint32_t hash_bytes(const char *p, size_t len, uint32_t h)
+{
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static bool grow(void **arr, uint32_t *cap, uint32_t need, size_t elem)
+{
+    if (need <= *cap) {
+        return true;
+    }
+    uint32_t n = *cap ? *cap : 64;
+    while (n < need) {
+        n *= 2;
+    }
+    void *p = realloc(*arr, (size_t)n * elem);
+    if (!p) {
+        return false;
+    }
+    *arr = p;
+    *cap = n;
+    return true;
+}
+
+static bool table_init(uint32_t **table, uint32_t cap)
+{
+    *table = (uint32_t *)malloc((size_t)cap * sizeof(uint32_t));
+    if (!*table) {
+        return false;
+    }
+    for (uint32_t i = 0; i < cap; i++) {
+        (*table)[i] = NO_ENTRY;
+    }
+    return true;
+}
+
+static bool strings_rehash(struct builder *b)
+{
+    const uint32_t cap = b->strings_cap ? b->strings_cap * 2 : 256;
+    uint32_t *table;
+    if (!table_init(&table, cap)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < b->strings_cap; i++) {
+        const uint32_t off = b->strings[i];
+        if (off == NO_ENTRY) {
+            continue;
+        }
+        const char *str = b->s->pool + off;
+        uint32_t j = hash_bytes(str, strlen(str), 2166136261u) & (cap - 1);
+        while (table[j] != NO_ENTRY) {
+            j = (j + 1) & (cap - 1);
+        }
+        table[j] = off;
+    }
+    free(b->strings);
+    b->strings = table;
+    b->strings_cap = cap;
+    return true;
+}
+
+/**
+ * @brief Vloží řetězec (len bajtů) do poolu, shodné řetězce sdílí jeden offset.
+ */
+static uint32_t intern(struct builder *b, const char *str, size_t len)
+{
+    if ((b->strings_count + 1) * 2 > b->strings_cap && !strings_rehash(b)) {
+        return NO_ENTRY;
+    }
+
+    uint32_t j = hash_bytes(str, len, 2166136261u) & (b->strings_cap - 1);
+    for (; b->strings[j] != NO_ENTRY; j = (j + 1) & (b->strings_cap - 1)) {
+        const char *have = b->s->pool + b->strings[j];
+        if (strncmp(have, str, len) == 0 && have[len] == '\0') {
+            return b->strings[j];
+        }
+    }
+
+    if (!grow((void **)&b->s->pool, &b->pool_cap, b->s->pool_size + (uint32_t)len + 1, 1)) {
+        return NO_ENTRY;
+    }
+    const uint32_t off = b->s->pool_size;
+    memcpy(b->s->pool + off, str, len);
+    b->s->pool[off + len] = '\0';
+    b->s->pool_size += (uint32_t)len + 1;
+
+    b->strings[j] = off;
+    b->strings_count++;
+    return off;
+}
+
+static uint32_t child_slot(uint32_t parent, uint32_t name, uint32_t cap)
+{
+    return (uint32_t)(((uint64_t)parent * 0x9E3779B97F4A7C15ULL ^ name) * 0x9E3779B97F4A7C15ULL >> 32) & (cap - 1);
+}
+
+static bool children_rehash(struct builder *b)
+{
+    const uint32_t cap = b->children_cap ? b->children_cap * 2 : 256;
+    uint32_t *table;
+    if (!table_init(&table, cap)) {
+        return false;
+    }
+    for (uint32_t n = 1; n < b->node_count; n++) {
+        uint32_t j = child_slot(b->nodes[n].parent, b->nodes[n].name, cap);
+        while (table[j] != NO_ENTRY) {
+            j = (j + 1) & (cap - 1);
+        }
+        table[j] = n;
+    }
+    free(b->children);
+    b->children = table;
+    b->children_cap = cap;
+    return true;
+}
+
+/**
+ * @brief Potomek uzlu parent se jménem name (offset), případně ho založí.
+ */
+static uint32_t path_child(struct builder *b, uint32_t parent, uint32_t name)
+{
+    if ((b->node_count + 1) * 2 > b->children_cap && !children_rehash(b)) {
+        return NO_ENTRY;
+    }
+
+    uint32_t j = child_slot(parent, name, b->children_cap);
+    for (; b->children[j] != NO_ENTRY; j = (j + 1) & (b->children_cap - 1)) {
+        const struct path_node *n = &b->nodes[b->children[j]];
+        if (n->parent == parent && n->name == name) {
+            return b->children[j];
+        }
+    }
+
+    /* Celá cesta = cesta rodiče + "/" + segment */
+    char full[SCRIPT_MAX_PATH];
+    const char *parent_path = (parent == 0) ? "" : b->s->pool + b->nodes[parent].path;
+    const int len = snprintf(full, sizeof(full), "%s/%s", parent_path, b->s->pool + name);
+    if (len < 0 || len >= (int)sizeof(full)) {
+        return NO_ENTRY;
+    }
+    const uint32_t path = intern(b, full, (size_t)len);
+
+    if (path == NO_ENTRY ||
+        !grow((void **)&b->nodes, &b->nodes_cap, b->node_count + 1, sizeof(struct path_node))) {
+        return NO_ENTRY;
+    }
+    const uint32_t id = b->node_count++;
+    b->nodes[id] = (struct path_node){ parent, name, path };
+    b->children[j] = id;
+    return id;
+}
+
+/**
+ * @brief Normalizuje absolutní cestu stejně jako make_abs_path a vrátí offset v poolu.
+ */
+static uint32_t intern_path(struct builder *b, const char *path)
+{
+    const size_t len = strlen(path);
+    if (len >= SCRIPT_MAX_PATH) {
+        return intern(b, path, len);
+    }
+
+    /* Zásobník uzlů kvůli ".." (kořen = uzel 0). */
+    uint32_t stack[SCRIPT_MAX_SEGMENTS + 1];
+    int depth = 0;
+    stack[0] = 0;
+
+    for (const char *p = path; *p != '\0';) {
+        while (*p == '/') {
+            ++p;
+        }
+        const char *seg = p;
+        while (*p != '\0' && *p != '/') {
+            ++p;
+        }
+        const size_t seg_len = (size_t)(p - seg);
+        if (seg_len == 0 || (seg_len == 1 && seg[0] == '.')) {
+            continue;
+        }
+        if (seg_len == 2 && seg[0] == '.' && seg[1] == '.') {
+            if (depth > 0) {
+                --depth;
+            }
+            continue;
+        }
+        if (depth == SCRIPT_MAX_SEGMENTS) {
+            return intern(b, path, len); /* necháme na make_abs_path */
+        }
+
+        const uint32_t name = intern(b, seg, seg_len);
+        const uint32_t node = (name == NO_ENTRY) ? NO_ENTRY : path_child(b, stack[depth], name);
+        if (node == NO_ENTRY) {
+            return intern(b, path, len);
+        }
+        stack[++depth] = node;
+    }
+
+    return b->nodes[stack[depth]].path;
+}
+
+static bool push_arg(struct builder *b, uint32_t off)
+{
+    if (off == NO_ENTRY ||
+        !grow((void **)&b->s->args, &b->args_cap, b->s->arg_count + 1, sizeof(uint32_t))) {
+        return false;
+    }
+    b->s->args[b->s->arg_count++] = off;
+    return true;
+}
+
+/**
+ * @brief Přeloží jeden řádek skriptu (stejná pravidla jako původní load).
+ */
+static bool compile_line(struct builder *b, char *line, const struct script_commands *cmds)
+{
+    char *p = line;
+    while (*p == ' ' || *p == '\t') {
+        ++p;
+    }
+    if (*p == '#' || *p == '\n' || *p == '\0') {
+        return true;
+    }
+
+    char *tokens[SCRIPT_MAX_ARGS];
+    int count = 0;
+    char *saveptr = NULL;
+    for (char *tok = strtok_r(p, " \t\r\n", &saveptr); tok != NULL && count < SCRIPT_MAX_ARGS;
+         tok = strtok_r(NULL, " \t\r\n", &saveptr)) {
+        tokens[count++] = tok;
+    }
+    if (count == 0) {
+        return true;
+    }
+
+    const int id = cmds->lookup(tokens[0]);
+    const unsigned path_mask = (id >= 0) ? cmds->path_args(id) : 0;
+
+    struct script_op op;
+    op.cmd = (id >= 0) ? (uint16_t)id : (uint16_t)SCRIPT_UNKNOWN_COMMAND;
+    op.argc = (uint16_t)count;
+    op.first_arg = b->s->arg_count;
+
+    if (!push_arg(b, intern(b, tokens[0], strlen(tokens[0])))) {
+        return false;
+    }
+    int position = 0;
+    for (int i = 1; i < count; i++) {
+        const bool option = tokens[i][0] == '-' && tokens[i][1] != '\0';
+        const bool vfs_path = !option && ((path_mask >> position) & 1u) && tokens[i][0] == '/';
+        if (!option) {
+            position++;
+        }
+        const uint32_t off = vfs_path ? intern_path(b, tokens[i]) : intern(b, tokens[i], strlen(tokens[i]));
+        if (!push_arg(b, off)) {
+            return false;
+        }
+    }
+
+    if (!grow((void **)&b->s->ops, &b->ops_cap, b->s->op_count + 1, sizeof(struct script_op))) {
+        return false;
+    }
+    b->s->ops[b->s->op_count++] = op;
+    return true;
+}
+
+struct script *script_compile(const char *filename, const struct script_commands *cmds)
+{
+    FILE *src = (filename && cmds) ? fopen(filename, "r") : NULL;
+    if (!src) {
+        return NULL;
+    }
+
+    struct builder b;
+    memset(&b, 0, sizeof(b));
+    b.s = (struct script *)calloc(1, sizeof(struct script));
+
+    /* Uzel 0 = kořen "/" */
+    bool ok = b.s && grow((void **)&b.nodes, &b.nodes_cap, 1, sizeof(struct path_node));
+    if (ok) {
+        b.node_count = 1;
+        b.nodes[0] = (struct path_node){ 0, NO_ENTRY, intern(&b, "/", 1) };
+        ok = b.nodes[0].path != NO_ENTRY && children_rehash(&b);
+    }
+
+    char *line = NULL;
+    size_t n = 0;
+    while (ok && getline(&line, &n, src) != -1) {
+        ok = compile_line(&b, line, cmds);
+    }
+    free(line);
+    fclose(src);
+
+    free(b.strings);
+    free(b.nodes);
+    free(b.children);
+    if (!ok) {
+        script_free(b.s);
+        return NULL;
+    }
+    return b.s;
+}
+
+void script_free(struct script *s)
+{
+    if (!s) {
+        return;
+    }
+    free(s->ops);
+    free(s->args);
+    free(s->pool);
+    free(s);
+}
+
+/* ========================================================================== */
+/* Cache na disku                                                             */
+/* ========================================================================== */
+
+static bool cache_name(const char *filename, char *out, size_t out_sz)
+{
+    const int len = snprintf(out, out_sz, "%s%s", filename, SCRIPT_CACHE_SUFFIX);
+    return len > 0 && (size_t)len < out_sz;
+}
+
+static uint32_t script_crc(const struct script *s)
+{
+    uint32_t crc = fs_crc32c(0, s->ops, (size_t)s->op_count * sizeof(struct script_op));
+    crc = fs_crc32c(crc, s->args, (size_t)s->arg_count * sizeof(uint32_t));
+    return fs_crc32c(crc, s->pool, s->pool_size);
+}
+
+/**
+ * @brief Hlavička popisující aktuální stav zdrojového skriptu.
+ */
+static bool source_header(const char *filename, const struct script_commands *cmds,
+                          struct script_cache_header *h)
+{
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        return false;
+    }
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, "ZSC1", 4);
+    h->signature = cmds->signature;
+    h->source_size = (int64_t)st.st_size;
+    h->source_mtime_sec = (int64_t)st.st_mtim.tv_sec;
+    h->source_mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+    return true;
+}
+
+int script_save(const struct script *s, const char *filename, const struct script_commands *cmds)
+{
+    char path[1024];
+    char tmp[1040];
+    struct script_cache_header h;
+    if (!s || !filename || !cmds || !cache_name(filename, path, sizeof(path)) ||
+        !source_header(filename, cmds, &h)) {
+        return 0;
+    }
+    h.op_count = s->op_count;
+    h.arg_count = s->arg_count;
+    h.pool_size = s->pool_size;
+    h.crc = script_crc(s);
+
+    /* Zápis do dočasného souboru a rename – rozepsaná cache se nikdy nenačte. */
+    (void)snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *out = fopen(tmp, "wb");
+    if (!out) {
+        return 0;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, out) == 1 &&
+              fwrite(s->ops, sizeof(struct script_op), s->op_count, out) == s->op_count &&
+              fwrite(s->args, sizeof(uint32_t), s->arg_count, out) == s->arg_count &&
+              fwrite(s->pool, 1, s->pool_size, out) == s->pool_size;
+    ok = (fclose(out) == 0) && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        (void)remove(tmp);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Načte cache, pokud odpovídá zdrojovému skriptu. *exists = cache existuje.
+ */
+static struct script *cache_read(const char *filename, const struct script_commands *cmds, bool *exists)
+{
+    char path[1024];
+    struct script_cache_header want;
+    struct script_cache_header h;
+    *exists = false;
+    if (!cache_name(filename, path, sizeof(path)) || !source_header(filename, cmds, &want)) {
+        return NULL;
+    }
+
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        return NULL;
+    }
+    *exists = true;
+
+    struct script *s = NULL;
+    if (fread(&h, sizeof(h), 1, in) != 1 || memcmp(h.magic, want.magic, 4) != 0 ||
+        h.signature != want.signature || h.source_size != want.source_size ||
+        h.source_mtime_sec != want.source_mtime_sec || h.source_mtime_nsec != want.source_mtime_nsec) {
+        goto cleanup;
+    }
+
+    s = (struct script *)calloc(1, sizeof(struct script));
+    if (!s) {
+        goto cleanup;
+    }
+    s->op_count = h.op_count;
+    s->arg_count = h.arg_count;
+    s->pool_size = h.pool_size;
+    s->ops = (struct script_op *)malloc((size_t)h.op_count * sizeof(struct script_op) + 1);
+    s->args = (uint32_t *)malloc((size_t)h.arg_count * sizeof(uint32_t) + 1);
+    s->pool = (char *)malloc((size_t)h.pool_size + 1);
+    if (!s->ops || !s->args || !s->pool ||
+        fread(s->ops, sizeof(struct script_op), h.op_count, in) != h.op_count ||
+        fread(s->args, sizeof(uint32_t), h.arg_count, in) != h.arg_count ||
+        fread(s->pool, 1, h.pool_size, in) != h.pool_size || script_crc(s) != h.crc) {
+        script_free(s);
+        s = NULL;
+        goto cleanup;
+    }
+
+    /* Odkazy musí mířit dovnitř – poškozená cache nesmí číst mimo buffer. */
+    s->pool[s->pool_size] = '\0';
+    for (uint32_t i = 0; i < s->op_count; i++) {
+        const struct script_op *op = &s->ops[i];
+        if (op->argc == 0 || op->argc > SCRIPT_MAX_ARGS || op->first_arg > s->arg_count ||
+            s->arg_count - op->first_arg < op->argc) {
+            script_free(s);
+            s = NULL;
+            goto cleanup;
+        }
+    }
+    for (uint32_t i = 0; i < s->arg_count; i++) {
+        if (s->args[i] >= s->pool_size) {
+            script_free(s);
+            s = NULL;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    fclose(in);
+    return s;
+}
+
+struct script *script_load(const char *filename, const struct script_commands *cmds)
+{
+    if (!filename || !cmds) {
+        return NULL;
+    }
+
+    bool cache_exists = false;
+    struct script *s = cache_read(filename, cmds, &cache_exists);
+    if (s) {
+        return s;
+    }
+
+    s = script_compile(filename, cmds);
+    if (s && cache_exists) {
+        (void)script_save(s, filename, cmds); /* cache si někdo vyžádal – obnovíme ji */
+    }
+    return s;
+}
@@ -0,0 +1,711 @@
+#define _POSIX_C_SOURCE 200809L
+/**
+ * @file fs_server.c
+ * @brief Smyčka událostí serverového režimu (viz fs_server.h).
+ *
+ * Každý klient má vstupní buffer (přečtené, ještě neprovedené řádky) a výstupní
+ * frontu. Po každém probuzení smyčka převezme výstupy dokončených řádků a rozdá
+ * další, vždy nejvýš jeden řádek na klienta; klient s plnou výstupní frontou se
+ * přeskakuje, dokud si výstup nepřečte. Pracovní vlákno po dokončení řádku
+ * probudí smyčku přes eventfd.
+ *
+ * Rozdávání má dvě fáze: volní klienti nejdřív připraví svůj další řádek (třída
+ * a termín), pak se do počtu pracovních vláken rozdávají připravené řádky podle
+ * termínu. Řádky, na které nezbylo vlákno, zůstávají připravené u klienta, takže
+ * pozdě přišlý interaktivní řádek předběhne dřív přišlé hromadné.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "../include/fs_server.h"
+#include "../include/fs_walk.h"
+
+enum {
+    SERVE_EVENTS = 64,                  /* událostí na jedno epoll_wait */
+    SERVE_READ_CHUNK = 64 * 1024,
+    SERVE_IN_MAX = 1 << 20,             /* víc nepřečteného vstupu se nebere (klient počká) */
+    SERVE_OUT_MAX = 1 << 20,            /* víc neodeslaného výstupu = další řádky klienta čekají */
+    SERVE_MIN_WORKERS = 4,              /* příkazy hlavně čekají na disk – víc vláken než jader */
+    SERVE_MAX_WORKERS = 32
+};
+
+struct serve_client {
+    int fd;
+    void *session;
+    uint32_t events;                    /* zaregistrované události epoll */
+    char *in;
+    size_t in_len;
+    size_t in_cap;
+    char *out;
+    size_t out_off;                     /* odeslaná část fronty */
+    size_t out_len;
+    size_t out_cap;
+    bool eof;                           /* klient zavřel zápis */
+    bool done;                          /* exit – jen doposlat výstup */
+    bool broken;                        /* chyba spojení – zavřít hned */
+    bool hup;                           /* klient zavřel obě strany – zbytek vstupu se provede naslepo */
+    bool busy;                          /* řádek má pracovní vlákno */
+    bool ready;                         /* line je připravený, čeká na vlákno */
+    bool line_serial;                   /* line musí běžet sám (ops->serial) */
+    enum fs_io_class cls;               /* třída line (ops->priority) */
+    int64_t deadline;                   /* termín line (CLOCK_MONOTONIC, ns) */
+    _Atomic uint64_t io_bytes;          /* bajty obrazu přenesené řádky klienta (podíl hromadných) */
+    /* předávka s pracovním vláknem (fronta a hotové pod serve.lock) */
+    char *line;                         /* řádek k provedení */
+    char *result;                       /* jeho výstup */
+    size_t result_len;
+    bool go_on;
+    struct serve_client *job_next;
+    struct serve_client *next;
+};
+
+struct serve {
+    const struct fs_server_ops *ops;
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd;                        /* eventfd: pracovní vlákno dokončilo řádek */
+    struct serve_client *clients;       /* v pořadí připojení (pořadí střídání) */
+    struct serve_client *owner;         /* relace s transakcí, NULL = žádná */
+    struct serve_client *waiting;       /* řádek, který musí běžet sám, čeká na doběhnutí ostatních */
+    int running;                        /* rozdané řádky (smyčka) */
+    int running_normal;                 /* z nich běžné a hromadné */
+    int running_bulk;
+    bool serial;                        /* právě běží řádek, který musí být sám */
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    struct serve_client *queue_head;    /* řádky pro pracovní vlákna */
+    struct serve_client *queue_tail;
+    struct serve_client *finished;      /* provedené řádky, výstup si vyzvedne smyčka */
+    bool stopping;
+    int workers;
+    pthread_t tids[SERVE_MAX_WORKERS];
+};
+
+static volatile sig_atomic_t serve_stop;
+
+static void serve_signal(int sig)
+{
+    (void)sig;
+    serve_stop = 1;
+}
+
+/* ========================================================================== */
+/* Buffery klienta                                                            */
+/* ========================================================================== */
+
+static bool buf_reserve(char **buf, size_t *cap, size_t need)
+{
+    if (need <= *cap) {
+        return true;
+    }
+    size_t grown = *cap ? *cap : 4096;
+    while (grown < need) {
+        grown *= 2;
+    }
+    char *p = (char *)realloc(*buf, grown);
+    if (!p) {
+        return false;
+    }
+    *buf = p;
+    *cap = grown;
+    return true;
+}
+
+static bool would_block(void)
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+static void client_read(struct serve_client *c)
+{
+    while (!c->eof && c->in_len < SERVE_IN_MAX) {
+        if (!buf_reserve(&c->in, &c->in_cap, c->in_len + SERVE_READ_CHUNK)) {
+            c->broken = true;
+            return;
+        }
+        const ssize_t n = read(c->fd, c->in + c->in_len, SERVE_READ_CHUNK);
+        if (n > 0) {
+            c->in_len += (size_t)n;
+        } else if (n == 0) {
+            c->eof = true;
+        } else {
+            c->broken = !would_block();
+            return;
+        }
+    }
+}
+
+static void client_flush(struct serve_client *c)
+{
+    while (!c->hup && c->out_off < c->out_len) {
+        const ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            c->broken = !would_block();
+            return;
+        }
+        c->out_off += (size_t)n;
+    }
+    c->out_off = 0;
+    c->out_len = 0;
+}
+
+/** Zaregistruje jen události, na které má smysl čekat. */
+static void client_watch(struct serve *srv, struct serve_client *c)
+{
+    if (c->hup) {
+        client_read(c); /* odregistrovaný klient – zbytek vstupu se dočte bez epoll */
+        return;
+    }
+
+    uint32_t events = 0;
+    if (!c->eof && !c->done && c->in_len < SERVE_IN_MAX) {
+        events |= EPOLLIN;
+    }
+    if (c->out_len > c->out_off) {
+        events |= EPOLLOUT;
+    }
+    if (events != c->events) {
+        struct epoll_event ev = { .events = events, .data.ptr = c };
+        (void)epoll_ctl(srv->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = events;
+    }
+}
+
+static bool client_finished(const struct serve *srv, const struct serve_client *c)
+{
+    if (c->busy || srv->waiting == c || (c->ready && !c->broken)) {
+        return false;   /* řádek běží nebo čeká – relaci teď nejde zavřít */
+    }
+    if (c->broken) {
+        return true;
+    }
+    /* po exit se zbytek vstupu zahodí (jako na stdin) */
+    return c->out_len == c->out_off && (c->done || (c->eof && c->in_len == 0));
+}
+
+/* ========================================================================== */
+/* Pracovní vlákna                                                            */
+/* ========================================================================== */
+
+/**
+ * @brief Provádí řádky z fronty; výstup příkazu jde do paměťového proudu.
+ */
+static void *serve_worker(void *arg)
+{
+    struct serve *srv = (struct serve *)arg;
+
+    pthread_mutex_lock(&srv->lock);
+    for (;;) {
+        while (!srv->queue_head && !srv->stopping) {
+            pthread_cond_wait(&srv->work, &srv->lock);
+        }
+        struct serve_client *c = srv->queue_head;
+        if (!c) {
+            break;  /* konec serveru a fronta je prázdná */
+        }
+        srv->queue_head = c->job_next;
+        if (!srv->queue_head) {
+            srv->queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&srv->lock);
+
+        fs_sched_set(c->cls, &c->io_bytes);
+        char *result = NULL;
+        size_t result_len = 0;
+        FILE *out = open_memstream(&result, &result_len);
+        bool go_on = false;
+        if (out) {
+            go_on = srv->ops->exec(c->session, c->line, out);
+            fclose(out);
+        }
+        fs_sched_set(FS_IO_NORMAL, NULL);
+
+        pthread_mutex_lock(&srv->lock);
+        c->result = result;
+        c->result_len = result_len;
+        c->go_on = go_on;
+        c->job_next = srv->finished;
+        srv->finished = c;
+        pthread_mutex_unlock(&srv->lock);
+
+        const uint64_t one = 1;
+        (void)!write(srv->wake_fd, &one, sizeof(one));
+        pthread_mutex_lock(&srv->lock);
+    }
+    pthread_mutex_unlock(&srv->lock);
+    return NULL;
+}
+
+static int worker_count(void)
+{
+    const int n = 2 * fs_walk_threads(SERVE_MAX_WORKERS / 2);
+    return (n < SERVE_MIN_WORKERS) ? SERVE_MIN_WORKERS : n;
+}
+
+/**
+ * @brief Spustí pracovní vlákna. Volá se s blokovaným SIGINT/SIGTERM, vlákna masku
+ *        zdědí a signál tak vždy probudí smyčku událostí.
+ */
+static bool workers_start(struct serve *srv)
+{
+    const int wanted = worker_count();
+    while (srv->workers < wanted && pthread_create(&srv->tids[srv->workers], NULL, serve_worker, srv) == 0) {
+        srv->workers++;
+    }
+    return srv->workers > 0;
+}
+
+static void workers_stop(struct serve *srv)
+{
+    pthread_mutex_lock(&srv->lock);
+    srv->stopping = true;
+    pthread_cond_broadcast(&srv->work);
+    pthread_mutex_unlock(&srv->lock);
+    for (int i = 0; i < srv->workers; i++) {
+        pthread_join(srv->tids[i], NULL);
+    }
+    srv->workers = 0;
+}
+
+/* ========================================================================== */
+/* Rozdělování řádků                                                          */
+/* ========================================================================== */
+
+/**
+ * @brief Vyjme další úplný řádek klienta (po EOF i neukončený poslední) do c->line.
+ * @return false pokud klient žádný řádek nemá.
+ */
+static bool client_take_line(struct serve_client *c)
+{
+    char *nl = (char *)memchr(c->in, '\n', c->in_len);
+    size_t len = 0;
+    if (nl) {
+        len = (size_t)(nl - c->in);
+    } else if ((c->eof || c->in_len >= SERVE_IN_MAX) && c->in_len > 0) {
+        len = c->in_len;    /* příliš dlouhý řádek se provede tak, jak je */
+    } else {
+        return false;
+    }
+
+    c->line = (char *)malloc(len + 1);
+    if (!c->line) {
+        c->broken = true;
+        return false;
+    }
+    memcpy(c->line, c->in, len);
+    c->line[len] = '\0';
+
+    const size_t consumed = nl ? len + 1 : len;
+    memmove(c->in, c->in + consumed, c->in_len - consumed);
+    c->in_len -= consumed;
+    return true;
+}
+
+static int64_t serve_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void submit_line(struct serve *srv, struct serve_client *c)
+{
+    c->ready = false;
+    c->busy = true;
+    c->job_next = NULL;
+    srv->running++;
+    srv->running_normal += c->cls == FS_IO_NORMAL;
+    srv->running_bulk += c->cls == FS_IO_BULK;
+    srv->serial = c->line_serial;
+
+    pthread_mutex_lock(&srv->lock);
+    if (srv->queue_tail) {
+        srv->queue_tail->job_next = c;
+    } else {
+        srv->queue_head = c;
+    }
+    srv->queue_tail = c;
+    pthread_cond_signal(&srv->work);
+    pthread_mutex_unlock(&srv->lock);
+}
+
+/** Připraví další řádek volného klienta: třída, termín a jestli musí běžet sám. */
+static void client_prepare(struct serve *srv, struct serve_client *c, int64_t now)
+{
+    if (c->ready || c->busy || c->done || c->broken || c->out_len - c->out_off > SERVE_OUT_MAX ||
+        !client_take_line(c)) {
+        return;
+    }
+    c->ready = true;
+    c->line_serial = srv->ops->serial && srv->ops->serial(c->session, c->line);
+    c->cls = srv->ops->priority ? srv->ops->priority(c->session, c->line) : FS_IO_NORMAL;
+    c->deadline = now + fs_sched_budget_ns(c->cls);
+}
+
+/** Smí připravený řádek klienta běžet vedle rozdaných? */
+static bool client_eligible(const struct serve *srv, const struct serve_client *c, bool bulk_due)
+{
+    if (!c->ready || (srv->owner && srv->owner != c)) {
+        return false;
+    }
+    switch (c->cls) {
+    case FS_IO_INTERACTIVE:
+        return true;
+    case FS_IO_BULK:
+        return srv->running_normal == 0 && srv->running_bulk == 0;
+    default:
+        return srv->running_bulk == 0 && !bulk_due;
+    }
+}
+
+/** Má a přednost před b? Hromadné řádky před termínem se střídají podle podílu klienta. */
+static bool client_before(const struct serve_client *a, const struct serve_client *b, int64_t now)
+{
+    if (a->cls == FS_IO_BULK && b->cls == FS_IO_BULK && a->deadline > now && b->deadline > now) {
+        return atomic_load_explicit(&a->io_bytes, memory_order_relaxed) <
+               atomic_load_explicit(&b->io_bytes, memory_order_relaxed);
+    }
+    return a->deadline < b->deadline;
+}
+
+/** Připravený řádek, který má běžet jako další (NULL = žádný teď nesmí). */
+static struct serve_client *serve_pick(const struct serve *srv, int64_t now)
+{
+    bool bulk_due = false;
+    for (const struct serve_client *c = srv->clients; c; c = c->next) {
+        bulk_due |= c->ready && c->cls == FS_IO_BULK && c->deadline <= now &&
+                    (!srv->owner || srv->owner == c);
+    }
+
+    struct serve_client *best = NULL;
+    for (struct serve_client *c = srv->clients; c; c = c->next) {
+        if (client_eligible(srv, c, bulk_due) && (!best || client_before(c, best, now))) {
+            best = c;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Rozdá pracovním vláknům další řádky, nejvýš jeden na klienta.
+ *
+ * Řádky různých klientů běží souběžně, vybírají se podle termínu (serve_pick).
+ * Řádek, který musí běžet sám (ops->serial), počká, až rozdané řádky doběhnou,
+ * a do jeho konce se nic dalšího nerozdá. Relace s transakcí (owner) má obraz
+ * pro sebe, řádky ostatních čekají.
+ */
+static void serve_dispatch(struct serve *srv)
+{
+    if (srv->waiting) {
+        if (srv->running == 0) {
+            submit_line(srv, srv->waiting);
+            srv->waiting = NULL;
+        }
+        return;
+    }
+
+    const int64_t now = serve_now_ns();
+    for (struct serve_client *c = srv->clients; c; c = c->next) {
+        client_prepare(srv, c, now);
+    }
+
+    while (!srv->serial && srv->running < srv->workers) {
+        struct serve_client *c = serve_pick(srv, now);
+        if (!c) {
+            return;
+        }
+        if (c->line_serial && srv->running > 0) {
+            c->ready = false;
+            srv->waiting = c;
+            return;
+        }
+        submit_line(srv, c);
+    }
+}
+
+/**
+ * @brief Převezme výstupy dokončených řádků do front klientů.
+ */
+static void serve_collect(struct serve *srv)
+{
+    pthread_mutex_lock(&srv->lock);
+    struct serve_client *done = srv->finished;
+    srv->finished = NULL;
+    pthread_mutex_unlock(&srv->lock);
+
+    while (done) {
+        struct serve_client *c = done;
+        done = c->job_next;
+
+        if (c->result_len > 0) {
+            if (buf_reserve(&c->out, &c->out_cap, c->out_len + c->result_len)) {
+                memcpy(c->out + c->out_len, c->result, c->result_len);
+                c->out_len += c->result_len;
+            } else {
+                c->broken = true;
+            }
+        }
+        c->broken |= c->result == NULL;  /* výstup nešel zachytit */
+        free(c->result);
+        free(c->line);
+        c->result = NULL;
+        c->line = NULL;
+        c->done = !c->go_on;
+        c->busy = false;
+
+        srv->running_normal -= c->cls == FS_IO_NORMAL;
+        srv->running_bulk -= c->cls == FS_IO_BULK;
+        if (--srv->running == 0) {
+            srv->serial = false;
+        }
+        if (srv->ops->exclusive(c->session)) {
+            srv->owner = c;
+        } else if (srv->owner == c) {
+            srv->owner = NULL;
+        }
+        client_flush(c);
+    }
+}
+
+/* ========================================================================== */
+/* Spojení                                                                    */
+/* ========================================================================== */
+
+static bool set_nonblocking(int fd)
+{
+    const int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 && fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+static void serve_accept(struct serve *srv)
+{
+    for (;;) {
+        const int fd = accept(srv->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            return; /* EAGAIN = fronta spojení je prázdná */
+        }
+
+        struct serve_client *c = (struct serve_client *)calloc(1, sizeof(*c));
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        if (!c || !set_nonblocking(fd) || !(c->session = srv->ops->open(srv->ops->arg))) {
+            free(c);
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->events = EPOLLIN;
+        if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            srv->ops->close(c->session);
+            free(c);
+            close(fd);
+            continue;
+        }
+
+        struct serve_client **tail = &srv->clients;
+        while (*tail) {
+            tail = &(*tail)->next;
+        }
+        *tail = c;
+    }
+}
+
+static void client_drop(struct serve *srv, struct serve_client *c)
+{
+    if (srv->owner == c) {
+        srv->owner = NULL;
+    }
+    if (srv->waiting == c) {
+        srv->waiting = NULL;
+    }
+    srv->ops->close(c->session);
+    (void)epoll_ctl(srv->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->in);
+    free(c->out);
+    free(c->line);
+    free(c);
+}
+
+/**
+ * @brief Vytvoří naslouchající socket. Opuštěný socket po pádu serveru smaže,
+ *        socket běžícího serveru nechá být (vrací -1).
+ */
+static int serve_listen(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        const bool alive = probe >= 0 && connect(probe, (const struct sockaddr *)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) {
+            close(probe);
+        }
+        if (alive) {
+            return -1;
+        }
+        (void)unlink(path);
+    }
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (!set_nonblocking(fd) || bind(fd, (const struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* ========================================================================== */
+/* API                                                                        */
+/* ========================================================================== */
+
+int fs_serve(const char *socket_path, const struct fs_server_ops *ops)
+{
+    if (!socket_path || !ops) {
+        return 0;
+    }
+
+    int ok = 0;
+    sigset_t old_mask;
+    sigset_t wait_mask;
+    bool masked = false;
+    struct serve srv = {
+        .ops = ops,
+        .listen_fd = -1,
+        .epoll_fd = -1,
+        .wake_fd = -1,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .work = PTHREAD_COND_INITIALIZER,
+    };
+    srv.listen_fd = serve_listen(socket_path);
+    srv.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    srv.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event listen_ev = { .events = EPOLLIN, .data.ptr = NULL };
+    struct epoll_event wake_ev = { .events = EPOLLIN, .data.ptr = &srv.wake_fd };
+    if (srv.listen_fd < 0 || srv.epoll_fd < 0 || srv.wake_fd < 0 ||
+        epoll_ctl(srv.epoll_fd, EPOLL_CTL_ADD, srv.listen_fd, &listen_ev) != 0 ||
+        epoll_ctl(srv.epoll_fd, EPOLL_CTL_ADD, srv.wake_fd, &wake_ev) != 0) {
+        goto cleanup;
+    }
+
+    /* bez SA_RESTART: signál probudí epoll_pwait a smyčka skončí. Mimo čekání je
+     * SIGINT/SIGTERM blokovaný, jinak by signál mezi testem serve_stop a usnutím
+     * v epoll propadl (nebo ho dostalo pomocné vlákno) a server by nikdy neskončil. */
+    struct sigaction sa = { .sa_handler = serve_signal };
+    sigemptyset(&sa.sa_mask);
+    (void)sigaction(SIGINT, &sa, NULL);
+    (void)sigaction(SIGTERM, &sa, NULL);
+    (void)signal(SIGPIPE, SIG_IGN);
+    serve_stop = 0;
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+    masked = true;
+    wait_mask = old_mask;
+    sigdelset(&wait_mask, SIGINT);
+    sigdelset(&wait_mask, SIGTERM);
+    if (!workers_start(&srv)) {
+        goto cleanup;
+    }
+    ok = 1;
+
+    while (!serve_stop) {
+        serve_collect(&srv);
+        serve_dispatch(&srv);
+
+        for (struct serve_client **link = &srv.clients; *link;) {
+            struct serve_client *c = *link;
+            if (client_finished(&srv, c)) {
+                *link = c->next;
+                client_drop(&srv, c);
+                continue;
+            }
+            client_watch(&srv, c);
+            link = &c->next;
+        }
+        if (srv.running == 0 && ops->idle) {
+            ops->idle(ops->arg);
+        }
+
+        struct epoll_event events[SERVE_EVENTS];
+        const int n = epoll_pwait(srv.epoll_fd, events, SERVE_EVENTS, -1, &wait_mask);
+        for (int i = 0; i < n; i++) {
+            struct serve_client *c = (struct serve_client *)events[i].data.ptr;
+            if (!c) {
+                serve_accept(&srv);
+                continue;
+            }
+            if (events[i].data.ptr == &srv.wake_fd) {
+                uint64_t count;
+                (void)!read(srv.wake_fd, &count, sizeof(count));
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP)) {
+                client_read(c);
+            }
+            if ((events[i].events & EPOLLHUP) && !c->hup) {
+                /* EPOLLHUP nejde odmaskovat – bez odregistrování by se smyčka točila naprázdno */
+                (void)epoll_ctl(srv.epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+                c->hup = true;
+            }
+            if (events[i].events & EPOLLOUT) {
+                client_flush(c);
+            }
+            if (events[i].events & EPOLLERR) {
+                c->broken = true;
+            }
+        }
+    }
+
+cleanup:
+    /* rozdané řádky doběhnou, jejich výstup už nikam nejde */
+    workers_stop(&srv);
+    serve_collect(&srv);
+    while (srv.clients) {
+        struct serve_client *c = srv.clients;
+        srv.clients = c->next;
+        client_drop(&srv, c);
+    }
+    if (srv.listen_fd >= 0) {
+        close(srv.listen_fd);
+        (void)unlink(socket_path);
+    }
+    if (srv.epoll_fd >= 0) {
+        close(srv.epoll_fd);
+    }
+    if (srv.wake_fd >= 0) {
+        close(srv.wake_fd);
+    }
+    if (masked) {
+        (void)pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    }
+    return ok;
+}
@@ -14,22 +14,25 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "../include/fs_utils.h"
+#include "../include/fs_compress.h"
+#include "../include/fs_dedup.h"
+#include "../include/fs_crc.h"
+#include "../include/fs_io.h"
+#include "../include/fs_lock.h"
 
 /* ========================================================================== */
 /* Interní helpery                                                            */
 /* ========================================================================== */
 
-/**
- * @brief Bezpečný přesun kurzoru na absolutní offset.
- * @return true při úspěchu, jinak false.
- */
-static bool seek_abs(FILE *f, long offset)
-{
-    return f && fseek(f, offset, SEEK_SET) == 0;
-}
-
 /**
  * @brief Absolutní offset inodu v souboru FS.
  */
@@ -55,35 +58,231 @@ static long bitmap_start(const struct superblock *sb, bool is_inode_bitmap)
     return is_inode_bitmap ? sb->bitmapi_start_address : sb->bitmap_start_address;
 }
 
+/* ========================================================================== */
+/* Počítadla svazku                                                           */
+/* ========================================================================== */
+
+/*
+ * Invariant: počítadla = součet přes obsazené bity bitmap, u inodů včetně obsahu
+ * (adresář / velikost souboru). Bit 0 -> 1 přičte aktuální obsah inodu, 1 -> 0 ho
+ * odečte a zápis obsazeného inodu přičte rozdíl proti starému obsahu. Stačí tak
+ * hlídat bitmapové funkce a write_inode(); volající nic počítat nemusí.
+ */
+
+static const long counters_offset = (long)offsetof(struct superblock, counters);
+
+/** Příspěvek inodu do počítadel se znaménkem sign. */
+static void inode_usage(const struct pseudo_inode *inode, int sign, struct fs_counters *delta)
+{
+    if (inode->isDirectory) {
+        delta->directories += sign;
+    } else {
+        delta->logical_bytes += sign * (int64_t)inode->file_size;
+    }
+}
+
+/** Přičte delta k platným počítadlům na disku (a v sb). */
+static void counters_add(FILE *f, struct superblock *sb, const struct fs_counters *delta)
+{
+    if (delta->used_inodes == 0 && delta->used_clusters == 0 && delta->directories == 0 &&
+        delta->logical_bytes == 0) {
+        return;
+    }
+
+    fs_lock(FS_LOCK_COUNTERS);
+    struct fs_counters c;
+    /* neplatná počítadla se neudržují – obnoví je až fsck --repair */
+    if (fs_pread(f, counters_offset, &c, sizeof(c)) && c.valid == FS_COUNTERS_VALID) {
+        c.used_inodes += delta->used_inodes;
+        c.used_clusters += delta->used_clusters;
+        c.directories += delta->directories;
+        c.logical_bytes += delta->logical_bytes;
+        if (fs_pwrite(f, counters_offset, &c, sizeof(c))) {
+            sb->counters = c;
+        }
+    }
+    fs_unlock(FS_LOCK_COUNTERS);
+}
+
+static int bit_count_upto(const uint8_t *bitmap, int bits)
+{
+    int count = 0;
+    for (int i = 0; i < bits / 8; i++) {
+        count += __builtin_popcount(bitmap[i]);
+    }
+    if (bits % 8 != 0) {
+        count += __builtin_popcount(bitmap[bits / 8] & ((1u << (bits % 8)) - 1u));
+    }
+    return count;
+}
+
+int fs_counters_scan(FILE *f, struct superblock *sb, struct fs_counters *out)
+{
+    if (!f || !sb || !out) {
+        return 0;
+    }
+
+    int ok = 0;
+    const size_t bitmap_bytes = (size_t)(sb->cluster_count + 7) / 8;
+    uint8_t *ibm = (uint8_t *)malloc(bitmap_bytes);
+    uint8_t *dbm = (uint8_t *)malloc(bitmap_bytes);
+    struct pseudo_inode *table = (struct pseudo_inode *)malloc((size_t)sb->cluster_count * sizeof(*table));
+    if (!ibm || !dbm || !table || !fs_pread(f, bitmap_start(sb, true), ibm, bitmap_bytes) ||
+        !fs_pread(f, bitmap_start(sb, false), dbm, bitmap_bytes) ||
+        !fs_pread(f, sb->inode_start_address, table, (size_t)sb->cluster_count * sizeof(*table))) {
+        goto cleanup;
+    }
+
+    *out = (struct fs_counters){ .valid = FS_COUNTERS_VALID };
+    out->used_inodes = bit_count_upto(ibm, sb->cluster_count);
+    out->used_clusters = bit_count_upto(dbm, sb->cluster_count);
+    for (int i = 0; i < sb->cluster_count; i++) {
+        if (ibm[i / 8] & (1u << (i % 8))) {
+            inode_usage(&table[i], 1, out);
+        }
+    }
+    ok = 1;
+
+cleanup:
+    free(ibm);
+    free(dbm);
+    free(table);
+    return ok;
+}
+
 /* ========================================================================== */
 /* Superblock + inode I/O                                                     */
 /* ========================================================================== */
 
+/** Snapshot, přes který vlákno právě čte (cesty @snap:/...), "" = živý svazek. */
+static _Thread_local char snapshot_view[MAX_NAME_LEN];
+
+void fs_set_snapshot_view(const char *name)
+{
+    /* cesty ve snapshotu vedou na jiné inody – cache cest se při čtení ze snapshotu nepoužívá */
+    (void)snprintf(snapshot_view, sizeof(snapshot_view), "%s", name ? name : "");
+}
+
+int snapshot_chunk_count(const struct superblock *sb)
+{
+    const long table = (long)sb->cluster_count * (long)sizeof(struct pseudo_inode);
+    return (int)((table + sb->cluster_size - 1) / sb->cluster_size);
+}
+
+long snapshot_header_bytes(const struct superblock *sb)
+{
+    return (sb->cluster_count + 7) / 8 + (long)snapshot_chunk_count(sb) * (long)sizeof(int32_t);
+}
+
+void snapshot_redirect(struct superblock *sb, const struct snapshot_entry *snap)
+{
+    sb->bitmapi_start_address = (int32_t)cluster_offset(sb, snap->first_cluster);
+    sb->inode_start_address = sb->bitmapi_start_address + (sb->cluster_count + 7) / 8;
+}
+
+/**
+ * @brief Přesměruje tabulku inodů a inode bitmapu na kopii ve snapshotu.
+ *
+ * Datové clustery jsou společné, takže všechny čtecí funkce pak beze změny
+ * vidí stav ze snapshotu; tabulku čtou přes read_inode_table().
+ */
+static void apply_snapshot_view(struct superblock *sb)
+{
+    for (int i = 0; i < FS_MAX_SNAPSHOTS; i++) {
+        if (strcmp(sb->snapshots[i].name, snapshot_view) == 0) {
+            snapshot_redirect(sb, &sb->snapshots[i]);
+            return;
+        }
+    }
+}
+
+int read_inode_table(FILE *f, const struct superblock *sb, long offset, void *out, size_t len)
+{
+    if (sb->inode_start_address < sb->data_start_address) {
+        return fs_pread(f, sb->inode_start_address + offset, out, len);
+    }
+
+    /* snapshot: inode_start_address ukazuje na mapu úseků, úsek bez clusteru jsou nuly */
+    uint8_t *dst = (uint8_t *)out;
+    while (len > 0) {
+        const long chunk = offset / sb->cluster_size;
+        const long within = offset % sb->cluster_size;
+        const size_t piece = ((size_t)(sb->cluster_size - within) < len) ? (size_t)(sb->cluster_size - within) : len;
+
+        int32_t cluster = CLUSTER_UNUSED;
+        if (!fs_pread(f, sb->inode_start_address + chunk * (long)sizeof(cluster), &cluster, sizeof(cluster))) {
+            return 0;
+        }
+        if (cluster == CLUSTER_UNUSED) {
+            memset(dst, 0, piece);
+        } else if (cluster < 0 || cluster >= sb->cluster_count ||
+                   !fs_pread(f, cluster_offset(sb, cluster) + within, dst, piece)) {
+            return 0;
+        }
+        dst += piece;
+        offset += (long)piece;
+        len -= piece;
+    }
+    return 1;
+}
+
 int load_superblock(FILE *f, struct superblock *sb)
 {
     if (!f || !sb) {
         return 0;
     }
 
-    if (!seek_abs(f, 0)) {
+    if (!fs_pread(f, 0, sb, sizeof(*sb)) || !FS_LAYOUT_OK(sb)) {
         return 0;
     }
 
-    return fread(sb, sizeof(*sb), 1, f) == 1;
+    if (snapshot_view[0] != '\0') {
+        apply_snapshot_view(sb);
+    }
+    return 1;
 }
 
-void read_inode(FILE *f, struct superblock *sb, int inode_id, struct pseudo_inode *inode)
+int fs_layout_check(const char *filename)
 {
-    if (!f || !sb || !inode || inode_id < 0) {
-        return;
+    FILE *f = filename ? fopen(filename, "rb") : NULL;
+    if (!f) {
+        return -1;
+    }
+    struct superblock sb;
+    const int layout = fs_pread(f, 0, &sb, sizeof(sb)) ? FS_LAYOUT_OK(&sb) : -1;
+    fclose(f);
+    return layout;
+}
+
+int write_superblock(FILE *f, struct superblock *sb)
+{
+    /* Při čtení ze snapshotu má sb přesměrované adresy – na disk nesmí. */
+    if (!f || !sb || snapshot_view[0] != '\0') {
+        return 0;
     }
 
-    const long off = inode_offset(sb, inode_id);
-    if (!seek_abs(f, off)) {
+    /* počítadla mají vlastní zápis (counters_add), starší kopie sb je nesmí přepsat */
+    return fs_pwrite(f, 0, sb, offsetof(struct superblock, counters));
+}
+
+int fs_counters_store(FILE *f, struct superblock *sb, const struct fs_counters *counters)
+{
+    /* ze snapshotu se nezapisuje (sb tam ukazuje na kopii inode bitmapy) */
+    if (!f || !sb || !counters || snapshot_view[0] != '\0' ||
+        !fs_pwrite(f, counters_offset, counters, sizeof(*counters))) {
+        return 0;
+    }
+    sb->counters = *counters;
+    return 1;
+}
+
+void read_inode(FILE *f, struct superblock *sb, int inode_id, struct pseudo_inode *inode)
+{
+    if (!f || !sb || !inode || inode_id < 0) {
         return;
     }
 
-    (void)fread(inode, sizeof(*inode), 1, f);
+    (void)read_inode_table(f, sb, (long)inode_id * (long)sizeof(*inode), inode, sizeof(*inode));
 }
 
 void write_inode(FILE *f, struct superblock *sb, int inode_id, struct pseudo_inode *inode)
@@ -92,217 +291,1544 @@ void write_inode(FILE *f, struct superblock *sb, int inode_id, struct pseudo_ino
         return;
     }
 
-    const long off = inode_offset(sb, inode_id);
-    if (!seek_abs(f, off)) {
-        return;
+    /* obsazený inode: počítadla dostanou rozdíl proti starému obsahu */
+    uint8_t byte = 0;
+    struct pseudo_inode old;
+    const bool used = fs_pread(f, bitmap_start(sb, true) + inode_id / 8, &byte, 1) &&
+                      (byte & (1u << (inode_id % 8))) != 0 &&
+                      fs_pread(f, inode_offset(sb, inode_id), &old, sizeof(old));
+
+    if (fs_pwrite(f, inode_offset(sb, inode_id), inode, sizeof(*inode)) && used) {
+        struct fs_counters delta = {0};
+        inode_usage(&old, -1, &delta);
+        inode_usage(inode, 1, &delta);
+        counters_add(f, sb, &delta);
+    }
+}
+
+/** Dávkové čtení inodů: mezera, kterou se vyplatí přečíst místo dalšího čtení, a délka úseku. */
+enum {
+    INODE_BATCH_GAP = 64,
+    INODE_BATCH_MAX = 1024
+};
+
+struct inode_ref {
+    int32_t id;
+    int index;      /* pozice v poli volajícího */
+};
+
+static int cmp_inode_ref(const void *a, const void *b)
+{
+    const int32_t x = ((const struct inode_ref *)a)->id;
+    const int32_t y = ((const struct inode_ref *)b)->id;
+    return (x > y) - (x < y);
+}
+
+int read_inodes(FILE *f, struct superblock *sb, const int32_t *ids, int count, struct pseudo_inode *out)
+{
+    if (!f || !sb || count <= 0) {
+        return count == 0;
+    }
+
+    int ok = 0;
+    struct inode_ref *refs = (struct inode_ref *)malloc((size_t)count * sizeof(*refs));
+    struct pseudo_inode *run = (struct pseudo_inode *)malloc(INODE_BATCH_MAX * sizeof(*run));
+    if (!refs || !run) {
+        goto cleanup;
     }
+    for (int i = 0; i < count; i++) {
+        if (ids[i] < 0 || ids[i] >= sb->cluster_count) {
+            goto cleanup;
+        }
+        refs[i] = (struct inode_ref){ ids[i], i };
+    }
+    qsort(refs, (size_t)count, sizeof(*refs), cmp_inode_ref);
+
+    /* úsek = inody first..last bez větších mezer; jedno čtení, rozdělení podle ID */
+    for (int i = 0; i < count;) {
+        const int32_t first = refs[i].id;
+        int32_t last = first;
+        int j = i + 1;
+        while (j < count && refs[j].id - last <= INODE_BATCH_GAP && refs[j].id - first < INODE_BATCH_MAX) {
+            last = refs[j++].id;
+        }
+        if (!read_inode_table(f, sb, (long)first * (long)sizeof(*run), run,
+                              (size_t)(last - first + 1) * sizeof(*run))) {
+            goto cleanup;
+        }
+        for (; i < j; i++) {
+            out[refs[i].index] = run[refs[i].id - first];
+        }
+    }
+    ok = 1;
 
-    (void)fwrite(inode, sizeof(*inode), 1, f);
+cleanup:
+    free(refs);
+    free(run);
+    return ok;
 }
 
 /* ========================================================================== */
 /* Bitmapy                                                                    */
 /* ========================================================================== */
 
-int find_free_bit(FILE *f, struct superblock *sb, bool is_inode_bitmap)
+/*
+ * Alokátor bez zámků: bitmapy se drží v paměti jako pole atomických 64bitových
+ * slov (zrcadlo disku). Bit se obsadí CAS nad slovem a uvolní fetch-and, disk
+ * je jen odraz zrcadla: změněné slovo se zapíše a zapisuje se znovu, dokud se
+ * zrcadlo mezitím změnilo, takže poslední zápis nese poslední stav.
+ *
+ * Vlákno hledá od své oblasti (celé cache line slov, fs_lock_home_shard) a jinde
+ * až když je jeho oblast plná – souběžné alokace si tak nepřepisují stejnou
+ * cache line. Jediné vlákno má oblast 0 a hledá od začátku jako dřív.
+ *
+ * Zrcadlo se načte při první změně bitmapy. Kdo bitmapu mění přímo na disku
+ * (format, abort transakce, rollback, oprava fsck), volá fs_bitmap_invalidate();
+ * to se děje jen mimo souběžné příkazy (server je pouští samostatně).
+ *
+ * Clustery uvolněné do paměťové vrstvy fs_io (dávka, transakce) jsou na disku
+ * ještě obsazené a abort nebo pád je vrátí původnímu souboru. Datové zrcadlo si
+ * je proto pamatuje (held) až do dalšího vyprázdnění vrstvy a alloc_direct_bits,
+ * jejíž clustery se zapisují přímo na disk (fs_pwrite_data), je přeskakuje.
+ */
+
+enum { BITMAP_LINE_WORDS = 8 };  /* 64 B cache line */
+
+struct bitmap_mirror {
+    _Atomic uint64_t *words;
+    int word_count;
+    int items;              /* bity bitmapy na disku (cluster_count) */
+    int usable;             /* přidělitelné bity (datová: jen clustery uvnitř obrazu), zbytek je obsazený */
+    long start;             /* adresa bitmapy na disku */
+    int region_words;       /* slov na oblast vlákna (násobek cache line) */
+    _Atomic uint64_t *held; /* uvolněné od posledního vyprázdnění vrstvy fs_io (jen datová) */
+    _Atomic uint64_t held_epoch;
+    atomic_bool ready;
+};
+
+static struct bitmap_mirror mirrors[2];  /* [0] datová, [1] inode bitmapa */
+static pthread_mutex_t mirror_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Maska bitů slova ve stejném pořadí bajtů, v jakém leží bitmapa na disku. */
+static uint64_t bitmap_word_mask(uint64_t mask)
 {
-    if (!f || !sb) {
-        return -1;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap64(mask);
+#else
+    return mask;
+#endif
+}
+
+static bool mirror_load(FILE *f, const struct superblock *sb, bool is_inode_bitmap, struct bitmap_mirror *m)
+{
+    const int items = sb->cluster_count;
+    const int size_in_bytes = (items + 7) / 8;
+    const int word_count = (items + 63) / 64;
+    const int lines = (word_count + BITMAP_LINE_WORDS - 1) / BITMAP_LINE_WORDS;
+
+    uint64_t *disk = (uint64_t *)calloc((size_t)word_count, sizeof(uint64_t));
+    _Atomic uint64_t *words = (_Atomic uint64_t *)aligned_alloc(64, (size_t)lines * 64);
+    _Atomic uint64_t *held = is_inode_bitmap ? NULL : (_Atomic uint64_t *)calloc((size_t)word_count, sizeof(uint64_t));
+    if (!disk || !words || (!is_inode_bitmap && !held) ||
+        !fs_pread(f, bitmap_start(sb, is_inode_bitmap), disk, (size_t)size_in_bytes)) {
+        free(disk);
+        free(words);
+        free(held);
+        return false;
     }
+    /* datová bitmapa má cluster_count bitů, ale obraz končí dřív (data_cluster_count);
+       za koncem se nealokuje – vlákno s oblastí na konci bitmapy by jinak dostalo cluster mimo obraz */
+    const int usable = is_inode_bitmap ? items : data_cluster_count(sb);
+    for (int w = 0; w < word_count; w++) {
+        uint64_t v = bitmap_word_mask(disk[w]);
+        const long first = (long)w * 64;
+        if (first + 64 > usable) {
+            v |= (usable > first) ? ~0ull << (usable - first) : ~0ull;
+        }
+        atomic_init(&words[w], v);
+    }
+    free(disk);
+
+    const int per_region = (word_count + FS_ALLOC_SHARDS - 1) / FS_ALLOC_SHARDS;
+    free((void *)m->words);
+    free((void *)m->held);
+    m->words = words;
+    m->held = held;
+    atomic_store(&m->held_epoch, fs_io_epoch());
+    m->word_count = word_count;
+    m->items = items;
+    m->usable = usable;
+    m->start = bitmap_start(sb, is_inode_bitmap);
+    m->region_words = (per_region + BITMAP_LINE_WORDS - 1) / BITMAP_LINE_WORDS * BITMAP_LINE_WORDS;
+    atomic_store_explicit(&m->ready, true, memory_order_release);
+    return true;
+}
 
-    const long start_addr = bitmap_start(sb, is_inode_bitmap);
+/** Zrcadlo bitmapy svazku sb (načte ho, pokud ještě neplatí), NULL = chyba čtení/paměti. */
+static struct bitmap_mirror *mirror_get(FILE *f, const struct superblock *sb, bool is_inode_bitmap)
+{
+    struct bitmap_mirror *m = &mirrors[is_inode_bitmap ? 1 : 0];
+    if (atomic_load_explicit(&m->ready, memory_order_acquire) && m->items == sb->cluster_count &&
+        m->start == bitmap_start(sb, is_inode_bitmap)) {
+        return m;
+    }
 
-    /* Pozn.: původní kód používá cluster_count jako "počet položek" bitmapy
-       pro inode i datové bloky – zachováváme to kvůli kompatibilitě. */
-    const int total_items = sb->cluster_count;
-    const int size_in_bytes = (total_items + 7) / 8;
+    pthread_mutex_lock(&mirror_lock);
+    const bool ok = (atomic_load_explicit(&m->ready, memory_order_acquire) && m->items == sb->cluster_count &&
+                     m->start == bitmap_start(sb, is_inode_bitmap)) ||
+                    mirror_load(f, sb, is_inode_bitmap, m);
+    pthread_mutex_unlock(&mirror_lock);
+    return ok ? m : NULL;
+}
 
-    uint8_t *buffer = (uint8_t *)malloc((size_t)size_in_bytes);
-    if (!buffer) {
-        return -1;
-    }
+void fs_bitmap_invalidate(void)
+{
+    atomic_store(&mirrors[0].ready, false);
+    atomic_store(&mirrors[1].ready, false);
+}
 
-    if (!seek_abs(f, start_addr)) {
-        free(buffer);
-        return -1;
+/**
+ * @brief Poznamená bity mask slova w jako uvolněné do vrstvy fs_io (jen datové
+ *        zrcadlo a jen když vrstva zápisy drží). Po vyprázdnění vrstvy se
+ *        poznámky zahodí – uvolnění je už na disku.
+ */
+static void mirror_hold(struct bitmap_mirror *m, int w, uint64_t mask)
+{
+    if (!m->held || mask == 0) {
+        return;
     }
-    (void)fread(buffer, 1, (size_t)size_in_bytes, f);
-
-    for (int i = 0; i < total_items; i++) {
-        const uint8_t byte = buffer[i / 8];
-        const uint8_t mask = (uint8_t)(1u << (i % 8));
-        if ((byte & mask) == 0) {
-            free(buffer);
-            return i;
+    const uint64_t epoch = fs_io_epoch();
+    if (atomic_load(&m->held_epoch) != epoch) {
+        pthread_mutex_lock(&mirror_lock);
+        if (atomic_load(&m->held_epoch) != epoch) {
+            for (int k = 0; k < m->word_count; k++) {
+                atomic_store_explicit(&m->held[k], 0, memory_order_relaxed);
+            }
+            atomic_store(&m->held_epoch, epoch);
         }
+        pthread_mutex_unlock(&mirror_lock);
+    }
+    if (fs_io_buffered()) {
+        atomic_fetch_or(&m->held[w], mask);
     }
+}
 
-    free(buffer);
-    return -1;
+/** Bity slova w, které alloc_direct_bits nesmí dát (uvolněné jen ve vrstvě fs_io). */
+static uint64_t mirror_held(struct bitmap_mirror *m, int w)
+{
+    if (!m->held || atomic_load(&m->held_epoch) != fs_io_epoch()) {
+        return 0;
+    }
+    return atomic_load_explicit(&m->held[w], memory_order_relaxed);
 }
 
-void set_bit(FILE *f, struct superblock *sb, bool is_inode_bitmap, int index, bool status)
+/** Slovo zrcadla v podobě pro disk (bez výplně za přidělitelnými bity). */
+static uint64_t mirror_disk_word(const struct bitmap_mirror *m, int w)
 {
-    if (!f || !sb || index < 0) {
-        return;
+    uint64_t v = atomic_load(&m->words[w]);
+    const long first = (long)w * 64;
+    if (first + 64 > m->usable) {
+        v &= (m->usable > first) ? (1ull << (m->usable - first)) - 1 : 0;
     }
+    return bitmap_word_mask(v);
+}
 
-    const long start_addr = bitmap_start(sb, is_inode_bitmap);
-    const long byte_offset = index / 8;
-    const int bit_offset = index % 8;
+/**
+ * @brief Zapíše slova first..last zrcadla na disk; opakuje, dokud je během zápisu
+ *        jiné vlákno změnilo.
+ */
+static int persist_words(FILE *f, const struct bitmap_mirror *m, int first, int last)
+{
+    const int count = last - first + 1;
+    const long size_in_bytes = (m->items + 7) / 8;
+    const long end = ((long)(last + 1) * 8 < size_in_bytes) ? (long)(last + 1) * 8 : size_in_bytes;
+    uint64_t one = 0;
+    uint64_t *buf = (count == 1) ? &one : (uint64_t *)malloc((size_t)count * sizeof(uint64_t));
+    if (!buf) {
+        return 0;
+    }
 
-    if (!seek_abs(f, start_addr + byte_offset)) {
-        return;
+    int ok = 0;
+    bool changed = true;
+    while (changed) {
+        for (int w = first; w <= last; w++) {
+            buf[w - first] = mirror_disk_word(m, w);
+        }
+        ok = fs_pwrite(f, m->start + (long)first * 8, buf, (size_t)(end - (long)first * 8));
+        changed = false;
+        for (int w = first; ok && w <= last && !changed; w++) {
+            changed = mirror_disk_word(m, w) != buf[w - first];
+        }
     }
 
-    uint8_t byte = 0;
-    (void)fread(&byte, 1, 1, f);
+    if (buf != &one) {
+        free(buf);
+    }
+    return ok;
+}
 
-    if (status) {
-        byte |= (uint8_t)(1u << bit_offset);
+/**
+ * @brief Promítne změnu jednoho bitu do počítadel (sign = +1 obsazení, -1 uvolnění).
+ */
+static void bit_counted(FILE *f, struct superblock *sb, bool is_inode_bitmap, int index, int sign)
+{
+    struct fs_counters delta = {0};
+    if (is_inode_bitmap) {
+        struct pseudo_inode inode;
+        read_inode(f, sb, index, &inode);
+        delta.used_inodes = sign;
+        inode_usage(&inode, sign, &delta);
     } else {
-        byte &= (uint8_t)~(1u << bit_offset);
+        delta.used_clusters = sign;
+    }
+    counters_add(f, sb, &delta);
+}
+
+/**
+ * @brief Promítne změnu bitů indexes[0..count-1] do počítadel (sign = +1 obsazení, -1 uvolnění).
+ */
+static void bits_changed(FILE *f, struct superblock *sb, bool is_inode_bitmap, const int32_t *indexes, int count,
+                         int sign)
+{
+    struct fs_counters delta = {0};
+    if (!is_inode_bitmap) {
+        delta.used_clusters = sign * count;
+        counters_add(f, sb, &delta);
+        return;
     }
 
-    /* Přepíšeme právě čtený bajt (o 1 zpět). */
-    (void)fseek(f, -1, SEEK_CUR);
-    (void)fwrite(&byte, 1, 1, f);
+    delta.used_inodes = sign * count;
+    struct pseudo_inode *inodes = (struct pseudo_inode *)malloc((size_t)count * sizeof(*inodes));
+    if (inodes && read_inodes(f, sb, indexes, count, inodes)) {
+        for (int i = 0; i < count; i++) {
+            inode_usage(&inodes[i], sign, &delta);
+        }
+    }
+    free(inodes);
+    counters_add(f, sb, &delta);
 }
 
-/* ========================================================================== */
-/* Adresáře                                                                   */
-/* ========================================================================== */
+/**
+ * @brief Změní jeden bit a promítne ho na disk a do počítadel.
+ */
+static void bit_update(FILE *f, struct superblock *sb, bool is_inode_bitmap, int index, bool status)
+{
+    struct bitmap_mirror *m = mirror_get(f, sb, is_inode_bitmap);
+    if (!m) {
+        return;
+    }
 
-int find_inode_in_dir(FILE *f, struct superblock *sb, int parent_inode_id, char *name)
+    const uint64_t bit = 1ull << (index % 64);
+    const uint64_t old = status ? atomic_fetch_or(&m->words[index / 64], bit)
+                                : atomic_fetch_and(&m->words[index / 64], ~bit);
+    if (((old & bit) != 0) == status) {
+        return; /* beze změny */
+    }
+    if (!status) {
+        mirror_hold(m, index / 64, bit);
+    }
+    if (persist_words(f, m, index / 64, index / 64)) {
+        bit_counted(f, sb, is_inode_bitmap, index, status ? 1 : -1);
+    }
+}
+
+int alloc_bit(FILE *f, struct superblock *sb, bool is_inode_bitmap)
 {
-    if (!f || !sb || !name || parent_inode_id < 0) {
+    if (!f || !sb || sb->cluster_count <= 0) {
         return -1;
     }
 
-    struct pseudo_inode parent;
-    read_inode(f, sb, parent_inode_id, &parent);
-    if (!parent.isDirectory) {
+    /* Pozn.: původní kód používá cluster_count jako "počet položek" bitmapy
+       pro inode i datové bloky – zachováváme to kvůli kompatibilitě. */
+    struct bitmap_mirror *m = mirror_get(f, sb, is_inode_bitmap);
+    if (!m) {
         return -1;
     }
 
-    const int32_t blocks[5] = { parent.direct1, parent.direct2, parent.direct3, parent.direct4, parent.direct5 };
-    const int items_per_cluster = (int)(sb->cluster_size / sizeof(struct directory_item));
-
-    struct directory_item item;
-    for (int i = 0; i < 5; i++) {
-        if (blocks[i] == CLUSTER_UNUSED) {
-            continue;
+    /* Od vlastní oblasti dál; nejnižší volný bit slova se obsadí jedním CAS. */
+    const int regions = (m->word_count + m->region_words - 1) / m->region_words;
+    const int home = fs_lock_home_shard() % regions;
+    for (int k = 0; k < regions; k++) {
+        const int first = ((home + k) % regions) * m->region_words;
+        const int end = (first + m->region_words < m->word_count) ? first + m->region_words : m->word_count;
+
+        for (int w = first; w < end; w++) {
+            uint64_t v = atomic_load_explicit(&m->words[w], memory_order_relaxed);
+            while (v != UINT64_MAX) {
+                const uint64_t bit = ~v & (v + 1);
+                if (atomic_compare_exchange_weak_explicit(&m->words[w], &v, v | bit, memory_order_acq_rel,
+                                                          memory_order_relaxed)) {
+                    const int index = w * 64 + __builtin_ctzll(bit);
+                    if (!persist_words(f, m, w, w)) {
+                        atomic_fetch_and(&m->words[w], ~bit);
+                        return -1;
+                    }
+                    bit_counted(f, sb, is_inode_bitmap, index, 1);
+                    return index;
+                }
+            }
         }
+    }
+    return -1;
+}
 
-        if (!seek_abs(f, cluster_offset(sb, blocks[i]))) {
-            continue;
-        }
+void set_bit(FILE *f, struct superblock *sb, bool is_inode_bitmap, int index, bool status)
+{
+    if (!f || !sb || index < 0 || index >= sb->cluster_count) {
+        return;
+    }
+    bit_update(f, sb, is_inode_bitmap, index, status);
+}
 
-        for (int j = 0; j < items_per_cluster; j++) {
-            (void)fread(&item, sizeof(item), 1, f);
-            if (item.item_name[0] != '\0' && strcmp(item.item_name, name) == 0) {
-                return item.inode;
+/**
+ * @brief alloc_bits / alloc_direct_bits; direct = přeskočit bity uvolněné jen ve vrstvě fs_io.
+ */
+static int alloc_bits_from(FILE *f, struct superblock *sb, bool is_inode_bitmap, int count, int32_t *out,
+                           bool direct)
+{
+    if (!f || !sb || count < 0 || (count > 0 && !out)) {
+        return 0;
+    }
+    if (count == 0) {
+        return 1;
+    }
+    struct bitmap_mirror *m = mirror_get(f, sb, is_inode_bitmap);
+    if (!m) {
+        return 0;
+    }
+
+    /* Hromadné obsazení (incp -r, cp -r) hledá od začátku, slovo po slovu:
+       všechny potřebné volné bity slova jedním CAS. */
+    int found = 0;
+    for (int w = 0; w < m->word_count && found < count; w++) {
+        const uint64_t held = direct ? mirror_held(m, w) : 0;
+        uint64_t v = atomic_load_explicit(&m->words[w], memory_order_relaxed);
+        uint64_t take = 0;
+        do {
+            take = 0;
+            uint64_t free_bits = ~(v | held);
+            for (int need = count - found; free_bits != 0 && need > 0; need--) {
+                take |= free_bits & (~free_bits + 1);
+                free_bits &= free_bits - 1;
             }
+        } while (take != 0 && !atomic_compare_exchange_weak_explicit(&m->words[w], &v, v | take,
+                                                                     memory_order_acq_rel, memory_order_relaxed));
+        for (; take != 0; take &= take - 1) {
+            out[found++] = w * 64 + __builtin_ctzll(take);
         }
     }
 
-    return -1;
+    int ok = found == count && persist_words(f, m, out[0] / 64, out[count - 1] / 64);
+    if (!ok) {
+        /* všechno, nebo nic */
+        for (int k = 0; k < found; k++) {
+            atomic_fetch_and(&m->words[out[k] / 64], ~(1ull << (out[k] % 64)));
+        }
+        return 0;
+    }
+    bits_changed(f, sb, is_inode_bitmap, out, count, 1);
+    return ok;
 }
 
-int add_directory_item(FILE *f, struct superblock *sb, int parent_inode_id, struct directory_item *new_item)
+int alloc_bits(FILE *f, struct superblock *sb, bool is_inode_bitmap, int count, int32_t *out)
 {
-    if (!f || !sb || !new_item || parent_inode_id < 0) {
+    return alloc_bits_from(f, sb, is_inode_bitmap, count, out, false);
+}
+
+int alloc_direct_bits(FILE *f, struct superblock *sb, int count, int32_t *out)
+{
+    return alloc_bits_from(f, sb, false, count, out, true);
+}
+
+static int cmp_int32(const void *a, const void *b)
+{
+    const int32_t x = *(const int32_t *)a;
+    const int32_t y = *(const int32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief clear_bits nad seřazenými platnými indexy.
+ */
+static int clear_sorted_bits(FILE *f, struct superblock *sb, bool is_inode_bitmap, const int32_t *indexes, int count)
+{
+    if (count == 0) {
+        return 1;
+    }
+    struct bitmap_mirror *m = mirror_get(f, sb, is_inode_bitmap);
+    int32_t *cleared = (int32_t *)malloc((size_t)count * sizeof(int32_t));
+    if (!m || !cleared) {
+        free(cleared);
         return 0;
     }
 
-    struct pseudo_inode parent;
-    read_inode(f, sb, parent_inode_id, &parent);
-    if (!parent.isDirectory) {
+    /* Seřazené indexy téhož slova se složí do jedné masky a slovo se změní najednou;
+       do počítadel jen bity, které opravdu byly obsazené (indexy bez opakování). */
+    int cleared_count = 0;
+    for (int k = 0; k < count;) {
+        const int w = indexes[k] / 64;
+        uint64_t mask = 0;
+        for (; k < count && indexes[k] / 64 == w; k++) {
+            mask |= 1ull << (indexes[k] % 64);
+        }
+        const uint64_t was = atomic_fetch_and(&m->words[w], ~mask) & mask;
+        mirror_hold(m, w, was);
+        for (uint64_t rest = was; rest != 0; rest &= rest - 1) {
+            cleared[cleared_count++] = w * 64 + __builtin_ctzll(rest);
+        }
+    }
+
+    const int ok = persist_words(f, m, indexes[0] / 64, indexes[count - 1] / 64);
+    if (ok && cleared_count > 0) {
+        bits_changed(f, sb, is_inode_bitmap, cleared, cleared_count, -1);
+    }
+    free(cleared);
+    return ok;
+}
+
+int clear_bits(FILE *f, struct superblock *sb, bool is_inode_bitmap, int32_t *indexes, int count)
+{
+    if (!f || !sb || count < 0 || (count > 0 && !indexes)) {
         return 0;
     }
+    if (count == 0) {
+        return 1;
+    }
+
+    qsort(indexes, (size_t)count, sizeof(indexes[0]), cmp_int32);
+    if (indexes[0] < 0 || indexes[count - 1] >= sb->cluster_count) {
+        return 0;
+    }
+    return clear_sorted_bits(f, sb, is_inode_bitmap, indexes, count);
+}
+
+int data_cluster_count(const struct superblock *sb)
+{
+    const long data_clusters = (sb->disk_size - sb->data_start_address) / sb->cluster_size;
+    return (data_clusters > sb->cluster_count) ? sb->cluster_count : (int)data_clusters;
+}
+
+int find_free_run(FILE *f, const struct superblock *sb, int n)
+{
+    const int data_clusters = data_cluster_count(sb);
+    const size_t bytes = (size_t)(sb->cluster_count + 7) / 8;
+    uint8_t *dbm = (uint8_t *)malloc(bytes);
+    if (n <= 0 || !dbm || !fs_pread(f, sb->bitmap_start_address, dbm, bytes)) {
+        free(dbm);
+        return -1;
+    }
+
+    int found = -1;
+    int run = 0;
+    for (int c = 0; c < data_clusters && found == -1; c++) {
+        run = ((dbm[c / 8] >> (c % 8)) & 1) ? 0 : run + 1;
+        if (run == n) {
+            found = c - n + 1;
+        }
+    }
+
+    free(dbm);
+    return found;
+}
+
+/* ========================================================================== */
+/* Sdílení clusterů                                                           */
+/* ========================================================================== */
+
+/**
+ * @brief Absolutní offset položky tabulky sdílení pro daný cluster.
+ */
+static long share_offset(const struct superblock *sb, int32_t cluster)
+{
+    return sb->refcount_start_address + (long)cluster * (long)sizeof(uint16_t);
+}
+
+int cluster_share_count(FILE *f, struct superblock *sb, int32_t cluster)
+{
+    if (!f || !sb || cluster < 0 || sb->refcount_start_address <= 0) {
+        return 0;
+    }
+
+    uint16_t count = 0;
+    (void)fs_pread(f, share_offset(sb, cluster), &count, sizeof(count));
+    return count;
+}
+
+/**
+ * @brief Zapíše počet dalších odkazů na cluster.
+ */
+static void cluster_set_share_count(FILE *f, struct superblock *sb, int32_t cluster, int count)
+{
+    const uint16_t value = (uint16_t)count;
+    (void)fs_pwrite(f, share_offset(sb, cluster), &value, sizeof(value));
+}
+
+/*
+ * Tabulka sdílení je rozdělená na FS_ALLOC_SHARDS úseků po celých 64 clusterech,
+ * položku chrání zámek jejího úseku. Uvolnění clusteru navíc drží FS_LOCK_DEDUP,
+ * aby store_data_cluster nemohl přidat odkaz na cluster, který z indexu zrovna
+ * mizí. Hromadné operace zamykají úseky vzestupně.
+ */
+
+static int shard_of(const struct superblock *sb, int cluster)
+{
+    const int words = (sb->cluster_count + 63) / 64;
+    return cluster / 64 / ((words + FS_ALLOC_SHARDS - 1) / FS_ALLOC_SHARDS);
+}
+
+static void lock_shards(int first, int last)
+{
+    for (int i = first; i <= last; i++) {
+        fs_lock_shard(i);
+    }
+}
+
+static void unlock_shards(int first, int last)
+{
+    for (int i = last; i >= first; i--) {
+        fs_unlock_shard(i);
+    }
+}
+
+int cluster_ref(FILE *f, struct superblock *sb, int32_t cluster)
+{
+    if (!f || !sb || cluster < 0 || cluster >= sb->cluster_count || sb->refcount_start_address <= 0) {
+        return 0;
+    }
+
+    /* Plný čítač se nesmí tiše zastavit – každé další uvolnění by pak ubralo odkaz,
+       který nikdy nebyl započtený, a cluster by se uvolnil, i když ho ještě někdo drží. */
+    const int shard = shard_of(sb, cluster);
+    fs_lock_shard(shard);
+    const int count = cluster_share_count(f, sb, cluster);
+    const int ok = count < UINT16_MAX;
+    if (ok) {
+        cluster_set_share_count(f, sb, cluster, count + 1);
+    }
+    fs_unlock_shard(shard);
+    return ok;
+}
+
+int32_t cluster_share(FILE *f, struct superblock *sb, int32_t cluster)
+{
+    if (cluster_ref(f, sb, cluster)) {
+        return cluster;
+    }
+    if (!f || !sb || cluster < 0 || cluster >= sb->cluster_count) {
+        return -1;
+    }
+
+    uint8_t *buf = (uint8_t *)malloc((size_t)sb->cluster_size);
+    const int copy = buf ? alloc_bit(f, sb, false) : -1;
+    if (copy == -1) {
+        free(buf);
+        return -1;
+    }
+    if (!read_cluster(f, sb, cluster, buf) || !write_cluster(f, sb, copy, buf)) {
+        set_bit(f, sb, false, copy, false);
+        free(buf);
+        return -1;
+    }
+    free(buf);
+    return copy;
+}
+
+void cluster_unref(FILE *f, struct superblock *sb, int32_t cluster)
+{
+    if (!f || !sb || cluster < 0 || cluster >= sb->cluster_count) {
+        return;
+    }
+
+    const int shard = shard_of(sb, cluster);
+    fs_lock_shard(shard);
+    const int count = cluster_share_count(f, sb, cluster);
+    if (count > 0) {
+        /* Cluster má ještě dalšího vlastníka – jen ubereme odkaz. */
+        cluster_set_share_count(f, sb, cluster, count - 1);
+        fs_unlock_shard(shard);
+        return;
+    }
+    fs_unlock_shard(shard);
+
+    /* Poslední odkaz: znovu pod oběma zámky (mezitím mohla deduplikace odkaz přidat). */
+    fs_lock(FS_LOCK_DEDUP);
+    fs_lock_shard(shard);
+    const int again = cluster_share_count(f, sb, cluster);
+    if (again > 0) {
+        cluster_set_share_count(f, sb, cluster, again - 1);
+    } else {
+        /* Uvolněný cluster se může použít na cokoliv – nesmí zůstat v indexu deduplikace. */
+        dedup_forget(f, sb, cluster);
+        bit_update(f, sb, false, cluster, false);
+    }
+    fs_unlock_shard(shard);
+    fs_unlock(FS_LOCK_DEDUP);
+}
+
+int32_t store_data_cluster(FILE *f, struct superblock *sb, const uint8_t *data)
+{
+    if (!f || !sb || !data) {
+        return -1;
+    }
+
+    /* Stejný obsah už na disku je – jen přidáme odkaz. */
+    fs_lock(FS_LOCK_DEDUP);
+    const int32_t same = dedup_find(f, sb, data);
+    if (same >= 0 && cluster_ref(f, sb, same)) {
+        fs_unlock(FS_LOCK_DEDUP);
+        return same;
+    }
+    fs_unlock(FS_LOCK_DEDUP);
+
+    const int free_block = alloc_bit(f, sb, false); /* data bitmap */
+    if (free_block == -1) {
+        return -1;
+    }
+
+    (void)write_cluster(f, sb, free_block, data);
+    fs_lock(FS_LOCK_DEDUP);
+    dedup_insert(f, sb, data, free_block);
+    fs_unlock(FS_LOCK_DEDUP);
+    return free_block;
+}
+
+void cluster_unref_batch(FILE *f, struct superblock *sb, int32_t *clusters, int count)
+{
+    if (!f || !sb || !clusters || count <= 0) {
+        return;
+    }
+
+    /* Po seřazení leží všechny odkazy na stejný cluster vedle sebe; uvolněné
+       clustery se posbírají na začátek pole a bitmapa se zapíše jednou. */
+    qsort(clusters, (size_t)count, sizeof(clusters[0]), cmp_int32);
+    int skip = 0;
+    while (skip < count && clusters[skip] < 0) {
+        skip++;                 /* díry a nepoužité odkazy nic nedrží */
+    }
+    clusters += skip;
+    count -= skip;
+    if (count == 0 || clusters[count - 1] >= sb->cluster_count) {
+        return;
+    }
+
+    const int first = shard_of(sb, clusters[0]);
+    const int last = shard_of(sb, clusters[count - 1]);
+    fs_lock(FS_LOCK_DEDUP);
+    lock_shards(first, last);
+
+    int freed = 0;
+    for (int k = 0; k < count;) {
+        const int32_t cluster = clusters[k];
+        int refs = 0;
+        for (; k < count && clusters[k] == cluster; k++) {
+            refs++;
+        }
+
+        const int shared = cluster_share_count(f, sb, cluster);
+        if (shared >= refs) {
+            cluster_set_share_count(f, sb, cluster, shared - refs);
+            continue;
+        }
+        if (shared > 0) {
+            cluster_set_share_count(f, sb, cluster, 0);
+        }
+        dedup_forget(f, sb, cluster);
+        clusters[freed++] = cluster;
+    }
+
+    (void)clear_sorted_bits(f, sb, false, clusters, freed);
+    unlock_shards(first, last);
+    fs_unlock(FS_LOCK_DEDUP);
+}
+
+/* ========================================================================== */
+/* Tail packing                                                               */
+/* ========================================================================== */
+
+/*
+ * Konce souborů se ukládají za sebe do "otevřeného" fragment clusteru
+ * (sb->frag_cluster, obsazeno sb->frag_used bajtů). Každý konec drží na
+ * fragment clusteru jeden odkaz v tabulce sdílení, vlastní odkaz má i samotný
+ * otevřený slot v superblocku. Uvolněné konce místo nevracejí – cluster se
+ * uvolní, až zmizí poslední konec a slot se mezitím přesune jinam.
+ */
+
+int frag_alloc(FILE *f, struct superblock *sb, const uint8_t *data, int len, int32_t *cluster, int *offset)
+{
+    if (!f || !sb || !data || !cluster || !offset || len <= 0 || len > sb->cluster_size) {
+        return 0;
+    }
+
+    /* Otevřený slot sdílí všechny zápisy – čte se čerstvý z disku a mění pod zámkem. */
+    const long slot_offset = (long)offsetof(struct superblock, frag_cluster);
+    const long used_offset = (long)offsetof(struct superblock, frag_used);
+    int ok = 0;
+    fs_lock(FS_LOCK_FRAG);
+    if (!fs_pread(f, slot_offset, &sb->frag_cluster, sizeof(sb->frag_cluster)) ||
+        !fs_pread(f, used_offset, &sb->frag_used, sizeof(sb->frag_used))) {
+        goto cleanup;
+    }
+
+    /* Odkaz konce se bere předem – při plném čítači sdílení se otevře nový fragment. */
+    if (sb->frag_cluster == CLUSTER_UNUSED || sb->frag_used + len > sb->cluster_size ||
+        !cluster_ref(f, sb, sb->frag_cluster)) {
+        const int free_block = alloc_bit(f, sb, false);
+        if (free_block == -1) {
+            goto cleanup;
+        }
+
+        uint8_t *zeros = (uint8_t *)calloc(1, (size_t)sb->cluster_size);
+        if (!zeros) {
+            set_bit(f, sb, false, free_block, false);
+            goto cleanup;
+        }
+        (void)write_cluster(f, sb, free_block, zeros);
+        free(zeros);
+
+        /* Starý fragment už slot nedrží – zůstane jen konci souborů. */
+        if (sb->frag_cluster != CLUSTER_UNUSED) {
+            cluster_unref(f, sb, sb->frag_cluster);
+        }
+        sb->frag_cluster = free_block;
+        sb->frag_used = 0;
+        (void)cluster_ref(f, sb, sb->frag_cluster); /* nový cluster, čítač je 0 */
+    }
+
+    if (!fs_pwrite(f, cluster_offset(sb, sb->frag_cluster) + sb->frag_used, data, (size_t)len)) {
+        cluster_unref(f, sb, sb->frag_cluster);
+        goto cleanup;
+    }
+    cluster_crc_refresh(f, sb, sb->frag_cluster);
+
+    *cluster = sb->frag_cluster;
+    *offset = sb->frag_used;
+
+    sb->frag_used += len;
+    ok = fs_pwrite(f, slot_offset, &sb->frag_cluster, sizeof(sb->frag_cluster)) &&
+         fs_pwrite(f, used_offset, &sb->frag_used, sizeof(sb->frag_used));
+
+cleanup:
+    fs_unlock(FS_LOCK_FRAG);
+    return ok;
+}
+
+int write_file_tail(FILE *f, struct superblock *sb, struct pseudo_inode *inode,
+                    int32_t blocks[5], int *block_count, const uint8_t *data, int len)
+{
+    if (!f || !sb || !inode || !blocks || !block_count || !data || len <= 0) {
+        return 0;
+    }
+
+    if (buffer_is_zero(data, (size_t)len)) {
+        /* Nulový konec: díra, nic se nealokuje ani nezapisuje. */
+        if (*block_count >= 5) {
+            return 0;
+        }
+        blocks[(*block_count)++] = CLUSTER_HOLE;
+        return 1;
+    }
+
+    if (len <= TAIL_PACK_MAX) {
+        int32_t frag = CLUSTER_UNUSED;
+        int offset = 0;
+        if (!frag_alloc(f, sb, data, len, &frag, &offset)) {
+            return 0;
+        }
+        inode->flags |= INODE_FLAG_TAIL;
+        inode->indirect1 = frag;
+        inode->indirect2 = TAIL_PACK(offset, len);
+        return 1;
+    }
+
+    if (*block_count >= 5) {
+        return 0;
+    }
+
+    const int free_block = alloc_bit(f, sb, false);
+    if (free_block == -1) {
+        return 0;
+    }
+
+    uint8_t *cluster_buf = (uint8_t *)calloc(1, (size_t)sb->cluster_size);
+    if (!cluster_buf) {
+        set_bit(f, sb, false, free_block, false);
+        return 0;
+    }
+    memcpy(cluster_buf, data, (size_t)len);
+    (void)write_cluster(f, sb, free_block, cluster_buf);
+    free(cluster_buf);
+
+    blocks[(*block_count)++] = free_block;
+    return 1;
+}
+
+/* ========================================================================== */
+/* Adresáře                                                                   */
+/* ========================================================================== */
+
+/**
+ * @brief Načte celý cluster adresáře (pole položek) jedním čtením a ověří jeho součet.
+ * @return Buffer o velikosti clusteru (uvolní volající) nebo NULL (i při CHECKSUM ERROR).
+ */
+static struct directory_item *read_dir_cluster(FILE *f, const struct superblock *sb, int32_t cluster)
+{
+    struct directory_item *items = (struct directory_item *)malloc((size_t)sb->cluster_size);
+    if (items && !read_cluster(f, sb, cluster, (uint8_t *)items)) {
+        free(items);
+        return NULL;
+    }
+    return items;
+}
+
+int find_inode_in_dir(FILE *f, struct superblock *sb, int parent_inode_id, char *name)
+{
+    if (!f || !sb || !name || parent_inode_id < 0) {
+        return -1;
+    }
+
+    struct pseudo_inode parent;
+    read_inode(f, sb, parent_inode_id, &parent);
+    if (!parent.isDirectory) {
+        return -1;
+    }
+
+    const int32_t blocks[5] = { parent.direct1, parent.direct2, parent.direct3, parent.direct4, parent.direct5 };
+    const int items_per_cluster = (int)(sb->cluster_size / sizeof(struct directory_item));
+
+    for (int i = 0; i < 5; i++) {
+        if (blocks[i] == CLUSTER_UNUSED) {
+            continue;
+        }
+
+        struct directory_item *items = read_dir_cluster(f, sb, blocks[i]);
+        if (!items) {
+            continue;
+        }
+        for (int j = 0; j < items_per_cluster; j++) {
+            if (items[j].item_name[0] != '\0' && strcmp(items[j].item_name, name) == 0) {
+                const int found = items[j].inode;
+                free(items);
+                return found;
+            }
+        }
+        free(items);
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Připraví k-tý cluster adresáře na zápis na místě (copy-on-write).
+ *
+ * Cluster sdílený se snapshotem se nejdřív zkopíruje do nového clusteru, adresář
+ * se přepojí na kopii a sdílený originál ztratí jeden odkaz.
+ *
+ * @return cluster, do kterého lze zapisovat, nebo -1 pokud došlo místo.
+ */
+static int32_t dir_cluster_for_write(FILE *f, struct superblock *sb, int dir_inode_id,
+                                     struct pseudo_inode *dir, int k)
+{
+    int32_t blocks[5];
+    inode_get_direct(dir, blocks);
+
+    if (cluster_share_count(f, sb, blocks[k]) == 0) {
+        return blocks[k];
+    }
+
+    uint8_t *copy = (uint8_t *)malloc((size_t)sb->cluster_size);
+    if (!copy || !read_cluster(f, sb, blocks[k], copy)) {
+        free(copy);
+        return -1;
+    }
+    const int free_block = alloc_bit(f, sb, false);
+    if (free_block == -1) {
+        free(copy);
+        return -1;
+    }
+
+    (void)write_cluster(f, sb, free_block, copy);
+    free(copy);
+
+    cluster_unref(f, sb, blocks[k]);
+    blocks[k] = free_block;
+    inode_set_direct(dir, blocks);
+    write_inode(f, sb, dir_inode_id, dir);
+    return free_block;
+}
+
+int add_directory_item(FILE *f, struct superblock *sb, int parent_inode_id, struct directory_item *new_item)
+{
+    if (!f || !sb || !new_item || parent_inode_id < 0) {
+        return 0;
+    }
+
+    struct pseudo_inode parent;
+    read_inode(f, sb, parent_inode_id, &parent);
+    if (!parent.isDirectory) {
+        return 0;
+    }
+
+    const int32_t blocks[5] = { parent.direct1, parent.direct2, parent.direct3, parent.direct4, parent.direct5 };
+    const int items_per_cluster = (int)(sb->cluster_size / sizeof(struct directory_item));
+
+    for (int i = 0; i < 5; i++) {
+        if (blocks[i] == CLUSTER_UNUSED) {
+            continue;
+        }
+
+        struct directory_item *items = read_dir_cluster(f, sb, blocks[i]);
+        if (!items) {
+            continue;
+        }
+        for (int j = 0; j < items_per_cluster; j++) {
+            if (items[j].item_name[0] == '\0') {
+                /* Cluster se zapíše celý – součet se spočítá z bufferu bez dalšího čtení. */
+                const int32_t target = dir_cluster_for_write(f, sb, parent_inode_id, &parent, i);
+                items[j] = *new_item;
+                const int ok = target != -1 && write_cluster(f, sb, target, (const uint8_t *)items);
+                free(items);
+                return ok;
+            }
+        }
+        free(items);
+    }
+
+    return 0;
+}
+
+void write_directory_inode(FILE *f, struct superblock *sb, int inode_id, int32_t cluster, const uint8_t *data)
+{
+    struct pseudo_inode inode = {0};
+    inode.nodeid = inode_id;
+    inode.isDirectory = true;
+    inode.references = 1;
+    inode.file_size = sb->cluster_size;
+    inode.direct1 = cluster;
+    inode.direct2 = CLUSTER_UNUSED;
+    inode.direct3 = CLUSTER_UNUSED;
+    inode.direct4 = CLUSTER_UNUSED;
+    inode.direct5 = CLUSTER_UNUSED;
+    inode.indirect1 = CLUSTER_UNUSED;
+    inode.indirect2 = CLUSTER_UNUSED;
+    write_inode(f, sb, inode_id, &inode);
+
+    (void)write_cluster(f, sb, cluster, data);
+}
+
+int new_directory_inode(FILE *f, struct superblock *sb, int parent_inode_id)
+{
+    uint8_t *dir_data = (uint8_t *)calloc(1, (size_t)sb->cluster_size);
+    if (!dir_data) {
+        return -1;
+    }
+
+    const int inode_id = alloc_bit(f, sb, true);
+    const int cluster = (inode_id != -1) ? alloc_bit(f, sb, false) : -1;
+    if (cluster == -1) {
+        set_bit(f, sb, true, inode_id, false);
+        free(dir_data);
+        return -1;
+    }
+
+    /* Data adresáře: cluster nul s položkami "." + "..". */
+    struct directory_item *items = (struct directory_item *)dir_data;
+    items[0].inode = inode_id;
+    items[0].type = DIR_TYPE_DIR;
+    strcpy(items[0].item_name, ".");
+    items[1].inode = parent_inode_id;
+    items[1].type = DIR_TYPE_DIR;
+    strcpy(items[1].item_name, "..");
+
+    write_directory_inode(f, sb, inode_id, cluster, dir_data);
+    free(dir_data);
+    return inode_id;
+}
+
+/**
+ * @brief Převod cesty na inode (pro potřeby příkazů).
+ *
+ * @param filename Cesta k souboru s FS (disk image).
+ * @param path Absolutní/relativní cesta v pseudo-FS (např. "/data/soubor.txt").
+ * @return inode ID při úspěchu, jinak -1.
+ */
+/* ========================================================================== */
+/* Cache cest                                                                 */
+/* ========================================================================== */
+
+/*
+ * Přímo mapovaná cache "normalizovaná cesta -> inode". Po sobě jdoucí příkazy
+ * nad stejným adresářem (mkdir /a/b/x1, mkdir /a/b/x2, ...) tak rodiče neprochází
+ * znovu od kořene a při plném zásahu se obraz ani neotevírá. Ukládají se jen
+ * nalezené cesty; přidání položky proto nic nezneplatní, odebrání ano.
+ *
+ * Cache sdílí všechna vlákna (dcache_lock). Hledání si pamatuje generaci ze
+ * začátku a po souběžném zneplatnění už nalezené prefixy neukládá – jinak by se
+ * do cache vrátila cesta, kterou jiný příkaz mezitím smazal.
+ */
+enum { DCACHE_SLOTS = 1024 };
+
+struct dcache_entry {
+    char *path;
+    int inode;
+    uint32_t generation;    /* platí jen při shodě s dcache_generation */
+};
+
+static struct dcache_entry dcache[DCACHE_SLOTS];
+static uint32_t dcache_generation = 1;
+static pthread_mutex_t dcache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void fs_dcache_invalidate(void)
+{
+    /* O(1): staré položky se přepíšou, až na ně dojde */
+    pthread_mutex_lock(&dcache_lock);
+    dcache_generation++;
+    pthread_mutex_unlock(&dcache_lock);
+}
+
+static uint32_t dcache_current(void)
+{
+    pthread_mutex_lock(&dcache_lock);
+    const uint32_t generation = dcache_generation;
+    pthread_mutex_unlock(&dcache_lock);
+    return generation;
+}
+
+static uint32_t dcache_slot(const char *path, size_t len)
+{
+    uint32_t h = 2166136261u; /* FNV-1a */
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)path[i]) * 16777619u;
+    }
+    return h & (DCACHE_SLOTS - 1);
+}
+
+static int dcache_get(const char *path, size_t len)
+{
+    const struct dcache_entry *e = &dcache[dcache_slot(path, len)];
+    int found = -1;
+    pthread_mutex_lock(&dcache_lock);
+    if (e->path && e->generation == dcache_generation && strlen(e->path) == len && memcmp(e->path, path, len) == 0) {
+        found = e->inode;
+    }
+    pthread_mutex_unlock(&dcache_lock);
+    return found;
+}
+
+/** Uloží cestu nalezenou v generaci generation (po zneplatnění už ne). */
+static void dcache_put(const char *path, size_t len, int inode, uint32_t generation)
+{
+    struct dcache_entry *e = &dcache[dcache_slot(path, len)];
+    char *copy = (char *)malloc(len + 1);
+    if (!copy) {
+        return;
+    }
+    memcpy(copy, path, len);
+    copy[len] = '\0';
+
+    pthread_mutex_lock(&dcache_lock);
+    if (generation == dcache_generation) {
+        char *old = e->path;
+        e->path = copy;
+        e->inode = inode;
+        e->generation = generation;
+        copy = old;
+    }
+    pthread_mutex_unlock(&dcache_lock);
+    free(copy);
+}
+
+/**
+ * @brief Klíč cache: cesta bez prázdných segmentů a ".", vždy od kořene ("" = kořen).
+ * @param key Buffer aspoň strlen(path) + 2 bajtů.
+ * @return délka klíče
+ */
+static size_t path_key(const char *path, char *key)
+{
+    size_t key_len = 0;
+    for (const char *p = path; *p != '\0';) {
+        while (*p == '/') {
+            ++p;
+        }
+        const char *seg = p;
+        while (*p != '\0' && *p != '/') {
+            ++p;
+        }
+        const size_t seg_len = (size_t)(p - seg);
+        if (seg_len == 0 || (seg_len == 1 && seg[0] == '.')) {
+            continue;
+        }
+        key[key_len++] = '/';
+        memcpy(key + key_len, seg, seg_len);
+        key_len += seg_len;
+    }
+    key[key_len] = '\0';
+    return key_len;
+}
+
+int fs_path_to_inode(const char *filename, const char *path)
+{
+    if (!filename || !path) {
+        return -1;
+    }
+
+    char *key = (char *)malloc(strlen(path) + 2);
+    if (!key) {
+        return -1;
+    }
+    const size_t key_len = path_key(path, key);
+
+    /* Nejdelší známý prefix (celá cesta, rodič, prarodič, ...). Ve snapshotu se
+       cache nepoužívá, cesty tam vedou na jiné inody. */
+    const bool use_cache = snapshot_view[0] == '\0';
+    const uint32_t generation = dcache_current();
+    size_t done = use_cache ? key_len : 0;
+    int current_inode = 0; /* root */
+    while (done > 0) {
+        const int cached = dcache_get(key, done);
+        if (cached != -1) {
+            current_inode = cached;
+            break;
+        }
+        while (done > 0 && key[--done] != '/') {
+        }
+    }
+
+    if (done == key_len) {
+        free(key);
+        return current_inode;
+    }
+
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        free(key);
+        return -1;
+    }
+
+    struct superblock sb;
+    (void)load_superblock(f, &sb);
+
+    /* Zbytek cesty po segmentech; každý nalezený prefix jde do cache. */
+    while (done < key_len) {
+        size_t end = done + 1;
+        while (end < key_len && key[end] != '/') {
+            ++end;
+        }
+
+        char name[MAX_NAME_LEN]; /* delší jméno v adresáři být nemůže */
+        const size_t name_len = end - done - 1;
+        if (name_len >= sizeof(name)) {
+            current_inode = -1;
+            break;
+        }
+        memcpy(name, key + done + 1, name_len);
+        name[name_len] = '\0';
+
+        current_inode = find_inode_in_dir(f, &sb, current_inode, name);
+        if (current_inode == -1) {
+            break;
+        }
+        if (use_cache) {
+            dcache_put(key, end, current_inode, generation);
+        }
+        done = end;
+    }
+
+    free(key);
+    fclose(f);
+    return current_inode;
+}
+
+/* ========================================================================== */
+/* Vzory cest (glob)                                                          */
+/* ========================================================================== */
+
+bool fs_glob_has_magic(const char *path)
+{
+    return path && strpbrk(path, "*?[") != NULL;
+}
+
+/**
+ * @brief Vyhodnotí třídu znaků "[...]" (p ukazuje za '[').
+ * @return ukazatel za ']', NULL pokud třída není uzavřená (pak se '[' bere doslova).
+ */
+static const char *glob_class(const char *p, char c, bool *matched)
+{
+    const bool negate = (*p == '!' || *p == '^');
+    if (negate) {
+        ++p;
+    }
+
+    bool found = false;
+    const char *first = p;
+    while (*p != '\0' && (*p != ']' || p == first)) {
+        if (p[1] == '-' && p[2] != '\0' && p[2] != ']') {
+            found |= (unsigned char)p[0] <= (unsigned char)c && (unsigned char)c <= (unsigned char)p[2];
+            p += 3;
+        } else {
+            found |= *p == c;
+            ++p;
+        }
+    }
+    if (*p != ']') {
+        return NULL;
+    }
+
+    *matched = found != negate;
+    return p + 1;
+}
+
+bool fs_glob_match(const char *pattern, const char *name)
+{
+    const char *p = pattern;
+    const char *n = name;
+    const char *star_p = NULL;  /* kam se vrátit po neúspěchu za poslední '*' */
+    const char *star_n = NULL;
+
+    while (*n != '\0') {
+        if (*p == '*') {
+            star_p = ++p;
+            star_n = n;
+            continue;
+        }
+
+        bool ok = false;
+        const char *next = NULL;
+        if (*p == '?') {
+            ok = true;
+            next = p + 1;
+        } else if (*p == '[' && (next = glob_class(p + 1, *n, &ok)) != NULL) {
+            /* ok nastavila glob_class */
+        } else if (*p == '\\' && p[1] != '\0') {
+            ok = p[1] == *n;
+            next = p + 2;
+        } else {
+            ok = *p != '\0' && *p == *n;
+            next = p + 1;
+        }
+
+        if (ok) {
+            p = next;
+            ++n;
+        } else if (star_p) {
+            /* '*' pohltí o znak víc */
+            p = star_p;
+            n = ++star_n;
+        } else {
+            return false;
+        }
+    }
+
+    while (*p == '*') {
+        ++p;
+    }
+    return *p == '\0';
+}
+
+/** Kandidát při rozvíjení vzoru: normalizovaná cesta ("" = kořen) a její inode. */
+struct glob_entry {
+    char *path;
+    int inode;
+};
+
+struct glob_list {
+    struct glob_entry *items;
+    int count;
+    int cap;
+};
+
+/** generation: generace cache cest ze začátku rozvíjení, 0 = neukládat (snapshot). */
+static bool glob_push(struct glob_list *list, const char *dir, const char *name, int inode, uint32_t generation)
+{
+    if (list->count == list->cap) {
+        const int cap = list->cap ? list->cap * 2 : 16;
+        struct glob_entry *items = (struct glob_entry *)realloc(list->items, (size_t)cap * sizeof(*items));
+        if (!items) {
+            return false;
+        }
+        list->items = items;
+        list->cap = cap;
+    }
+
+    const size_t len = strlen(dir) + strlen(name) + 1;
+    char *path = (char *)malloc(len + 1);
+    if (!path) {
+        return false;
+    }
+    (void)snprintf(path, len + 1, "%s/%s", dir, name);
+
+    /* nalezená cesta rovnou do cache – příkaz nad shodou ji už nebude hledat */
+    if (generation != 0) {
+        dcache_put(path, len, inode, generation);
+    }
+    list->items[list->count++] = (struct glob_entry){ path, inode };
+    return true;
+}
+
+static void glob_list_free(struct glob_list *list)
+{
+    for (int i = 0; i < list->count; i++) {
+        free(list->items[i].path);
+    }
+    free(list->items);
+    *list = (struct glob_list){ NULL, 0, 0 };
+}
 
-    const int32_t blocks[5] = { parent.direct1, parent.direct2, parent.direct3, parent.direct4, parent.direct5 };
+/**
+ * @brief Rozšíří kandidáty o jeden segment vzoru.
+ *
+ * Segment se vzorem projde každý adresář jedním čtením jeho clusterů, doslovný
+ * segment se jen dohledá. Kandidát, který není adresář, se zahodí.
+ */
+static bool glob_step(FILE *f, struct superblock *sb, const struct glob_list *from, char *segment,
+                      struct glob_list *to, uint32_t generation)
+{
+    const bool magic = fs_glob_has_magic(segment);
     const int items_per_cluster = (int)(sb->cluster_size / sizeof(struct directory_item));
 
-    struct directory_item item;
-    for (int i = 0; i < 5; i++) {
-        if (blocks[i] == CLUSTER_UNUSED) {
+    for (int c = 0; c < from->count; c++) {
+        struct pseudo_inode dir;
+        read_inode(f, sb, from->items[c].inode, &dir);
+        if (!dir.isDirectory) {
             continue;
         }
 
-        const long base = cluster_offset(sb, blocks[i]);
-
-        for (int j = 0; j < items_per_cluster; j++) {
-            const long item_pos = base + (long)j * (long)sizeof(struct directory_item);
+        if (!magic) {
+            const int inode = find_inode_in_dir(f, sb, from->items[c].inode, segment);
+            if (inode != -1 && !glob_push(to, from->items[c].path, segment, inode, generation)) {
+                return false;
+            }
+            continue;
+        }
 
-            if (!seek_abs(f, item_pos)) {
+        int32_t blocks[5];
+        inode_get_direct(&dir, blocks);
+        for (int b = 0; b < 5; b++) {
+            if (blocks[b] == CLUSTER_UNUSED) {
                 continue;
             }
-
-            (void)fread(&item, sizeof(item), 1, f);
-            if (item.item_name[0] == '\0') {
-                if (!seek_abs(f, item_pos)) {
-                    return 0;
+            struct directory_item *items = read_dir_cluster(f, sb, blocks[b]);
+            if (!items) {
+                continue;
+            }
+            for (int j = 0; j < items_per_cluster; j++) {
+                char name[MAX_NAME_LEN];
+                (void)snprintf(name, sizeof(name), "%s", items[j].item_name);
+                if (name[0] == '\0' || strcmp(name, ".") == 0 || strcmp(name, "..") == 0 ||
+                    !fs_glob_match(segment, name)) {
+                    continue;
+                }
+                if (!glob_push(to, from->items[c].path, name, items[j].inode, generation)) {
+                    free(items);
+                    return false;
                 }
-                (void)fwrite(new_item, sizeof(*new_item), 1, f);
-                return 1;
             }
+            free(items);
         }
     }
+    return true;
+}
 
-    return 0;
+static int cmp_glob_path(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
 }
 
-/**
- * @brief Převod cesty na inode (pro potřeby příkazů).
- *
- * @param filename Cesta k souboru s FS (disk image).
- * @param path Absolutní/relativní cesta v pseudo-FS (např. "/data/soubor.txt").
- * @return inode ID při úspěchu, jinak -1.
- */
-int fs_path_to_inode(const char *filename, const char *path)
+int fs_glob(const char *filename, const char *pattern, char ***out)
 {
-    if (!filename || !path) {
+    if (!filename || !pattern || !out) {
         return -1;
     }
+    *out = NULL;
 
-    FILE *f = fopen(filename, "rb");
-    if (!f) {
-        return -1;
+    /* Doslovný začátek (segmenty před prvním vzorem) vyřeší fs_path_to_inode přes cache. */
+    const char *magic = strpbrk(pattern, "*?[");
+    if (!magic) {
+        return 0;
+    }
+    const char *cut = magic;
+    while (cut > pattern && cut[-1] != '/') {
+        --cut;
     }
 
+    int count = -1;
+    struct glob_list current = { NULL, 0, 0 };
+    struct glob_list next = { NULL, 0, 0 };
+    char *prefix = (char *)malloc((size_t)(cut - pattern) + 2);
+    char *rest = strdup(cut);
+    FILE *f = NULL;
     struct superblock sb;
-    (void)load_superblock(f, &sb);
-
-    int current_inode = 0; /* root */
-
-    char *path_copy = strdup(path);
-    if (!path_copy) {
-        fclose(f);
-        return -1;
+    if (!prefix || !rest) {
+        goto cleanup;
+    }
+    memcpy(prefix, pattern, (size_t)(cut - pattern));
+    prefix[cut - pattern] = '\0';
+
+    const uint32_t generation = (snapshot_view[0] == '\0') ? dcache_current() : 0;
+    const int start = fs_path_to_inode(filename, prefix);
+    if (start == -1) {
+        count = 0;
+        goto cleanup;
+    }
+    f = fopen(filename, "rb");
+    if (!f || !load_superblock(f, &sb)) {
+        goto cleanup;
     }
 
-    char *token = strtok(path_copy, "/");
-    while (token != NULL) {
-        if (strcmp(token, ".") == 0 || token[0] == '\0') {
-            token = strtok(NULL, "/");
+    /* první kandidát: normalizovaný prefix (stejný tvar jako klíče dcache) */
+    current.items = (struct glob_entry *)malloc(sizeof(struct glob_entry));
+    char *start_path = (char *)malloc(strlen(prefix) + 2);
+    if (!current.items || !start_path) {
+        free(start_path);
+        goto cleanup;
+    }
+    (void)path_key(prefix, start_path);
+    current.items[0] = (struct glob_entry){ start_path, start };
+    current.count = 1;
+    current.cap = 1;
+
+    char *save = NULL;
+    for (char *segment = strtok_r(rest, "/", &save); segment && current.count > 0;
+         segment = strtok_r(NULL, "/", &save)) {
+        if (strcmp(segment, ".") == 0) {
             continue;
         }
-
-        const int next_inode = find_inode_in_dir(f, &sb, current_inode, token);
-        if (next_inode == -1) {
-            free(path_copy);
-            fclose(f);
-            return -1;
+        if (!glob_step(f, &sb, &current, segment, &next, generation)) {
+            goto cleanup;
         }
+        glob_list_free(&current);
+        current = next;
+        next = (struct glob_list){ NULL, 0, 0 };
+    }
 
-        current_inode = next_inode;
-        token = strtok(NULL, "/");
+    char **paths = (char **)malloc((size_t)(current.count + 1) * sizeof(char *));
+    if (!paths) {
+        goto cleanup;
+    }
+    for (int i = 0; i < current.count; i++) {
+        paths[i] = current.items[i].path;
+        current.items[i].path = NULL;
+    }
+    qsort(paths, (size_t)current.count, sizeof(paths[0]), cmp_glob_path);
+    *out = paths;
+    count = current.count;
+
+cleanup:
+    glob_list_free(&current);
+    glob_list_free(&next);
+    free(prefix);
+    free(rest);
+    if (f) {
+        fclose(f);
     }
+    return count;
+}
 
-    free(path_copy);
-    fclose(f);
-    return current_inode;
+void fs_glob_free(char **matches, int count)
+{
+    for (int i = 0; matches && i < count; i++) {
+        free(matches[i]);
+    }
+    free(matches);
 }
 
 /* ========================================================================== */
@@ -321,33 +1847,28 @@ int remove_directory_item(FILE *f, struct superblock *sb, int parent_inode_id, c
     const int32_t blocks[5] = { parent.direct1, parent.direct2, parent.direct3, parent.direct4, parent.direct5 };
     const int items_per_cluster = (int)(sb->cluster_size / sizeof(struct directory_item));
 
-    struct directory_item item;
     for (int i = 0; i < 5; i++) {
         if (blocks[i] == CLUSTER_UNUSED) {
             continue;
         }
 
-        const long base = cluster_offset(sb, blocks[i]);
-
+        struct directory_item *items = read_dir_cluster(f, sb, blocks[i]);
+        if (!items) {
+            continue;
+        }
         for (int j = 0; j < items_per_cluster; j++) {
-            const long item_pos = base + (long)j * (long)sizeof(struct directory_item);
-
-            if (!seek_abs(f, item_pos)) {
-                continue;
-            }
-            (void)fread(&item, sizeof(item), 1, f);
+            if (items[j].item_name[0] != '\0' && strcmp(items[j].item_name, name) == 0) {
+                fs_dcache_invalidate(); /* cesty přes tuto položku už neplatí */
 
-            if (item.item_name[0] != '\0' && strcmp(item.item_name, name) == 0) {
                 /* "Smažeme" položku nulováním – zachováme původní chování. */
-                const struct directory_item empty_item = (struct directory_item){0};
-
-                if (!seek_abs(f, item_pos)) {
-                    return 0;
-                }
-                (void)fwrite(&empty_item, sizeof(empty_item), 1, f);
-                return 1;
+                const int32_t target = dir_cluster_for_write(f, sb, parent_inode_id, &parent, i);
+                items[j] = (struct directory_item){0};
+                const int ok = target != -1 && write_cluster(f, sb, target, (const uint8_t *)items);
+                free(items);
+                return ok;
             }
         }
+        free(items);
     }
 
     return 0;
@@ -365,31 +1886,64 @@ int is_dir_empty(FILE *f, struct superblock *sb, int inode_id)
     const int32_t blocks[5] = { inode.direct1, inode.direct2, inode.direct3, inode.direct4, inode.direct5 };
     const int items_per_cluster = (int)(sb->cluster_size / sizeof(struct directory_item));
 
-    struct directory_item item;
     for (int i = 0; i < 5; i++) {
         if (blocks[i] == CLUSTER_UNUSED) {
             continue;
         }
 
-        const long base = cluster_offset(sb, blocks[i]);
-
+        struct directory_item *items = read_dir_cluster(f, sb, blocks[i]);
+        if (!items) {
+            continue;
+        }
         for (int j = 0; j < items_per_cluster; j++) {
-            if (!seek_abs(f, base + (long)j * (long)sizeof(struct directory_item))) {
-                continue;
-            }
-            (void)fread(&item, sizeof(item), 1, f);
-
-            if (item.item_name[0] != '\0') {
-                if (strcmp(item.item_name, ".") != 0 && strcmp(item.item_name, "..") != 0) {
-                    return 0; /* není prázdný */
-                }
+            if (items[j].item_name[0] != '\0' && strcmp(items[j].item_name, ".") != 0 &&
+                strcmp(items[j].item_name, "..") != 0) {
+                free(items);
+                return 0; /* není prázdný */
             }
         }
+        free(items);
     }
 
     return 1; /* je prázdný */
 }
 
+int inode_cluster_list(const struct pseudo_inode *inode, int32_t clusters[6])
+{
+    /* Inline soubor žádné clustery nemá – v oblasti odkazů leží data. */
+    if (!inode || (inode->flags & INODE_FLAG_INLINE)) {
+        return 0;
+    }
+
+    int count = 0;
+    int32_t blocks[5];
+    inode_get_direct(inode, blocks);
+    for (int i = 0; i < 5; i++) {
+        if (blocks[i] != CLUSTER_UNUSED && blocks[i] != CLUSTER_HOLE) {
+            clusters[count++] = blocks[i];
+        }
+    }
+
+    /* Konec ve fragmentu drží na fragment clusteru jeden odkaz. */
+    if (inode->flags & INODE_FLAG_TAIL) {
+        clusters[count++] = inode->indirect1;
+    }
+    return count;
+}
+
+void free_file_clusters(FILE *f, struct superblock *sb, const struct pseudo_inode *inode)
+{
+    if (!f || !sb || !inode) {
+        return;
+    }
+
+    int32_t clusters[6];
+    const int count = inode_cluster_list(inode, clusters);
+    for (int i = 0; i < count; i++) {
+        cluster_unref(f, sb, clusters[i]);
+    }
+}
+
 void free_inode_resources(FILE *f, struct superblock *sb, int inode_id)
 {
     if (!f || !sb || inode_id < 0) {
@@ -399,13 +1953,8 @@ void free_inode_resources(FILE *f, struct superblock *sb, int inode_id)
     struct pseudo_inode inode;
     read_inode(f, sb, inode_id, &inode);
 
-    /* 1) Uvolnění datových bloků v bitmapě */
-    const int32_t blocks[5] = { inode.direct1, inode.direct2, inode.direct3, inode.direct4, inode.direct5 };
-    for (int i = 0; i < 5; i++) {
-        if (blocks[i] != CLUSTER_UNUSED) {
-            set_bit(f, sb, false, blocks[i], false); /* data bitmap: 0 */
-        }
-    }
+    /* 1) Uvolnění datových bloků (sdílené clustery jen ztratí jeden odkaz) */
+    free_file_clusters(f, sb, &inode);
 
     /* 2) Uvolnění inodu v inode bitmapě */
     set_bit(f, sb, true, inode_id, false);
@@ -457,75 +2006,339 @@ void parse_path(const char *path, char *parent_path, char *filename)
 /* Práce s obsahem souborů                                                    */
 /* ========================================================================== */
 
-int load_file_content(FILE *f, struct superblock *sb, int inode_id, uint8_t *buffer)
+void inode_get_direct(const struct pseudo_inode *inode, int32_t blocks[5])
 {
-    if (!f || !sb || !buffer || inode_id < 0) {
+    blocks[0] = inode->direct1;
+    blocks[1] = inode->direct2;
+    blocks[2] = inode->direct3;
+    blocks[3] = inode->direct4;
+    blocks[4] = inode->direct5;
+}
+
+void inode_set_direct(struct pseudo_inode *inode, const int32_t blocks[5])
+{
+    inode->direct1 = blocks[0];
+    inode->direct2 = blocks[1];
+    inode->direct3 = blocks[2];
+    inode->direct4 = blocks[3];
+    inode->direct5 = blocks[4];
+}
+
+bool buffer_is_zero(const uint8_t *buf, size_t len)
+{
+    if (!buf) {
+        return false;
+    }
+
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    /* 4 x 16 B na iteraci, OR do jednoho registru a jediný test na konci bloku */
+    for (; i + 64 <= len; i += 64) {
+        __m128i acc = _mm_loadu_si128((const __m128i *)(buf + i));
+        acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i *)(buf + i + 16)));
+        acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i *)(buf + i + 32)));
+        acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i *)(buf + i + 48)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF) {
+            return false;
+        }
+    }
+#endif
+
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, buf + i, sizeof(word));
+        if (word != 0) {
+            return false;
+        }
+    }
+
+    for (; i < len; i++) {
+        if (buf[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool file_cluster_is_hole(const struct pseudo_inode *inode, int index)
+{
+    if (!inode || index < 0 || index >= 5 || (inode->flags & (INODE_FLAG_INLINE | INODE_FLAG_COMPRESSED))) {
+        return false;
+    }
+
+    int32_t blocks[5];
+    inode_get_direct(inode, blocks);
+    return blocks[index] == CLUSTER_HOLE;
+}
+
+int write_cluster(FILE *f, struct superblock *sb, int32_t cluster, const uint8_t *buf)
+{
+    if (!f || !sb || !buf || cluster < 0) {
         return 0;
     }
 
-    struct pseudo_inode inode;
-    read_inode(f, sb, inode_id, &inode);
+    if (!fs_pwrite(f, cluster_offset(sb, cluster), buf, (size_t)sb->cluster_size)) {
+        return 0;
+    }
 
-    const int32_t blocks[5] = { inode.direct1, inode.direct2, inode.direct3, inode.direct4, inode.direct5 };
+    cluster_crc_store(f, sb, cluster, buf);
+    return 1;
+}
 
-    int bytes_remaining = inode.file_size;
-    int bytes_read = 0;
+int read_cluster(FILE *f, const struct superblock *sb, int32_t cluster, uint8_t *buf)
+{
+    if (!f || !sb || !buf || cluster < 0) {
+        return 0;
+    }
 
-    for (int i = 0; i < 5; i++) {
-        if (blocks[i] == CLUSTER_UNUSED || bytes_remaining <= 0) {
-            break;
-        }
+    if (!fs_pread(f, cluster_offset(sb, cluster), buf, (size_t)sb->cluster_size)) {
+        return 0;
+    }
 
-        if (!seek_abs(f, cluster_offset(sb, blocks[i]))) {
-            break;
+    return cluster_crc_verify(f, sb, cluster, buf);
+}
+
+/**
+ * @brief Načte část k-tého fyzického clusteru souboru (od offsetu within, max. max bajtů).
+ *
+ * Fyzické clustery jsou přímé odkazy (díry se dopočítají jako nuly) a za nimi
+ * případný konec ve sdíleném fragmentu (INODE_FLAG_TAIL).
+ *
+ * @return počet načtených bajtů, 0 pokud cluster neexistuje.
+ */
+static int read_phys_part(FILE *f, const struct superblock *sb, const struct pseudo_inode *inode,
+                          int k, int within, uint8_t *buf, int max)
+{
+    int32_t blocks[5];
+    inode_get_direct(inode, blocks);
+
+    int direct_count = 0;
+    while (direct_count < 5 && blocks[direct_count] != CLUSTER_UNUSED) {
+        direct_count++;
+    }
+
+    int32_t cluster = CLUSTER_UNUSED;
+    int start = within;
+    int avail = 0;
+
+    if (k < direct_count) {
+        cluster = blocks[k];
+        avail = sb->cluster_size - within;
+    } else if (k == direct_count && (inode->flags & INODE_FLAG_TAIL)) {
+        cluster = inode->indirect1;
+        start = TAIL_OFFSET(inode->indirect2) + within;
+        avail = TAIL_LENGTH(inode->indirect2) - within;
+    }
+
+    const int n = (avail < max) ? avail : max;
+    if (n <= 0) {
+        return 0;
+    }
+
+    if (cluster == CLUSTER_HOLE) {
+        /* Díra se na disku nenachází – dopočítáme nuly. */
+        memset(buf, 0, (size_t)n);
+        return n;
+    }
+
+    /* Čte se vždy celý cluster, aby šel ověřit kontrolní součet. */
+    if (start == 0 && n == sb->cluster_size) {
+        return read_cluster(f, sb, cluster, buf) ? n : 0;
+    }
+
+    uint8_t *whole = (uint8_t *)malloc((size_t)sb->cluster_size);
+    if (!whole) {
+        return 0;
+    }
+
+    const int ok = read_cluster(f, sb, cluster, whole);
+    if (ok) {
+        memcpy(buf, whole + start, (size_t)n);
+    }
+    free(whole);
+    return ok ? n : 0;
+}
+
+/**
+ * @brief Načte len bajtů fyzického obsahu souboru od offsetu off (přes hranice clusterů).
+ * @return 1 pokud se načetlo vše, jinak 0.
+ */
+static int read_phys_range(FILE *f, const struct superblock *sb, const struct pseudo_inode *inode,
+                           long off, int len, uint8_t *buf)
+{
+    int done = 0;
+    while (done < len) {
+        const long pos = off + done;
+        const int n = read_phys_part(f, sb, inode, (int)(pos / sb->cluster_size),
+                                     (int)(pos % sb->cluster_size), buf + done, len - done);
+        if (n <= 0) {
+            return 0;
         }
+        done += n;
+    }
+    return 1;
+}
 
-        const int to_read = (bytes_remaining > sb->cluster_size) ? sb->cluster_size : bytes_remaining;
-        (void)fread(buffer + bytes_read, 1, (size_t)to_read, f);
+/**
+ * @brief Načte a rozbalí index-tý cluster komprimovaného souboru (viz fs_compress.h).
+ */
+static int read_compressed_cluster(FILE *f, const struct superblock *sb, const struct pseudo_inode *inode,
+                                   int index, uint8_t *buf, int to_read)
+{
+    uint8_t header[5 * sizeof(uint16_t)];
+    const int header_len = fs_compress_header_len(inode->file_size, sb->cluster_size);
+    if (header_len > (int)sizeof(header) || !read_phys_range(f, sb, inode, 0, header_len, header)) {
+        return 0;
+    }
 
-        bytes_read += to_read;
-        bytes_remaining -= to_read;
+    long off = header_len;
+    for (int j = 0; j < index; j++) {
+        off += (header[j * 2] | (header[j * 2 + 1] << 8)) & COMPRESS_LEN_MASK;
     }
 
-    return bytes_read;
+    const unsigned entry = (unsigned)(header[index * 2] | (header[index * 2 + 1] << 8));
+    const int stored = (int)(entry & COMPRESS_LEN_MASK);
+
+    if (entry & COMPRESS_RAW_FLAG) {
+        return (stored == to_read && read_phys_range(f, sb, inode, off, stored, buf)) ? to_read : 0;
+    }
+
+    uint8_t *packed = (uint8_t *)malloc((size_t)stored);
+    if (!packed) {
+        return 0;
+    }
+
+    int n = 0;
+    if (read_phys_range(f, sb, inode, off, stored, packed)) {
+        n = fs_lz_decompress(packed, stored, buf, to_read);
+    }
+    free(packed);
+
+    return (n == to_read) ? to_read : 0;
 }
 
-int write_buffer_to_new_inode(FILE *f, struct superblock *sb, int inode_id, uint8_t *buffer, int size)
+int read_file_cluster(FILE *f, struct superblock *sb, const struct pseudo_inode *inode, int index, uint8_t *buf)
 {
-    if (!f || !sb || !buffer || inode_id < 0 || size < 0) {
+    if (!f || !sb || !inode || !buf || index < 0 || index >= 5) {
+        return 0;
+    }
+
+    const long start = (long)index * (long)sb->cluster_size;
+    if (start >= inode->file_size) {
+        return 0;
+    }
+
+    const long remaining = inode->file_size - start;
+    const int to_read = (remaining > sb->cluster_size) ? sb->cluster_size : (int)remaining;
+
+    if (inode->flags & INODE_FLAG_INLINE) {
+        /* Inline soubor má jediný "cluster" přímo v inodu. */
+        const int n = (to_read > INODE_INLINE_MAX) ? INODE_INLINE_MAX : to_read;
+        memcpy(buf, inode->inline_data, (size_t)n);
+        return n;
+    }
+
+    if (inode->flags & INODE_FLAG_COMPRESSED) {
+        return read_compressed_cluster(f, sb, inode, index, buf, to_read);
+    }
+
+    /* Logický cluster = fyzický cluster (přímý, díra, nebo konec ve fragmentu). */
+    return read_phys_part(f, sb, inode, index, 0, buf, to_read);
+}
+
+int load_file_content(FILE *f, struct superblock *sb, int inode_id, uint8_t *buffer)
+{
+    if (!f || !sb || !buffer || inode_id < 0) {
         return 0;
     }
 
+    struct pseudo_inode inode;
+    read_inode(f, sb, inode_id, &inode);
+
+    int bytes_read = 0;
+    for (int i = 0; i < 5; i++) {
+        const int n = read_file_cluster(f, sb, &inode, i, buffer + bytes_read);
+        if (n <= 0) {
+            break;
+        }
+        bytes_read += n;
+    }
+
+    return bytes_read;
+}
+
+/**
+ * @brief Uloží data na disk po clusterech: nulové clustery jako díry, plné clustery
+ *        do nových clusterů, neúplný konec přes write_file_tail().
+ *
+ * Nastaví přímé odkazy (případně konec ve fragmentu) v inodu.
+ * @return 1 při úspěchu, 0 pokud došlo místo (alokované clustery vrátí).
+ */
+static int store_clusters(FILE *f, struct superblock *sb, struct pseudo_inode *inode, const uint8_t *buffer, int size)
+{
     int32_t blocks[5] = { CLUSTER_UNUSED, CLUSTER_UNUSED, CLUSTER_UNUSED, CLUSTER_UNUSED, CLUSTER_UNUSED };
-    int bytes_rem = size;
     int b_idx = 0;
+    inode->indirect1 = CLUSTER_UNUSED;
+    inode->indirect2 = CLUSTER_UNUSED;
 
-    while (bytes_rem > 0 && b_idx < 5) {
-        const int free_block = find_free_bit(f, sb, false); /* data bitmap */
-        if (free_block == -1) {
-            return 0; /* došlo místo */
-        }
+    const int full_clusters = size / sb->cluster_size;
+    const int tail = size % sb->cluster_size;
 
-        set_bit(f, sb, false, free_block, true);
-        blocks[b_idx++] = free_block;
+    for (int i = 0; i < full_clusters && b_idx < 5; i++) {
+        const uint8_t *data = buffer + (long)i * sb->cluster_size;
 
-        if (!seek_abs(f, cluster_offset(sb, free_block))) {
-            return 0;
+        /* Nulový cluster se nealokuje ani nezapisuje – zůstane díra. */
+        if (buffer_is_zero(data, (size_t)sb->cluster_size)) {
+            blocks[b_idx++] = CLUSTER_HOLE;
+            continue;
         }
 
-        /* Původní chování: vždy zapíšeme celý cluster_size (vyčištěný nulami). */
-        uint8_t *cluster_buf = (uint8_t *)calloc(1, (size_t)sb->cluster_size);
-        if (!cluster_buf) {
-            return 0;
+        const int32_t cluster = store_data_cluster(f, sb, data);
+        if (cluster == -1) {
+            goto no_space;
         }
+        blocks[b_idx++] = cluster;
+    }
+
+    /* Neúplný poslední blok: krátký konec se zabalí do sdíleného fragmentu. */
+    if (tail > 0 && !write_file_tail(f, sb, inode, blocks, &b_idx, buffer + (size - tail), tail)) {
+        goto no_space;
+    }
+
+    inode_set_direct(inode, blocks);
+    return 1;
 
-        const int to_copy = (bytes_rem > sb->cluster_size) ? sb->cluster_size : bytes_rem;
-        memcpy(cluster_buf, buffer + (size - bytes_rem), (size_t)to_copy);
+no_space:
+    /* došlo místo – vrátíme už alokované clustery */
+    for (int i = 0; i < b_idx; i++) {
+        if (blocks[i] != CLUSTER_HOLE) {
+            cluster_unref(f, sb, blocks[i]);
+        }
+    }
+    return 0;
+}
 
-        (void)fwrite(cluster_buf, 1, (size_t)sb->cluster_size, f);
-        free(cluster_buf);
+/**
+ * @brief Kolik bajtů by obsah zabral bez komprese (díry nic, konec jen svou délku).
+ */
+static int plain_stored_size(const uint8_t *buffer, int size, int cluster_size)
+{
+    int stored = 0;
+    for (int start = 0; start < size; start += cluster_size) {
+        const int len = (size - start > cluster_size) ? cluster_size : size - start;
+        if (!buffer_is_zero(buffer + start, (size_t)len)) {
+            stored += len;
+        }
+    }
+    return stored;
+}
 
-        bytes_rem -= to_copy;
+int write_prepared_to_new_inode(FILE *f, struct superblock *sb, int inode_id, uint8_t *buffer, int size, bool compress,
+                                const uint8_t *payload, int payload_len)
+{
+    if (!f || !sb || !buffer || inode_id < 0 || size < 0) {
+        return 0;
     }
 
     struct pseudo_inode inode = (struct pseudo_inode){0};
@@ -533,14 +2346,50 @@ int write_buffer_to_new_inode(FILE *f, struct superblock *sb, int inode_id, uint
     inode.file_size = size;
     inode.references = 1;
     inode.isDirectory = false;
-    inode.direct1 = blocks[0];
-    inode.direct2 = blocks[1];
-    inode.direct3 = blocks[2];
-    inode.direct4 = blocks[3];
-    inode.direct5 = blocks[4];
-    inode.indirect1 = CLUSTER_UNUSED;
-    inode.indirect2 = CLUSTER_UNUSED;
+
+    /* Malý soubor: data rovnou do inodu, žádný cluster ani další seek při čtení. */
+    if (size > 0 && size <= INODE_INLINE_MAX) {
+        inode.flags = INODE_FLAG_INLINE;
+        memcpy(inode.inline_data, buffer, (size_t)size);
+        write_inode(f, sb, inode_id, &inode);
+        return 1;
+    }
+
+    /* Komprese (pro soubor nebo celý svazek): uloží se payload místo obsahu,
+       pokud ušetří aspoň osminu místa proti běžnému uložení. */
+    if (size > 0 && (compress || (sb->features & FS_FEATURE_COMPRESS))) {
+        const int plain = plain_stored_size(buffer, size, sb->cluster_size);
+
+        /* payload spočítaný předem platí jen pro stejnou velikost clusteru */
+        uint8_t *computed = NULL;
+        if (!payload || sb->cluster_size != CLUSTER_SIZE) {
+            computed = (uint8_t *)malloc((size_t)size);
+            payload = computed;
+            payload_len = computed ? fs_compress_file(buffer, size, sb->cluster_size, computed, size) : 0;
+        }
+
+        if (payload_len > 0 && payload_len <= plain - plain / 8) {
+            inode.flags = INODE_FLAG_COMPRESSED;
+            const int ok = store_clusters(f, sb, &inode, payload, payload_len);
+            free(computed);
+            if (!ok) {
+                return 0;
+            }
+            write_inode(f, sb, inode_id, &inode);
+            return 1;
+        }
+        free(computed);
+    }
+
+    if (!store_clusters(f, sb, &inode, buffer, size)) {
+        return 0;
+    }
 
     write_inode(f, sb, inode_id, &inode);
     return 1;
 }
+
+int write_buffer_to_new_inode(FILE *f, struct superblock *sb, int inode_id, uint8_t *buffer, int size, bool compress)
+{
+    return write_prepared_to_new_inode(f, sb, inode_id, buffer, size, compress, NULL, 0);
+}
@@ -0,0 +1,298 @@
+#define _POSIX_C_SOURCE 200809L
+/**
+ * @file fs_walk.c
+ * @brief Paralelní průchod podstromem nad snímkem tabulky inodů (viz fs_walk.h).
+ *
+ * Úloha = jeden adresář. Každé vlákno má frontu úloh chráněnou vlastním zámkem;
+ * vlastník pracuje na jejím konci (do hloubky, teplá cache), zloděj bere ze
+ * začátku (velké nezpracované podstromy). Počet rozpracovaných úloh (pending) se
+ * snižuje až po zařazení dětí, takže nula znamená, že je hotovo.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "../include/fs_walk.h"
+#include "../include/fs_utils.h"
+#include "../include/fs_io.h"
+#include "../include/fs_out.h"
+
+struct walk_task {
+    int32_t inode_id;
+    int depth;
+    int top;
+    char *path;             /* cesta adresáře ("" = kořen VFS) */
+};
+
+struct walk_deque {
+    pthread_mutex_t lock;
+    struct walk_task *items;
+    int head;
+    int tail;
+    int cap;
+};
+
+struct walk_pool {
+    FILE *f;                /* sdílený – čte se jen přes fs_pread (pread) */
+    const struct superblock *sb;
+    const struct pseudo_inode *table;
+    atomic_uchar *visited;  /* adresáře už zařazené do práce (ochrana proti cyklům) */
+    atomic_long pending;
+    int threads;
+    struct walk_deque queues[WALK_MAX_THREADS];
+    walk_visit_fn visit;
+    void *arg;
+};
+
+struct walk_thread {
+    struct walk_pool *pool;
+    int index;
+};
+
+/* ========================================================================== */
+/* Fronty                                                                     */
+/* ========================================================================== */
+
+static bool deque_push(struct walk_deque *q, const struct walk_task *task)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->tail == q->cap) {
+        /* nejdřív posunout k začátku (místo po ukradených), pak teprve zvětšit */
+        if (q->head > 0) {
+            memmove(q->items, q->items + q->head, (size_t)(q->tail - q->head) * sizeof(*q->items));
+            q->tail -= q->head;
+            q->head = 0;
+        }
+        if (q->tail == q->cap) {
+            const int cap = q->cap ? q->cap * 2 : 64;
+            struct walk_task *items = (struct walk_task *)realloc(q->items, (size_t)cap * sizeof(*items));
+            if (!items) {
+                pthread_mutex_unlock(&q->lock);
+                return false;
+            }
+            q->items = items;
+            q->cap = cap;
+        }
+    }
+    q->items[q->tail++] = *task;
+    pthread_mutex_unlock(&q->lock);
+    return true;
+}
+
+static bool deque_pop(struct walk_deque *q, struct walk_task *out, bool steal)
+{
+    pthread_mutex_lock(&q->lock);
+    const bool found = q->tail > q->head;
+    if (found) {
+        *out = steal ? q->items[q->head++] : q->items[--q->tail];
+    }
+    pthread_mutex_unlock(&q->lock);
+    return found;
+}
+
+/* ========================================================================== */
+/* Zpracování adresáře                                                        */
+/* ========================================================================== */
+
+static void walk_dir(struct walk_pool *pool, int self, const struct walk_task *task, struct directory_item *items)
+{
+    const struct superblock *sb = pool->sb;
+    const int items_per_cluster = (int)(sb->cluster_size / sizeof(struct directory_item));
+
+    int32_t blocks[5];
+    inode_get_direct(&pool->table[task->inode_id], blocks);
+
+    for (int b = 0; b < 5; b++) {
+        if (blocks[b] == CLUSTER_UNUSED || blocks[b] == CLUSTER_HOLE ||
+            !read_cluster(pool->f, sb, blocks[b], (uint8_t *)items)) {
+            continue;
+        }
+
+        for (int j = 0; j < items_per_cluster; j++) {
+            const struct directory_item *item = &items[j];
+            if (item->item_name[0] == '\0' || strcmp(item->item_name, ".") == 0 ||
+                strcmp(item->item_name, "..") == 0) {
+                continue;
+            }
+
+            char name[MAX_NAME_LEN];
+            (void)snprintf(name, sizeof(name), "%s", item->item_name);
+            const bool valid = item->inode >= 0 && item->inode < sb->cluster_count;
+            const struct pseudo_inode *inode = valid ? &pool->table[item->inode] : NULL;
+            const struct walk_entry entry = {
+                .dir_path = task->path,
+                .name = name,
+                .parent_inode = task->inode_id,
+                .inode_id = item->inode,
+                .inode = inode,
+                .item = item,
+                /* adresář odkazovaný podruhé (poškozený obraz) se znovu neprochází */
+                .repeat = inode && inode->isDirectory && atomic_exchange(&pool->visited[item->inode], 1) != 0,
+                .depth = task->depth + 1,
+                .top = (task->depth == 0) ? b * items_per_cluster + j : task->top,
+            };
+            pool->visit(pool->arg, self, &entry);
+
+            if (!inode || !inode->isDirectory || entry.repeat) {
+                continue;
+            }
+            const size_t len = strlen(task->path) + strlen(name) + 2;
+            struct walk_task child = { item->inode, entry.depth, entry.top, (char *)malloc(len) };
+            if (!child.path) {
+                continue;
+            }
+            (void)snprintf(child.path, len, "%s/%s", task->path, name);
+
+            atomic_fetch_add(&pool->pending, 1);
+            if (!deque_push(&pool->queues[self], &child)) {
+                free(child.path);
+                atomic_fetch_sub(&pool->pending, 1);
+            }
+        }
+    }
+}
+
+static void *walk_worker(void *arg)
+{
+    const struct walk_thread *w = (const struct walk_thread *)arg;
+    struct walk_pool *pool = w->pool;
+    struct directory_item *items = (struct directory_item *)malloc((size_t)pool->sb->cluster_size);
+
+    while (items) {
+        struct walk_task task;
+        bool found = deque_pop(&pool->queues[w->index], &task, false);
+        for (int k = 1; !found && k < pool->threads; k++) {
+            found = deque_pop(&pool->queues[(w->index + k) % pool->threads], &task, true);
+        }
+
+        if (found) {
+            walk_dir(pool, w->index, &task, items);
+            free(task.path);
+            atomic_fetch_sub(&pool->pending, 1);
+        } else if (atomic_load(&pool->pending) == 0) {
+            break;
+        } else {
+            sched_yield(); /* práce ještě vzniká u ostatních */
+        }
+    }
+
+    free(items);
+    return NULL;
+}
+
+/* ========================================================================== */
+/* API                                                                        */
+/* ========================================================================== */
+
+int fs_walk_threads(int max)
+{
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1 || max < 1) {
+        return 1;
+    }
+    return (cpus > max) ? max : (int)cpus;
+}
+
+int fs_walk_table(FILE *f, const struct superblock *sb, const struct pseudo_inode *table, int root_inode,
+                  const char *root_path, walk_visit_fn visit, void *arg)
+{
+    if (!f || !sb || !table || root_inode < 0 || root_inode >= sb->cluster_count || !table[root_inode].isDirectory) {
+        return 0;
+    }
+
+    int threads = 0;
+    struct walk_pool pool = {
+        .f = f,
+        .sb = sb,
+        .table = table,
+        .threads = fs_walk_threads(WALK_MAX_THREADS),
+        .visit = visit,
+        .arg = arg,
+    };
+    pool.visited = (atomic_uchar *)calloc((size_t)sb->cluster_count, sizeof(atomic_uchar));
+    for (int t = 0; t < pool.threads; t++) {
+        pthread_mutex_init(&pool.queues[t].lock, NULL);
+    }
+    if (!pool.visited) {
+        goto cleanup;
+    }
+    atomic_store(&pool.visited[root_inode], 1);
+
+    /* kořen "/" jako "", ať cesty potomků nezačínají "//" */
+    struct walk_task root = { root_inode, 0, 0, strdup(strcmp(root_path, "/") == 0 ? "" : root_path) };
+    if (!root.path) {
+        goto cleanup;
+    }
+    atomic_store(&pool.pending, 1);
+    (void)deque_push(&pool.queues[0], &root);
+
+    pthread_t tid[WALK_MAX_THREADS];
+    struct walk_thread workers[WALK_MAX_THREADS];
+    bool started[WALK_MAX_THREADS] = { false };
+    for (int t = 0; t < pool.threads; t++) {
+        workers[t] = (struct walk_thread){ &pool, t };
+    }
+    for (int t = 1; t < pool.threads; t++) {
+        started[t] = fs_out_thread(&tid[t], walk_worker, &workers[t]) == 0;
+    }
+    walk_worker(&workers[0]);   /* hlavní vlákno je vlákno 0 */
+    for (int t = 1; t < pool.threads; t++) {
+        if (started[t]) {
+            pthread_join(tid[t], NULL);
+        }
+    }
+    threads = pool.threads;
+
+cleanup:
+    for (int t = 0; t < pool.threads; t++) {
+        struct walk_deque *q = &pool.queues[t];
+        for (int i = q->head; i < q->tail; i++) {
+            free(q->items[i].path);
+        }
+        free(q->items);
+        pthread_mutex_destroy(&q->lock);
+    }
+    free(pool.visited);
+    return threads;
+}
+
+int fs_walk(const char *filename, int root_inode, const char *root_path, walk_visit_fn visit, void *arg)
+{
+    FILE *f = fopen(filename, "rb");
+    struct superblock sb;
+    if (!f || !load_superblock(f, &sb)) {
+        if (f) {
+            fclose(f);
+        }
+        return 0;
+    }
+
+    /* snímek celé tabulky inodů jedním čtením */
+    int threads = 0;
+    const size_t table_size = (size_t)sb.cluster_count * sizeof(struct pseudo_inode);
+    struct pseudo_inode *table = (struct pseudo_inode *)malloc(table_size);
+    if (table && read_inode_table(f, &sb, 0, table, table_size)) {
+        threads = fs_walk_table(f, &sb, table, root_inode, root_path, visit, arg);
+    }
+
+    free(table);
+    fclose(f);
+    return threads;
+}
+
+int fs_walk_path_cmp(const char *a, const char *b)
+{
+    while (*a != '\0' && *a == *b) {
+        ++a;
+        ++b;
+    }
+    const int ca = (*a == '/') ? 1 : (unsigned char)*a;
+    const int cb = (*b == '/') ? 1 : (unsigned char)*b;
+    return ca - cb;
+}
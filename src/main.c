@@ -13,13 +13,27 @@
  */
 
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <glob.h>
+#include <poll.h>
+#include <sys/stat.h>
 
 /* Project headers (Makefile adds -I./include) */
 #include "fs_core.h"
 #include "fs_utils.h"
+#include "fs_dedup.h"
+#include "fs_crc.h"
+#include "fs_io.h"
+#include "fs_script.h"
+#include "fs_prefetch.h"
+#include "fs_server.h"
+#include "fs_out.h"
+#include "fs_lock.h"
+#include "fs_sched.h"
 
 /** Maximální délka cesty, kterou drží "shell" (musí být konzistentní napříč main.c). */
 enum { MAX_PATH_LEN = 1024 };
@@ -33,8 +47,13 @@ enum { MAX_ARGS = 16 };
 typedef struct ShellContext {
     const char *fs_name;
     char cwd[MAX_PATH_LEN];
+    bool in_txn;            /* běží transakce zahájená příkazem begin */
+    bool snapshot;          /* cesty jdou do snapshotu (ten se nemění, zámky netřeba) */
 } ShellContext;
 
+/** Rozvržení obrazu (fs_layout_check): -1 = nezjištěno, po formátu a cizí změně znovu. */
+static _Atomic int image_layout = -1;
+
 /**
  * @brief Rozdělí řádek na tokeny podle whitespace.
  *
@@ -168,7 +187,7 @@ static bool is_inode_directory(const char *fs_name, int inode_id)
 {
     FILE *f = fopen(fs_name, "rb");
     if (f == NULL) {
-        printf("FILE NOT FOUND\n");
+        fs_printf("FILE NOT FOUND\n");
         return false;
     }
 
@@ -183,307 +202,1788 @@ static bool is_inode_directory(const char *fs_name, int inode_id)
 }
 
 /**
- * @brief Provede jeden příkaz.
+ * @brief Připraví argument "@snap:/cesta" pro čtení ze snapshotu.
  *
- * @return true pokud se má pokračovat, false pokud se má ukončit ("exit").
+ * Zapne čtení ze snapshotu (fs_set_snapshot_view) a argument přepíše na cestu
+ * uvnitř snapshotu. Bez části za dvojtečkou jde o kořen snapshotu.
+ *
+ * @return false pokud snapshot neexistuje (hláška už je vypsaná).
  */
-static bool exec_command(ShellContext *ctx, int argc, char **argv)
+static bool enter_snapshot_path(const ShellContext *ctx, char **arg, char *name, size_t name_sz)
 {
-    if (argc == 0) {
-        return true;
-    }
+    const char *spec = *arg + 1;
+    const char *colon = strchr(spec, ':');
+    const size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
 
-    const char *cmd = argv[0];
+    if (len == 0 || len >= name_sz) {
+        fs_printf("PATH NOT FOUND\n");
+        return false;
+    }
+    memcpy(name, spec, len);
+    name[len] = '\0';
 
-    /* --- systémové příkazy --- */
-    if (strcmp(cmd, "exit") == 0) {
+    if (!fs_snapshot_exists(ctx->fs_name, name)) {
+        fs_printf("PATH NOT FOUND\n");
         return false;
     }
-    if (strcmp(cmd, "pwd") == 0) {
-        printf("%s\n", ctx->cwd);
+
+    *arg = (colon && colon[1] != '\0') ? (char *)colon + 1 : "/";
+    fs_set_snapshot_view(name);
+    return true;
+}
+
+/* ========================================================================== */
+/* Příkazy                                                                    */
+/* ========================================================================== */
+
+/** Obsluha příkazu; vrací false, pokud se má shell ukončit ("exit"). */
+typedef bool (*command_fn)(ShellContext *ctx, int argc, char **argv);
+
+static bool run_command(ShellContext *ctx, int id, int argc, char **argv);
+
+static bool cmd_exit(ShellContext *ctx, int argc, char **argv)
+{
+    (void)ctx;
+    (void)argc;
+    (void)argv;
+    return false;
+}
+
+static bool cmd_begin(ShellContext *ctx, int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    if (ctx->in_txn) {
+        fs_printf("TRANSACTION ACTIVE\n");
+        return true;
+    }
+    /* Uvnitř load nejdřív zapíšeme, co skript udělal před begin. */
+    if (fs_io_in_transaction()) {
+        (void)fs_io_end();
+    }
+    if (!fs_io_begin()) {
+        fs_printf("TRANSACTION FAILED\n");
         return true;
     }
-    if (strcmp(cmd, "cd") == 0) {
-        const char *target = (argc >= 2) ? argv[1] : "/";
-        char abs_path[MAX_PATH_LEN];
-        make_abs_path(ctx->cwd, target, abs_path, sizeof(abs_path));
+    ctx->in_txn = true;
+    fs_printf("OK\n");
+    return true;
+}
 
-        const int inode_id = fs_path_to_inode(ctx->fs_name, abs_path);
-        if (inode_id == -1) {
-            printf("PATH NOT FOUND\n");
-            return true;
-        }
-        if (!is_inode_directory(ctx->fs_name, inode_id)) {
-            /* Zadání chce pro cd chybu "PATH NOT FOUND". */
-            printf("PATH NOT FOUND\n");
-            return true;
+static bool cmd_commit(ShellContext *ctx, int argc, char **argv)
+{
+    (void)argc;
+    const bool commit = strcmp(argv[0], "commit") == 0;
+    if (!ctx->in_txn) {
+        fs_printf("NO TRANSACTION\n");
+        return true;
+    }
+    ctx->in_txn = false;
+    (void)(commit ? fs_io_end() : fs_io_abort());
+
+    /* Po abort už aktuální adresář nemusí existovat. */
+    if (!commit) {
+        fs_dcache_invalidate();
+        fs_bitmap_invalidate();
+        if (fs_path_to_inode(ctx->fs_name, ctx->cwd) == -1) {
+            (void)snprintf(ctx->cwd, sizeof(ctx->cwd), "/");
         }
+    }
+    fs_printf("OK\n");
+    return true;
+}
+
+static bool cmd_pwd(ShellContext *ctx, int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    fs_printf("%s\n", ctx->cwd);
+    return true;
+}
 
-        (void)snprintf(ctx->cwd, sizeof(ctx->cwd), "%s", abs_path);
-        printf("OK\n");
+static bool cmd_cd(ShellContext *ctx, int argc, char **argv)
+{
+    const char *target = (argc >= 2) ? argv[1] : "/";
+    char abs_path[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, target, abs_path, sizeof(abs_path));
+
+    const int inode_id = fs_path_to_inode(ctx->fs_name, abs_path);
+    if (inode_id == -1) {
+        fs_printf("PATH NOT FOUND\n");
+        return true;
+    }
+    if (!is_inode_directory(ctx->fs_name, inode_id)) {
+        /* Zadání chce pro cd chybu "PATH NOT FOUND". */
+        fs_printf("PATH NOT FOUND\n");
         return true;
     }
 
-    if (strcmp(cmd, "load") == 0) {
-        if (argc < 2) {
-            printf("FILE NOT FOUND\n");
-            return true;
-        }
-        FILE *script = fopen(argv[1], "r");
-        if (script == NULL) {
-            printf("FILE NOT FOUND\n");
-            return true;
-        }
+    (void)snprintf(ctx->cwd, sizeof(ctx->cwd), "%s", abs_path);
+    fs_printf("OK\n");
+    return true;
+}
 
-        char *line = NULL;
-        size_t n = 0;
-        while (getline(&line, &n, script) != -1) {
-            /* přeskoč komentáře a prázdné řádky */
-            char *p = line;
-            while (*p == ' ' || *p == '\t') {
-                ++p;
-            }
-            if (*p == '#' || *p == '\n' || *p == '\0') {
-                continue;
-            }
+static bool cmd_load(ShellContext *ctx, int argc, char **argv);
+static bool cmd_compile(ShellContext *ctx, int argc, char **argv);
 
-            char *argv2[MAX_ARGS];
-            const int argc2 = tokenize(line, argv2, MAX_ARGS);
-            if (argc2 == 0) {
-                continue;
-            }
-            if (!exec_command(ctx, argc2, argv2)) {
-                break;
-            }
-        }
-        free(line);
-        fclose(script);
+static bool cmd_format(ShellContext *ctx, int argc, char **argv)
+{
+    if (argc < 2) {
+        fs_printf("CANNOT CREATE FILE\n");
         return true;
     }
+    if (fs_format(ctx->fs_name, argv[1])) {
+        fs_printf("OK\n");
+    } else {
+        fs_printf("CANNOT CREATE FILE\n");
+    }
+    atomic_store(&image_layout, -1);
+    fs_dcache_invalidate();
+    fs_bitmap_invalidate();
+    (void)snprintf(ctx->cwd, sizeof(ctx->cwd), "/");
+    return true;
+}
+
+static bool cmd_statfs(ShellContext *ctx, int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    fs_statfs(ctx->fs_name);
+    return true;
+}
 
-    /* --- příkazy pracující s cestami ve FS ---
-     * Pozn.: implementace ve fs_* funkcích očekává absolutní cestu.
-     */
+static bool cmd_snapshot(ShellContext *ctx, int argc, char **argv)
+{
+    /* snapshot list | snapshot create|delete|rollback <name> */
+    const char *sub = (argc >= 2) ? argv[1] : "";
+    if (strcmp(sub, "list") == 0) {
+        fs_snapshot_list(ctx->fs_name);
+        return true;
+    }
+    if (argc < 3) {
+        fs_printf("INVALID ARGUMENT\n");
+        return true;
+    }
 
-    if (strcmp(cmd, "format") == 0) {
-        if (argc < 2) {
-            printf("CANNOT CREATE FILE\n");
-            return true;
-        }
-        if (fs_format(ctx->fs_name, argv[1])) {
-            printf("OK\n");
-        } else {
-            printf("CANNOT CREATE FILE\n");
+    int ok = 0;
+    if (strcmp(sub, "create") == 0) {
+        ok = fs_snapshot_create(ctx->fs_name, argv[2]);
+    } else if (strcmp(sub, "delete") == 0) {
+        ok = fs_snapshot_delete(ctx->fs_name, argv[2]);
+    } else if (strcmp(sub, "rollback") == 0) {
+        ok = fs_snapshot_rollback(ctx->fs_name, argv[2]);
+        if (ok) {
+            /* aktuální adresář ve vráceném stavu nemusí existovat */
+            fs_dcache_invalidate();
+            fs_bitmap_invalidate();
+            (void)snprintf(ctx->cwd, sizeof(ctx->cwd), "/");
         }
-        (void)snprintf(ctx->cwd, sizeof(ctx->cwd), "/");
+    } else {
+        fs_printf("INVALID ARGUMENT\n");
+    }
+    if (ok) {
+        fs_printf("OK\n");
+    }
+    return true;
+}
+
+static bool cmd_scrub(ShellContext *ctx, int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    if (fs_scrub(ctx->fs_name)) {
+        fs_printf("OK\n");
+    }
+    return true;
+}
+
+static bool cmd_dedupe(ShellContext *ctx, int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    if (fs_dedupe(ctx->fs_name)) {
+        fs_printf("OK\n");
+    }
+    return true;
+}
+
+static bool cmd_tune(ShellContext *ctx, int argc, char **argv)
+{
+    /* tune = výpis vlastností, tune <feature> on|off = změna */
+    if (argc == 2) {
+        fs_printf("INVALID ARGUMENT\n");
         return true;
     }
+    if (fs_tune(ctx->fs_name, (argc >= 3) ? argv[1] : NULL, (argc >= 3) ? argv[2] : NULL) && argc >= 3) {
+        fs_printf("OK\n");
+    }
+    return true;
+}
 
-    if (strcmp(cmd, "statfs") == 0) {
-        fs_statfs(ctx->fs_name);
+static bool cmd_allocbench(ShellContext *ctx, int argc, char **argv)
+{
+    /* allocbench [vlákna] */
+    const int threads = (argc >= 2) ? atoi(argv[1]) : 0;
+    if (argc >= 2 && threads <= 0) {
+        fs_printf("INVALID ARGUMENT\n");
         return true;
     }
+    (void)fs_allocbench(ctx->fs_name, threads);
+    return true;
+}
 
-    if (strcmp(cmd, "ls") == 0) {
-        const char *target = (argc >= 2) ? argv[1] : ".";
-        char abs[MAX_PATH_LEN];
-        make_abs_path(ctx->cwd, target, abs, sizeof(abs));
+static bool cmd_ls(ShellContext *ctx, int argc, char **argv)
+{
+    /* ls [-l] [cesta] */
+    const bool long_format = argc >= 2 && strcmp(argv[1], "-l") == 0;
+    if (long_format) {
+        argv++;
+        argc--;
+    }
+    const char *target = (argc >= 2) ? argv[1] : ".";
+    char abs[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, target, abs, sizeof(abs));
 
-        const int inode_id = fs_path_to_inode(ctx->fs_name, abs);
-        if (inode_id == -1) {
-            printf("PATH NOT FOUND\n");
-            return true;
-        }
-        fs_ls(ctx->fs_name, inode_id);
+    const int inode_id = fs_path_to_inode(ctx->fs_name, abs);
+    if (inode_id == -1) {
+        fs_printf("PATH NOT FOUND\n");
         return true;
     }
+    fs_ls(ctx->fs_name, inode_id, long_format);
+    return true;
+}
 
-    if (strcmp(cmd, "info") == 0) {
-        if (argc < 2) {
-            printf("PATH NOT FOUND\n");
-            return true;
-        }
-        char abs[MAX_PATH_LEN];
-        make_abs_path(ctx->cwd, argv[1], abs, sizeof(abs));
-        fs_info_path(ctx->fs_name, abs);
+static bool cmd_info(ShellContext *ctx, int argc, char **argv)
+{
+    if (argc < 2) {
+        fs_printf("PATH NOT FOUND\n");
         return true;
     }
+    char abs[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, argv[1], abs, sizeof(abs));
+    fs_info_path(ctx->fs_name, abs);
+    return true;
+}
 
-    if (strcmp(cmd, "mkdir") == 0) {
-        if (argc < 2) {
-            printf("PATH NOT FOUND\n");
-            return true;
-        }
-        char abs[MAX_PATH_LEN];
-        make_abs_path(ctx->cwd, argv[1], abs, sizeof(abs));
-        if (fs_mkdir(ctx->fs_name, abs)) {
-            printf("OK\n");
-        }
+static bool cmd_mkdir(ShellContext *ctx, int argc, char **argv)
+{
+    if (argc < 2) {
+        fs_printf("PATH NOT FOUND\n");
         return true;
     }
+    char abs[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, argv[1], abs, sizeof(abs));
+    if (fs_mkdir(ctx->fs_name, abs)) {
+        fs_printf("OK\n");
+    }
+    return true;
+}
 
-    if (strcmp(cmd, "rmdir") == 0) {
-        if (argc < 2) {
-            printf("PATH NOT FOUND\n");
-            return true;
-        }
-        char abs[MAX_PATH_LEN];
-        make_abs_path(ctx->cwd, argv[1], abs, sizeof(abs));
-        if (strcmp(abs, ctx->cwd) == 0 || strcmp(abs, "/") == 0) {
-            /* Zakázat mazání aktuálního adresáře (a rootu) – udržení konzistence PWD. */
-            printf("NOT EMPTY\n");
-            return true;
-        }
-        if (fs_rmdir(ctx->fs_name, abs)) {
-            printf("OK\n");
-        }
+static bool cmd_rmdir(ShellContext *ctx, int argc, char **argv)
+{
+    if (argc < 2) {
+        fs_printf("PATH NOT FOUND\n");
+        return true;
+    }
+    char abs[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, argv[1], abs, sizeof(abs));
+    if (strcmp(abs, ctx->cwd) == 0 || strcmp(abs, "/") == 0) {
+        /* Zakázat mazání aktuálního adresáře (a rootu) – udržení konzistence PWD. */
+        fs_printf("NOT EMPTY\n");
         return true;
     }
+    if (fs_rmdir(ctx->fs_name, abs)) {
+        fs_printf("OK\n");
+    }
+    return true;
+}
 
-    if (strcmp(cmd, "incp") == 0) {
-        if (argc < 3) {
-            printf("FILE NOT FOUND\n");
-            return true;
-        }
-        char abs[MAX_PATH_LEN];
-        make_abs_path(ctx->cwd, argv[2], abs, sizeof(abs));
-        if (fs_incp(ctx->fs_name, argv[1], abs)) {
-            printf("OK\n");
-        }
+static bool cmd_incp(ShellContext *ctx, int argc, char **argv)
+{
+    /* incp [-z] [-r] <host> <vfs>: -z uloží komprimovaně, -r importuje celý adresář */
+    bool compress = false;
+    bool recursive = false;
+    while (argc >= 2 && (strcmp(argv[1], "-z") == 0 || strcmp(argv[1], "-r") == 0)) {
+        compress |= argv[1][1] == 'z';
+        recursive |= argv[1][1] == 'r';
+        argv++;
+        argc--;
+    }
+    if (argc < 3) {
+        fs_printf("FILE NOT FOUND\n");
         return true;
     }
+    char abs[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, argv[2], abs, sizeof(abs));
+    const int ok = recursive ? fs_incp_tree(ctx->fs_name, argv[1], abs, compress)
+                             : fs_incp(ctx->fs_name, argv[1], abs, compress);
+    if (ok) {
+        fs_printf("OK\n");
+    }
+    return true;
+}
 
-    if (strcmp(cmd, "outcp") == 0) {
-        if (argc < 3) {
-            printf("FILE NOT FOUND\n");
-            return true;
-        }
-        char abs[MAX_PATH_LEN];
-        make_abs_path(ctx->cwd, argv[1], abs, sizeof(abs));
-        if (fs_outcp(ctx->fs_name, abs, argv[2])) {
-            printf("OK\n");
-        }
+static bool cmd_outcp(ShellContext *ctx, int argc, char **argv)
+{
+    /* outcp [-r] <vfs> <host>: -r exportuje celý adresář */
+    const bool recursive = argc >= 2 && strcmp(argv[1], "-r") == 0;
+    if (recursive) {
+        argv++;
+        argc--;
+    }
+    if (argc < 3) {
+        fs_printf("FILE NOT FOUND\n");
         return true;
     }
+    char abs[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, argv[1], abs, sizeof(abs));
+    const int ok = recursive ? fs_outcp_tree(ctx->fs_name, abs, argv[2]) : fs_outcp(ctx->fs_name, abs, argv[2]);
+    if (ok) {
+        fs_printf("OK\n");
+    }
+    return true;
+}
 
-    if (strcmp(cmd, "cat") == 0) {
-        if (argc < 2) {
-            printf("FILE NOT FOUND\n");
-            return true;
-        }
-        char abs[MAX_PATH_LEN];
-        make_abs_path(ctx->cwd, argv[1], abs, sizeof(abs));
-        fs_cat(ctx->fs_name, abs);
+static bool cmd_cat(ShellContext *ctx, int argc, char **argv)
+{
+    if (argc < 2) {
+        fs_printf("FILE NOT FOUND\n");
         return true;
     }
+    char abs[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, argv[1], abs, sizeof(abs));
+    fs_cat(ctx->fs_name, abs);
+    return true;
+}
 
-    if (strcmp(cmd, "rm") == 0) {
-        if (argc < 2) {
-            printf("FILE NOT FOUND\n");
-            return true;
-        }
-        char abs[MAX_PATH_LEN];
-        make_abs_path(ctx->cwd, argv[1], abs, sizeof(abs));
-        if (fs_rm(ctx->fs_name, abs)) {
-            printf("OK\n");
-        }
+static bool cmd_rm(ShellContext *ctx, int argc, char **argv)
+{
+    /* rm [-r] <cesta>: -r smaže i adresář s celým obsahem */
+    const bool recursive = argc >= 2 && strcmp(argv[1], "-r") == 0;
+    if (recursive) {
+        argv++;
+        argc--;
+    }
+    if (argc < 2) {
+        fs_printf("FILE NOT FOUND\n");
         return true;
     }
+    char abs[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, argv[1], abs, sizeof(abs));
+    if (recursive ? fs_rm_tree(ctx->fs_name, abs) : fs_rm(ctx->fs_name, abs)) {
+        fs_printf("OK\n");
+    }
+    return true;
+}
 
-    if (strcmp(cmd, "cp") == 0) {
-        if (argc < 3) {
-            printf("FILE NOT FOUND\n");
-            return true;
-        }
-        char abs1[MAX_PATH_LEN];
-        char abs2[MAX_PATH_LEN];
-        make_abs_path(ctx->cwd, argv[1], abs1, sizeof(abs1));
-        make_abs_path(ctx->cwd, argv[2], abs2, sizeof(abs2));
-        if (fs_cp(ctx->fs_name, abs1, abs2)) {
-            printf("OK\n");
-        }
+static bool cmd_cp(ShellContext *ctx, int argc, char **argv)
+{
+    /* cp [-r] <zdroj> <cíl>: -r zkopíruje adresář s celým obsahem */
+    const bool recursive = argc >= 2 && strcmp(argv[1], "-r") == 0;
+    if (recursive) {
+        argv++;
+        argc--;
+    }
+    if (argc < 3) {
+        fs_printf("FILE NOT FOUND\n");
         return true;
     }
+    char abs1[MAX_PATH_LEN];
+    char abs2[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, argv[1], abs1, sizeof(abs1));
+    make_abs_path(ctx->cwd, argv[2], abs2, sizeof(abs2));
+    if (recursive ? fs_cp_tree(ctx->fs_name, abs1, abs2) : fs_cp(ctx->fs_name, abs1, abs2)) {
+        fs_printf("OK\n");
+    }
+    return true;
+}
 
-    if (strcmp(cmd, "mv") == 0) {
-        if (argc < 3) {
-            printf("FILE NOT FOUND\n");
-            return true;
-        }
-        char abs1[MAX_PATH_LEN];
-        char abs2[MAX_PATH_LEN];
-        make_abs_path(ctx->cwd, argv[1], abs1, sizeof(abs1));
-        make_abs_path(ctx->cwd, argv[2], abs2, sizeof(abs2));
-        if (fs_mv(ctx->fs_name, abs1, abs2)) {
-            printf("OK\n");
-        }
+static bool cmd_mv(ShellContext *ctx, int argc, char **argv)
+{
+    if (argc < 3) {
+        fs_printf("FILE NOT FOUND\n");
         return true;
     }
+    char abs1[MAX_PATH_LEN];
+    char abs2[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, argv[1], abs1, sizeof(abs1));
+    make_abs_path(ctx->cwd, argv[2], abs2, sizeof(abs2));
+    if (fs_mv(ctx->fs_name, abs1, abs2)) {
+        fs_printf("OK\n");
+    }
+    return true;
+}
 
-    /* --- rozšíření pro login na "r": xcp + add --- */
-    if (strcmp(cmd, "xcp") == 0) {
-        if (argc < 4) {
-            printf("FILE NOT FOUND\n");
-            return true;
-        }
+/* --- rozšíření pro login na "r": xcp + add --- */
+static bool cmd_xcp(ShellContext *ctx, int argc, char **argv)
+{
+    if (argc < 3) {
+        fs_printf("FILE NOT FOUND\n");
+        return true;
+    }
+
+    /* xcp s1 s2 ... sN dest – převod všech cest na absolutní podle cwd.
+       Bez toho by relativní cesty uvnitř podadresáře byly vyhodnoceny od '/'. */
+    const int source_count = argc - 2;
+    char abs_src[MAX_ARGS][MAX_PATH_LEN];
+    const char *sources[MAX_ARGS];
+    for (int i = 0; i < source_count; i++) {
+        make_abs_path(ctx->cwd, argv[1 + i], abs_src[i], sizeof(abs_src[i]));
+        sources[i] = abs_src[i];
+    }
 
-        /* Převod na absolutní cesty podle cwd (stejně jako u cp/mv/rm/...).
-           Bez toho by relativní cesty uvnitř podadresáře byly vyhodnoceny od '/'. */
-        char abs1[MAX_PATH_LEN], abs2[MAX_PATH_LEN], abs3[MAX_PATH_LEN];
-        make_abs_path(ctx->cwd, argv[1], abs1, sizeof(abs1));
-        make_abs_path(ctx->cwd, argv[2], abs2, sizeof(abs2));
-        make_abs_path(ctx->cwd, argv[3], abs3, sizeof(abs3));
+    char abs_dest[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, argv[argc - 1], abs_dest, sizeof(abs_dest));
 
-        if (fs_xcp(ctx->fs_name, abs1, abs2, abs3)) {
-            printf("OK\n");
-        }
+    if (fs_xcp(ctx->fs_name, sources, source_count, abs_dest)) {
+        fs_printf("OK\n");
+    }
+    return true;
+}
+
+static bool cmd_add(ShellContext *ctx, int argc, char **argv)
+{
+    if (argc < 3) {
+        fs_printf("FILE NOT FOUND\n");
         return true;
     }
-    if (strcmp(cmd, "add") == 0) {
-        if (argc < 3) {
-            printf("FILE NOT FOUND\n");
-            return true;
-        }
 
-        /* Převod na absolutní cesty podle cwd. */
-        char abs1[MAX_PATH_LEN], abs2[MAX_PATH_LEN];
-        make_abs_path(ctx->cwd, argv[1], abs1, sizeof(abs1));
-        make_abs_path(ctx->cwd, argv[2], abs2, sizeof(abs2));
+    /* Převod na absolutní cesty podle cwd. */
+    char abs1[MAX_PATH_LEN], abs2[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, argv[1], abs1, sizeof(abs1));
+    make_abs_path(ctx->cwd, argv[2], abs2, sizeof(abs2));
+
+    if (fs_add(ctx->fs_name, abs1, abs2)) {
+        fs_printf("OK\n");
+    }
+    return true;
+}
+
+static bool cmd_du(ShellContext *ctx, int argc, char **argv)
+{
+    char abs[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, (argc >= 2) ? argv[1] : ".", abs, sizeof(abs));
+    (void)fs_du(ctx->fs_name, abs);
+    return true;
+}
+
+/**
+ * Velikost pro find -size: [+|-]N[c|w|b|k|M|G] jako v GNU find – c bajty, w 2 B,
+ * b (i bez přípony) bloky po 512 B, k/M/G KiB/MiB/GiB.
+ */
+static bool parse_find_size(const char *arg, struct find_filter *filter)
+{
+    filter->size_cmp = (*arg == '+') ? 1 : (*arg == '-') ? -1 : 0;
+    arg += (filter->size_cmp != 0);
+
+    char *end = NULL;
+    const long value = strtol(arg, &end, 10);
+    if (end == arg || value < 0) {
+        return false;
+    }
+
+    static const struct { char suffix; long unit; } units[] = {
+        { 'c', 1L }, { 'w', 2L }, { 'b', 512L }, { 'k', 1024L }, { 'M', 1024L * 1024L },
+        { 'G', 1024L * 1024L * 1024L },
+    };
+    filter->unit = 512L;
+    for (size_t i = 0; *end != '\0' && i < sizeof(units) / sizeof(units[0]); i++) {
+        if (*end == units[i].suffix) {
+            filter->unit = units[i].unit;
+            ++end;
+            break;
+        }
+    }
+    filter->size = value;
+    return *end == '\0';
+}
 
-        if (fs_add(ctx->fs_name, abs1, abs2)) {
-            printf("OK\n");
+static bool cmd_find(ShellContext *ctx, int argc, char **argv)
+{
+    /* find [dir] [-name vzor] [-type f|d] [-size [+|-]N[c|w|b|k|M|G]] */
+    struct find_filter filter = { NULL, 0, 0, -1, 1 };
+    const char *dir = ".";
+    bool valid = true;
+    for (int k = 1; k < argc && valid; k++) {
+        const bool has_value = k + 1 < argc;
+        if (k == 1 && argv[k][0] != '-') {
+            dir = argv[k];
+        } else if (strcmp(argv[k], "-name") == 0 && has_value) {
+            filter.name = argv[++k];
+        } else if (strcmp(argv[k], "-type") == 0 && has_value) {
+            filter.type = argv[++k][0];
+            valid = (filter.type == 'f' || filter.type == 'd') && argv[k][1] == '\0';
+        } else if (strcmp(argv[k], "-size") == 0 && has_value) {
+            valid = parse_find_size(argv[++k], &filter);
+        } else {
+            valid = false;
         }
+    }
+    if (!valid) {
+        fs_printf("INVALID ARGUMENT\n");
         return true;
     }
 
-    printf("UNKNOWN COMMAND\n");
+    char abs[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, dir, abs, sizeof(abs));
+    (void)fs_find(ctx->fs_name, abs, &filter);
     return true;
 }
 
-int main(int argc, char **argv)
+static bool cmd_tree(ShellContext *ctx, int argc, char **argv)
 {
-    if (argc != 2) {
-        /* původní chování: špatný počet parametrů -> CANNOT OPEN FILE */
-        printf("CANNOT OPEN FILE\n");
-        return 1;
+    char abs[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, (argc >= 2) ? argv[1] : ".", abs, sizeof(abs));
+    (void)fs_tree(ctx->fs_name, abs);
+    return true;
+}
+
+static bool cmd_fsck(ShellContext *ctx, int argc, char **argv)
+{
+    /* fsck [--repair] */
+    const bool repair = argc >= 2 && strcmp(argv[1], "--repair") == 0;
+    if (argc > 2 || (argc == 2 && !repair)) {
+        fs_printf("INVALID ARGUMENT\n");
+        return true;
     }
+    (void)fs_fsck(ctx->fs_name, repair);
+    return true;
+}
 
-    ShellContext ctx = {
-        .fs_name = argv[1],
-        .cwd = "/",
-    };
+/* Pozice argumentů s cestou ve VFS (počítáno bez přepínačů "-x"), pro překlad skriptů. */
+#define PATH_ARG(i) (1u << (i))
+#define PATH_ALL    0xFFFFu
 
-    char *line = NULL;
-    size_t n = 0;
+/* Příkaz umí číst ze snapshotu přes @snap:/cesta v prvním argumentu. */
+#define CMD_SNAPSHOT_READ 0x01
 
-    while (getline(&line, &n, stdin) != -1) {
-        char *argv2[MAX_ARGS];
-        const int argc2 = tokenize(line, argv2, MAX_ARGS);
-        if (!exec_command(&ctx, argc2, argv2)) {
-            break;
+/* Soubory na hostiteli – plán load --prefetch (argumenty bez přepínačů "-x"). */
+#define CMD_HOST_READ     0x02  /* první argument se čte z hostitele */
+#define CMD_HOST_WRITE    0x04  /* argumenty se můžou na hostiteli zapisovat */
+#define CMD_HOST_BARRIER  0x08  /* může číst/zapisovat cokoli (vnořený skript) */
+
+/* Shody vzoru se vloží místo něj jako další argumenty (jinak se příkaz pustí pro každou shodu). */
+#define CMD_GLOB_SPLICE   0x10
+
+/* Zámky inodů v serveru: první/poslední cesta se mění (výhradně cíl i rodič), ostatní se čtou. */
+#define CMD_WRITE_FIRST   0x20
+#define CMD_WRITE_LAST    0x40
+/* V serveru běží sám: transakce a příkazy nad celým svazkem. */
+#define CMD_SERIAL        0x80
+/* Obraz jen čte – zámek obrazu mezi procesy stačí sdílený (fs_io_enter). */
+#define CMD_READ_ONLY     0x100
+/* Běží i nad obrazem jiného rozvržení (format ho přepíše, ostatní obraz nečtou). */
+#define CMD_ANY_IMAGE     0x200
+/* Mění aktuální adresář relace – load --parallel ho pouští samotný. */
+#define CMD_CHDIR         0x400
+
+/** Tabulka příkazů shellu (pořadí = id v přeložených skriptech). */
+static const struct command {
+    const char *name;
+    command_fn fn;
+    unsigned path_args;
+    unsigned flags;
+} commands[] = {
+    { "exit",     cmd_exit,     0,                       CMD_READ_ONLY | CMD_ANY_IMAGE },
+    { "begin",    cmd_begin,    0,                       CMD_SERIAL },
+    { "commit",   cmd_commit,   0,                       CMD_SERIAL },
+    { "abort",    cmd_commit,   0,                       CMD_SERIAL },
+    { "pwd",      cmd_pwd,      0,                       CMD_READ_ONLY },
+    { "cd",       cmd_cd,       PATH_ARG(0),             CMD_CHDIR | CMD_READ_ONLY },
+    { "load",     cmd_load,     0,                       CMD_HOST_BARRIER | CMD_SERIAL | CMD_ANY_IMAGE },
+    { "compile",  cmd_compile,  0,                       CMD_HOST_BARRIER | CMD_READ_ONLY | CMD_ANY_IMAGE },
+    { "format",   cmd_format,   0,                       CMD_SERIAL | CMD_ANY_IMAGE },
+    { "statfs",   cmd_statfs,   0,                       CMD_READ_ONLY },
+    { "snapshot", cmd_snapshot, 0,                       CMD_SERIAL },
+    { "scrub",    cmd_scrub,    0,                       CMD_SERIAL },
+    { "dedupe",   cmd_dedupe,   0,                       CMD_SERIAL },
+    { "tune",     cmd_tune,     0,                       CMD_SERIAL },
+    { "ls",       cmd_ls,       PATH_ARG(0),             CMD_SNAPSHOT_READ | CMD_READ_ONLY },
+    { "info",     cmd_info,     PATH_ARG(0),             CMD_SNAPSHOT_READ | CMD_READ_ONLY },
+    { "mkdir",    cmd_mkdir,    PATH_ARG(0),             CMD_WRITE_FIRST },
+    { "rmdir",    cmd_rmdir,    PATH_ARG(0),             CMD_WRITE_FIRST },
+    { "incp",     cmd_incp,     PATH_ARG(1),             CMD_HOST_READ | CMD_WRITE_FIRST },
+    { "outcp",    cmd_outcp,    PATH_ARG(0),             CMD_SNAPSHOT_READ | CMD_HOST_WRITE | CMD_READ_ONLY },
+    { "cat",      cmd_cat,      PATH_ARG(0),             CMD_SNAPSHOT_READ | CMD_READ_ONLY },
+    { "rm",       cmd_rm,       PATH_ARG(0),             CMD_WRITE_FIRST },
+    { "cp",       cmd_cp,       PATH_ARG(0) | PATH_ARG(1), CMD_WRITE_LAST },
+    { "mv",       cmd_mv,       PATH_ARG(0) | PATH_ARG(1), CMD_WRITE_FIRST | CMD_WRITE_LAST },
+    { "xcp",      cmd_xcp,      PATH_ALL,                CMD_GLOB_SPLICE | CMD_WRITE_LAST },
+    { "add",      cmd_add,      PATH_ARG(0) | PATH_ARG(1), CMD_WRITE_FIRST },
+    { "du",       cmd_du,       PATH_ARG(0),             CMD_SNAPSHOT_READ | CMD_READ_ONLY },
+    /* bez PATH_ARG: adresář je volitelný a vzor -name by se jinak rozvinul jako cesta */
+    { "find",     cmd_find,     0,                       CMD_SNAPSHOT_READ | CMD_READ_ONLY },
+    { "tree",     cmd_tree,     PATH_ARG(0),             CMD_SNAPSHOT_READ | CMD_READ_ONLY },
+    { "fsck",     cmd_fsck,     0,                       CMD_SERIAL },
+    { "allocbench", cmd_allocbench, 0,                   CMD_SERIAL },
+};
+
+enum { COMMAND_COUNT = (int)(sizeof(commands) / sizeof(commands[0])) };
+
+/* ========================================================================== */
+/* Perfektní hash jmen příkazů                                                */
+/* ========================================================================== */
+
+/*
+ * Tabulka COMMAND_HASH_SIZE slotů bez kolizí: při startu se hledá seed, pro který
+ * každý příkaz padne do jiného slotu. Vyhledání = jeden hash a jedno strcmp.
+ */
+enum { COMMAND_HASH_SIZE = 64 };
+
+static int8_t command_slots[COMMAND_HASH_SIZE];
+static uint32_t command_seed;
+
+static uint32_t command_hash(const char *name, uint32_t seed)
+{
+    uint32_t h = seed;
+    for (const char *p = name; *p != '\0'; ++p) {
+        h = (h ^ (uint8_t)*p) * 16777619u;
+    }
+    return (h ^ (h >> 15)) & (COMMAND_HASH_SIZE - 1);
+}
+
+static void command_table_init(void)
+{
+    for (uint32_t seed = 2166136261u;; seed++) {
+        memset(command_slots, -1, sizeof(command_slots));
+        bool collision = false;
+        for (int i = 0; i < COMMAND_COUNT && !collision; i++) {
+            int8_t *slot = &command_slots[command_hash(commands[i].name, seed)];
+            collision = *slot != -1;
+            *slot = (int8_t)i;
+        }
+        if (!collision) {
+            command_seed = seed;
+            return;
+        }
+    }
+}
+
+static int command_lookup(const char *name)
+{
+    const int id = command_slots[command_hash(name, command_seed)];
+    return (id >= 0 && strcmp(commands[id].name, name) == 0) ? id : -1;
+}
+
+static unsigned command_path_args(int id)
+{
+    return (id >= 0 && id < COMMAND_COUNT) ? commands[id].path_args : 0;
+}
+
+/** Otisk tabulky příkazů – přeložený skript z jiné verze se nepoužije. */
+static uint32_t command_signature(void)
+{
+    uint32_t crc = 0;
+    for (int i = 0; i < COMMAND_COUNT; i++) {
+        crc = fs_crc32c(crc, commands[i].name, strlen(commands[i].name) + 1);
+        crc = fs_crc32c(crc, &commands[i].path_args, sizeof(commands[i].path_args));
+    }
+    return crc;
+}
+
+static struct script_commands script_commands_desc(void)
+{
+    return (struct script_commands){ command_lookup, command_path_args, command_signature() };
+}
+
+/* ========================================================================== */
+/* Zámky inodů                                                                */
+/* ========================================================================== */
+
+/*
+ * Jen v serverovém režimu (ze stdin běží příkazy po jednom a zámky by stály
+ * hledání cest navíc). Inody cest příkazu se najdou bez zámků, zamknou se jako
+ * jedna sada (fs_lock.h) a cesty se vyhodnotí znovu: když je mezitím jiný
+ * příkaz změnil (mv, rm, mkdir), zámky se pustí a zkusí se to s novými inody.
+ */
+static bool lock_paths;
+
+struct locked_paths {
+    int count;
+    bool write[MAX_ARGS];
+    char abs[MAX_ARGS][MAX_PATH_LEN];
+};
+
+/** Inody cest: [0] cíl, [1] rodič měněné cesty (-1 = neexistuje / netřeba). */
+static void resolve_locked_paths(const ShellContext *ctx, const struct locked_paths *lp, int ids[][2])
+{
+    for (int i = 0; i < lp->count; i++) {
+        ids[i][0] = fs_path_to_inode(ctx->fs_name, lp->abs[i]);
+        ids[i][1] = -1;
+        if (lp->write[i]) {
+            char parent[MAX_PATH_LEN];
+            make_abs_path(lp->abs[i], "..", parent, sizeof(parent));
+            ids[i][1] = fs_path_to_inode(ctx->fs_name, parent);
+        }
+    }
+}
+
+/**
+ * @brief Zavolá obsluhu příkazu se zamčenými inody jeho cest.
+ *
+ * Čtená cesta se drží sdíleně, měněná (CMD_WRITE_FIRST/LAST) výhradně i s
+ * rodičovským adresářem – do adresáře tak v jednu chvíli přidává nebo z něj
+ * ubírá jen jeden příkaz.
+ */
+static bool call_locked(ShellContext *ctx, const struct command *cmd, int argc, char **argv)
+{
+    /* Hromadný řádek server pouští jen bez souběžných změn (fs_server.h); inody
+       nezamyká, aby interaktivní čtení nečekalo na celý strom. */
+    if (!lock_paths || ctx->snapshot || (cmd->flags & CMD_SERIAL) || cmd->path_args == 0 ||
+        fs_sched_tag().cls == FS_IO_BULK) {
+        fs_sched_run_begin();
+        const bool keep_running = cmd->fn(ctx, argc, argv);
+        fs_sched_run_end();
+        return keep_running;
+    }
+
+    struct locked_paths lp;
+    lp.count = 0;
+    unsigned pos = 0;
+    for (int k = 1; k < argc && lp.count < MAX_ARGS; k++) {
+        if (argv[k][0] == '-' && argv[k][1] != '\0') {
+            continue;
+        }
+        if (pos < 16 && (cmd->path_args & PATH_ARG(pos))) {
+            make_abs_path(ctx->cwd, argv[k], lp.abs[lp.count], MAX_PATH_LEN);
+            lp.write[lp.count] = lp.count == 0 && (cmd->flags & CMD_WRITE_FIRST);
+            lp.count++;
+        }
+        pos++;
+    }
+    if (lp.count > 0 && (cmd->flags & CMD_WRITE_LAST)) {
+        lp.write[lp.count - 1] = true;
+    }
+
+    int ids[MAX_ARGS][2];
+    int check[MAX_ARGS][2];
+    struct fs_lock_set set;
+    resolve_locked_paths(ctx, &lp, ids);
+    for (;;) {
+        fs_lock_set_init(&set);
+        for (int i = 0; i < lp.count; i++) {
+            fs_lock_set_add(&set, ids[i][0], lp.write[i]);
+            fs_lock_set_add(&set, ids[i][1], true);
+        }
+        fs_lock_set_acquire(&set);
+
+        resolve_locked_paths(ctx, &lp, check);
+        if (memcmp(ids, check, (size_t)lp.count * sizeof(ids[0])) == 0) {
+            break;
+        }
+        fs_lock_set_release(&set);
+        memcpy(ids, check, (size_t)lp.count * sizeof(ids[0]));
+    }
+
+    fs_sched_run_begin();
+    const bool keep_running = cmd->fn(ctx, argc, argv);
+    fs_sched_run_end();
+    fs_lock_set_release(&set);
+    return keep_running;
+}
+
+/* ========================================================================== */
+/* Provádění                                                                  */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/* Vzory v argumentech                                                        */
+/* ========================================================================== */
+
+/** Je argument cílem, do kterého se shody kopírují pod svým jménem (adresář)? */
+static bool is_target_directory(const ShellContext *ctx, const char *arg, bool vfs)
+{
+    const size_t len = strlen(arg);
+    if (len > 0 && arg[len - 1] == '/') {
+        return true;
+    }
+    if (!vfs) {
+        struct stat st;
+        return stat(arg, &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    char abs[MAX_PATH_LEN];
+    make_abs_path(ctx->cwd, arg, abs, sizeof(abs));
+    const int inode_id = fs_path_to_inode(ctx->fs_name, abs);
+    return inode_id != -1 && is_inode_directory(ctx->fs_name, inode_id);
+}
+
+/**
+ * @brief Provede příkaz; první argument se vzorem (*, ?, [...]) se nejdřív rozvine.
+ *
+ * Cesty ve VFS rozvíjí fs_glob (každý adresář jedno čtení, shody rovnou v cache
+ * cest, takže příkaz nad shodou rodiče znovu nehledá), vstup z hostitele (incp)
+ * glob(3). Příkaz se pak pustí pro každou shodu; je-li za vzorem ještě cílový
+ * argument a jde o adresář, dostane každá shoda cíl "adresář/jméno"; víc shod do cíle,
+ * který adresářem není, se odmítne celé (TARGET NOT A DIRECTORY) dřív, než se
+ * cokoli změní. xcp shody dostane všechny najednou. Vzor bez shody zůstane doslova (příkaz ohlásí chybu).
+ */
+static bool run_with_patterns(ShellContext *ctx, int id, int argc, char **argv)
+{
+    const struct command *cmd = &commands[id];
+    int pattern = -1;
+    bool host = false;
+    int last = -1;          /* poslední poziční argument */
+    bool last_vfs = false;
+    unsigned pos = 0;
+    for (int k = 1; k < argc; k++) {
+        if (argv[k][0] == '-' && argv[k][1] != '\0') {
+            continue;       /* přepínač */
+        }
+        const bool vfs = pos < 16 && (cmd->path_args & PATH_ARG(pos));
+        const bool from_host = pos == 0 && (cmd->flags & CMD_HOST_READ);
+        if (pattern == -1 && (vfs || from_host) && fs_glob_has_magic(argv[k])) {
+            pattern = k;
+            host = from_host;
+        }
+        last = k;
+        last_vfs = vfs;
+        pos++;
+    }
+    if (pattern == -1) {
+        return call_locked(ctx, cmd, argc, argv);
+    }
+
+    char **matches = NULL;
+    int count = 0;
+    glob_t host_matches;
+    if (host) {
+        count = (glob(argv[pattern], 0, NULL, &host_matches) == 0) ? (int)host_matches.gl_pathc : 0;
+        matches = (count > 0) ? host_matches.gl_pathv : NULL;
+    } else {
+        char abs[MAX_PATH_LEN];
+        make_abs_path(ctx->cwd, argv[pattern], abs, sizeof(abs));
+        count = fs_glob(ctx->fs_name, abs, &matches);
+    }
+    if (count <= 0) {
+        if (host) {
+            globfree(&host_matches);
+        }
+        return call_locked(ctx, cmd, argc, argv);
+    }
+
+    const bool into_dir = last != pattern && is_target_directory(ctx, argv[last], last_vfs);
+    const int cap = argc + ((cmd->flags & CMD_GLOB_SPLICE) ? count : 0);
+    char **args = (char **)malloc((size_t)cap * sizeof(char *));
+    bool keep_running = true;
+    if (!args) {
+        /* bez paměti nejde ani rozvinout */
+    } else if (cmd->flags & CMD_GLOB_SPLICE) {
+        int n = 0;
+        for (int k = 0; k < argc; k++) {
+            if (k != pattern) {
+                args[n++] = argv[k];
+                continue;
+            }
+            for (int m = 0; m < count; m++) {
+                args[n++] = matches[m];
+            }
+        }
+        keep_running = call_locked(ctx, cmd, n, args);
+    } else if (count > 1 && last != pattern && !into_dir) {
+        /* víc shod do jednoho cíle by se navzájem přepsalo – nic se nespustí */
+        fs_printf("TARGET NOT A DIRECTORY\n");
+    } else {
+        for (int m = 0; m < count && keep_running; m++) {
+            memcpy(args, argv, (size_t)argc * sizeof(char *));
+            args[pattern] = matches[m];
+
+            char target[MAX_PATH_LEN];
+            if (into_dir) {
+                const char *slash = strrchr(matches[m], '/');
+                const size_t len = strlen(argv[last]);
+                (void)snprintf(target, sizeof(target), "%s%s%s", argv[last],
+                               (len > 0 && argv[last][len - 1] == '/') ? "" : "/", slash ? slash + 1 : matches[m]);
+                args[last] = target;
+            }
+            keep_running = call_locked(ctx, cmd, argc, args);
+        }
+    }
+
+    free(args);
+    if (host) {
+        globfree(&host_matches);
+    } else {
+        fs_glob_free(matches, count);
+    }
+    return keep_running;
+}
+
+/**
+ * @brief Provede příkaz s už známým id.
+ *
+ * @return true pokud se má pokračovat, false pokud se má ukončit ("exit").
+ */
+static bool run_command(ShellContext *ctx, int id, int argc, char **argv)
+{
+    /* Obraz jiného rozvržení se nečte ani nemění – jen format ho přepíše. */
+    if (!(commands[id].flags & CMD_ANY_IMAGE)) {
+        int layout = atomic_load(&image_layout);
+        if (layout == -1) {
+            layout = fs_layout_check(ctx->fs_name);
+            atomic_store(&image_layout, layout);
+        }
+        if (layout == 0) {
+            fs_printf("INCOMPATIBLE IMAGE\n");
+            return true;
+        }
+    }
+
+    /* Příkazy jen pro čtení umí číst ze snapshotu: ls/cat/info/outcp @snap:/cesta
+       (první argument za přepínači). Relativní cesta uvnitř snapshotu se bere od jeho kořene. */
+    int first = 1;
+    while (first < argc && argv[first][0] == '-' && argv[first][1] != '\0') {
+        first++;
+    }
+    if (first < argc && argv[first][0] == '@' && (commands[id].flags & CMD_SNAPSHOT_READ)) {
+        char snap_name[MAX_PATH_LEN];
+        if (!enter_snapshot_path(ctx, &argv[first], snap_name, sizeof(snap_name))) {
+            return true;
+        }
+
+        ShellContext view = *ctx;
+        (void)snprintf(view.cwd, sizeof(view.cwd), "/");
+        view.snapshot = true;
+        (void)run_with_patterns(&view, id, argc, argv);
+        fs_set_snapshot_view(NULL);
+        return true;
+    }
+
+    return run_with_patterns(ctx, id, argc, argv);
+}
+
+/**
+ * @brief Provede jeden příkaz.
+ *
+ * @return true pokud se má pokračovat, false pokud se má ukončit ("exit").
+ */
+static bool exec_command(ShellContext *ctx, int argc, char **argv)
+{
+    if (argc == 0) {
+        return true;
+    }
+
+    const int id = command_lookup(argv[0]);
+    if (id < 0) {
+        fs_printf("UNKNOWN COMMAND\n");
+        return true;
+    }
+    return run_command(ctx, id, argc, argv);
+}
+
+/* ========================================================================== */
+/* load --prefetch                                                            */
+/* ========================================================================== */
+
+/*
+ * Operace nad obrazem se provádějí dál jedna po druhé v pořadí skriptu – jinak by
+ * alokátor přiděloval inody a clustery v jiném pořadí a obraz by se od sériového
+ * běhu lišil. Souběžně se přednačítají vstupy incp z hostitele. Graf závislostí je
+ * proto nad cestami na hostiteli: soubor se smí začít číst až po provedení poslední
+ * dřívější operace, která ho zapisuje (outcp), nebo bariéry (vnořený load, compile).
+ * Příkazy samotné tu souběžně neběží (to dělá load --parallel, níže).
+ */
+enum {
+    PREFETCH_WINDOW = 256,          /* kolik operací dopředu se smí přednačítat */
+    HOST_WRITER_BUCKETS = 4096      /* kolize jen přidají zbytečnou závislost */
+};
+
+struct prefetch_plan {
+    int32_t after;                  /* přednačíst až po provedení této operace (-1 = hned) */
+    const char *path;               /* soubor na hostiteli, NULL = nic */
+    bool compress;                  /* incp -z: připravit i komprimovaný payload */
+};
+
+static uint32_t host_path_bucket(const char *host_cwd, const char *path)
+{
+    char abs[MAX_PATH_LEN];
+    make_abs_path(host_cwd, path, abs, sizeof(abs));
+    return fs_crc32c(0, abs, strlen(abs)) % HOST_WRITER_BUCKETS;
+}
+
+/**
+ * @brief Sestaví plán přednačítání: pro každou operaci čtený soubor a závislost.
+ * @return Pole op_count záznamů (uvolní volající), NULL při chybě.
+ */
+static struct prefetch_plan *plan_prefetch(const struct script *s)
+{
+    char host_cwd[MAX_PATH_LEN];
+    if (!getcwd(host_cwd, sizeof(host_cwd))) {
+        return NULL;
+    }
+
+    struct prefetch_plan *plan = (struct prefetch_plan *)calloc(s->op_count + 1u, sizeof(*plan));
+    int32_t *writer = (int32_t *)malloc(HOST_WRITER_BUCKETS * sizeof(*writer));
+    if (!plan || !writer) {
+        free(plan);
+        free(writer);
+        return NULL;
+    }
+    memset(writer, -1, HOST_WRITER_BUCKETS * sizeof(*writer));
+
+    int32_t barrier = -1;
+    for (uint32_t i = 0; i < s->op_count; i++) {
+        const struct script_op *op = &s->ops[i];
+        const unsigned flags = (op->cmd < COMMAND_COUNT) ? commands[op->cmd].flags : 0;
+
+        plan[i].after = -1;
+        /* incp -r / outcp -r a vzory pracují s cestami, které v argumentech nejsou */
+        bool many = false;
+        for (uint32_t k = 1; k < op->argc; k++) {
+            const char *arg = s->pool + s->args[op->first_arg + k];
+            if (arg[0] == '-') {
+                plan[i].compress |= strcmp(arg, "-z") == 0;
+                many |= strcmp(arg, "-r") == 0;
+                continue;
+            }
+            many |= fs_glob_has_magic(arg);
+            const uint32_t bucket = host_path_bucket(host_cwd, arg);
+
+            if ((flags & CMD_HOST_READ) && !plan[i].path && !many) {
+                plan[i].path = arg;
+                plan[i].after = (writer[bucket] > barrier) ? writer[bucket] : barrier;
+            }
+            /* zapisovaný argument neurčujeme přesně – počítá se každý */
+            if (flags & CMD_HOST_WRITE) {
+                writer[bucket] = (int32_t)i;
+            }
+        }
+        /* outcp -r / outcp se vzorem: zapisované cesty neznáme */
+        if ((flags & CMD_HOST_BARRIER) || ((flags & CMD_HOST_WRITE) && many)) {
+            barrier = (int32_t)i;
+        }
+    }
+
+    free(writer);
+    return plan;
+}
+
+/** Tokeny operace skriptu (nejvýš MAX_ARGS). */
+static int script_argv(const struct script *s, const struct script_op *op, char **argv)
+{
+    const int argc = (op->argc < MAX_ARGS) ? op->argc : MAX_ARGS;
+    for (int k = 0; k < argc; k++) {
+        argv[k] = s->pool + s->args[op->first_arg + (uint32_t)k];
+    }
+    return argc;
+}
+
+/**
+ * @brief Provede operaci skriptu i v implicitní transakci.
+ * @return false pokud se má skript ukončit ("exit").
+ */
+static bool run_script_op(ShellContext *ctx, const struct script *s, uint32_t i)
+{
+    const struct script_op *op = &s->ops[i];
+    char *argv[MAX_ARGS];
+    const int argc = script_argv(s, op, argv);
+
+    if (!fs_io_in_transaction()) {
+        (void)fs_io_begin(); /* při chybě commitu poběží skript bez transakce */
+    }
+    if (op->cmd == SCRIPT_UNKNOWN_COMMAND || op->cmd >= COMMAND_COUNT) {
+        fs_printf("UNKNOWN COMMAND\n");
+        return true;
+    }
+    return run_command(ctx, op->cmd, argc, argv);
+}
+
+/**
+ * @brief Provede operace skriptu jednu po druhé.
+ * @param threads Počet vláken přednačítání (load --prefetch), 0 = bez něj.
+ */
+static void run_script_serial(ShellContext *ctx, const struct script *s, int threads)
+{
+    struct prefetch_plan *plan = (threads > 0) ? plan_prefetch(s) : NULL;
+    /* vnořený load --prefetch poběží bez přednačítání (pool už patří vnějšímu) */
+    const bool prefetching = plan && prefetch_start(threads);
+    uint32_t next = 0;
+
+    for (uint32_t i = 0; i < s->op_count; i++) {
+        if (prefetching) {
+            /* operace před i jsou provedené – jejich zápisy už na hostiteli jsou */
+            while (next < s->op_count && next <= i + PREFETCH_WINDOW && plan[next].after < (int32_t)i) {
+                if (plan[next].path) {
+                    prefetch_submit(next, plan[next].path, plan[next].compress);
+                }
+                next++;
+            }
+            prefetch_begin_op(i);
+        }
+
+        const bool go_on = run_script_op(ctx, s, i);
+        if (prefetching) {
+            prefetch_end_op(i);
+        }
+        if (!go_on) {
+            break;
+        }
+    }
+
+    if (prefetching) {
+        prefetch_stop();
+    }
+    free(plan);
+}
+
+/* ========================================================================== */
+/* load --parallel                                                            */
+/* ========================================================================== */
+
+/*
+ * Nezávislé operace skriptu běží souběžně na poolu vláken. Každá operace má klíče –
+ * cesty ve VFS a na hostiteli, které čte nebo mění (podle path_args a příznaků
+ * CMD_WRITE_* a CMD_HOST_*). Měněná cesta ve VFS přidá ještě klíč "položky rodiče":
+ * vytvoření a smazání v jednom adresáři tak zůstanou v pořadí skriptu a položky
+ * leží ve stejných slotech jako po sériovém běhu. Operace jsou v konfliktu, když
+ * některé jejich klíče leží na stejné cestě nebo jeden v podstromu druhého a aspoň
+ * jeden je zápis. Pozdější pak čeká, až dřívější doběhne (hrana grafu). Graf se
+ * staví za běhu v okně PARALLEL_WINDOW operací od nejstarší nevypsané.
+ *
+ * Samotné (bariéra: počká na všechny dřívější, pozdější čekají na ni) běží operace,
+ * jejichž cesty předem neznáme nebo které mění víc než své cesty: CMD_SERIAL,
+ * vnořený load a compile, cd, příkazy bez cest (pwd, statfs, find, exit), vzory,
+ * čtení ze snapshotu (pohled je společný) a -r (jako hromadný řádek serveru: incp -r
+ * zapisuje data mimo paměťovou vrstvu). Souběžné operace se zamykají jako v serveru
+ * (call_locked), výstup každé jde do bufferu a vypisuje se v pořadí skriptu.
+ *
+ * Jména, obsah souborů i položky adresářů jsou pak stejné jako po sériovém běhu.
+ * Čísla inodů a umístění clusterů se můžou lišit (alokace proběhnou v jiném
+ * pořadí) a při zaplnění svazku může NO SPACE dostat jiná z nezávislých operací.
+ */
+enum {
+    PARALLEL_WINDOW = 256,          /* kolik operací dopředu se smí plánovat */
+    PARALLEL_MAX_THREADS = 64,
+    PARALLEL_MAX_KEYS = 2 * MAX_ARGS
+};
+
+/** Cesta, se kterou operace pracuje. */
+struct op_key {
+    char *path;                     /* absolutní, normalizovaná */
+    bool host;                      /* soubor na hostiteli (jinak VFS) */
+    bool write;
+    bool entries;                   /* jen položky adresáře (rodič měněné cesty), ne podstrom */
+};
+
+struct parallel_op {
+    uint32_t index;                 /* operace skriptu */
+    int key_count;
+    struct op_key keys[PARALLEL_MAX_KEYS];
+    int waiting;                    /* nedokončené dřívější operace v konfliktu */
+    int dependent_count;
+    uint32_t dependents[PARALLEL_WINDOW];   /* pozdější operace, které na ni čekají */
+    bool done;
+    char *out;                      /* výstup operace */
+    size_t out_len;
+    struct parallel_op *next_ready;
+};
+
+struct parallel_run {
+    const struct script *s;
+    ShellContext ctx;               /* kontext pro souběžné operace (mění se jen v bariéře) */
+    struct parallel_op *slots;      /* okno: operace i je ve slotu i % PARALLEL_WINDOW */
+    struct parallel_op *ready_head;
+    struct parallel_op *ready_tail;
+    bool stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t work;            /* vláknům: přibyla připravená operace */
+    pthread_cond_t finished;        /* hlavnímu vláknu: operace doběhla */
+    int threads;
+    pthread_t tids[PARALLEL_MAX_THREADS];
+};
+
+static struct parallel_op *parallel_slot(struct parallel_run *run, uint32_t index)
+{
+    return &run->slots[index % PARALLEL_WINDOW];
+}
+
+static void parallel_op_clear(struct parallel_op *op)
+{
+    for (int k = 0; k < op->key_count; k++) {
+        free(op->keys[k].path);
+    }
+    free(op->out);
+    op->key_count = 0;
+    op->dependent_count = 0;
+    op->done = false;
+    op->out = NULL;
+    op->out_len = 0;
+    op->next_ready = NULL;
+}
+
+/** Je cesta a cestou b nebo leží v jejím podstromu? */
+static bool path_within(const char *a, const char *b)
+{
+    const size_t len = strlen(b);
+    if (strncmp(a, b, len) != 0) {
+        return false;
+    }
+    return a[len] == '\0' || a[len] == '/' || (len > 0 && b[len - 1] == '/');
+}
+
+static bool keys_conflict(const struct op_key *a, const struct op_key *b)
+{
+    if (a->host != b->host || (!a->write && !b->write)) {
+        return false;
+    }
+    if (a->entries && b->entries) {
+        return strcmp(a->path, b->path) == 0;
+    }
+    /* položky adresáře kolidují s ním samým a s jeho předky, ne s jeho podstromem */
+    if (a->entries) {
+        return path_within(a->path, b->path);
+    }
+    if (b->entries) {
+        return path_within(b->path, a->path);
+    }
+    return path_within(a->path, b->path) || path_within(b->path, a->path);
+}
+
+static bool ops_conflict(const struct parallel_op *a, const struct parallel_op *b)
+{
+    for (int i = 0; i < a->key_count; i++) {
+        for (int j = 0; j < b->key_count; j++) {
+            if (keys_conflict(&a->keys[i], &b->keys[j])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool op_add_key(struct parallel_op *op, const char *base, const char *path, bool host, bool write,
+                       bool entries)
+{
+    if (op->key_count >= PARALLEL_MAX_KEYS) {
+        return false;
+    }
+    char abs[MAX_PATH_LEN];
+    make_abs_path(base, path, abs, sizeof(abs));
+    char *copy = strdup(abs);
+    if (!copy) {
+        return false;
+    }
+    op->keys[op->key_count++] = (struct op_key){ copy, host, write, entries };
+    return true;
+}
+
+/** Měněná cesta ve VFS: výhradně ona i položky rodiče (jako zámky v call_locked). */
+static bool op_mark_write(struct parallel_op *op, int key)
+{
+    op->keys[key].write = true;
+    return op_add_key(op, op->keys[key].path, "..", false, true, true);
+}
+
+/**
+ * @brief Sestaví klíče operace index.
+ * @return false pokud musí běžet samotná (bariéra) – i když na klíče nezbyla paměť.
+ */
+static bool parallel_plan_op(const struct parallel_run *run, const char *host_cwd, struct parallel_op *op,
+                             uint32_t index)
+{
+    const struct script_op *sop = &run->s->ops[index];
+    op->index = index;
+    if (sop->cmd >= COMMAND_COUNT) {
+        return false;
+    }
+    const struct command *cmd = &commands[sop->cmd];
+    if (cmd->path_args == 0 || (cmd->flags & (CMD_SERIAL | CMD_HOST_BARRIER | CMD_CHDIR))) {
+        return false;
+    }
+
+    char *argv[MAX_ARGS];
+    const int argc = script_argv(run->s, sop, argv);
+    int first_vfs = -1;
+    int last_vfs = -1;
+    unsigned pos = 0;
+    for (int k = 1; k < argc; k++) {
+        if (argv[k][0] == '-' && argv[k][1] != '\0') {
+            if (strcmp(argv[k], "-r") == 0) {
+                return false;
+            }
+            continue;
+        }
+        const bool vfs = pos < 16 && (cmd->path_args & PATH_ARG(pos));
+        const bool host_read = pos == 0 && (cmd->flags & CMD_HOST_READ);
+        if ((vfs || host_read) && fs_glob_has_magic(argv[k])) {
+            return false;
+        }
+        if (vfs && argv[k][0] == '@' && (cmd->flags & CMD_SNAPSHOT_READ)) {
+            return false;
+        }
+
+        if (vfs) {
+            if (!op_add_key(op, run->ctx.cwd, argv[k], false, false, false)) {
+                return false;
+            }
+            first_vfs = (first_vfs < 0) ? op->key_count - 1 : first_vfs;
+            last_vfs = op->key_count - 1;
+        } else if (host_read || (cmd->flags & CMD_HOST_WRITE)) {
+            if (!op_add_key(op, host_cwd, argv[k], true, !host_read, false)) {
+                return false;
+            }
+        }
+        pos++;
+    }
+
+    if (first_vfs < 0) {
+        /* ls, du, tree bez cesty čtou aktuální adresář */
+        return op_add_key(op, run->ctx.cwd, ".", false, false, false);
+    }
+    if ((cmd->flags & CMD_WRITE_FIRST) && !op_mark_write(op, first_vfs)) {
+        return false;
+    }
+    if ((cmd->flags & CMD_WRITE_LAST) && !op->keys[last_vfs].write && !op_mark_write(op, last_vfs)) {
+        return false;
+    }
+    return true;
+}
+
+/* Volá se se zamčeným run->lock. */
+static void parallel_push_ready(struct parallel_run *run, struct parallel_op *op)
+{
+    op->next_ready = NULL;
+    if (run->ready_tail) {
+        run->ready_tail->next_ready = op;
+    } else {
+        run->ready_head = op;
+    }
+    run->ready_tail = op;
+    pthread_cond_signal(&run->work);
+}
+
+/**
+ * @brief Zařadí naplánovanou operaci index do grafu: čeká na nedokončené dřívější
+ *        operace okna, se kterými je v konfliktu. Volá se se zamčeným run->lock.
+ */
+static void parallel_insert(struct parallel_run *run, uint32_t oldest, uint32_t index)
+{
+    struct parallel_op *op = parallel_slot(run, index);
+    op->waiting = 0;
+    for (uint32_t k = oldest; k < index; k++) {
+        struct parallel_op *prev = parallel_slot(run, k);
+        if (!prev->done && ops_conflict(prev, op)) {
+            prev->dependents[prev->dependent_count++] = index;
+            op->waiting++;
+        }
+    }
+    if (op->waiting == 0) {
+        parallel_push_ready(run, op);
+    }
+}
+
+static void *parallel_worker(void *arg)
+{
+    struct parallel_run *run = (struct parallel_run *)arg;
+    FILE *const own_out = fs_out();
+
+    pthread_mutex_lock(&run->lock);
+    for (;;) {
+        while (!run->ready_head && !run->stopping) {
+            pthread_cond_wait(&run->work, &run->lock);
+        }
+        struct parallel_op *op = run->ready_head;
+        if (!op) {
+            break;
+        }
+        run->ready_head = op->next_ready;
+        if (!run->ready_head) {
+            run->ready_tail = NULL;
+        }
+        ShellContext ctx = run->ctx;
+        pthread_mutex_unlock(&run->lock);
+
+        const struct script_op *sop = &run->s->ops[op->index];
+        char *argv[MAX_ARGS];
+        const int argc = script_argv(run->s, sop, argv);
+        /* bez paměti na buffer jde výstup rovnou (mimo pořadí), operace se ale provede */
+        FILE *out = open_memstream(&op->out, &op->out_len);
+        if (out) {
+            fs_out_set(out);
+        }
+        (void)run_command(&ctx, sop->cmd, argc, argv);
+        if (out) {
+            fs_out_set(own_out);
+            fclose(out);
+        }
+
+        pthread_mutex_lock(&run->lock);
+        op->done = true;
+        for (int k = 0; k < op->dependent_count; k++) {
+            struct parallel_op *next = parallel_slot(run, op->dependents[k]);
+            if (--next->waiting == 0) {
+                parallel_push_ready(run, next);
+            }
+        }
+        pthread_cond_signal(&run->finished);
+    }
+    pthread_mutex_unlock(&run->lock);
+    return NULL;
+}
+
+/**
+ * @brief Provede skript se souběžnými nezávislými operacemi (load --parallel).
+ * @return false pokud pool nejde spustit – skript pak poběží sériově.
+ */
+static bool run_script_parallel(ShellContext *ctx, const struct script *s, int threads)
+{
+    char host_cwd[MAX_PATH_LEN];
+    if (!getcwd(host_cwd, sizeof(host_cwd))) {
+        return false;
+    }
+    struct parallel_run *run = (struct parallel_run *)calloc(1, sizeof(*run));
+    struct parallel_op *slots = (struct parallel_op *)calloc(PARALLEL_WINDOW, sizeof(*slots));
+    if (!run || !slots) {
+        free(run);
+        free(slots);
+        return false;
+    }
+    run->s = s;
+    run->ctx = *ctx;
+    run->slots = slots;
+    pthread_mutex_init(&run->lock, NULL);
+    pthread_cond_init(&run->work, NULL);
+    pthread_cond_init(&run->finished, NULL);
+
+    /* souběžné operace se zamykají jako řádky serveru */
+    const bool had_locks = lock_paths;
+    lock_paths = true;
+    while (run->threads < threads && run->threads < PARALLEL_MAX_THREADS &&
+           fs_out_thread(&run->tids[run->threads], parallel_worker, run) == 0) {
+        run->threads++;
+    }
+
+    const bool started = run->threads > 0;
+    uint32_t oldest = 0;            /* nejstarší nevypsaná operace */
+    uint32_t next = 0;              /* další operace k naplánování */
+    bool barrier = false;           /* operace next musí běžet samotná */
+    bool go_on = started;
+    while (go_on && oldest < s->op_count) {
+        if (oldest == next && !fs_io_in_transaction()) {
+            (void)fs_io_begin(); /* při chybě commitu poběží skript bez transakce */
+        }
+
+        pthread_mutex_lock(&run->lock);
+        while (!barrier && next < s->op_count && next < oldest + PARALLEL_WINDOW) {
+            struct parallel_op *op = parallel_slot(run, next);
+            if (!parallel_plan_op(run, host_cwd, op, next)) {
+                parallel_op_clear(op);
+                barrier = true;
+                break;
+            }
+            parallel_insert(run, oldest, next);
+            next++;
+        }
+        if (oldest < next) {
+            struct parallel_op *op = parallel_slot(run, oldest);
+            while (!op->done) {
+                pthread_cond_wait(&run->finished, &run->lock);
+            }
+            pthread_mutex_unlock(&run->lock);
+            if (op->out_len > 0) {
+                (void)fwrite(op->out, 1, op->out_len, fs_out());
+            }
+            parallel_op_clear(op);
+            oldest++;
+            continue;
+        }
+        pthread_mutex_unlock(&run->lock);
+
+        /* bariéra: všechny dřívější operace doběhly a jsou vypsané */
+        go_on = run_script_op(ctx, s, next);
+        oldest = ++next;
+        barrier = false;
+        pthread_mutex_lock(&run->lock);
+        run->ctx = *ctx;
+        pthread_mutex_unlock(&run->lock);
+    }
+
+    pthread_mutex_lock(&run->lock);
+    run->stopping = true;
+    pthread_cond_broadcast(&run->work);
+    pthread_mutex_unlock(&run->lock);
+    for (int i = 0; i < run->threads; i++) {
+        pthread_join(run->tids[i], NULL);
+    }
+    lock_paths = had_locks;
+
+    pthread_cond_destroy(&run->finished);
+    pthread_cond_destroy(&run->work);
+    pthread_mutex_destroy(&run->lock);
+    free(slots);
+    free(run);
+    return started;
+}
+
+/**
+ * @brief Provede přeložený skript (load).
+ *
+ * Skript běží v implicitní transakci – změny se zapíšou jednou na konci.
+ * Po commit/abort ve skriptu začne pro zbytek operací nová.
+ *
+ * @param prefetch Počet vláken přednačítání (load --prefetch), 0 = bez něj.
+ * @param parallel Počet vláken pro souběžné operace (load --parallel), 0 = sériově.
+ */
+static void run_script(ShellContext *ctx, const struct script *s, int prefetch, int parallel)
+{
+    if (parallel == 0 || !run_script_parallel(ctx, s, parallel)) {
+        run_script_serial(ctx, s, prefetch);
+    }
+
+    if (!ctx->in_txn) {
+        (void)fs_io_end(); /* explicitní transakce (i nedokončená ze skriptu) běží dál */
+    }
+}
+
+static bool cmd_load(ShellContext *ctx, int argc, char **argv)
+{
+    /* load [--prefetch N | --parallel N] <skript> */
+    int prefetch = 0;
+    int parallel = 0;
+    if (argc >= 2 && (strcmp(argv[1], "--prefetch") == 0 || strcmp(argv[1], "--parallel") == 0)) {
+        const int threads = (argc >= 3) ? atoi(argv[2]) : 0;
+        if (threads < 1) {
+            fs_printf("INVALID ARGUMENT\n");
+            return true;
+        }
+        if (strcmp(argv[1], "--prefetch") == 0) {
+            prefetch = threads;
+        } else {
+            parallel = threads;
+        }
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc < 2) {
+        fs_printf("FILE NOT FOUND\n");
+        return true;
+    }
+
+    const struct script_commands desc = script_commands_desc();
+    struct script *s = script_load(argv[1], &desc);
+    if (s == NULL) {
+        fs_printf("FILE NOT FOUND\n");
+        return true;
+    }
+    run_script(ctx, s, prefetch, parallel);
+    script_free(s);
+    return true;
+}
+
+static bool cmd_compile(ShellContext *ctx, int argc, char **argv)
+{
+    (void)ctx;
+    /* compile <skript> – přeloží skript a uloží ho vedle (<skript>.zsc) pro další load */
+    if (argc < 2) {
+        fs_printf("FILE NOT FOUND\n");
+        return true;
+    }
+
+    const struct script_commands desc = script_commands_desc();
+    struct script *s = script_compile(argv[1], &desc);
+    if (s == NULL) {
+        fs_printf("FILE NOT FOUND\n");
+        return true;
+    }
+    if (script_save(s, argv[1], &desc)) {
+        fs_printf("OK\n");
+    } else {
+        fs_printf("CANNOT CREATE FILE\n");
+    }
+    script_free(s);
+    return true;
+}
+
+/* ========================================================================== */
+/* Zámek obrazu mezi procesy                                                  */
+/* ========================================================================== */
+
+/** Zamyká řádek obraz výhradně? Jen čtecí příkazy (CMD_READ_ONLY) stačí sdíleně. */
+static bool line_writes(int argc, char **argv)
+{
+    const int id = (argc > 0) ? command_lookup(argv[0]) : -1;
+    return id >= 0 && !(commands[id].flags & CMD_READ_ONLY);
+}
+
+/** Obraz mezitím změnil jiný proces – cesty ani zrcadla bitmap už neplatí. */
+static void image_changed(void)
+{
+    atomic_store(&image_layout, -1);
+    fs_dcache_invalidate();
+    fs_bitmap_invalidate();
+}
+
+/** Shell bez čekajícího vstupu (terminál): potvrdit a pustit zámek pro ostatní procesy. */
+static bool stdin_idle(void)
+{
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+    return poll(&pfd, 1, 0) == 0;
+}
+
+/* ========================================================================== */
+/* Serverový režim                                                            */
+/* ========================================================================== */
+
+/** Relace klienta = vlastní shell (aktuální adresář, transakce). */
+static void *serve_open(void *arg)
+{
+    ShellContext *ctx = (ShellContext *)calloc(1, sizeof(*ctx));
+    if (ctx) {
+        ctx->fs_name = (const char *)arg;
+        (void)snprintf(ctx->cwd, sizeof(ctx->cwd), "/");
+    }
+    return ctx;
+}
+
+/** Pracovní vlákno serveru: výstup příkazu jde do out, potvrzení až po jeho doběhnutí. */
+static bool serve_exec(void *session, char *line, FILE *out)
+{
+    char *argv[MAX_ARGS];
+    const int argc = tokenize(line, argv, MAX_ARGS);
+    const bool writes = line_writes(argc, argv);
+    fs_out_set(out);
+    fs_io_enter(writes);
+    const bool go_on = exec_command((ShellContext *)session, argc, argv);
+    fs_io_leave();
+    fs_out_set(NULL);
+    if (writes) {
+        fs_io_commit();
+    }
+    return go_on;
+}
+
+/** Musí řádek běžet sám? Transakce a příkazy nad celým svazkem. */
+static bool serve_serial(void *session, const char *line)
+{
+    if (((const ShellContext *)session)->in_txn) {
+        return true;
+    }
+
+    char copy[MAX_PATH_LEN];
+    (void)snprintf(copy, sizeof(copy), "%s", line);
+    char *argv[MAX_ARGS];
+    const int argc = tokenize(copy, argv, MAX_ARGS);
+    if (argc == 0) {
+        return false;
+    }
+    const int id = command_lookup(argv[0]);
+    return id >= 0 && (commands[id].flags & CMD_SERIAL);
+}
+
+/** Třída řádku: rekurzivní (-r) hromadně, čtecí příkazy interaktivně, ostatní běžně. */
+static enum fs_io_class serve_priority(void *session, const char *line)
+{
+    (void)session;
+    char copy[MAX_PATH_LEN];
+    (void)snprintf(copy, sizeof(copy), "%s", line);
+    char *argv[MAX_ARGS];
+    const int argc = tokenize(copy, argv, MAX_ARGS);
+    for (int k = 1; k < argc; k++) {
+        if (strcmp(argv[k], "-r") == 0) {
+            return FS_IO_BULK;
+        }
+    }
+    return line_writes(argc, argv) ? FS_IO_NORMAL : FS_IO_INTERACTIVE;
+}
+
+static bool serve_exclusive(void *session)
+{
+    return ((const ShellContext *)session)->in_txn;
+}
+
+static void serve_close(void *session)
+{
+    ShellContext *ctx = (ShellContext *)session;
+    /* klient odpojený mezi begin a commit – jeho změny se zahodí */
+    if (ctx->in_txn) {
+        (void)fs_io_abort();
+        fs_dcache_invalidate();
+        fs_bitmap_invalidate();
+    }
+    free(ctx);
+}
+
+static void serve_idle(void *arg)
+{
+    (void)arg;
+    fs_io_flush(); /* batch: nic dalšího nečeká, potvrdit hned */
+}
+
+int main(int argc, char **argv)
+{
+    /* fs_app [--durability=none|batch|always] [--serve <socket>] <obraz> */
+    int durability = FS_DURABILITY_BATCH;
+    const char *serve_path = NULL;
+    while (argc > 2) {
+        if (strncmp(argv[1], "--durability=", 13) == 0) {
+            durability = fs_durability_parse(argv[1] + 13);
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--serve") == 0 && argc > 3) {
+            serve_path = argv[2];
+            argv += 2;
+            argc -= 2;
+        } else {
+            break;
+        }
+    }
+
+    if (argc != 2 || durability < 0) {
+        /* původní chování: špatný počet parametrů -> CANNOT OPEN FILE */
+        fs_printf("CANNOT OPEN FILE\n");
+        return 1;
+    }
+
+    command_table_init();
+
+    ShellContext ctx = {
+        .fs_name = argv[1],
+        .cwd = "/",
+    };
+
+    /* Přehraje žurnál po případném pádu předchozího běhu. */
+    fs_io_on_change(image_changed);
+    fs_io_open(ctx.fs_name, (enum fs_durability)durability);
+
+    if (serve_path) {
+        const struct fs_server_ops ops = {
+            .open = serve_open,
+            .exec = serve_exec,
+            .serial = serve_serial,
+            .exclusive = serve_exclusive,
+            .priority = serve_priority,
+            .close = serve_close,
+            .idle = serve_idle,
+            .arg = (void *)ctx.fs_name,
+        };
+        lock_paths = true;
+        const int served = fs_serve(serve_path, &ops);
+        if (!served) {
+            fs_printf("CANNOT OPEN FILE\n");
+        }
+        fs_io_checkpoint();
+        return served ? 0 : 1;
+    }
+
+    char *line = NULL;
+    size_t n = 0;
+
+    while (getline(&line, &n, stdin) != -1) {
+        char *argv2[MAX_ARGS];
+        const int argc2 = tokenize(line, argv2, MAX_ARGS);
+        fs_io_enter(line_writes(argc2, argv2));
+        const bool go_on = exec_command(&ctx, argc2, argv2);
+        fs_io_leave();
+        fs_io_commit();
+        if (!go_on) {
+            break;
+        }
+        if (stdin_idle()) {
+            fs_io_flush();
         }
     }
 
+    fs_io_checkpoint();
     free(line);
     return 0;
 }
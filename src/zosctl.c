@@ -0,0 +1,145 @@
+#define _POSIX_C_SOURCE 200809L
+/**
+ * @file zosctl.c
+ * @brief Klient serverového režimu: zosctl <socket> [příkaz ...]
+ *
+ * S příkazem v argumentech pošle jeden řádek, bez něj přeposílá stdin (stejně
+ * jako fs_app obraz < skript). Výstup serveru vypisuje průběžně, jak přichází;
+ * po konci vstupu zavře zápis a skončí, až server relaci zavře.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+enum { CTL_CHUNK = 64 * 1024 };
+
+static int ctl_connect(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (const struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        const ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: zosctl <socket> [command ...]\n");
+        return 2;
+    }
+
+    const int fd = ctl_connect(argv[1]);
+    if (fd < 0) {
+        printf("CANNOT OPEN FILE\n");
+        return 1;
+    }
+
+    /* vstup: jeden řádek z argumentů, nebo stdin */
+    char *pending = (char *)malloc(CTL_CHUNK);
+    char *reply = (char *)malloc(CTL_CHUNK);
+    size_t pending_off = 0;
+    size_t pending_len = 0;
+    bool input_open = argc == 2;
+    if (!pending || !reply) {
+        return 1;
+    }
+    for (int i = 2; i < argc; i++) {
+        const int n = snprintf(pending + pending_len, CTL_CHUNK - pending_len, "%s%s", argv[i],
+                               (i + 1 < argc) ? " " : "\n");
+        if (n < 0 || (size_t)n >= CTL_CHUNK - pending_len) {
+            printf("INVALID ARGUMENT\n");
+            return 1;
+        }
+        pending_len += (size_t)n;
+    }
+
+    /* Zápis do socketu je neblokující: server přestane číst, dokud si neodebereme
+       výstup, a blokující zápis by tu skončil vzájemným čekáním. */
+    (void)fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    bool write_open = true;
+    int status = 0;
+    for (;;) {
+        if (write_open && !input_open && pending_off == pending_len) {
+            (void)shutdown(fd, SHUT_WR);
+            write_open = false;
+        }
+
+        struct pollfd fds[2] = {
+            { .fd = fd, .events = POLLIN | ((pending_off < pending_len) ? POLLOUT : 0) },
+            { .fd = STDIN_FILENO, .events = (input_open && pending_off == pending_len) ? POLLIN : 0 },
+        };
+        if (poll(fds, input_open ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            status = 1;
+            break;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            const ssize_t n = read(fd, reply, CTL_CHUNK);
+            if (n == 0) {
+                break;  /* server relaci zavřel (exit nebo konec vstupu) */
+            }
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                status = 1;
+                break;
+            }
+            if (n > 0 && !write_all(STDOUT_FILENO, reply, (size_t)n)) {
+                status = 1;
+                break;
+            }
+        }
+        if ((fds[0].revents & POLLOUT) && pending_off < pending_len) {
+            const ssize_t n = send(fd, pending + pending_off, pending_len - pending_off, MSG_NOSIGNAL);
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                status = 1;
+                break;
+            }
+            pending_off += (n > 0) ? (size_t)n : 0;
+        }
+        if (input_open && (fds[1].revents & (POLLIN | POLLHUP))) {
+            const ssize_t n = read(STDIN_FILENO, pending, CTL_CHUNK);
+            input_open = n > 0 || (n < 0 && errno == EINTR);
+            pending_off = 0;
+            pending_len = (n > 0) ? (size_t)n : 0;
+        }
+    }
+
+    free(pending);
+    free(reply);
+    close(fd);
+    return status;
+}